@@ -132,6 +132,8 @@ extension DateTimeX on DateTime? {
   static DateTime get epoch => DateTime.fromMillisecondsSinceEpoch(0);
 }
 
+/// Metadata of an MKV file, built from the map returned by
+/// `VideoDataExtractor.getMkvMetadata`.
 class MkvMetadata {
   final String format;
   final int bitrate; // in bits per second
@@ -139,6 +141,7 @@ class MkvMetadata {
   final List<VideoStream> videoStreams;
   final List<AudioStream> audioStreams;
   final List<TextStream> textStreams;
+  final List<Chapter> chapters;
 
   const MkvMetadata({
     this.format = '',
@@ -147,16 +150,18 @@ class MkvMetadata {
     this.videoStreams = const [],
     this.audioStreams = const [],
     this.textStreams = const [],
+    this.chapters = const [],
   });
 
   factory MkvMetadata.fromJson(Map<dynamic, dynamic> json) {
     return MkvMetadata(
-      format: json['format'] as String? ?? '',
+      format: json['format'] as String? ?? 'Matroska',
       bitrate: json['bitrate'] as int? ?? 0,
-      attachments: (json['attachments'] as List?)?.map((item) => item as String).toList() ?? [],
+      attachments: (json['attachments'] as List?)?.map((item) => item['fileName'] as String? ?? '').toList() ?? [],
       videoStreams: (json['videoStreams'] as List?)?.map((stream) => VideoStream.fromJson(stream)).toList() ?? [],
       audioStreams: (json['audioStreams'] as List?)?.map((stream) => AudioStream.fromJson(stream)).toList() ?? [],
-      textStreams: (json['textStreams'] as List?)?.map((stream) => TextStream.fromJson(stream)).toList() ?? [],
+      textStreams: (json['subtitleStreams'] as List?)?.map((stream) => TextStream.fromJson(stream)).toList() ?? [],
+      chapters: (json['chapters'] as List?)?.map((chapter) => Chapter.fromJson(chapter)).toList() ?? [],
     );
   }
 
@@ -164,10 +169,11 @@ class MkvMetadata {
     return {
       'format': format,
       'bitrate': bitrate,
-      'attachments': attachments,
+      'attachments': attachments.map((fileName) => {'fileName': fileName}).toList(),
       'videoStreams': videoStreams.map((stream) => stream.toJson()).toList(),
       'audioStreams': audioStreams.map((stream) => stream.toJson()).toList(),
-      'textStreams': textStreams.map((stream) => stream.toJson()).toList(),
+      'subtitleStreams': textStreams.map((stream) => stream.toJson()).toList(),
+      'chapters': chapters.map((chapter) => chapter.toJson()).toList(),
     };
   }
 
@@ -175,7 +181,48 @@ class MkvMetadata {
   String get bitrateFormatted => '${(bitrate / 1000).round()} kbps';
 
   @override
-  String toString() => 'MkvMetadata(format: $format, bitrate: $bitrateFormatted, videoStreams: ${videoStreams.length}, audioStreams: ${audioStreams.length}, textStreams: ${textStreams.length}, attachments: ${attachments.length})';
+  String toString() => 'MkvMetadata(format: $format, bitrate: $bitrateFormatted, videoStreams: ${videoStreams.length}, audioStreams: ${audioStreams.length}, textStreams: ${textStreams.length}, attachments: ${attachments.length}, chapters: ${chapters.length})';
+}
+
+/// The codec name when the file has one, its Matroska codec ID otherwise
+String _codecFormat(Map<dynamic, dynamic> json) {
+  final String codecName = json['codecName'] as String? ?? '';
+  return codecName.isNotEmpty ? codecName : json['codecId'] as String? ?? '';
+}
+
+class Chapter {
+  final String title;
+  final Duration start;
+  final Duration end;
+  final int depth;
+
+  const Chapter({
+    this.title = '',
+    this.start = Duration.zero,
+    this.end = Duration.zero,
+    this.depth = 0,
+  });
+
+  factory Chapter.fromJson(Map<dynamic, dynamic> json) {
+    return Chapter(
+      title: json['title'] as String? ?? '',
+      start: Duration(microseconds: (((json['start'] as num?) ?? 0) * 1000).round()),
+      end: Duration(microseconds: (((json['end'] as num?) ?? 0) * 1000).round()),
+      depth: json['depth'] as int? ?? 0,
+    );
+  }
+
+  Map<String, dynamic> toJson() {
+    return {
+      'title': title,
+      'start': start.inMicroseconds / 1000,
+      'end': end.inMicroseconds / 1000,
+      'depth': depth,
+    };
+  }
+
+  @override
+  String toString() => '${start.toString().split('.').first} $title';
 }
 
 class Size {
@@ -220,11 +267,20 @@ class VideoStream {
   });
 
   factory VideoStream.fromJson(Map<dynamic, dynamic> json) {
+    final int width = json['width'] as int? ?? 0;
+    final int height = json['height'] as int? ?? 0;
+    int displayWidth = json['displayWidth'] as int? ?? 0;
+    int displayHeight = json['displayHeight'] as int? ?? 0;
+    if (displayWidth == 0 || displayHeight == 0) {
+      displayWidth = width;
+      displayHeight = height;
+    }
+    final int divisor = displayWidth.gcd(displayHeight);
     return VideoStream(
-      format: json['format'] as String? ?? '',
-      size: json['size'] != null ? Size.fromJson(json['size']) : const Size(),
-      aspectRatio: json['aspectRatio'] != null ? Size.fromJson(json['aspectRatio']) : const Size(),
-      fps: (json['fps'] as num?)?.toDouble() ?? 0.0,
+      format: _codecFormat(json),
+      size: Size(width: width, height: height),
+      aspectRatio: divisor > 0 ? Size(width: displayWidth ~/ divisor, height: displayHeight ~/ divisor) : const Size(),
+      fps: (json['frameRate'] as num?)?.toDouble() ?? 0.0,
       bitrate: json['bitrate'] as int? ?? 0,
       bitDepth: json['bitDepth'] as int? ?? 0,
     );
@@ -232,10 +288,12 @@ class VideoStream {
 
   Map<String, dynamic> toJson() {
     return {
-      'format': format,
-      'size': size.toJson(),
-      'aspectRatio': aspectRatio.toJson(),
-      'fps': fps,
+      'codecName': format,
+      'width': size.width,
+      'height': size.height,
+      'displayWidth': aspectRatio.width,
+      'displayHeight': aspectRatio.height,
+      'frameRate': fps,
       'bitrate': bitrate,
       'bitDepth': bitDepth,
     };
@@ -261,7 +319,7 @@ class AudioStream {
 
   factory AudioStream.fromJson(Map<dynamic, dynamic> json) {
     return AudioStream(
-      format: json['format'] as String? ?? '',
+      format: _codecFormat(json),
       bitrate: json['bitrate'] as int? ?? 0,
       channels: json['channels'] as int? ?? 0,
       language: json['language'] as String?,
@@ -270,7 +328,7 @@ class AudioStream {
 
   Map<String, dynamic> toJson() {
     return {
-      'format': format,
+      'codecName': format,
       'bitrate': bitrate,
       'channels': channels,
       'language': language,
@@ -292,18 +350,19 @@ class TextStream {
   });
 
   factory TextStream.fromJson(Map<dynamic, dynamic> json) {
+    final String name = json['name'] as String? ?? '';
     return TextStream(
-      format: json['format'] as String? ?? '',
+      format: _codecFormat(json),
       language: json['language'] as String? ?? '',
-      title: json['title'] as String?,
+      title: name.isNotEmpty ? name : null,
     );
   }
 
   Map<String, dynamic> toJson() {
     return {
-      'format': format,
+      'codecName': format,
       'language': language,
-      'title': title,
+      'name': title ?? '',
     };
   }
 }
@@ -1,7 +1,5 @@
 import 'dart:io';
-import 'dart:isolate';
 
-import 'package:flutter/foundation.dart';
 import 'package:flutter/material.dart';
 import 'dart:async';
 
@@ -13,65 +11,6 @@ import 'package:video_thumbnail_exporter/video_thumbnail_exporter.dart';
 
 import 'classes.dart';
 
-class _MkvMetadataParams {
-  final String filePath;
-  final RootIsolateToken rootToken;
-  _MkvMetadataParams(this.filePath, this.rootToken);
-}
-
-class _ThumbnailParams {
-  final String videoPath;
-  final String outputPath;
-  final RootIsolateToken rootToken;
-  _ThumbnailParams(this.videoPath, this.outputPath, this.rootToken);
-}
-
-class _MetadataParams {
-  final String filePath;
-  final RootIsolateToken rootToken;
-  _MetadataParams(this.filePath, this.rootToken);
-}
-
-class _DurationParams {
-  final String filePath;
-  final RootIsolateToken rootToken;
-  _DurationParams(this.filePath, this.rootToken);
-}
-
-Future<bool> _generateThumbnailInIsolate(_ThumbnailParams params) async {
-  BackgroundIsolateBinaryMessenger.ensureInitialized(params.rootToken);
-  return await VideoDataExtractor.extractCachedThumbnail(
-    videoPath: params.videoPath,
-    outputPath: params.outputPath,
-    size: 1024,
-  );
-}
-
-Future<Map<String, dynamic>> _extractMetadataInIsolate(_MetadataParams params) async {
-  BackgroundIsolateBinaryMessenger.ensureInitialized(params.rootToken);
-  final fileMetadata = await VideoDataExtractor.getFileMetadata(filePath: params.filePath);
-  final duration = await VideoDataExtractor.getVideoDuration(videoPath: params.filePath);
-  return {
-    ...fileMetadata,
-    'duration': Duration(milliseconds: duration.toInt()),
-  };
-}
-
-Future<MkvMetadata> _extractMkvMetadataInIsolate(_MkvMetadataParams params) async {
-  BackgroundIsolateBinaryMessenger.ensureInitialized(params.rootToken);
-
-  try {
-    final a = await VideoDataExtractor.getMkvMetadata(mkvPath: params.filePath);
-    
-    // Parse the JSON inside the isolate to avoid blocking the main thread.
-    return MkvMetadata.fromJson(a);
-  } catch (e, st) {
-    print('Error extracting MKV metadata: $e\n$st');
-    // Return an empty object on error.
-    return const MkvMetadata();
-  }
-}
-
 void main() async {
   WidgetsFlutterBinding.ensureInitialized();
 
@@ -97,7 +36,6 @@ class _MyAppState extends State<MyApp> {
   Metadata? _metadata;
   MkvMetadata? _mkvMetadata;
   bool _isProcessing = false;
-  bool _mediainfoAvailable = false;
 
   @override
   void dispose() {
@@ -111,204 +49,9 @@ class _MyAppState extends State<MyApp> {
 
   String get extension => clean(_controller.text.split(".").last.toLowerCase());
 
-  Future<void> _getMkvMetadataWithMediaInfo(String filepath) async {
-    // call MediaInfo CLI to extract MKV metadata
-    filepath = clean(filepath);
-    setState(() {
-      _status = 'Extracting MKV metadata with MediaInfo...';
-      _isProcessing = true;
-    });
-    try {
-      final result = await Process.run(
-        'MediaInfo.exe',
-        ['--fullscan', filepath],
-        runInShell: true,
-      );
-
-      if (result.exitCode != 0) {
-        throw Exception('MediaInfo failed: ${result.stderr}');
-      }
-
-      final metadataString = result.stdout.toString();
-      if (metadataString.isEmpty) {
-        throw Exception('No metadata extracted by MediaInfo');
-      }
-
-      final metadataJson = parseMediaInfoCliOutput(metadataString);
-      _mkvMetadata = MkvMetadata.fromJson(metadataJson);
-
-      setState(() {
-        _status = 'MKV Metadata extracted successfully';
-      });
-    } catch (e) {
-      print('Error extracting MKV metadata with MediaInfo: $e');
-      setState(() {
-        _status = 'Error extracting MKV metadata with MediaInfo: $e';
-      });
-    } finally {
-      setState(() {
-        _isProcessing = false;
-      });
-    }
-  }
-
-  Map<String, dynamic> parseMediaInfoCliOutput(String cliOutput) {
-    // Normalize input: remove excess whitespace and blank lines
-    final normalizedOutput = cliOutput.split('\n').map((line) => line.trim()).where((line) => line.isNotEmpty).join('\n');
-    // print('Normalized MediaInfo output:\n$normalizedOutput');
-
-    // Helper to extract all values for a key in a section
-    List<String> extractAllValues(List<String> lines, String key) {
-      final prefix = key;
-      return lines.where((line) => line.startsWith(prefix)).map((line) => line.substring(prefix.length).trim().replaceFirst(": ", "")).where((v) => v.isNotEmpty).toList();
-    }
-
-    int parseInt(String? s) {
-      if (s == null) return 0;
-      final digits = RegExp(r'[\d,]+').firstMatch(s.replaceAll(' ', ''));
-      return int.tryParse(digits?.group(0)?.replaceAll(',', '') ?? '0') ?? 0;
-    }
-
-    double parseDouble(String? s) {
-      if (s == null) return 0.0;
-      final match = RegExp(r'[\d.]+').firstMatch(s.replaceAll(' ', ''));
-      return double.tryParse(match?.group(0) ?? '0') ?? 0.0;
-    }
-
-    Map<String, int> parseAspectRatio(String? s) {
-      if (s == null) return {'width': 0, 'height': 0};
-      final colon = RegExp(r'(\d+)\s*:\s*(\d+)').firstMatch(s);
-      if (colon != null) {
-        return {
-          'width': int.tryParse(colon.group(1)!) ?? 0,
-          'height': int.tryParse(colon.group(2)!) ?? 0,
-        };
-      }
-      final floatVal = double.tryParse(s.replaceAll(' ', ''));
-      if (floatVal != null && floatVal > 0) {
-        return {'width': (floatVal).round(), 'height': 1};
-      }
-      return {'width': 0, 'height': 0};
-    }
-
-    // Section regex
-    final videoMatches = RegExp(r'^Video(?: #\d+)?\n([\s\S]*?)(?=^General\n|^Video(?: #\d+)?\n|^Audio(?: #\d+)?\n|^Text(?: #\d+)?\n|^Menu\n|\Z)', multiLine: true).allMatches(normalizedOutput);
-    final audioMatches = RegExp(r'^Audio(?: #\d+)?\n([\s\S]*?)(?=^General\n|^Video(?: #\d+)?\n|^Audio(?: #\d+)?\n|^Text(?: #\d+)?\n|^Menu\n|\Z)', multiLine: true).allMatches(normalizedOutput);
-    final textMatches = RegExp(r'^Text(?: #\d+)?\n([\s\S]*?)(?=^General\n|^Video(?: #\d+)?\n|^Audio(?: #\d+)?\n|^Text(?: #\d+)?\n|^Menu\n|\Z)', multiLine: true).allMatches(normalizedOutput);
-    final generalMatch = RegExp(r'^General\n([\s\S]*?)(?=^Video(?: #\d+)?\n|^Audio(?: #\d+)?\n|^Text(?: #\d+)?\n|^Menu\n|\Z)', multiLine: true).firstMatch(normalizedOutput);
-
-    String format = '';
-    int bitrate = 0;
-    List<String> attachments = [];
-    List<Map<String, dynamic>> videoStreams = [];
-    List<Map<String, dynamic>> audioStreams = [];
-    List<Map<String, dynamic>> textStreams = [];
-
-    // --- General section ---
-    if (generalMatch != null) {
-      final lines = generalMatch.group(1)!.split('\n');
-      // Pick the first non-empty Format
-      final formats = extractAllValues(lines, 'Format');
-      format = formats.isNotEmpty ? formats.first : '';
-      // Pick the first valid Overall bit rate
-      final bitrates = extractAllValues(lines, 'Overall bit rate');
-      bitrate = bitrates.map(parseInt).firstWhere((v) => v > 0, orElse: () => 0);
-      // Pick the first non-empty Attachments
-      final atts = extractAllValues(lines, 'Attachments');
-      if (atts.isNotEmpty) {
-        attachments = atts.first.split(' / ').map((s) => s.trim()).where((s) => s.isNotEmpty).toList();
-      }
-    }
-
-    print('Parsed general section: format=$format, bitrate=$bitrate, attachments=${attachments.length}');
-
-    // --- Video section(s) ---
-    for (final match in videoMatches) {
-      final lines = match.group(1)!.split('\n');
-      final formats = extractAllValues(lines, 'Format');
-      final vFormat = formats.isNotEmpty ? formats.first : '';
-      final widths = extractAllValues(lines, 'Width');
-      final width = widths.isNotEmpty ? parseInt(widths.first) : 0;
-      final heights = extractAllValues(lines, 'Height');
-      final height = heights.isNotEmpty ? parseInt(heights.first) : 0;
-      final aspectRatios = extractAllValues(lines, 'Display aspect ratio');
-      final aspectRatio = aspectRatios.isNotEmpty ? parseAspectRatio(aspectRatios[1]) : {'width': 0, 'height': 0};
-      final fpss = extractAllValues(lines, 'Frame rate');
-      final fps = fpss.isNotEmpty ? parseDouble(fpss[2]) : 0.0;
-      final bitrates = extractAllValues(lines, 'Bit rate');
-      final vBitrate = bitrates.map(parseInt).firstWhere((v) => v > 0, orElse: () => 0);
-      final bitDepths = extractAllValues(lines, 'Bit depth');
-      final bitDepth = bitDepths.map(parseInt).firstWhere((v) => v > 0, orElse: () => 0);
-
-      videoStreams.add({
-        'format': vFormat,
-        'size': {'width': width, 'height': height},
-        'aspectRatio': aspectRatio,
-        'fps': fps,
-        'bitrate': vBitrate,
-        'bitDepth': bitDepth,
-      });
-    }
-
-    // --- Audio section(s) ---
-    for (final match in audioMatches) {
-      final lines = match.group(1)!.split('\n');
-      final formats = extractAllValues(lines, 'Format');
-      final aFormat = formats.isNotEmpty ? formats.first : '';
-      final bitrates = extractAllValues(lines, 'Bit rate');
-      final aBitrate = bitrates.map(parseInt).firstWhere((v) => v > 0, orElse: () => 0);
-      final channelsList = extractAllValues(lines, 'Channel(s)');
-      final channels = channelsList.isNotEmpty ? parseInt(channelsList.first) : 0;
-      // Language: pick the first non-empty value
-      final languages = extractAllValues(lines, 'Language');
-      final language = languages.isNotEmpty ? languages.first : '';
-
-      audioStreams.add({
-        'format': aFormat,
-        'bitrate': aBitrate,
-        'channels': channels,
-        'language': language,
-      });
-    }
-
-    // --- Text section(s) ---
-    for (final match in textMatches) {
-      final lines = match.group(1)!.split('\n');
-      final formats = extractAllValues(lines, 'Format');
-      final tFormat = formats.isNotEmpty ? formats.first : '';
-      final languages = extractAllValues(lines, 'Language');
-      final language = languages.isNotEmpty ? languages.first : '';
-      final titles = extractAllValues(lines, 'Title');
-      final title = titles.isNotEmpty ? titles.first : null;
-
-      textStreams.add({
-        'format': tFormat,
-        'language': language,
-        'title': title,
-      });
-    }
-
-    print("Parser found: format=$format, bitrate=$bitrate, video=${videoStreams.length}, audio=${audioStreams.length}, text=${textStreams.length}, attachments=${attachments.length}");
-
-    return {
-      'format': format,
-      'bitrate': bitrate,
-      'attachments': attachments,
-      'videoStreams': videoStreams,
-      'audioStreams': audioStreams,
-      'textStreams': textStreams,
-    };
-  }
-
   Future<void> _getMkvMetadata(String filePath) async {
     filePath = clean(filePath);
 
-    if (_mediainfoAvailable) {
-      print('MediaInfo is available');
-      _getMkvMetadataWithMediaInfo(filePath);
-      return;
-    }
-
     print('extension: "$extension"');
 
     await Future.delayed(const Duration(milliseconds: 1));
@@ -319,13 +62,13 @@ class _MyAppState extends State<MyApp> {
         _isProcessing = true;
       });
 
-      // Extract MKV metadata
-      // Use compute to run getMkvMetadata in a background isolate for UI responsiveness
-      var rootToken = RootIsolateToken.instance!;
-      _mkvMetadata = await compute<_MkvMetadataParams, MkvMetadata>(
-        _extractMkvMetadataInIsolate,
-        _MkvMetadataParams(filePath, rootToken),
-      );
+      // Extract MKV metadata, parsed on a native worker thread
+      try {
+        _mkvMetadata = MkvMetadata.fromJson(await VideoDataExtractor.getMkvMetadata(mkvPath: filePath));
+      } catch (e, st) {
+        print('Error extracting MKV metadata: $e\n$st');
+        _mkvMetadata = const MkvMetadata();
+      }
 
       setState(() {
         _status = 'MKV Metadata extracted successfully';
@@ -336,6 +79,56 @@ class _MyAppState extends State<MyApp> {
     }
   }
 
+  // Time per call of getMkvMetadata as a map (read through MkvMetadata) and
+  // packed (every field read once). Both come from the metadata cache after
+  // the first round, so this is mostly encoding, the channel and decoding.
+  Future<void> _compareEncodings(String filePath) async {
+    filePath = clean(filePath);
+    if (extension != 'mkv') return;
+
+    setState(() {
+      _status = 'Comparing result encodings...';
+      _isProcessing = true;
+    });
+
+    const int rounds = 200;
+    await VideoDataExtractor.getMkvMetadata(mkvPath: filePath);
+    await VideoDataExtractor.getMkvMetadataPacked(mkvPath: filePath);
+
+    final mapWatch = Stopwatch()..start();
+    for (int i = 0; i < rounds; i++) {
+      MkvMetadata.fromJson(await VideoDataExtractor.getMkvMetadata(mkvPath: filePath));
+    }
+    mapWatch.stop();
+
+    // Roughly the fields MkvMetadata.fromJson reads, once per round
+    int checksum = 0;
+    final packedWatch = Stopwatch()..start();
+    for (int i = 0; i < rounds; i++) {
+      final packed = await VideoDataExtractor.getMkvMetadataPacked(mkvPath: filePath);
+      checksum = packed.title.length + packed.muxingApp.length + packed.writingApp.length;
+      for (final track in packed.tracks) {
+        checksum += track.codecId.length + track.language.length + track.name.length + track.width + track.channels;
+      }
+      for (final attachment in packed.attachments) {
+        checksum += attachment.fileName.length + attachment.mimeType.length + attachment.size;
+      }
+      for (final chapter in packed.chapters) {
+        checksum += chapter.title.length + chapter.start.toInt();
+      }
+      for (final tag in packed.tags) {
+        checksum += tag.name.length + tag.value.length;
+      }
+    }
+    packedWatch.stop();
+
+    setState(() {
+      _status = 'Map: ${(mapWatch.elapsedMicroseconds / rounds).toStringAsFixed(0)} us per file, '
+          'packed: ${(packedWatch.elapsedMicroseconds / rounds).toStringAsFixed(0)} us per file';
+      _isProcessing = false;
+    });
+  }
+
   Future<void> _processFilePath(String filePath) async {
     setState(() {
       _status = 'Processing...';
@@ -388,11 +181,11 @@ class _MyAppState extends State<MyApp> {
       final tempDir = await getTemporaryDirectory();
       final fileNameWithoutExt = path.basenameWithoutExtension(fileName);
       final tempPath = path.join(tempDir.path, '$fileNameWithoutExt.png');
-      final rootToken = RootIsolateToken.instance!;
 
-      final bool success = await compute<_ThumbnailParams, bool>(
-        _generateThumbnailInIsolate,
-        _ThumbnailParams(filePath, tempPath, rootToken),
+      final bool success = await VideoDataExtractor.extractCachedThumbnail(
+        videoPath: filePath,
+        outputPath: tempPath,
+        size: 1024,
       );
 
       if (!mounted) return;
@@ -426,12 +219,15 @@ class _MyAppState extends State<MyApp> {
 
   Future<void> _extractMetadata(String filePath) async {
     try {
-      final rootToken = RootIsolateToken.instance!;
       // Fetch base metadata and video duration in parallel for efficiency
-      final metadataMap = await compute<_MetadataParams, Map<String, dynamic>>(
-        _extractMetadataInIsolate,
-        _MetadataParams(filePath, rootToken),
-      );
+      final results = await Future.wait([
+        VideoDataExtractor.getFileMetadata(filePath: filePath),
+        VideoDataExtractor.getVideoDuration(videoPath: filePath),
+      ]);
+      final metadataMap = {
+        ...results[0] as Map<String, dynamic>,
+        'duration': Duration(milliseconds: (results[1] as double).toInt()),
+      };
 
       setState(() {
         _metadata = Metadata.fromJson(metadataMap);
@@ -504,12 +300,6 @@ class _MyAppState extends State<MyApp> {
     return Scaffold(
       appBar: AppBar(
         title: const Text('Video Data Extractor'),
-        actions: [
-          Switch(
-            value: _mediainfoAvailable,
-            onChanged: (value) => setState(() => _mediainfoAvailable = value),
-          )
-        ],
       ),
       body: Row(
         crossAxisAlignment: CrossAxisAlignment.start,
@@ -543,6 +333,11 @@ class _MyAppState extends State<MyApp> {
                         onPressed: _isProcessing || isCurrentMkv ? null : () async => await _getMkvMetadata(_controller.text),
                         child: const Text('Get MKV Metadata'),
                       ),
+                      const SizedBox(width: 8),
+                      ElevatedButton(
+                        onPressed: _isProcessing ? null : () async => await _compareEncodings(_controller.text),
+                        child: const Text('Compare Encodings'),
+                      ),
                       if (_isProcessing)
                         const Padding(
                           padding: EdgeInsets.only(left: 16.0),
@@ -716,6 +511,7 @@ class _MyAppState extends State<MyApp> {
             _buildMetadataField('Format', _mkvMetadata!.format),
             _buildMetadataField('Bit rate', _mkvMetadata!.bitrateFormatted),
             _buildMetadataField('Attachments', _mkvMetadata!.attachments.isNotEmpty ? _mkvMetadata!.attachments.join(', ') : 'None'),
+            _buildMetadataField('Chapters', _mkvMetadata!.chapters.isNotEmpty ? _mkvMetadata!.chapters.join(', ') : 'None'),
           ],
         ),
       ),
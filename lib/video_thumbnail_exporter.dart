@@ -1,13 +1,17 @@
 // ignore_for_file: curly_braces_in_flow_control_structures
 
 import 'dart:async';
+import 'dart:convert';
 import 'dart:io';
+import 'dart:typed_data';
 import 'package:flutter/foundation.dart';
 import 'package:flutter/services.dart';
 
 String get assets => "${(Platform.resolvedExecutable.split(ps)..removeLast()).join(ps)}${ps}data${ps}flutter_assets${ps}assets";
 String get ps => Platform.pathSeparator;
 
+/// Calls that touch the disk run on a pool of native worker threads, so they
+/// can be awaited straight from the UI isolate without dropping frames.
 class VideoDataExtractor {
   static const MethodChannel _channel = MethodChannel('video_thumbnail_exporter');
 
@@ -39,11 +43,19 @@ class VideoDataExtractor {
 
     /// The size of the thumbnail in pixels. Usual values are 256, 512, or 1024.
     required int size,
+
+    /// From [newRequestId], to [cancelRequest] or [reprioritizeRequest] it later.
+    int? requestId,
+
+    /// Higher runs first, see [reprioritizeRequest].
+    int priority = 0,
   }) async {
     final Map<String, dynamic> args = <String, dynamic>{
       'videoPath': videoPath,
       'outputPath': outputPath,
       'size': size,
+      if (requestId != null) 'requestId': requestId,
+      'priority': priority,
     };
 
     return await _channel.invokeMethod<bool>('getThumbnail', args) ?? false;
@@ -68,29 +80,189 @@ class VideoDataExtractor {
 
   /// Returns the Video Metadata as a Map.
   ///
+  /// Only the [sections] requested are parsed and returned, e.g.
+  /// `MkvSection.info` for a duration-only probe. Results are cached across
+  /// launches, see [configureMetadataCache].
+  ///
+  /// Streams (`videoStreams`, `audioStreams`, `subtitleStreams`) carry
+  /// `trackNumber`, `trackUid`, `codecId`, `codecName`, `language` and
+  /// `name`. When the file has mkvmerge's statistics tags and
+  /// [MkvSection.tags] is requested they also carry the exact `bitrate`
+  /// (bits per second), `frameCount`, `streamSize` (bytes) and
+  /// `streamDuration` (milliseconds) of the track.
+  ///
+  /// [MkvSection.chapters] adds `editions` (`uid`, `default`, `hidden`,
+  /// `ordered`) and `chapters`, in file order with nested chapters after
+  /// their parent (`edition` index, `depth`, `uid`, `start` and `end` in
+  /// milliseconds, `title`, `language`, `hidden`, `enabled`).
+  /// [MkvSection.tags] adds `tags`, one per SimpleTag (`name`, `value`,
+  /// `language` and the targets: `targetTypeValue`, `targetType`,
+  /// `trackUid`, `editionUid`, `chapterUid`, `attachmentUid`).
+  ///
   /// Throws an ArgumentError if the video file is not an MKV file.
   ///
   /// Otherwise throws a PlatformException.
   static Future<Map<dynamic, dynamic>> getMkvMetadata({
     /// The path to the video file to extract metadata from.
-    required String mkvPath,
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// A combination of [MkvSection] flags. Defaults to [MkvSection.all].
+    int sections = MkvSection.all,
+
+    /// From [newRequestId], to [cancelRequest] or [reprioritizeRequest] it later.
+    int? requestId,
+
+    /// Higher runs first, see [reprioritizeRequest].
+    int priority = 0,
   }) async {
     final Map<String, dynamic> args = <String, dynamic>{
-      'mkvPath': mkvPath,
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'sections': sections,
+      if (requestId != null) 'requestId': requestId,
+      'priority': priority,
     };
 
-    if (mkvPath.split('.').last.toLowerCase() != 'mkv') //
-      throw ArgumentError('Only MKV files are supported for metadata extraction for now.');
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for metadata extraction for now.');
 
     return await _channel.invokeMethod<Map<dynamic, dynamic>>('getMkvMetadata', args) ?? {};
   }
 
+  /// Same as [getMkvMetadata], but the result comes back as one buffer that
+  /// is decoded field by field as it is read, instead of a map built up
+  /// front. Prefer it when only a few fields of many files are needed.
+  ///
+  /// Throws an ArgumentError if the video file is not an MKV file.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<PackedMkvMetadata> getMkvMetadataPacked({
+    /// The path to the video file to extract metadata from.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// A combination of [MkvSection] flags. Defaults to [MkvSection.all].
+    int sections = MkvSection.all,
+
+    /// From [newRequestId], to [cancelRequest] or [reprioritizeRequest] it later.
+    int? requestId,
+
+    /// Higher runs first, see [reprioritizeRequest].
+    int priority = 0,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'sections': sections,
+      'packed': true,
+      if (requestId != null) 'requestId': requestId,
+      'priority': priority,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for metadata extraction for now.');
+
+    return PackedMkvMetadata((await _channel.invokeMethod<Uint8List>('getMkvMetadata', args))!);
+  }
+
+  /// Returns the metadata of every file in [mkvPaths] in one call, parsed in
+  /// parallel on the native worker threads and in the same order as
+  /// [mkvPaths].
+  ///
+  /// Each entry has the `path` and either its `metadata` (as returned by
+  /// [getMkvMetadata]) or an `error` code and `message`; a file that cannot
+  /// be read does not fail the batch.
+  ///
+  /// With a [chunkSize], results are sent back [chunkSize] files at a time as
+  /// they are ready and passed to [onChunk] along with the index of their
+  /// first file. Chunks may arrive out of order.
+  ///
+  /// With [packed], each `metadata` is a Uint8List to read with
+  /// [PackedMkvMetadata], see [getMkvMetadataPacked].
+  ///
+  /// [cancelRequest] drops the files that have not started yet, and they come
+  /// back with the error `cancelled`. [reprioritizeRequest] moves them.
+  ///
+  /// Throws a PlatformException if the arguments are invalid.
+  static Future<List<Map<dynamic, dynamic>>> getMkvMetadataBatch({
+    /// The paths of the MKV files.
+    required List<String> mkvPaths,
+
+    /// A combination of [MkvSection] flags. Defaults to [MkvSection.all].
+    int sections = MkvSection.all,
+
+    /// Files per chunk, 0 for a single reply.
+    int chunkSize = 0,
+
+    /// Called with each chunk when [chunkSize] is set.
+    void Function(int offset, List<Map<dynamic, dynamic>> results)? onChunk,
+
+    /// Return each `metadata` packed instead of as a map.
+    bool packed = false,
+
+    /// From [newRequestId], to [cancelRequest] or [reprioritizeRequest] it later.
+    int? requestId,
+
+    /// Higher runs first, see [reprioritizeRequest].
+    int priority = 0,
+  }) async {
+    final int batchId = _nextBatchId++;
+    final List<Map<dynamic, dynamic>> results = List.filled(mkvPaths.length, const {});
+    if (chunkSize > 0) {
+      _installCallHandler();
+      _batchChunkHandlers[batchId] = (offset, chunk) {
+        results.setRange(offset, offset + chunk.length, chunk);
+        onChunk?.call(offset, chunk);
+      };
+    }
+
+    try {
+      final reply = await _channel.invokeMethod<Map<dynamic, dynamic>>('getMkvMetadataBatch', <String, dynamic>{
+        'mkvPaths': mkvPaths,
+        'sections': sections,
+        'chunkSize': chunkSize,
+        'batchId': batchId,
+        'packed': packed,
+        if (requestId != null) 'requestId': requestId,
+        'priority': priority,
+      });
+      if (chunkSize > 0) return results;
+      return (reply?['results'] as List? ?? const []).cast<Map<dynamic, dynamic>>();
+    } finally {
+      _batchChunkHandlers.remove(batchId);
+    }
+  }
+
+  static int _nextBatchId = 1;
+  static final Map<int, void Function(int offset, List<Map<dynamic, dynamic>> results)> _batchChunkHandlers = {};
+  static bool _callHandlerInstalled = false;
+
+  /// Receives what the native side pushes on its own, e.g. batch chunks.
+  static void _installCallHandler() {
+    if (_callHandlerInstalled) return;
+    _callHandlerInstalled = true;
+    _channel.setMethodCallHandler((call) async {
+      if (call.method == 'onMkvMetadataBatchChunk') {
+        final Map<dynamic, dynamic> args = call.arguments as Map<dynamic, dynamic>;
+        final handler = _batchChunkHandlers[args['batchId']];
+        handler?.call(args['offset'] as int, (args['results'] as List).cast<Map<dynamic, dynamic>>());
+      }
+      return null;
+    });
+  }
+
   /// Returns true if the attachment was successfully written to [outputPath].
   ///
   /// Otherwise throws a PlatformException.
   static Future<bool> extractVideoAttachment({
     /// The path to the video file to extract the attachment from.
-    required String mkvPath,
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
 
     /// The path where the attachment will be saved.
     required String outputPath,
@@ -99,31 +271,727 @@ class VideoDataExtractor {
     int attachmentIndex = 0,
   }) async {
     final Map<String, dynamic> args = <String, dynamic>{
-      'mkvPath': mkvPath,
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
       'attachmentIndex': attachmentIndex,
       'outputPath': outputPath,
     };
 
-    if (mkvPath.split('.').last.toLowerCase() != 'mkv') //
-      throw ArgumentError('Only MKV files are supported for attachment extraction.');
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for attachment extraction.');
 
     return await _channel.invokeMethod<bool>('extractMkvAttachment', args) ?? false;
   }
 
+  /// Same as [extractVideoAttachment], but returns how the attachment was
+  /// copied: `bytes`, `elapsedUs`, `bytesPerSecond` and `method`
+  /// (`copy_file_range`, `sendfile`, `unbuffered` or `buffered`).
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>> extractVideoAttachmentWithStats({
+    /// The path to the video file to extract the attachment from.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The path where the attachment will be saved.
+    required String outputPath,
+
+    /// The index of the attachment to extract. Defaults to 0 (the first attachment).
+    int attachmentIndex = 0,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'attachmentIndex': attachmentIndex,
+      'outputPath': outputPath,
+      'reportStats': true,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for attachment extraction.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('extractMkvAttachment', args) ?? {};
+  }
+
+  /// Returns the bytes of an attachment without writing it to disk.
+  ///
+  /// Reads [length] bytes starting [offset] bytes into the attachment, or
+  /// everything from [offset] on when [length] is null. The window is clamped
+  /// to the attachment, so fewer bytes come back near its end. A single call
+  /// returns at most 64 MiB; use [readVideoAttachmentChunks] for larger ones.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Uint8List> readVideoAttachment({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The index of the attachment to read. Defaults to 0 (the first attachment).
+    int attachmentIndex = 0,
+
+    /// Where to start, in bytes from the start of the attachment.
+    int offset = 0,
+
+    /// How many bytes to read.
+    int? length,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'attachmentIndex': attachmentIndex,
+      'offset': offset,
+      if (length != null) 'length': length,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for attachment extraction.');
+
+    return await _channel.invokeMethod<Uint8List>('readMkvAttachment', args) ?? Uint8List(0);
+  }
+
+  /// Streams the bytes of an attachment in chunks of [chunkSize], one
+  /// [readVideoAttachment] call per chunk. Pass a [session] to avoid
+  /// reopening the file for every chunk.
+  static Stream<Uint8List> readVideoAttachmentChunks({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The index of the attachment to read. Defaults to 0 (the first attachment).
+    int attachmentIndex = 0,
+
+    /// Size of each chunk, at most 64 MiB.
+    int chunkSize = 4 * 1024 * 1024,
+  }) async* {
+    int offset = 0;
+    while (true) {
+      final Uint8List chunk = await readVideoAttachment(
+        mkvPath: mkvPath,
+        session: session,
+        attachmentIndex: attachmentIndex,
+        offset: offset,
+        length: chunkSize,
+      );
+      if (chunk.isNotEmpty) yield chunk;
+      if (chunk.length < chunkSize) break;
+      offset += chunk.length;
+    }
+  }
+
+  /// Writes every attachment of an MKV file into [outputDir] in a single
+  /// pass, or only those matching [mimeTypes] (prefixes, e.g.
+  /// `application/x-truetype-font` or `font/`) or [extensions] (e.g. `.ttf`).
+  /// Prefer it over calling [extractVideoAttachment] once per font.
+  ///
+  /// Files are named after the attachments, made safe for the file system and
+  /// unique within the directory. The returned map contains `files`, one map
+  /// per selected attachment in file order (`index`, `fileName`, `mimeType`,
+  /// `path`, `size` and whether it was `written`), plus `writtenFiles`,
+  /// `bytes`, `streamReads`, `elapsedUs` and `bytesPerSecond`.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>> extractAllAttachments({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The directory the attachments are written to, created if needed.
+    required String outputDir,
+
+    /// Only extract attachments whose MIME type starts with one of these.
+    List<String>? mimeTypes,
+
+    /// Only extract attachments whose file name ends with one of these.
+    List<String>? extensions,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'outputDir': outputDir,
+      if (mimeTypes != null) 'mimeTypes': mimeTypes,
+      if (extensions != null) 'extensions': extensions,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for attachment extraction.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('extractAllMkvAttachments', args) ?? {};
+  }
+
+  /// Resolves the attachments of an MKV file (or those matching [mimeTypes]
+  /// or [extensions], as in [extractAllAttachments]) to files in a
+  /// content-addressed store shared by every MKV file.
+  ///
+  /// Each distinct payload is written once: the fonts a whole season carries
+  /// in every episode resolve to the same files, and an attachment seen
+  /// before is resolved without reading its data again. The store lives in
+  /// [storeDirectory], by default `%LOCALAPPDATA%\video_thumbnail_exporter\attachments`.
+  /// Stored files are named after their content, not the attachment.
+  ///
+  /// The returned map contains `files`, one map per selected attachment
+  /// (`index`, `fileName`, `mimeType`, `size`, whether it was `resolved`
+  /// and, if so, its `path`, content `hash` and whether this call `created`
+  /// it), plus `uidHits`, `contentHits`, `blobsWritten` and `bytesWritten`.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>> resolveAttachments({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The directory of the store.
+    String? storeDirectory,
+
+    /// Only resolve attachments whose MIME type starts with one of these.
+    List<String>? mimeTypes,
+
+    /// Only resolve attachments whose file name ends with one of these.
+    List<String>? extensions,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      if (storeDirectory != null) 'storeDirectory': storeDirectory,
+      if (mimeTypes != null) 'mimeTypes': mimeTypes,
+      if (extensions != null) 'extensions': extensions,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for attachment extraction.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('resolveMkvAttachments', args) ?? {};
+  }
+
+  /// Returns the names of the TrueType/OpenType font attachments of an MKV
+  /// file without extracting them: only the font headers and `name` tables
+  /// are read, a few KiB per font, so subtitle renderers can pick the fonts
+  /// a script needs before extracting anything.
+  ///
+  /// The returned map contains `fonts`, one map per face (collections have
+  /// several) with `attachmentIndex`, `fileName`, `faceIndex`, `family`,
+  /// `subfamily`, `fullName`, `postScriptName`, `typographicFamily` and
+  /// `typographicSubfamily` (empty when the font lacks them), plus
+  /// `bytesRead`. Attachments that are not fonts are skipped.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>> getMkvFonts({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for font introspection.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('getMkvFonts', args) ?? {};
+  }
+
+  /// Returns the nearest keyframe at or before [timeMs] according to the MKV
+  /// Cues index, or null if there is none.
+  ///
+  /// The map contains `track`, `timeMs` (the keyframe time), `clusterPosition`
+  /// (absolute byte offset of the Cluster holding it), `relativePosition` and
+  /// `cueCount`. No decoding is involved, so this is cheap enough for
+  /// storyboard and scrub-preview planning.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>?> findMkvKeyframe({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The timestamp to look up, in milliseconds.
+    required double timeMs,
+
+    /// The track number. 0 (the default) means the first video track.
+    int track = 0,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'timeMs': timeMs,
+      'track': track,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for keyframe lookup.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('findMkvCue', args);
+  }
+
+  /// Demuxes the keyframe shown at [timeMs] straight from an MKV file.
+  ///
+  /// Returns null if the track has no keyframe. Otherwise returns a map with
+  /// `track`, `timeMs` (the keyframe's own timestamp, at or before the one
+  /// asked for), `clusterPosition`, `codecId`, `codecPrivate` and `data`.
+  /// `data` is the raw, still encoded frame and `codecPrivate` the decoder
+  /// configuration for the track (e.g. the avcC record for H.264), both as
+  /// Uint8List, ready to be handed to a decoder.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>?> getMkvKeyframe({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// The timestamp of the wanted frame, in milliseconds.
+    required double timeMs,
+
+    /// The track number. 0 (the default) means the first video track.
+    int track = 0,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'timeMs': timeMs,
+      'track': track,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for keyframe extraction.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('getMkvKeyframe', args);
+  }
+
+  /// Computes exact per-track statistics by reading every block of an MKV
+  /// file.
+  ///
+  /// The file is split into byte ranges scanned in parallel, one per
+  /// [threads] (0, the default, means one per core; small files use fewer).
+  /// Returns a map with `tracks` (one map per track with `track`, `blocks`,
+  /// `frames`, `bytes`, `keyframes`, `durationMs`, `bitrate` and
+  /// `min`/`max`/`avgKeyframeIntervalMs`), `clusters`, `threads` and `scanMs`.
+  ///
+  /// This reads the whole file, prefer [getMkvMetadata] when estimates are
+  /// enough.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>?> getMkvTrackStatistics({
+    /// The path to the MKV file.
+    String? mkvPath,
+
+    /// A session from [openMkvSession], used instead of [mkvPath].
+    int? session,
+
+    /// Maximum number of worker threads, 0 for one per core.
+    int threads = 0,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (mkvPath != null) 'mkvPath': mkvPath,
+      if (session != null) 'session': session,
+      'threads': threads,
+    };
+
+    _checkMkvTarget(mkvPath, session, 'Only MKV files are supported for track statistics.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('getMkvTrackStatistics', args);
+  }
+
   /// Returns just the duration of the video in milliseconds.
   ///
   /// This is optimized for speed by only extracting the duration metadata.
-  /// Returns 0.0 if duration couldn't be determined.
+  /// Returns 0.0 if duration couldn't be determined. Results are cached
+  /// across launches, see [configureMetadataCache].
   ///
   /// Otherwise throws a PlatformException.
   static Future<double> getVideoDuration({
     /// The path to the video file to extract the duration from.
     required String videoPath,
+
+    /// From [newRequestId], to [cancelRequest] or [reprioritizeRequest] it later.
+    int? requestId,
+
+    /// Higher runs first, see [reprioritizeRequest].
+    int priority = 0,
   }) async {
     final Map<String, dynamic> args = <String, dynamic>{
       'videoPath': videoPath,
+      if (requestId != null) 'requestId': requestId,
+      'priority': priority,
     };
 
     return await _channel.invokeMethod<double>('getVideoDuration', args) ?? 0.0;
   }
+
+  /// Returns a new id to pass as `requestId` to [extractCachedThumbnail],
+  /// [getVideoDuration], [getMkvMetadata] or [getMkvMetadataBatch].
+  static int newRequestId() => _nextRequestId++;
+
+  static int _nextRequestId = 1;
+
+  /// Drops the request [requestId] if it has not started yet; its future then
+  /// fails with a PlatformException whose code is `cancelled`.
+  ///
+  /// Returns false if it has already started or finished.
+  static Future<bool> cancelRequest(int requestId) async {
+    return await _channel.invokeMethod<bool>('cancelRequest', <String, dynamic>{'requestId': requestId}) ?? false;
+  }
+
+  /// Moves the request [requestId] to [priority] (higher runs first), e.g.
+  /// when its item scrolls into or out of view.
+  ///
+  /// Returns false if it has already started or finished.
+  static Future<bool> reprioritizeRequest(int requestId, int priority) async {
+    return await _channel.invokeMethod<bool>('reprioritize', <String, dynamic>{
+          'requestId': requestId,
+          'priority': priority,
+        }) ??
+        false;
+  }
+
+  /// Returns the state of the native request queue: `queued`, `running`,
+  /// `peakQueued`, `threads`, `submitted`, `completed`, `cancelled`, and how
+  /// long requests waited before starting (`averageWaitMs`, `maxWaitMs`).
+  ///
+  /// Identical thumbnail, duration and metadata requests made while one is
+  /// still queued or running share its result instead of reading the file
+  /// again; `dedupRequests`, `dedupHits` and `dedupHitRate` count those.
+  static Future<Map<dynamic, dynamic>> getSchedulerStats() async {
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('getSchedulerStats') ?? {};
+  }
+
+  /// Returns the duration of an MKV file and how it was determined.
+  ///
+  /// Works for files whose header has no Duration (e.g. live recordings):
+  /// those are timed from their last block, located through the Cues or by
+  /// reading the last few MiB of the file. The map holds `durationMs`,
+  /// `method` (`info`, `cues` or `tail`, cheapest first) and `bytesRead`.
+  ///
+  /// [getVideoDuration] already uses this for MKV files.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>?> probeMkvDuration({
+    /// The path to the MKV file.
+    required String mkvPath,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      'mkvPath': mkvPath,
+    };
+
+    if (mkvPath.split('.').last.toLowerCase() != 'mkv') //
+      throw ArgumentError('Only MKV files are supported for duration probing.');
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('probeMkvDuration', args);
+  }
+
+  /// Configures the persistent cache behind [getMkvMetadata] and
+  /// [getVideoDuration].
+  ///
+  /// Results are cached on disk keyed by path, size and last write time, so
+  /// they are reused across launches until the file changes. By default the
+  /// cache lives in `%LOCALAPPDATA%\video_thumbnail_exporter\metadata_cache`
+  /// and may grow to 64 MiB; once full it stops storing until it is compacted
+  /// on the next launch (or the next call to this method), dropping the
+  /// oldest entries. Omitted arguments keep their current value.
+  ///
+  /// Only one running app uses a cache directory at a time. Another instance
+  /// pointed at the same directory runs without the cache, and `enabled`
+  /// comes back false.
+  ///
+  /// Returns a map with `enabled`, `directory`, `entries`, `dataBytes`,
+  /// `maxBytes` and `compactedBytes`.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<Map<dynamic, dynamic>> configureMetadataCache({
+    /// Directory holding the cache files.
+    String? directory,
+
+    /// Size budget of the cache, in bytes.
+    int? maxBytes,
+
+    /// Whether results are looked up in and stored to the cache.
+    bool? enabled,
+
+    /// Drop every cached entry.
+    bool clear = false,
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      if (directory != null) 'directory': directory,
+      if (maxBytes != null) 'maxBytes': maxBytes,
+      if (enabled != null) 'enabled': enabled,
+      'clear': clear,
+    };
+
+    return await _channel.invokeMethod<Map<dynamic, dynamic>>('configureMetadataCache', args) ?? {};
+  }
+
+  /// Parses an MKV file once and keeps it open, returning a session handle.
+  ///
+  /// Pass the handle as `session` to [getMkvMetadata], [extractVideoAttachment],
+  /// [findMkvKeyframe], [getMkvKeyframe] and [getMkvTrackStatistics] to skip
+  /// reopening and reparsing the file on every call. Sessions parse every
+  /// section by default. Close them with [closeMkvSession]; a session unused
+  /// for [idleTimeout] is closed automatically, after which calls using it
+  /// throw a PlatformException with code `invalid_session`.
+  ///
+  /// Otherwise throws a PlatformException.
+  static Future<int> openMkvSession({
+    /// The path to the MKV file.
+    required String mkvPath,
+
+    /// A combination of [MkvSection] flags to parse. Defaults to everything,
+    /// the Cues included. Sections a later call needs that are not in here
+    /// are parsed by that call and then kept with the session.
+    int? sections,
+
+    /// How long the session stays open without being used.
+    Duration idleTimeout = const Duration(minutes: 5),
+  }) async {
+    final Map<String, dynamic> args = <String, dynamic>{
+      'mkvPath': mkvPath,
+      if (sections != null) 'sections': sections,
+      'idleTimeoutMs': idleTimeout.inMilliseconds,
+    };
+
+    _checkMkvTarget(mkvPath, null, 'Only MKV files are supported for sessions.');
+
+    return (await _channel.invokeMethod<int>('openMkvSession', args))!;
+  }
+
+  /// Closes a session opened by [openMkvSession].
+  ///
+  /// Returns false if the session had already expired or been closed.
+  static Future<bool> closeMkvSession(int session) async {
+    return await _channel.invokeMethod<bool>('closeMkvSession', <String, dynamic>{'session': session}) ?? false;
+  }
+
+  static void _checkMkvTarget(String? mkvPath, int? session, String message) {
+    if (session != null) return;
+    if (mkvPath == null) //
+      throw ArgumentError('Either mkvPath or session must be given.');
+    if (mkvPath.split('.').last.toLowerCase() != 'mkv') //
+      throw ArgumentError(message);
+  }
+}
+
+/// Sections of an MKV file that [VideoDataExtractor.getMkvMetadata] can parse.
+///
+/// Combine them with `|`, e.g. `MkvSection.info | MkvSection.tracks`.
+class MkvSection {
+  MkvSection._();
+
+  /// Title, duration, muxing/writing app and estimated bitrate.
+  static const int info = 0x01;
+
+  /// Video and audio streams.
+  static const int tracks = 0x02;
+
+  /// Attached files (fonts, cover art, ...).
+  static const int attachments = 0x04;
+
+  /// Editions and chapters.
+  static const int chapters = 0x10;
+
+  /// Tags, including the statistics mkvmerge writes for every track.
+  static const int tags = 0x20;
+
+  static const int all = info | tracks | attachments | chapters | tags;
+}
+
+/// Result of [VideoDataExtractor.getMkvMetadataPacked]: the fields of the map
+/// [VideoDataExtractor.getMkvMetadata] returns, read out of one buffer only
+/// when asked for. Strings are decoded once, on first use.
+///
+/// Times are in milliseconds. Fields of sections that were not requested
+/// read as 0 or empty. The layout is described in
+/// `windows/mkv_packed_metadata.h`.
+class PackedMkvMetadata {
+  PackedMkvMetadata(Uint8List bytes)
+      : _bytes = bytes,
+        _data = ByteData.sublistView(bytes) {
+    if (bytes.length < _headerSize || _u32(0) != _magic) //
+      throw const FormatException('Not packed MKV metadata.');
+    if (_u16(4) != version) //
+      throw FormatException('Unsupported packed MKV metadata version ${_u16(4)}.');
+    _stringTable = _u32(12);
+    _strings = List<String?>.filled(_u32(_stringTable), null);
+  }
+
+  /// Version of the layout this class reads.
+  static const int version = 1;
+
+  static const int _magic = 0x504B564D; // "MKVP"
+  static const int _headerSize = 120;
+  static const int _blocks = 56;
+  static const int _tracks = 0;
+  static const int _attachments = 1;
+  static const int _editions = 2;
+  static const int _chapters = 3;
+  static const int _tags = 4;
+
+  final Uint8List _bytes;
+  final ByteData _data;
+  late final int _stringTable;
+  late final List<String?> _strings;
+
+  /// The [MkvSection] flags the buffer was built from.
+  int get sections => _u32(8);
+
+  String get title => _string(40);
+  double get duration => _f64(16);
+  String get muxingApp => _string(44);
+  String get writingApp => _string(48);
+
+  /// Estimated, in bits per second.
+  int get bitrate => _u64(24);
+  int get timecodeScale => _u64(32);
+
+  /// Video tracks first, then audio, then subtitles.
+  List<PackedMkvTrack> get tracks => _records(_tracks, (_, offset) => PackedMkvTrack._(this, offset));
+  Iterable<PackedMkvTrack> get videoStreams => tracks.where((track) => track.isVideo);
+  Iterable<PackedMkvTrack> get audioStreams => tracks.where((track) => track.isAudio);
+  Iterable<PackedMkvTrack> get subtitleStreams => tracks.where((track) => track.isSubtitle);
+
+  /// In file order; [PackedMkvAttachment.index] is what the attachment calls take.
+  List<PackedMkvAttachment> get attachments => _records(_attachments, (i, offset) => PackedMkvAttachment._(this, offset, i));
+  List<PackedMkvEdition> get editions => _records(_editions, (_, offset) => PackedMkvEdition._(this, offset));
+
+  /// In file order, nested chapters after their parent.
+  List<PackedMkvChapter> get chapters => _records(_chapters, (_, offset) => PackedMkvChapter._(this, offset));
+  List<PackedMkvTag> get tags => _records(_tags, (_, offset) => PackedMkvTag._(this, offset));
+
+  List<T> _records<T>(int block, T Function(int index, int offset) view) {
+    final int entry = _blocks + block * 12;
+    final int start = _u32(entry);
+    final int stride = _u32(entry + 8);
+    return List<T>.generate(_u32(entry + 4), (i) => view(i, start + i * stride), growable: false);
+  }
+
+  int _u8(int offset) => _data.getUint8(offset);
+  int _u16(int offset) => _data.getUint16(offset, Endian.little);
+  int _u32(int offset) => _data.getUint32(offset, Endian.little);
+  int _u64(int offset) => _data.getUint64(offset, Endian.little);
+  double _f64(int offset) => _data.getFloat64(offset, Endian.little);
+
+  String _string(int offset) {
+    final int index = _u32(offset);
+    return _strings[index] ??= utf8.decode(Uint8List.sublistView(
+      _bytes,
+      _u32(_stringTable + 4 + 4 * index),
+      _u32(_stringTable + 8 + 4 * index),
+    ));
+  }
+}
+
+/// One record of a [PackedMkvMetadata], read in place.
+abstract class _PackedRecord {
+  const _PackedRecord(this._metadata, this._offset);
+
+  final PackedMkvMetadata _metadata;
+  final int _offset;
+
+  int _u8(int field) => _metadata._u8(_offset + field);
+  int _u16(int field) => _metadata._u16(_offset + field);
+  int _u32(int field) => _metadata._u32(_offset + field);
+  int _u64(int field) => _metadata._u64(_offset + field);
+  double _f64(int field) => _metadata._f64(_offset + field);
+  String _string(int field) => _metadata._string(_offset + field);
+}
+
+class PackedMkvTrack extends _PackedRecord {
+  const PackedMkvTrack._(PackedMkvMetadata metadata, int offset) : super(metadata, offset);
+
+  /// Matroska TrackType: 1 for video, 2 for audio, 0x11 for subtitles.
+  int get type => _u8(0);
+  bool get isVideo => type == 0x01;
+  bool get isAudio => type == 0x02;
+  bool get isSubtitle => type == 0x11;
+
+  int get trackNumber => _u32(4);
+  int get trackUid => _u64(8);
+  String get codecId => _string(16);
+  String get codecName => _string(20);
+  String get language => _string(24);
+  String get name => _string(28);
+
+  int get width => _u32(32);
+  int get height => _u32(36);
+  int get displayWidth => _u32(40);
+  int get displayHeight => _u32(44);
+  double get frameRate => isVideo ? _f64(48) : 0;
+
+  double get sampleRate => isAudio ? _f64(48) : 0;
+  int get channels => _u8(2);
+
+  /// Bits per channel for video, per sample for audio.
+  int get bitDepth => _u8(1);
+
+  /// Whether the file has mkvmerge's statistics tags for this track, which
+  /// give the exact values below. They need [MkvSection.tags].
+  bool get hasStatistics => (_u8(3) & 0x01) != 0;
+
+  /// In bits per second.
+  int get bitrate => _u64(56);
+  int get frameCount => _u64(64);
+
+  /// In bytes.
+  int get streamSize => _u64(72);
+  double get streamDuration => _f64(80);
+}
+
+class PackedMkvAttachment extends _PackedRecord {
+  const PackedMkvAttachment._(PackedMkvMetadata metadata, int offset, this.index) : super(metadata, offset);
+
+  final int index;
+  int get uid => _u64(0);
+
+  /// In bytes.
+  int get size => _u64(8);
+  String get fileName => _string(16);
+  String get mimeType => _string(20);
+  String get description => _string(24);
+}
+
+class PackedMkvEdition extends _PackedRecord {
+  const PackedMkvEdition._(PackedMkvMetadata metadata, int offset) : super(metadata, offset);
+
+  int get uid => _u64(0);
+  bool get isDefault => (_u8(8) & 0x01) != 0;
+  bool get hidden => (_u8(8) & 0x02) != 0;
+  bool get ordered => (_u8(8) & 0x04) != 0;
+}
+
+class PackedMkvChapter extends _PackedRecord {
+  const PackedMkvChapter._(PackedMkvMetadata metadata, int offset) : super(metadata, offset);
+
+  int get uid => _u64(0);
+  double get start => _f64(8);
+  double get end => _f64(16);
+  String get title => _string(24);
+  String get language => _string(28);
+
+  /// Index in [PackedMkvMetadata.editions].
+  int get edition => _u16(32);
+
+  /// 0 for top-level chapters.
+  int get depth => _u8(34);
+  bool get hidden => (_u8(35) & 0x01) != 0;
+  bool get enabled => (_u8(35) & 0x02) != 0;
+}
+
+class PackedMkvTag extends _PackedRecord {
+  const PackedMkvTag._(PackedMkvMetadata metadata, int offset) : super(metadata, offset);
+
+  /// 0 for tags about the whole file.
+  int get trackUid => _u64(0);
+  int get editionUid => _u64(8);
+  int get chapterUid => _u64(16);
+  int get attachmentUid => _u64(24);
+  int get targetTypeValue => _u32(32);
+  String get targetType => _string(36);
+  String get name => _string(40);
+  String get language => _string(44);
+  String get value => _string(48);
 }
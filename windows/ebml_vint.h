@@ -0,0 +1,98 @@
+#ifndef EBML_VINT_H
+#define EBML_VINT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <stdlib.h>
+#endif
+
+// EBML variable-size integer (VINT) decoding over an in-memory span.
+//
+// The length of a VINT is one plus the number of leading zero bits of its
+// first byte, so it is found with a single count-leading-zeros instead of a
+// bit-by-bit loop. When at least 8 bytes are readable the whole VINT is
+// fetched with one unaligned big-endian load and a shift.
+
+// Size value whose VINT bits are all set: the element's size is unknown
+const uint64_t MKV_UNKNOWN_SIZE = 0xFFFFFFFFFFFFFFFFULL;
+
+// VINT length (1-8) given its first byte, 0 if the byte is 0 (invalid)
+inline unsigned ebmlVintLength(uint8_t first) {
+    if (first == 0) {
+        return 0;
+    }
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, first);
+    return 8 - static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_clz(first)) - 23;
+#endif
+}
+
+// 8 bytes at `p` as a big-endian integer, `p` need not be aligned
+inline uint64_t ebmlLoadBigEndian(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#ifdef _MSC_VER
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+}
+
+// The `length` byte big-endian integer at `p`, `available` bytes readable
+inline uint64_t ebmlLoadVint(const uint8_t* p, size_t available, unsigned length) {
+    if (available >= 8) {
+        return ebmlLoadBigEndian(p) >> (64 - 8 * length);
+    }
+    uint64_t value = 0;
+    for (unsigned i = 0; i < length; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// Decode an element ID (length marker kept, at most 4 bytes). Returns the
+// number of bytes used, 0 if the ID is invalid or cut off by `available`.
+inline unsigned ebmlDecodeId(const uint8_t* p, size_t available, uint32_t& id) {
+    if (available == 0) {
+        return 0;
+    }
+    unsigned length = ebmlVintLength(p[0]);
+    if (length == 0 || length > 4 || length > available) {
+        return 0;
+    }
+    id = static_cast<uint32_t>(ebmlLoadVint(p, available, length));
+    return length;
+}
+
+// Decode an element size (length marker stripped). All value bits set gives
+// MKV_UNKNOWN_SIZE. Returns the number of bytes used, 0 if the size is
+// invalid or cut off by `available`.
+inline unsigned ebmlDecodeSize(const uint8_t* p, size_t available, uint64_t& size) {
+    if (available == 0) {
+        return 0;
+    }
+    unsigned length = ebmlVintLength(p[0]);
+    if (length == 0 || length > available) {
+        return 0;
+    }
+    uint64_t mask = (uint64_t(1) << (7 * length)) - 1;
+    size = ebmlLoadVint(p, available, length) & mask;
+    if (size == mask) {
+        size = MKV_UNKNOWN_SIZE;
+    }
+    return length;
+}
+
+// Decode a big-endian unsigned integer element of `size` (0-8) bytes
+inline uint64_t ebmlDecodeUnsigned(const uint8_t* p, size_t available, unsigned size) {
+    return size == 0 ? 0 : ebmlLoadVint(p, available, size);
+}
+
+#endif // EBML_VINT_H
@@ -0,0 +1,258 @@
+#include "file_copy.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <boost/nowide/convert.hpp>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#endif
+
+namespace {
+
+// Large enough that per-call overhead disappears, small enough to stay out
+// of the way of the rest of the process
+const size_t ChunkSize = 4 * 1024 * 1024;
+
+#ifdef _WIN32
+
+// Unbuffered reads must start, and be sized, on sector boundaries. 4 KiB
+// covers both 512 byte and 4K native sectors.
+const uint64_t SectorAlignment = 4096;
+
+bool writeAt(HANDLE file, uint64_t offset, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD count = 0;
+        if (!WriteFile(file, data, static_cast<DWORD>(size), &count, &overlapped) || count == 0) {
+            return false;
+        }
+        data += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+// Copy [offset, offset + length) of `source` to the start of `output`,
+// reading from `alignment` boundaries
+bool copyChunks(HANDLE source, HANDLE output, uint64_t offset, uint64_t length,
+    uint64_t alignment, uint8_t* buffer) {
+    const uint64_t end = offset + length;
+    uint64_t position = offset - offset % alignment;
+    while (position < end) {
+        DWORD want = static_cast<DWORD>(ChunkSize);
+        if (alignment == 1) {
+            want = static_cast<DWORD>(std::min<uint64_t>(ChunkSize, end - position));
+        }
+
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(position);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD got = 0;
+        if (!ReadFile(source, buffer, want, &got, &overlapped) || got == 0) {
+            return false;
+        }
+
+        // Aligned reads start before `offset` and may run past `end`
+        uint64_t from = std::max(position, offset);
+        uint64_t to = std::min(position + got, end);
+        if (to <= from ||
+            !writeAt(output, from - offset, buffer + (from - position), static_cast<size_t>(to - from))) {
+            return false;
+        }
+        position += got;
+    }
+    return true;
+}
+
+bool copySection(const std::string& sourcePath, uint64_t offset, uint64_t length,
+    const std::string& outputPath, FileCopyMethod& method) {
+    const std::wstring source = boost::nowide::widen(sourcePath);
+    const std::wstring outputName = boost::nowide::widen(outputPath);
+
+    HANDLE output = CreateFileW(outputName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (output == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // Reserve the space up front so the file is laid out in one piece
+    FILE_ALLOCATION_INFO allocation = {};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(length);
+    SetFileInformationByHandle(output, FileAllocationInfo, &allocation, sizeof(allocation));
+
+    // VirtualAlloc hands out page aligned memory, as unbuffered reads need
+    uint8_t* buffer = static_cast<uint8_t*>(
+        VirtualAlloc(nullptr, ChunkSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    bool ok = false;
+    if (buffer != nullptr) {
+        const DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+        HANDLE input = CreateFileW(source.c_str(), GENERIC_READ, share, nullptr, OPEN_EXISTING,
+            FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (input != INVALID_HANDLE_VALUE) {
+            method = FILE_COPY_UNBUFFERED;
+            ok = copyChunks(input, output, offset, length, SectorAlignment, buffer);
+            CloseHandle(input);
+        }
+
+        // Some volumes (network shares, odd sector sizes) refuse unbuffered
+        // reads; the buffered copy rewrites the output from the start
+        if (!ok) {
+            input = CreateFileW(source.c_str(), GENERIC_READ, share, nullptr, OPEN_EXISTING,
+                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (input != INVALID_HANDLE_VALUE) {
+                method = FILE_COPY_BUFFERED;
+                ok = copyChunks(input, output, offset, length, 1, buffer);
+                CloseHandle(input);
+            }
+        }
+        VirtualFree(buffer, 0, MEM_RELEASE);
+    }
+
+    CloseHandle(output);
+    if (!ok) {
+        DeleteFileW(outputName.c_str());
+    }
+    return ok;
+}
+
+#else
+
+bool copySection(const std::string& sourcePath, uint64_t offset, uint64_t length,
+    const std::string& outputPath, FileCopyMethod& method) {
+    int input = ::open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (input < 0) {
+        return false;
+    }
+    int output = ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output < 0) {
+        ::close(input);
+        return false;
+    }
+
+    uint64_t copied = 0;
+    method = FILE_COPY_BUFFERED;
+
+#ifdef __linux__
+    // Reserve the space up front. Unlike posix_fallocate this fails instead
+    // of writing zeros on file systems that cannot do it.
+    if (length > 0) {
+        fallocate(output, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(length));
+    }
+
+    // Each method picks up where the previous one gave up; copy_file_range
+    // is refused across some file systems, sendfile by some others
+    method = FILE_COPY_KERNEL;
+    while (copied < length) {
+        off_t inputOffset = static_cast<off_t>(offset + copied);
+        off_t outputOffset = static_cast<off_t>(copied);
+        ssize_t count = copy_file_range(input, &inputOffset, output, &outputOffset,
+            static_cast<size_t>(std::min<uint64_t>(length - copied, 1 << 30)), 0);
+        if (count > 0) {
+            copied += count;
+        }
+        else if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (copied < length && lseek(output, static_cast<off_t>(copied), SEEK_SET) >= 0) {
+        method = FILE_COPY_SENDFILE;
+        while (copied < length) {
+            off_t inputOffset = static_cast<off_t>(offset + copied);
+            ssize_t count = sendfile(output, input, &inputOffset,
+                static_cast<size_t>(std::min<uint64_t>(length - copied, 1 << 30)));
+            if (count > 0) {
+                copied += count;
+            }
+            else if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            else {
+                break;
+            }
+        }
+    }
+#endif
+
+    if (copied < length) {
+        method = FILE_COPY_BUFFERED;
+        std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(ChunkSize, length - copied)));
+        while (copied < length) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), length - copied));
+            ssize_t got = pread(input, buffer.data(), want, static_cast<off_t>(offset + copied));
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                break;
+            }
+            size_t written = 0;
+            while (written < static_cast<size_t>(got)) {
+                ssize_t count = pwrite(output, buffer.data() + written, got - written,
+                    static_cast<off_t>(copied + written));
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    break;
+                }
+                written += count;
+            }
+            copied += written;
+            if (written < static_cast<size_t>(got)) {
+                break;
+            }
+        }
+    }
+
+    ::close(input);
+    bool ok = ::close(output) == 0 && copied == length;
+    if (!ok) {
+        ::unlink(outputPath.c_str());
+    }
+    return ok;
+}
+
+#endif
+
+} // namespace
+
+const char* getFileCopyMethodName(FileCopyMethod method) {
+    switch (method) {
+    case FILE_COPY_KERNEL: return "copy_file_range";
+    case FILE_COPY_SENDFILE: return "sendfile";
+    case FILE_COPY_UNBUFFERED: return "unbuffered";
+    case FILE_COPY_BUFFERED: return "buffered";
+    default: return "none";
+    }
+}
+
+bool copyFileSection(const std::string& sourcePath, uint64_t offset, uint64_t length,
+    const std::string& outputPath, FileCopyStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    FileCopyMethod method = FILE_COPY_NONE;
+    bool ok = copySection(sourcePath, offset, length, outputPath, method);
+
+    if (stats != nullptr) {
+        stats->bytes = ok ? length : 0;
+        stats->method = method;
+        stats->elapsedUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    return ok;
+}
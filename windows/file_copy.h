@@ -0,0 +1,44 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <cstdint>
+#include <string>
+
+// How copyFileSection() moved the bytes
+enum FileCopyMethod {
+    FILE_COPY_NONE = 0,
+    FILE_COPY_KERNEL,      // copy_file_range, the kernel copies (or reflinks)
+    FILE_COPY_SENDFILE,    // sendfile, the kernel copies through the page cache
+    FILE_COPY_UNBUFFERED,  // large reads bypassing the file cache (Windows)
+    FILE_COPY_BUFFERED     // large buffered reads and writes
+};
+
+const char* getFileCopyMethodName(FileCopyMethod method);
+
+struct FileCopyStats {
+    uint64_t bytes;
+    uint64_t elapsedUs;
+    FileCopyMethod method;
+
+    FileCopyStats() : bytes(0), elapsedUs(0), method(FILE_COPY_NONE) {}
+
+    uint64_t getBytesPerSecond() const {
+        return elapsedUs > 0 ? bytes * 1000000 / elapsedUs : 0;
+    }
+};
+
+// Copy `length` bytes starting at `offset` of `sourcePath` into a new file
+// at `outputPath` (both UTF-8), replacing it if it exists.
+//
+// The output is preallocated to `length` first, then the copy is left to
+// the kernel where it can do it (copy_file_range, then sendfile on Linux).
+// On Windows the source is read in large chunks with FILE_FLAG_NO_BUFFERING,
+// so a multi-hundred-MB attachment does not churn the file cache. Anything
+// else falls back to a large buffered copy.
+//
+// Returns false if any byte could not be copied; the partial output is
+// removed.
+bool copyFileSection(const std::string& sourcePath, uint64_t offset, uint64_t length,
+    const std::string& outputPath, FileCopyStats* stats = nullptr);
+
+#endif // FILE_COPY_H
@@ -0,0 +1,707 @@
+#include "metadata_cache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include "single_flight_table.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <boost/nowide/convert.hpp>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// On-disk layout. Both files carry the same generation number so an index is
+// never paired with a log it was not built for.
+
+struct MetadataCache::IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t slotCount;     // power of two
+    uint64_t generation;
+    std::atomic<uint64_t> entries;
+    uint64_t reserved[4];
+};
+
+// `location` packs the record's offset in the log and its length, so one
+// atomic store publishes both
+struct MetadataCache::IndexSlot {
+    std::atomic<uint64_t> hash;      // 0 = empty
+    std::atomic<uint64_t> location;  // 0 = no record yet
+};
+
+namespace {
+
+const uint32_t IndexMagic = 0x494D5456;   // "VTMI"
+const uint32_t DataMagic = 0x444D5456;    // "VTMD"
+const uint32_t RecordMagic = 0x524D5456;  // "VTMR"
+const uint32_t FormatVersion = 1;
+
+const uint64_t DefaultSlots = 1 << 17;
+const unsigned MaxProbes = 256;
+const unsigned LengthBits = 26;
+const uint64_t LengthMask = (uint64_t(1) << LengthBits) - 1;
+
+struct DataHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+};
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t length;        // whole record, header included
+    uint32_t kind;
+    uint32_t pathLength;
+    uint32_t checksum;      // of the path and the payload
+    uint32_t reserved;
+    uint64_t fileSize;
+    uint64_t lastWriteTime;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "index slots must be lock-free");
+static_assert(sizeof(RecordHeader) + MetadataCache::MaxRecordSize + 64 * 1024 < (1 << LengthBits),
+    "record length must fit in a slot location");
+
+uint64_t hashKey(uint32_t kind, const std::string& path) {
+    // FNV-1a, 0 is reserved for empty slots
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int shift = 0; shift < 32; shift += 8) {
+        hash = (hash ^ ((kind >> shift) & 0xFF)) * 0x100000001B3ULL;
+    }
+    for (unsigned char c : path) {
+        hash = (hash ^ c) * 0x100000001B3ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+uint32_t checksum(const uint8_t* data, size_t size) {
+    uint32_t hash = 0x811C9DC5u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x01000193u;
+    }
+    return hash;
+}
+
+DataHeader newDataHeader() {
+    DataHeader header = {};
+    header.magic = DataMagic;
+    header.version = FormatVersion;
+    header.generation = static_cast<uint64_t>(
+        std::chrono::system_clock::now().time_since_epoch().count()) | 1;
+    return header;
+}
+
+uint64_t nextPowerOfTwo(uint64_t value) {
+    uint64_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// Thin positional file I/O, so readers never share a file cursor
+
+const intptr_t InvalidFile = -1;
+
+#ifdef _WIN32
+
+intptr_t openFile(const std::string& path, bool create) {
+    HANDLE handle = CreateFileW(boost::nowide::widen(path).c_str(), GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return handle == INVALID_HANDLE_VALUE ? InvalidFile : reinterpret_cast<intptr_t>(handle);
+}
+
+// Opened without any sharing, so a second open fails until it is closed
+// (or the process holding it dies)
+intptr_t openLockFile(const std::string& path) {
+    HANDLE handle = CreateFileW(boost::nowide::widen(path).c_str(), GENERIC_READ | GENERIC_WRITE,
+        0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return handle == INVALID_HANDLE_VALUE ? InvalidFile : reinterpret_cast<intptr_t>(handle);
+}
+
+void closeFile(intptr_t file) {
+    CloseHandle(reinterpret_cast<HANDLE>(file));
+}
+
+bool readAt(intptr_t file, uint64_t offset, void* data, size_t size) {
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD count = 0;
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1 << 30));
+        if (!ReadFile(reinterpret_cast<HANDLE>(file), dst, chunk, &count, &overlapped) || count == 0) {
+            return false;
+        }
+        dst += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool writeAt(intptr_t file, uint64_t offset, const void* data, size_t size) {
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD count = 0;
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, 1 << 30));
+        if (!WriteFile(reinterpret_cast<HANDLE>(file), src, chunk, &count, &overlapped) || count == 0) {
+            return false;
+        }
+        src += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+uint64_t getFileSize(intptr_t file) {
+    LARGE_INTEGER size;
+    return GetFileSizeEx(reinterpret_cast<HANDLE>(file), &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+}
+
+bool resizeFile(intptr_t file, uint64_t size) {
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(size);
+    return SetFilePointerEx(reinterpret_cast<HANDLE>(file), position, nullptr, FILE_BEGIN) &&
+        SetEndOfFile(reinterpret_cast<HANDLE>(file));
+}
+
+void* mapFile(intptr_t file, size_t size, void*& mapping) {
+    mapping = CreateFileMappingW(reinterpret_cast<HANDLE>(file), nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        return nullptr;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+    if (base == nullptr) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+    return base;
+}
+
+void unmapFile(void* base, size_t, void* mapping) {
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+    return MoveFileExW(boost::nowide::widen(from).c_str(), boost::nowide::widen(to).c_str(),
+        MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+intptr_t openFile(const std::string& path, bool create) {
+    int fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    return fd < 0 ? InvalidFile : fd;
+}
+
+// flock() locks belong to the open file, so a second open in this process
+// fails too
+intptr_t openLockFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(fd);
+        return InvalidFile;
+    }
+    return fd < 0 ? InvalidFile : fd;
+}
+
+void closeFile(intptr_t file) {
+    ::close(static_cast<int>(file));
+}
+
+bool readAt(intptr_t file, uint64_t offset, void* data, size_t size) {
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t count = pread(static_cast<int>(file), dst, size, static_cast<off_t>(offset));
+        if (count <= 0) {
+            return false;
+        }
+        dst += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool writeAt(intptr_t file, uint64_t offset, const void* data, size_t size) {
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t count = pwrite(static_cast<int>(file), src, size, static_cast<off_t>(offset));
+        if (count <= 0) {
+            return false;
+        }
+        src += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+uint64_t getFileSize(intptr_t file) {
+    struct stat st;
+    return fstat(static_cast<int>(file), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+bool resizeFile(intptr_t file, uint64_t size) {
+    return ftruncate(static_cast<int>(file), static_cast<off_t>(size)) == 0;
+}
+
+void* mapFile(intptr_t file, size_t size, void*&) {
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, static_cast<int>(file), 0);
+    return base == MAP_FAILED ? nullptr : base;
+}
+
+void unmapFile(void* base, size_t size, void*) {
+    munmap(base, size);
+}
+
+bool replaceFile(const std::string& from, const std::string& to) {
+    return rename(from.c_str(), to.c_str()) == 0;
+}
+
+#endif
+
+} // namespace
+
+bool makeMetadataCacheKey(const std::string& path, uint32_t kind, MetadataCacheKey& key) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(boost::nowide::widen(path).c_str(), GetFileExInfoStandard, &data) ||
+        (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return false;
+    }
+    key.fileSize = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    key.lastWriteTime = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+        data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    key.fileSize = static_cast<uint64_t>(st.st_size);
+    key.lastWriteTime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+#endif
+    key.path = normalizeRequestPath(path);
+    key.kind = kind;
+    return true;
+}
+
+MetadataCache::MetadataCache() :
+    budget(DefaultBudget),
+    lockFile(InvalidFile),
+    dataFile(InvalidFile),
+    indexFile(InvalidFile),
+#ifdef _WIN32
+    indexMapping(nullptr),
+#endif
+    indexSize(0),
+    index(nullptr),
+    slots(nullptr),
+    slotMask(0),
+    dataEnd(0),
+    hits(0),
+    misses(0),
+    stores(0),
+    rejected(0),
+    compactedBytes(0)
+{
+}
+
+MetadataCache::~MetadataCache() {
+    close();
+}
+
+std::string MetadataCache::lockPath() const {
+    return directory + "/metadata_cache.lock";
+}
+
+std::string MetadataCache::dataPath() const {
+    return directory + "/metadata_cache.dat";
+}
+
+std::string MetadataCache::indexPath() const {
+    return directory + "/metadata_cache.idx";
+}
+
+bool MetadataCache::open(const std::string& cacheDirectory, uint64_t cacheBudget) {
+    close();
+    directory = cacheDirectory;
+    budget = cacheBudget;
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::u8path(directory), error);
+
+    // Each instance appends at its own end of the log, so only one may have
+    // it open
+    lockFile = openLockFile(lockPath());
+    if (lockFile == InvalidFile) {
+        return false;
+    }
+
+    if (!openFiles() && !createFiles(DefaultSlots)) {
+        close();
+        return false;
+    }
+
+    // Compact when the log is close to the budget, mostly superseded records
+    // or the index is getting crowded
+    uint64_t live = 0;
+    for (uint64_t i = 0; i <= slotMask; i++) {
+        live += slots[i].location.load(std::memory_order_relaxed) & LengthMask;
+    }
+    uint64_t entries = index->entries.load(std::memory_order_relaxed);
+    if (dataEnd > budget / 4 * 3 || dataEnd - sizeof(DataHeader) > live * 2 || entries > slotMask / 2) {
+        compact();
+    }
+
+    if (!isOpen()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MetadataCache::close() {
+    closeFiles();
+    if (lockFile != InvalidFile) {
+        closeFile(lockFile);
+    }
+    lockFile = InvalidFile;
+}
+
+bool MetadataCache::clear() {
+    if (!isOpen()) {
+        return false;
+    }
+    closeFiles();
+    return createFiles(DefaultSlots);
+}
+
+bool MetadataCache::openFiles() {
+    dataFile = openFile(dataPath(), false);
+    indexFile = openFile(indexPath(), false);
+    if (dataFile == InvalidFile || indexFile == InvalidFile) {
+        closeFiles();
+        return false;
+    }
+
+    DataHeader dataHeader = {};
+    uint64_t fileSize = getFileSize(indexFile);
+    if (!readAt(dataFile, 0, &dataHeader, sizeof(dataHeader)) ||
+        dataHeader.magic != DataMagic || dataHeader.version != FormatVersion ||
+        fileSize < sizeof(IndexHeader) || fileSize > SIZE_MAX) {
+        closeFiles();
+        return false;
+    }
+
+    indexSize = static_cast<size_t>(fileSize);
+    void* mapping = nullptr;
+    void* base = mapFile(indexFile, indexSize, mapping);
+    if (base == nullptr) {
+        closeFiles();
+        return false;
+    }
+    index = static_cast<IndexHeader*>(base);
+    slots = reinterpret_cast<IndexSlot*>(index + 1);
+#ifdef _WIN32
+    indexMapping = mapping;
+#endif
+
+    uint64_t slotCount = index->slotCount;
+    if (index->magic != IndexMagic || index->version != FormatVersion ||
+        index->generation != dataHeader.generation || slotCount != nextPowerOfTwo(slotCount) ||
+        indexSize != sizeof(IndexHeader) + slotCount * sizeof(IndexSlot)) {
+        closeFiles();
+        return false;
+    }
+
+    slotMask = slotCount - 1;
+    dataEnd = getFileSize(dataFile);
+    return true;
+}
+
+bool MetadataCache::createFiles(uint64_t slotCount) {
+    closeFiles();
+
+    DataHeader dataHeader = newDataHeader();
+    IndexHeader indexHeader;
+    memset(static_cast<void*>(&indexHeader), 0, sizeof(indexHeader));
+    indexHeader.magic = IndexMagic;
+    indexHeader.version = FormatVersion;
+    indexHeader.slotCount = slotCount;
+    indexHeader.generation = dataHeader.generation;
+
+    // Resizing zero-fills the slots
+    intptr_t data = openFile(dataPath(), true);
+    intptr_t indexOut = openFile(indexPath(), true);
+    bool ok = data != InvalidFile && indexOut != InvalidFile &&
+        writeAt(data, 0, &dataHeader, sizeof(dataHeader)) &&
+        resizeFile(indexOut, sizeof(IndexHeader) + slotCount * sizeof(IndexSlot)) &&
+        writeAt(indexOut, 0, &indexHeader, sizeof(indexHeader));
+    if (data != InvalidFile) {
+        closeFile(data);
+    }
+    if (indexOut != InvalidFile) {
+        closeFile(indexOut);
+    }
+
+    return ok && openFiles();
+}
+
+void MetadataCache::closeFiles() {
+    if (index != nullptr) {
+#ifdef _WIN32
+        unmapFile(index, indexSize, indexMapping);
+        indexMapping = nullptr;
+#else
+        unmapFile(index, indexSize, nullptr);
+#endif
+    }
+    index = nullptr;
+    slots = nullptr;
+    slotMask = 0;
+    indexSize = 0;
+
+    if (dataFile != InvalidFile) {
+        closeFile(dataFile);
+    }
+    if (indexFile != InvalidFile) {
+        closeFile(indexFile);
+    }
+    dataFile = InvalidFile;
+    indexFile = InvalidFile;
+    dataEnd = 0;
+}
+
+bool MetadataCache::compact() {
+    // Live records, oldest first
+    std::vector<uint64_t> locations;
+    for (uint64_t i = 0; i <= slotMask; i++) {
+        uint64_t location = slots[i].location.load(std::memory_order_relaxed);
+        if (location != 0) {
+            locations.push_back(location);
+        }
+    }
+    std::sort(locations.begin(), locations.end());
+
+    // Drop the oldest until the rest fits in half the budget
+    uint64_t total = 0;
+    for (uint64_t location : locations) {
+        total += location & LengthMask;
+    }
+    size_t first = 0;
+    while (first < locations.size() && total > budget / 2) {
+        total -= locations[first++] & LengthMask;
+    }
+
+    uint64_t slotCount = std::max(DefaultSlots, nextPowerOfTwo((locations.size() - first) * 4));
+    uint64_t oldSize = dataEnd;
+
+    // Build the new log and index next to the old ones, then swap them in
+    std::string newData = dataPath() + ".tmp";
+    std::string newIndex = indexPath() + ".tmp";
+    intptr_t data = openFile(newData, true);
+    intptr_t indexOut = openFile(newIndex, true);
+    bool ok = data != InvalidFile && indexOut != InvalidFile;
+
+    DataHeader dataHeader = newDataHeader();
+    ok = ok && writeAt(data, 0, &dataHeader, sizeof(dataHeader));
+
+    std::vector<uint64_t> table(slotCount * 2, 0);  // hash, location pairs
+    uint64_t entries = 0;
+    uint64_t end = sizeof(DataHeader);
+    std::vector<uint8_t> record;
+    for (size_t i = first; ok && i < locations.size(); i++) {
+        record.clear();
+        if (!readRecord(locations[i], nullptr, record)) {
+            continue;
+        }
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>(record.data());
+        uint64_t hash = hashKey(header->kind,
+            std::string(reinterpret_cast<const char*>(header + 1), header->pathLength));
+
+        uint64_t slot = hash & (slotCount - 1);
+        while (table[slot * 2] != 0 && table[slot * 2] != hash) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        if (table[slot * 2] == 0) {
+            entries++;
+        }
+        table[slot * 2] = hash;
+        table[slot * 2 + 1] = (end << LengthBits) | record.size();
+
+        ok = writeAt(data, end, record.data(), record.size());
+        end += record.size();
+    }
+
+    IndexHeader indexHeader;
+    memset(static_cast<void*>(&indexHeader), 0, sizeof(indexHeader));
+    indexHeader.magic = IndexMagic;
+    indexHeader.version = FormatVersion;
+    indexHeader.slotCount = slotCount;
+    indexHeader.generation = dataHeader.generation;
+    indexHeader.entries.store(entries, std::memory_order_relaxed);
+    ok = ok && writeAt(indexOut, 0, &indexHeader, sizeof(indexHeader)) &&
+        writeAt(indexOut, sizeof(indexHeader), table.data(), table.size() * sizeof(uint64_t));
+
+    if (data != InvalidFile) {
+        closeFile(data);
+    }
+    if (indexOut != InvalidFile) {
+        closeFile(indexOut);
+    }
+
+    closeFiles();
+    ok = ok && replaceFile(newData, dataPath()) && replaceFile(newIndex, indexPath());
+    if (!ok || !openFiles()) {
+        // Whatever state the files are in, start over rather than fail
+        return createFiles(DefaultSlots);
+    }
+
+    compactedBytes = oldSize - end;
+    return true;
+}
+
+MetadataCache::IndexSlot* MetadataCache::probe(uint64_t hash) const {
+    uint64_t i = hash & slotMask;
+    for (unsigned n = 0; n < MaxProbes && n <= slotMask; n++) {
+        IndexSlot* slot = &slots[i];
+        uint64_t slotHash = slot->hash.load(std::memory_order_acquire);
+        if (slotHash == hash || slotHash == 0) {
+            return slot;
+        }
+        i = (i + 1) & slotMask;
+    }
+    return nullptr;
+}
+
+bool MetadataCache::readRecord(uint64_t location, const MetadataCacheKey* key,
+    std::vector<uint8_t>& record) const {
+    uint64_t offset = location >> LengthBits;
+    size_t length = static_cast<size_t>(location & LengthMask);
+    if (length < sizeof(RecordHeader)) {
+        return false;
+    }
+
+    record.resize(length);
+    if (!readAt(dataFile, offset, record.data(), length)) {
+        return false;
+    }
+
+    RecordHeader header;
+    memcpy(&header, record.data(), sizeof(header));
+    if (header.magic != RecordMagic || header.length != length ||
+        header.pathLength > length - sizeof(RecordHeader)) {
+        return false;
+    }
+    if (key && (header.kind != key->kind || header.fileSize != key->fileSize ||
+        header.lastWriteTime != key->lastWriteTime || header.pathLength != key->path.size() ||
+        memcmp(record.data() + sizeof(RecordHeader), key->path.data(), key->path.size()) != 0)) {
+        return false;
+    }
+    return checksum(record.data() + sizeof(RecordHeader), length - sizeof(RecordHeader)) == header.checksum;
+}
+
+bool MetadataCache::find(const MetadataCacheKey& key, std::vector<uint8_t>& payload) const {
+    if (!isOpen()) {
+        return false;
+    }
+
+    uint64_t hash = hashKey(key.kind, key.path);
+    IndexSlot* slot = probe(hash);
+    uint64_t location = slot && slot->hash.load(std::memory_order_acquire) == hash ?
+        slot->location.load(std::memory_order_acquire) : 0;
+
+    if (location == 0 || !readRecord(location, &key, payload)) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        payload.clear();
+        return false;
+    }
+
+    payload.erase(payload.begin(), payload.begin() + sizeof(RecordHeader) + key.path.size());
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool MetadataCache::store(const MetadataCacheKey& key, const uint8_t* payload, size_t size) {
+    if (!isOpen() || size > MaxRecordSize || key.path.size() > 64 * 1024) {
+        return false;
+    }
+
+    // Build the record outside the lock
+    size_t length = sizeof(RecordHeader) + key.path.size() + size;
+    std::vector<uint8_t> record(length);
+    memcpy(record.data() + sizeof(RecordHeader), key.path.data(), key.path.size());
+    if (size > 0) {
+        memcpy(record.data() + sizeof(RecordHeader) + key.path.size(), payload, size);
+    }
+
+    RecordHeader header = {};
+    header.magic = RecordMagic;
+    header.length = static_cast<uint32_t>(length);
+    header.kind = key.kind;
+    header.pathLength = static_cast<uint32_t>(key.path.size());
+    header.checksum = checksum(record.data() + sizeof(RecordHeader), length - sizeof(RecordHeader));
+    header.fileSize = key.fileSize;
+    header.lastWriteTime = key.lastWriteTime;
+    memcpy(record.data(), &header, sizeof(header));
+
+    uint64_t hash = hashKey(key.kind, key.path);
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    IndexSlot* slot = probe(hash);
+    bool newEntry = slot && slot->hash.load(std::memory_order_relaxed) == 0;
+    uint64_t entries = index->entries.load(std::memory_order_relaxed);
+    if (!slot || (newEntry && entries >= (slotMask + 1) / 4 * 3) || dataEnd + length > budget) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (!writeAt(dataFile, dataEnd, record.data(), length)) {
+        return false;
+    }
+    uint64_t location = (dataEnd << LengthBits) | length;
+    dataEnd += length;
+
+    // Readers see the hash only once the location is in place
+    if (newEntry) {
+        slot->location.store(location, std::memory_order_relaxed);
+        slot->hash.store(hash, std::memory_order_release);
+        index->entries.store(entries + 1, std::memory_order_relaxed);
+    }
+    else {
+        slot->location.store(location, std::memory_order_release);
+    }
+
+    stores.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+MetadataCacheStats MetadataCache::getStats() const {
+    MetadataCacheStats stats;
+    if (isOpen()) {
+        stats.entries = index->entries.load(std::memory_order_relaxed);
+        stats.dataBytes = getFileSize(dataFile);
+    }
+    stats.budget = budget;
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.stores = stores.load(std::memory_order_relaxed);
+    stats.rejected = rejected.load(std::memory_order_relaxed);
+    stats.compactedBytes = compactedBytes;
+    return stats;
+}
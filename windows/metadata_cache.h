@@ -0,0 +1,140 @@
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Persistent cache of per-file results (MKV metadata, durations), keyed by
+// the file's path, size and last write time so a changed file misses.
+//
+// Two files live in the cache directory:
+//   metadata_cache.dat  append-only log of records (key + opaque payload)
+//   metadata_cache.idx  open-addressing hash table of record locations,
+//                       memory-mapped and shared by readers and the writer
+//
+// find() is lock-free: it probes the mapped index with atomic loads and
+// reads the record with a positional read, then checks the record's key, so
+// a slot being updated concurrently only ever yields a miss. store() appends
+// under a mutex and publishes the record with a single atomic store.
+//
+// The log only grows while the cache is open; store() refuses records once
+// it reaches the size budget. open() compacts the log, dropping superseded
+// records and then the oldest ones until it fits in half the budget.
+//
+// A third file, metadata_cache.lock, is held exclusively while the cache is
+// open, so only one MetadataCache in any process appends to the log. open()
+// fails while another one has the directory; callers then go without a cache.
+
+// What identifies a cached result
+struct MetadataCacheKey {
+    std::string path;        // UTF-8, see normalizeRequestPath()
+    uint64_t fileSize;
+    uint64_t lastWriteTime;  // platform file time, only compared for equality
+    uint32_t kind;           // what was computed, including its options
+
+    MetadataCacheKey() : fileSize(0), lastWriteTime(0), kind(0) {}
+};
+
+// Fill `key` for the file at `path`, so that every spelling of the path gives
+// the same key. Returns false if the file cannot be stat'ed (missing, no
+// access), in which case it must not be cached.
+bool makeMetadataCacheKey(const std::string& path, uint32_t kind, MetadataCacheKey& key);
+
+struct MetadataCacheStats {
+    uint64_t entries;      // keys in the index
+    uint64_t dataBytes;    // size of the log
+    uint64_t budget;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t rejected;     // stores refused because the cache is full
+    uint64_t compactedBytes;  // bytes dropped by the last compaction
+
+    MetadataCacheStats() :
+        entries(0), dataBytes(0), budget(0), hits(0), misses(0), stores(0),
+        rejected(0), compactedBytes(0) {
+    }
+};
+
+class MetadataCache {
+public:
+    static const uint64_t DefaultBudget = 64ULL * 1024 * 1024;
+    static const uint32_t MaxRecordSize = 16 * 1024 * 1024;
+
+    MetadataCache();
+    ~MetadataCache();
+
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+    // Open (creating if needed) the cache in `directory` and compact it if it
+    // outgrew `budget` bytes. Damaged or mismatched files are reset. Fails if
+    // another MetadataCache, in this process or another, has it open.
+    bool open(const std::string& directory, uint64_t budget = DefaultBudget);
+    void close();
+    bool isOpen() const { return index != nullptr; }
+
+    // Drop every entry. Needs exclusive access, like open() and close().
+    bool clear();
+
+    // Payload stored for `key`. Returns false on a miss or a stale entry.
+    bool find(const MetadataCacheKey& key, std::vector<uint8_t>& payload) const;
+
+    // Append a record for `key`, replacing any previous one. Returns false if
+    // the record would go past the budget or the index is full.
+    bool store(const MetadataCacheKey& key, const uint8_t* payload, size_t size);
+
+    MetadataCacheStats getStats() const;
+    const std::string& getDirectory() const { return directory; }
+
+private:
+    struct IndexHeader;
+    struct IndexSlot;
+
+    std::string directory;
+    uint64_t budget;
+
+    // Platform handles of the lock file, the log and the index file
+    intptr_t lockFile;
+    intptr_t dataFile;
+    intptr_t indexFile;
+#ifdef _WIN32
+    void* indexMapping;
+#endif
+    size_t indexSize;
+    IndexHeader* index;
+    IndexSlot* slots;
+    uint64_t slotMask;
+
+    std::mutex writeMutex;
+    uint64_t dataEnd;  // append position, guarded by writeMutex
+
+    mutable std::atomic<uint64_t> hits;
+    mutable std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> stores;
+    std::atomic<uint64_t> rejected;
+    uint64_t compactedBytes;
+
+    bool openFiles();
+    bool createFiles(uint64_t slotCount);
+    bool compact();
+    void closeFiles();
+
+    // Slot holding `hash`, or the empty slot where it would go; nullptr if
+    // the probe sequence is exhausted
+    IndexSlot* probe(uint64_t hash) const;
+
+    // Read the record at `location` into `record` and check it, against `key`
+    // too when given
+    bool readRecord(uint64_t location, const MetadataCacheKey* key,
+        std::vector<uint8_t>& record) const;
+
+    std::string lockPath() const;
+    std::string dataPath() const;
+    std::string indexPath() const;
+};
+
+#endif // METADATA_CACHE_H
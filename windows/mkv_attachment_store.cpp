@@ -0,0 +1,246 @@
+#include "mkv_attachment_store.h"
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <system_error>
+#include <boost/nowide/cstdio.hpp>
+#include "mkv_attachment_writer.h"
+#include "xxhash64.h"
+
+namespace {
+
+// Payloads up to this size are hashed from memory and written from the same
+// buffer; larger ones are hashed in chunks and copied by the copy engine
+const uint64_t InMemoryLimit = 16 * 1024 * 1024;
+const uint64_t HashChunkSize = 4 * 1024 * 1024;
+
+const char* const UidLogName = "uids.idx";
+
+struct UidRecord {
+    uint64_t uid;
+    uint64_t size;
+    uint64_t hash;
+};
+
+std::string toHex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+    return hex;
+}
+
+bool fileExists(const std::string& path) {
+    std::error_code error;
+    return std::filesystem::is_regular_file(std::filesystem::u8path(path), error);
+}
+
+// Move a finished temporary file to its blob name. Another writer may have
+// published the same payload meanwhile, which is just as good.
+bool publish(const std::string& tempPath, const std::string& path) {
+    std::error_code error;
+    std::filesystem::rename(std::filesystem::u8path(tempPath), std::filesystem::u8path(path), error);
+    if (error) {
+        std::filesystem::remove(std::filesystem::u8path(tempPath), error);
+        return fileExists(path);
+    }
+    return true;
+}
+
+} // namespace
+
+MkvAttachmentStore::MkvAttachmentStore() :
+    uidLog(nullptr), tempTag(0), tempCounter(0) {
+}
+
+MkvAttachmentStore::~MkvAttachmentStore() {
+    close();
+}
+
+bool MkvAttachmentStore::open(const std::string& path) {
+    close();
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::u8path(path), error);
+    if (error) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    directory = path;
+    std::string logPath = directory + "/" + UidLogName;
+
+    // A torn last record (crash while appending) is dropped, and cut off the
+    // file so the records appended below stay aligned
+    if (FILE* log = boost::nowide::fopen(logPath.c_str(), "rb")) {
+        UidRecord record;
+        uint64_t records = 0;
+        while (fread(&record, sizeof(record), 1, log) == 1) {
+            uidHashes[UidKey{record.uid, record.size}] = record.hash;
+            records++;
+        }
+        fclose(log);
+
+        uint64_t whole = records * sizeof(UidRecord);
+        auto logFile = std::filesystem::u8path(logPath);
+        if (std::filesystem::file_size(logFile, error) != whole && !error) {
+            std::filesystem::resize_file(logFile, whole, error);
+        }
+        if (error) {
+            uidHashes.clear();
+            directory.clear();
+            return false;
+        }
+    }
+
+    uidLog = boost::nowide::fopen(logPath.c_str(), "ab");
+    if (uidLog == nullptr) {
+        uidHashes.clear();
+        directory.clear();
+        return false;
+    }
+
+    std::random_device random;
+    tempTag = (static_cast<uint64_t>(random()) << 32) ^ random();
+    stats = MkvAttachmentStoreStats();
+    return true;
+}
+
+void MkvAttachmentStore::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (uidLog != nullptr) {
+        fclose(uidLog);
+        uidLog = nullptr;
+    }
+    uidHashes.clear();
+    directory.clear();
+}
+
+bool MkvAttachmentStore::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return uidLog != nullptr;
+}
+
+MkvAttachmentStoreStats MkvAttachmentStore::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+std::string MkvAttachmentStore::blobPath(uint64_t hash, uint64_t size) const {
+    return directory + "/" + toHex(hash) + "-" + std::to_string(size);
+}
+
+std::string MkvAttachmentStore::tempPath() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return directory + "/.partial-" + toHex(tempTag) + "-" + std::to_string(tempCounter++);
+}
+
+void MkvAttachmentStore::rememberUid(uint64_t uid, uint64_t size, uint64_t hash) {
+    if (uid == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto inserted = uidHashes.insert(std::make_pair(UidKey{uid, size}, hash));
+    if (!inserted.second && inserted.first->second == hash) {
+        return;
+    }
+    inserted.first->second = hash;
+
+    if (uidLog != nullptr) {
+        UidRecord record = {uid, size, hash};
+        fwrite(&record, sizeof(record), 1, uidLog);
+        fflush(uidLog);
+    }
+}
+
+bool MkvAttachmentStore::hashPayload(MkvMetadataExtractor& extractor, size_t index, uint64_t& hash,
+    std::vector<uint8_t>& data) {
+    const uint64_t size = extractor.getAttachments()[index].dataSize;
+    if (size <= InMemoryLimit) {
+        if (!extractor.readAttachment(index, 0, size, data) || data.size() != size) {
+            return false;
+        }
+        hash = XxHash64::hash(data.data(), data.size());
+        return true;
+    }
+
+    data.clear();
+    XxHash64 state;
+    std::vector<uint8_t> chunk;
+    for (uint64_t offset = 0; offset < size; offset += HashChunkSize) {
+        uint64_t length = std::min(HashChunkSize, size - offset);
+        if (!extractor.readAttachment(index, offset, length, chunk) || chunk.size() != length) {
+            return false;
+        }
+        state.update(chunk.data(), chunk.size());
+    }
+    hash = state.digest();
+    return true;
+}
+
+bool MkvAttachmentStore::resolve(MkvMetadataExtractor& extractor, size_t index, MkvAttachmentBlob& blob) {
+    if (!isOpen() || index >= extractor.getAttachments().size()) {
+        return false;
+    }
+
+    const MkvAttachment& attachment = extractor.getAttachments()[index];
+    blob = MkvAttachmentBlob();
+    blob.size = attachment.dataSize;
+
+    // A FileUID seen before: no need to look at the data
+    if (attachment.uid != 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = uidHashes.find(UidKey{attachment.uid, attachment.dataSize});
+        if (it != uidHashes.end()) {
+            blob.hash = it->second;
+            blob.path = blobPath(blob.hash, blob.size);
+            lock.unlock();
+
+            // Still there, unless someone cleaned the directory
+            if (fileExists(blob.path)) {
+                lock.lock();
+                stats.uidHits++;
+                return true;
+            }
+        }
+    }
+
+    std::vector<uint8_t> data;
+    if (!hashPayload(extractor, index, blob.hash, data)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.bytesHashed += blob.size;
+        blob.path = blobPath(blob.hash, blob.size);
+    }
+
+    if (fileExists(blob.path)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.contentHits++;
+    }
+    else {
+        std::string temp = tempPath();
+        bool written = blob.size <= InMemoryLimit
+            ? MkvAttachmentWriter::writeFile(temp, data.data(), data.size())
+            : extractor.extractAttachment(index, temp);
+        if (!written) {
+            std::error_code error;
+            std::filesystem::remove(std::filesystem::u8path(temp), error);
+            return false;
+        }
+        if (!publish(temp, blob.path)) {
+            return false;
+        }
+
+        blob.created = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.blobsWritten++;
+        stats.bytesWritten += blob.size;
+    }
+
+    rememberUid(attachment.uid, attachment.dataSize, blob.hash);
+    return true;
+}
@@ -0,0 +1,99 @@
+#ifndef MKV_ATTACHMENT_STORE_H
+#define MKV_ATTACHMENT_STORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "mkv_metadata_extractor_version5.h"
+
+// A stored attachment payload
+struct MkvAttachmentBlob {
+    std::string path;  // UTF-8
+    uint64_t hash;     // XXH64 of the payload
+    uint64_t size;
+    bool created;      // written by this call, rather than found in the store
+
+    MkvAttachmentBlob() : hash(0), size(0), created(false) {}
+};
+
+struct MkvAttachmentStoreStats {
+    uint64_t uidHits;       // resolved from FileUID and size, no data read
+    uint64_t contentHits;   // payload hashed and found already stored
+    uint64_t blobsWritten;
+    uint64_t bytesWritten;
+    uint64_t bytesHashed;
+
+    MkvAttachmentStoreStats() :
+        uidHits(0), contentHits(0), blobsWritten(0), bytesWritten(0), bytesHashed(0) {
+    }
+};
+
+// Content-addressed store of attachment payloads, so the fonts a whole
+// season carries in every episode are extracted once.
+//
+// Blobs live in the store directory as "<xxh64>-<size>" (no extension, the
+// same payload can come under several names). Attachments are first looked
+// up by (FileUID, size): a FileUID seen before resolves to its blob without
+// reading the data again. Otherwise the payload is hashed, and only written
+// if no blob with that hash and size exists yet. The FileUID map is kept in
+// "uids.idx" so it survives restarts.
+//
+// mkvmerge gives every attachment a random FileUID when muxing, so the UID
+// shortcut mostly serves repeated requests for the same files; identical
+// fonts from different episodes meet through the content hash.
+//
+// Thread safe; blobs are written under a temporary name and renamed, so a
+// reader never sees a partial one.
+class MkvAttachmentStore {
+public:
+    MkvAttachmentStore();
+    ~MkvAttachmentStore();
+
+    MkvAttachmentStore(const MkvAttachmentStore&) = delete;
+    MkvAttachmentStore& operator=(const MkvAttachmentStore&) = delete;
+
+    // Open (creating if needed) the store in `directory`
+    bool open(const std::string& directory);
+    void close();
+    bool isOpen() const;
+    const std::string& getDirectory() const { return directory; }
+
+    // Blob holding attachment `index` of `extractor`, extracting the payload
+    // if the store does not have it yet
+    bool resolve(MkvMetadataExtractor& extractor, size_t index, MkvAttachmentBlob& blob);
+
+    MkvAttachmentStoreStats getStats() const;
+
+private:
+    struct UidKey {
+        uint64_t uid;
+        uint64_t size;
+        bool operator==(const UidKey& other) const { return uid == other.uid && size == other.size; }
+    };
+    struct UidKeyHash {
+        size_t operator()(const UidKey& key) const {
+            return static_cast<size_t>(key.uid ^ (key.size * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    mutable std::mutex mutex;
+    std::string directory;
+    FILE* uidLog;
+    std::unordered_map<UidKey, uint64_t, UidKeyHash> uidHashes;
+    MkvAttachmentStoreStats stats;
+    uint64_t tempTag;      // random per open(), keeps temporary names unique across processes
+    uint64_t tempCounter;
+
+    std::string blobPath(uint64_t hash, uint64_t size) const;
+    std::string tempPath();
+    void rememberUid(uint64_t uid, uint64_t size, uint64_t hash);
+
+    // XXH64 of the payload. Payloads small enough to hold are left in `data`,
+    // so a new blob is written without reading them a second time.
+    bool hashPayload(MkvMetadataExtractor& extractor, size_t index, uint64_t& hash,
+        std::vector<uint8_t>& data);
+};
+
+#endif // MKV_ATTACHMENT_STORE_H
@@ -0,0 +1,97 @@
+#include "mkv_attachment_writer.h"
+#include <cstdio>
+#include <boost/nowide/cstdio.hpp>
+
+MkvAttachmentWriter::MkvAttachmentWriter(size_t threads, size_t maxQueuedBytes) :
+    threadCount(threads == 0 ? 1 : threads), maxQueuedBytes(maxQueuedBytes),
+    queuedBytes(0), finishing(false) {
+}
+
+MkvAttachmentWriter::~MkvAttachmentWriter() {
+    finish();
+}
+
+size_t MkvAttachmentWriter::write(const std::string& path, const uint8_t* data, size_t size,
+    std::shared_ptr<const void> owner) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Threads start with the first file, a filter that matches nothing
+    // costs none
+    if (threads.empty() && !finishing) {
+        for (size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back(&MkvAttachmentWriter::run, this);
+        }
+    }
+
+    // A single file larger than the budget still goes through once the
+    // queue has drained
+    spaceFreed.wait(lock, [&] {
+        return queuedBytes == 0 || queuedBytes + size <= maxQueuedBytes;
+    });
+
+    size_t ticket = results.size();
+    results.push_back(0);
+
+    Job job;
+    job.ticket = ticket;
+    job.path = path;
+    job.data = data;
+    job.size = size;
+    job.owner = std::move(owner);
+    jobs.push_back(std::move(job));
+    queuedBytes += size;
+
+    jobReady.notify_one();
+    return ticket;
+}
+
+void MkvAttachmentWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finishing = true;
+    }
+    jobReady.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+bool MkvAttachmentWriter::succeeded(size_t ticket) const {
+    return ticket < results.size() && results[ticket] != 0;
+}
+
+bool MkvAttachmentWriter::writeFile(const std::string& path, const uint8_t* data, size_t size) {
+    FILE* outFile = boost::nowide::fopen(path.c_str(), "wb");
+    if (outFile == nullptr) {
+        return false;
+    }
+
+    // One write for the whole file, the stdio buffer would only add a copy
+    setvbuf(outFile, nullptr, _IONBF, 0);
+    size_t written = size > 0 ? fwrite(data, 1, size, outFile) : 0;
+    bool ok = fclose(outFile) == 0;
+    return ok && written == size;
+}
+
+void MkvAttachmentWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobReady.wait(lock, [&] { return !jobs.empty() || finishing; });
+        if (jobs.empty()) {
+            return;
+        }
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+
+        lock.unlock();
+        bool ok = writeFile(job.path, job.data, job.size);
+        job.owner.reset();
+        lock.lock();
+
+        results[job.ticket] = ok ? 1 : 0;
+        queuedBytes -= job.size;
+        spaceFreed.notify_all();
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef MKV_ATTACHMENT_WRITER_H
+#define MKV_ATTACHMENT_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes extracted attachments on a few background threads, so the caller
+// can keep sweeping the MKV file forward while the output files are created
+// and filled. Creating a file costs far more than writing a font, so a
+// release with dozens of attachments is bound by file creation, not reads.
+class MkvAttachmentWriter {
+public:
+    static const size_t DefaultThreads = 4;
+    static const size_t DefaultMaxQueuedBytes = 64 * 1024 * 1024;
+
+    explicit MkvAttachmentWriter(size_t threads = DefaultThreads,
+        size_t maxQueuedBytes = DefaultMaxQueuedBytes);
+    ~MkvAttachmentWriter();
+
+    MkvAttachmentWriter(const MkvAttachmentWriter&) = delete;
+    MkvAttachmentWriter& operator=(const MkvAttachmentWriter&) = delete;
+
+    // Queue `size` bytes at `data` to be written to `path` (UTF-8). `owner`
+    // keeps the bytes alive until they are written; it may be null when they
+    // outlive the writer (a file mapping). Blocks while more than the queue
+    // budget is waiting. Returns a ticket for succeeded().
+    size_t write(const std::string& path, const uint8_t* data, size_t size,
+        std::shared_ptr<const void> owner);
+
+    // Wait until every queued file is written and stop the threads
+    void finish();
+
+    // Whether the file behind `ticket` was fully written, valid after finish()
+    bool succeeded(size_t ticket) const;
+
+    // Write `size` bytes to a new file at `path` on the calling thread
+    static bool writeFile(const std::string& path, const uint8_t* data, size_t size);
+
+private:
+    struct Job {
+        size_t ticket;
+        std::string path;
+        const uint8_t* data;
+        size_t size;
+        std::shared_ptr<const void> owner;
+    };
+
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable spaceFreed;
+    std::deque<Job> jobs;
+    std::vector<std::thread> threads;
+    std::vector<char> results;  // per ticket, guarded by mutex
+    size_t threadCount;
+    size_t maxQueuedBytes;
+    size_t queuedBytes;
+    bool finishing;
+
+    void run();
+};
+
+#endif // MKV_ATTACHMENT_WRITER_H
@@ -0,0 +1,450 @@
+#include "mkv_block_reader.h"
+#include "mkv_resync_scanner.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <boost/nowide/convert.hpp>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+namespace {
+
+// A mapped read that fails raises an access violation instead of returning
+// an error, so only files whose pages cannot vanish are mapped: not those on
+// network shares (dropped connection) or removable drives (unplugged).
+bool isMappingSafe(const std::wstring& path) {
+    wchar_t volume[MAX_PATH];
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH)) {
+        return false;
+    }
+    UINT type = GetDriveTypeW(volume);
+    return type == DRIVE_FIXED || type == DRIVE_RAMDISK;
+}
+
+} // namespace
+#endif
+
+MkvBlockReader::MkvBlockReader(size_t windowSize) :
+    buffer(windowSize),
+    window(buffer.data()),
+    fileSize(0),
+    streamPos(0),
+    windowStart(0),
+    windowPos(0),
+    windowLen(0),
+    readSize(std::min(MinReadSize, windowSize)),
+    hitEof(false),
+    mapped(false),
+    mappingBase(nullptr)
+#ifdef _WIN32
+    , mappingFile(INVALID_HANDLE_VALUE),
+    mappingHandle(nullptr)
+#endif
+{
+}
+
+MkvBlockReader::~MkvBlockReader() {
+    close();
+}
+
+bool MkvBlockReader::open(const std::string& filePath) {
+    close();
+
+    file.open(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    std::streamoff end = file.tellg();
+    if (end < 0) {
+        file.close();
+        return false;
+    }
+    fileSize = static_cast<uint64_t>(end);
+    file.seekg(0, std::ios::beg);
+    streamPos = 0;
+
+    return true;
+}
+
+bool MkvBlockReader::openMapped(const std::string& filePath) {
+    close();
+
+#ifdef _WIN32
+    std::wstring widePath = boost::nowide::widen(filePath);
+    if (!isMappingSafe(widePath)) {
+        return false;
+    }
+
+    // Others may keep writing: Windows refuses to truncate a file below a
+    // mapped view (ERROR_USER_MAPPED_FILE), so the pages cannot vanish, and
+    // a long-lived session does not lock editors out of the file
+    HANDLE fileHandle = CreateFileW(widePath.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0 ||
+        static_cast<uint64_t>(size.QuadPart) > std::numeric_limits<size_t>::max()) {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    HANDLE mappingObject = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingObject == nullptr) {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    void* base = MapViewOfFile(mappingObject, FILE_MAP_READ, 0, 0, 0);
+    if (base == nullptr) {
+        CloseHandle(mappingObject);
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    mappingFile = fileHandle;
+    mappingHandle = mappingObject;
+    fileSize = static_cast<uint64_t>(size.QuadPart);
+#else
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+        static_cast<uint64_t>(st.st_size) > std::numeric_limits<size_t>::max()) {
+        ::close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    fileSize = static_cast<uint64_t>(st.st_size);
+#endif
+
+    mapped = true;
+    mappingBase = base;
+    window = static_cast<const uint8_t*>(base);
+    windowStart = 0;
+    windowPos = 0;
+    windowLen = static_cast<size_t>(fileSize);
+
+    return true;
+}
+
+void MkvBlockReader::close() {
+    if (file.is_open()) {
+        file.close();
+    }
+    unmap();
+
+    window = buffer.data();
+    fileSize = 0;
+    streamPos = 0;
+    windowStart = 0;
+    windowPos = 0;
+    windowLen = 0;
+    readSize = std::min(MinReadSize, buffer.size());
+    hitEof = false;
+    stats = MkvReadStats();
+}
+
+void MkvBlockReader::unmap() {
+    if (!mapped) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappingBase);
+    CloseHandle(mappingHandle);
+    CloseHandle(mappingFile);
+    mappingHandle = nullptr;
+    mappingFile = INVALID_HANDLE_VALUE;
+#else
+    munmap(mappingBase, static_cast<size_t>(fileSize));
+#endif
+
+    mappingBase = nullptr;
+    mapped = false;
+}
+
+void MkvBlockReader::seek(uint64_t pos) {
+    hitEof = false;
+
+    // Cheap path: target is inside the bytes we already hold
+    if (pos >= windowStart && pos <= windowStart + windowLen) {
+        windowPos = static_cast<size_t>(pos - windowStart);
+        stats.windowSeeks++;
+        return;
+    }
+
+    // Drop the window, the next read refills at the new position
+    windowStart = pos;
+    windowPos = 0;
+    windowLen = 0;
+}
+
+size_t MkvBlockReader::read(void* dst, size_t count) {
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    size_t copied = 0;
+
+    if (mapped && windowPos >= windowLen) {
+        refill();
+    }
+
+    // Drain what is left in the window first
+    size_t available = windowLen - windowPos;
+    if (available > 0) {
+        size_t chunk = std::min(available, count);
+        memcpy(out, window + windowPos, chunk);
+        windowPos += chunk;
+        copied += chunk;
+    }
+
+    if (copied < count && !mapped) {
+        size_t remaining = count - copied;
+
+        if (remaining >= buffer.size()) {
+            // Large reads go straight to the caller's buffer
+            uint64_t pos = tell();
+            size_t got = readStream(pos, out + copied, remaining);
+            copied += got;
+            windowStart = pos + got;
+            windowPos = 0;
+            windowLen = 0;
+        }
+        else if (refill()) {
+            size_t chunk = std::min(windowLen, remaining);
+            memcpy(out + copied, window, chunk);
+            windowPos = chunk;
+            copied += chunk;
+        }
+    }
+
+    if (copied < count) {
+        hitEof = true;
+    }
+
+    return copied;
+}
+
+bool MkvBlockReader::readView(size_t count, std::string_view& view) {
+    if (count > windowLen - windowPos) {
+        // Only a fresh window can help, and only if the bytes fit in it
+        if (!mapped && count > buffer.size()) {
+            return false;
+        }
+        if (!refill(count) || count > windowLen - windowPos) {
+            return false;
+        }
+    }
+
+    view = std::string_view(reinterpret_cast<const char*>(window + windowPos), count);
+    windowPos += count;
+    return true;
+}
+
+bool MkvBlockReader::scanLevel1(uint64_t limit, uint32_t& foundId) {
+    limit = std::min(limit, fileSize);
+
+    while (tell() + 4 <= limit) {
+        if (windowLen - windowPos < 4) {
+            // Scans are bulk forward reads, use the whole window
+            if (!refill(buffer.size()) || windowLen - windowPos < 4) {
+                break;
+            }
+        }
+
+        size_t available = static_cast<size_t>(
+            std::min<uint64_t>(windowLen - windowPos, limit - tell()));
+        size_t offset = findMkvLevel1Id(window + windowPos, available, foundId);
+        if (offset < available) {
+            windowPos += offset;
+            return true;
+        }
+
+        // Keep the last 3 bytes, an ID may straddle the window edge
+        windowPos += available - 3;
+    }
+
+    hitEof = true;
+    return false;
+}
+
+bool MkvBlockReader::refill(size_t minimumRead) {
+    uint64_t pos = tell();
+
+    if (mapped) {
+        // The mapping is the window; just re-anchor it if a seek moved past it
+        if (pos >= fileSize) {
+            return false;
+        }
+        windowStart = 0;
+        windowPos = static_cast<size_t>(pos);
+        windowLen = static_cast<size_t>(fileSize);
+        return true;
+    }
+
+    // Grow the refill while reads continue where the last one ended (or just
+    // past it), start over small after a real jump
+    if (stats.streamReads > 0) {
+        if (pos >= streamPos && pos - streamPos <= readSize) {
+            readSize = std::min(readSize * 2, buffer.size());
+        }
+        else {
+            readSize = std::min(MinReadSize, buffer.size());
+        }
+    }
+    readSize = std::min(std::max(readSize, minimumRead), buffer.size());
+
+    windowStart = pos;
+    windowPos = 0;
+    windowLen = 0;
+
+    if (pos >= fileSize) {
+        return false;
+    }
+
+    size_t toRead = static_cast<size_t>(std::min<uint64_t>(readSize, fileSize - pos));
+    windowLen = readStream(pos, buffer.data(), toRead);
+    return windowLen > 0;
+}
+
+size_t MkvBlockReader::readStream(uint64_t pos, void* dst, size_t count) {
+    if (!file.is_open() || pos >= fileSize) {
+        return 0;
+    }
+
+    // A failed read leaves the stream failed, so the next one seeks afresh:
+    // an I/O error only cuts the reads that hit it short
+    if (streamPos != pos || !file.good()) {
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(pos), std::ios::beg);
+        stats.streamSeeks++;
+        if (file.fail()) {
+            return 0;
+        }
+    }
+
+    // Fewer bytes than asked when the file shrank since open() (someone is
+    // still writing it) or the device failed; the caller sees eof
+    file.read(reinterpret_cast<char*>(dst), count);
+    size_t got = static_cast<size_t>(file.gcount());
+
+    stats.streamReads++;
+    stats.bytesRead += got;
+    streamPos = pos + got;
+
+    return got;
+}
+
+uint32_t MkvBlockReader::readElementId() {
+    uint32_t id = 0;
+    if (windowPos < windowLen) {
+        unsigned length = ebmlDecodeId(window + windowPos, windowLen - windowPos, id);
+        if (length != 0) {
+            windowPos += length;
+            return id;
+        }
+    }
+
+    // Invalid, or cut by the end of the window: go byte by byte
+    uint8_t firstByte = 0;
+    if (!readByte(firstByte)) {
+        return 0;
+    }
+
+    // Length is given by the position of the first set bit (max 4 bytes)
+    unsigned len = ebmlVintLength(firstByte);
+    if (len == 0 || len > 4) {
+        return 0;
+    }
+
+    id = firstByte;
+    for (unsigned i = 1; i < len; i++) {
+        uint8_t nextByte = 0;
+        readByte(nextByte);
+        id = (id << 8) | nextByte;
+    }
+
+    return id;
+}
+
+uint64_t MkvBlockReader::readElementSize() {
+    uint64_t value = 0;
+    if (windowPos < windowLen) {
+        unsigned length = ebmlDecodeSize(window + windowPos, windowLen - windowPos, value);
+        if (length != 0) {
+            windowPos += length;
+            return value;
+        }
+    }
+
+    // Invalid, or cut by the end of the window: go byte by byte
+    uint8_t firstByte = 0;
+    if (!readByte(firstByte)) {
+        return 0;
+    }
+
+    unsigned len = ebmlVintLength(firstByte);
+    if (len == 0) {
+        // Invalid size
+        return 0;
+    }
+
+    // Strip the length marker
+    value = firstByte & (0xFF >> len);
+    for (unsigned i = 1; i < len; i++) {
+        uint8_t nextByte = 0;
+        readByte(nextByte);
+        value = (value << 8) | nextByte;
+    }
+
+    // All value bits set means the size is unknown
+    if (value == (1ULL << (7 * len)) - 1) {
+        return MKV_UNKNOWN_SIZE;
+    }
+
+    return value;
+}
+
+uint64_t MkvBlockReader::readUnsigned(uint64_t size) {
+    if (size > 8) {
+        skip(size);
+        return 0;
+    }
+
+    size_t available = windowLen - std::min(windowPos, windowLen);
+    if (available >= size) {
+        uint64_t value = ebmlDecodeUnsigned(window + windowPos, available, static_cast<unsigned>(size));
+        windowPos += static_cast<size_t>(size);
+        return value;
+    }
+
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < size; i++) {
+        uint8_t byte = 0;
+        readByte(byte);
+        value = (value << 8) | byte;
+    }
+
+    return value;
+}
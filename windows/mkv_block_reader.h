@@ -0,0 +1,131 @@
+#ifndef MKV_BLOCK_READER_H
+#define MKV_BLOCK_READER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <boost/nowide/fstream.hpp>
+#include "ebml_vint.h"
+
+// Counters describing how much work the reader pushed down to the stream.
+struct MkvReadStats {
+    uint64_t streamReads;   // read() calls issued to the underlying stream
+    uint64_t streamSeeks;   // seekg() calls issued to the underlying stream
+    uint64_t bytesRead;     // bytes transferred from the underlying stream
+    uint64_t windowSeeks;   // seeks served from the current window
+
+    MkvReadStats() : streamReads(0), streamSeeks(0), bytesRead(0), windowSeeks(0) {}
+};
+
+// Block-buffered reader used by the EBML parser.
+//
+// The file is read through a fixed-size window so the small reads the parser
+// issues (IDs, sizes, integers) are served from memory. Seeks that land inside
+// the current window only move the cursor; anything else refills on demand.
+//
+// Refills start small and double while the parser keeps reading forward, so
+// a probe that only needs the first few elements only touches a few KiB.
+//
+// When opened with openMapped() the whole file is mapped into memory and the
+// window simply covers the mapping, so no stream calls are made at all.
+class MkvBlockReader {
+public:
+    static constexpr size_t DefaultWindowSize = 64 * 1024;
+    static constexpr size_t MinReadSize = 4 * 1024;
+
+    explicit MkvBlockReader(size_t windowSize = DefaultWindowSize);
+    ~MkvBlockReader();
+
+    bool open(const std::string& filePath);
+
+    // Map the file instead of streaming it. Returns false if the file cannot
+    // be mapped (empty, too large for the address space, on a network share
+    // or removable drive, ...), in which case the reader is left closed and
+    // the caller can fall back to open(). Others can still write to the file
+    // while it is mapped, but not truncate it.
+    bool openMapped(const std::string& filePath);
+
+    void close();
+    bool isOpen() const { return mapped || file.is_open(); }
+    bool isMapped() const { return mapped; }
+
+    uint64_t size() const { return fileSize; }
+    uint64_t tell() const { return windowStart + windowPos; }
+
+    // True once a read could not be fully satisfied, at the end of the file
+    // or on an I/O error. Cleared by seek().
+    bool eof() const { return hitEof; }
+
+    // Move the cursor to an absolute position. Positions past the end of file
+    // are allowed; the next read will report eof.
+    void seek(uint64_t pos);
+    void skip(uint64_t count) { seek(tell() + count); }
+
+    // Read up to `count` bytes, returns the number of bytes copied. Stream
+    // errors and a file cut short since open() give short reads.
+    size_t read(void* dst, size_t count);
+
+    bool readByte(uint8_t& value) {
+        if (windowPos < windowLen || refill()) {
+            value = window[windowPos++];
+            return true;
+        }
+        hitEof = true;
+        return false;
+    }
+
+    // EBML primitives. IDs keep their length marker bits, sizes have them
+    // stripped (MKV_UNKNOWN_SIZE if all value bits are set). Both return 0 on
+    // invalid input or at end of file. Decoded straight from the window when
+    // the VINT lies inside it, see ebml_vint.h.
+    uint32_t readElementId();
+    uint64_t readElementSize();
+    uint64_t readUnsigned(uint64_t size);
+
+    // Move the cursor to the next top-level Matroska element ID before
+    // `limit` and store it in `foundId`. Returns false if there is none.
+    bool scanLevel1(uint64_t limit, uint32_t& foundId);
+
+    // Return `count` bytes without copying them and advance past them.
+    // In mapped mode the view stays valid until close(); otherwise it is only
+    // valid until the next call on the reader. Returns false (and does not
+    // move) when the bytes cannot be viewed in one piece.
+    bool readView(size_t count, std::string_view& view);
+
+    const MkvReadStats& getStats() const { return stats; }
+    void resetStats() { stats = MkvReadStats(); }
+
+private:
+    boost::nowide::ifstream file;
+    std::vector<uint8_t> buffer;
+    const uint8_t* window;  // buffer.data() or the mapping
+    uint64_t fileSize;
+    uint64_t streamPos;     // where the stream cursor currently is
+    uint64_t windowStart;   // file offset of window[0]
+    size_t windowPos;       // cursor inside the window
+    size_t windowLen;       // valid bytes in the window
+    size_t readSize;        // size of the next refill, grows on forward reads
+    bool hitEof;
+    MkvReadStats stats;
+
+    // Mapping state
+    bool mapped;
+    void* mappingBase;
+#ifdef _WIN32
+    void* mappingFile;
+    void* mappingHandle;
+#endif
+
+    // Load a new window starting at tell(), reading at least `minimumRead`
+    // bytes when possible. Returns false at end of file.
+    bool refill(size_t minimumRead = 0);
+
+    // Read directly from the stream at `pos`, bypassing the window.
+    size_t readStream(uint64_t pos, void* dst, size_t count);
+
+    void unmap();
+};
+
+#endif // MKV_BLOCK_READER_H
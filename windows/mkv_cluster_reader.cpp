@@ -0,0 +1,516 @@
+#include "mkv_cluster_reader.h"
+#include "mkv_metadata_extractor_version5.h"
+#include "mkv_resync_scanner.h"
+#include <algorithm>
+
+namespace {
+
+// How much of the end of the file the tail probe reads first
+const uint64_t TailProbeSize = 4 * 1024 * 1024;
+
+// Remembers the latest keyframe at or before the target, or the first one
+// after it when there is none before
+class KeyframeFinder : public MkvBlockVisitor {
+public:
+    KeyframeFinder(uint64_t track, int64_t target) :
+        found(false), timestamp(0), clusterPosition(0), frameOffset(0), frameSize(0),
+        track(track), target(target) {
+    }
+
+    bool onBlock(const MkvBlock& block) override {
+        if (block.track != track || !block.keyframe || block.frameSizes.empty()) {
+            return true;
+        }
+        if (found && block.timestamp > target) {
+            return false;
+        }
+
+        found = true;
+        timestamp = block.timestamp;
+        clusterPosition = block.clusterPosition;
+        frameOffset = block.dataOffset;
+        frameSize = block.frameSizes.front();
+
+        // The first keyframe past the target ends the walk
+        return block.timestamp <= target;
+    }
+
+    bool found;
+    int64_t timestamp;
+    uint64_t clusterPosition;
+    uint64_t frameOffset;
+    uint64_t frameSize;
+
+private:
+    uint64_t track;
+    int64_t target;
+};
+
+// Latest end time (timestamp plus duration) of any block
+class EndTimeTracker : public MkvBlockVisitor {
+public:
+    explicit EndTimeTracker(const MkvMetadataExtractor& extractor) :
+        found(false), endTime(0), extractor(extractor) {
+    }
+
+    bool onBlock(const MkvBlock& block) override {
+        uint64_t duration = block.duration;
+        if (duration == 0) {
+            // No BlockDuration, use the track's DefaultDuration (nanoseconds per frame)
+            const MkvStream* stream = extractor.findStream(block.track);
+            if (stream && stream->defaultDuration != 0) {
+                duration = stream->defaultDuration * block.frameSizes.size() / extractor.getTimecodeScale();
+            }
+        }
+
+        int64_t end = block.timestamp + static_cast<int64_t>(duration);
+        if (!found || end > endTime) {
+            endTime = end;
+        }
+        found = true;
+        return true;
+    }
+
+    bool found;
+    int64_t endTime;
+
+private:
+    const MkvMetadataExtractor& extractor;
+};
+
+} // namespace
+
+MkvClusterReader::MkvClusterReader() : limit(0), clusterTime(0) {
+}
+
+MkvClusterReader::~MkvClusterReader() {
+    close();
+}
+
+bool MkvClusterReader::open(const std::string& filePath, uint64_t segmentEnd, bool useMapping) {
+    close();
+
+    if (!(useMapping && reader.openMapped(filePath)) && !reader.open(filePath)) {
+        return false;
+    }
+
+    limit = (segmentEnd == 0 || segmentEnd > reader.size()) ? reader.size() : segmentEnd;
+    return true;
+}
+
+void MkvClusterReader::close() {
+    reader.close();
+    limit = 0;
+    clusterTime = 0;
+}
+
+uint64_t MkvClusterReader::findCluster(uint64_t from) {
+    uint64_t pos = from;
+    bool scanned = false;
+
+    while (pos < limit) {
+        reader.seek(pos);
+        uint32_t id = reader.readElementId();
+        uint64_t size = reader.readElementSize();
+        uint64_t dataPos = reader.tell();
+        bool sizeFits = size != MKV_UNKNOWN_SIZE && !reader.eof() &&
+            size <= limit - std::min(limit, dataPos);
+
+        // An ID found by scanning may just be payload bytes, only trust it if
+        // its size lands on another top-level element
+        bool plausible = !scanned || (size == MKV_UNKNOWN_SIZE && !reader.eof()) ||
+            (sizeFits && endsOnLevel1(dataPos + size));
+
+        if (isMkvLevel1Id(id) && plausible) {
+            if (id == MkvIds::Cluster && !reader.eof()) {
+                return pos;
+            }
+            if (sizeFits) {
+                pos = dataPos + size;
+                scanned = false;
+                continue;
+            }
+        }
+
+        // Damaged data, an element of unknown size or a false match, scan for
+        // the next one
+        uint32_t foundId = 0;
+        reader.seek(pos + 1);
+        if (!reader.scanLevel1(limit, foundId)) {
+            return 0;
+        }
+        pos = reader.tell();
+        scanned = true;
+    }
+
+    return 0;
+}
+
+bool MkvClusterReader::endsOnLevel1(uint64_t end) {
+    if (end == limit) {
+        return true;
+    }
+    reader.seek(end);
+    return isMkvLevel1Id(reader.readElementId());
+}
+
+bool MkvClusterReader::readCluster(uint64_t pos, MkvBlockVisitor& visitor, uint64_t& next) {
+    next = 0;
+
+    reader.seek(pos);
+    if (reader.readElementId() != MkvIds::Cluster) {
+        return false;
+    }
+
+    uint64_t size = reader.readElementSize();
+    bool unknownSize = size == MKV_UNKNOWN_SIZE || size > limit - std::min(limit, reader.tell());
+    uint64_t end = unknownSize ? limit : reader.tell() + size;
+
+    clusterTime = 0;
+    block.clusterPosition = pos;
+
+    while (reader.tell() < end) {
+        uint64_t elementPos = reader.tell();
+        uint32_t id = reader.readElementId();
+        if (id == 0 || reader.eof()) {
+            break;
+        }
+
+        // A Cluster of unknown size ends at the next top-level element
+        if (isMkvLevel1Id(id)) {
+            next = id == MkvIds::Cluster ? elementPos : findCluster(elementPos);
+            return true;
+        }
+
+        uint64_t elementSize = reader.readElementSize();
+        if (elementSize == MKV_UNKNOWN_SIZE || elementSize > end - std::min(end, reader.tell())) {
+            break;
+        }
+        uint64_t elementEnd = reader.tell() + elementSize;
+
+        bool haveBlock = false;
+        switch (id) {
+        case MkvIds::Timestamp:
+            clusterTime = static_cast<int64_t>(reader.readUnsigned(elementSize));
+            break;
+
+        case MkvIds::SimpleBlock:
+            haveBlock = readBlockHeader(elementSize);
+            break;
+
+        case MkvIds::BlockGroup:
+            haveBlock = readBlockGroup(elementSize);
+            break;
+
+        default:
+            break;
+        }
+
+        if (haveBlock && !visitor.onBlock(block)) {
+            return false;
+        }
+
+        reader.seek(elementEnd);
+    }
+
+    // Damaged data ends the Cluster early, look for the next one from there
+    next = findCluster(unknownSize || reader.tell() < end ? reader.tell() : end);
+    return true;
+}
+
+bool MkvClusterReader::readBlockGroup(uint64_t size) {
+    uint64_t end = reader.tell() + size;
+    bool haveBlock = false;
+    bool hasReference = false;
+    uint64_t duration = 0;
+
+    while (reader.tell() < end) {
+        uint32_t id = reader.readElementId();
+        uint64_t elementSize = reader.readElementSize();
+        if (id == 0 || elementSize == MKV_UNKNOWN_SIZE || reader.eof() ||
+            elementSize > end - std::min(end, reader.tell())) {
+            return false;
+        }
+        uint64_t elementEnd = reader.tell() + elementSize;
+
+        switch (id) {
+        case MkvIds::Block:
+            haveBlock = readBlockHeader(elementSize);
+            break;
+
+        case MkvIds::ReferenceBlock:
+            // Any reference means the block depends on another frame
+            hasReference = true;
+            break;
+
+        case MkvIds::BlockDuration:
+            duration = reader.readUnsigned(elementSize);
+            break;
+
+        default:
+            break;
+        }
+
+        reader.seek(elementEnd);
+    }
+
+    if (!haveBlock) {
+        return false;
+    }
+
+    block.keyframe = !hasReference;
+    block.duration = duration;
+    return true;
+}
+
+bool MkvClusterReader::readBlockHeader(uint64_t size) {
+    uint64_t end = reader.tell() + size;
+
+    block.track = reader.readElementSize();
+
+    uint8_t timeHigh, timeLow, flags;
+    if (block.track == 0 || !reader.readByte(timeHigh) || !reader.readByte(timeLow) || !reader.readByte(flags)) {
+        return false;
+    }
+
+    // Signed 16-bit timestamp relative to the Cluster
+    block.timestamp = clusterTime + static_cast<int16_t>((timeHigh << 8) | timeLow);
+    block.duration = 0;
+    block.lacing = flags & 0x06;
+    block.keyframe = (flags & 0x80) != 0;  // SimpleBlock only, BlockGroup overrides it
+
+    return readLacing(end);
+}
+
+bool MkvClusterReader::readLacing(uint64_t end) {
+    block.frameSizes.clear();
+
+    if (block.lacing == MKV_LACING_NONE) {
+        if (reader.tell() > end) {
+            return false;
+        }
+        block.dataOffset = reader.tell();
+        block.frameSizes.push_back(static_cast<uint32_t>(end - reader.tell()));
+        return true;
+    }
+
+    uint8_t lastFrame;
+    if (!reader.readByte(lastFrame)) {
+        return false;
+    }
+    size_t frameCount = static_cast<size_t>(lastFrame) + 1;
+    uint64_t lacedBytes = 0;
+
+    switch (block.lacing) {
+    case MKV_LACING_XIPH:
+        // Each size is a run of 255s terminated by a smaller byte
+        for (size_t i = 0; i + 1 < frameCount; i++) {
+            uint64_t frameSize = 0;
+            uint8_t value;
+            do {
+                if (!reader.readByte(value)) {
+                    return false;
+                }
+                frameSize += value;
+            } while (value == 0xFF && frameSize <= end);
+            if (frameSize > end) {
+                return false;
+            }
+            block.frameSizes.push_back(static_cast<uint32_t>(frameSize));
+            lacedBytes += frameSize;
+        }
+        break;
+
+    case MKV_LACING_EBML: {
+        // First size as an unsigned VINT, then signed differences to the previous one
+        uint64_t firstStart = reader.tell();
+        uint64_t first = reader.readElementSize();
+        if (first == MKV_UNKNOWN_SIZE || reader.tell() == firstStart || first > end) {
+            return false;
+        }
+        int64_t frameSize = static_cast<int64_t>(first);
+        block.frameSizes.push_back(static_cast<uint32_t>(frameSize));
+        lacedBytes += frameSize;
+
+        for (size_t i = 1; i + 1 < frameCount; i++) {
+            uint64_t start = reader.tell();
+            uint64_t raw = reader.readElementSize();
+            uint64_t length = reader.tell() - start;
+            if (raw == MKV_UNKNOWN_SIZE || length == 0 || length > 8) {
+                return false;
+            }
+
+            // Signed VINTs are stored with a bias of 2^(7 * length - 1) - 1
+            int64_t bias = (int64_t(1) << (7 * length - 1)) - 1;
+            frameSize += static_cast<int64_t>(raw) - bias;
+            if (frameSize < 0 || static_cast<uint64_t>(frameSize) > end) {
+                return false;
+            }
+            block.frameSizes.push_back(static_cast<uint32_t>(frameSize));
+            lacedBytes += frameSize;
+        }
+        break;
+    }
+
+    case MKV_LACING_FIXED: {
+        if (reader.tell() > end || (end - reader.tell()) % frameCount != 0) {
+            return false;
+        }
+        uint32_t frameSize = static_cast<uint32_t>((end - reader.tell()) / frameCount);
+        block.frameSizes.assign(frameCount, frameSize);
+        block.dataOffset = reader.tell();
+        return true;
+    }
+    }
+
+    // The last frame takes whatever is left. Every size is at most `end`, so
+    // the sum of the 255 at most can't wrap.
+    if (reader.eof() || reader.tell() > end || lacedBytes > end - reader.tell()) {
+        return false;
+    }
+    block.dataOffset = reader.tell();
+    block.frameSizes.push_back(static_cast<uint32_t>(end - reader.tell() - lacedBytes));
+    return true;
+}
+
+bool MkvClusterReader::readBytes(uint64_t offset, uint64_t size, std::vector<uint8_t>& data) {
+    if (offset > reader.size() || size > reader.size() - offset) {
+        return false;
+    }
+
+    data.resize(static_cast<size_t>(size));
+    reader.seek(offset);
+    return reader.read(data.data(), data.size()) == data.size();
+}
+
+bool readMkvKeyframe(const MkvMetadataExtractor& extractor, uint64_t track, double timeMs, MkvKeyframe& keyframe) {
+    if (track == 0) {
+        if (extractor.getVideoStreams().empty()) {
+            return false;
+        }
+        track = extractor.getVideoStreams().front().trackNumber;
+    }
+
+    const MkvStream* stream = extractor.findStream(track);
+    uint64_t timecodeScale = extractor.getTimecodeScale();
+    if (!stream || timeMs < 0.0 || timecodeScale == 0) {
+        return false;
+    }
+
+    const MkvSegmentLayout& layout = extractor.getSegmentLayout();
+    MkvClusterReader clusters;
+    if (!clusters.open(extractor.getFilePath(), layout.end)) {
+        return false;
+    }
+
+    uint64_t firstCluster = layout.firstCluster;
+    if (firstCluster == 0) {
+        firstCluster = clusters.findCluster(layout.dataStart);
+    }
+
+    // Start from the nearest cue if there is one, it already points at a keyframe
+    uint64_t pos = firstCluster;
+    MkvCuePoint cue;
+    if (extractor.findCue(track, timeMs, cue)) {
+        pos = cue.clusterPosition;
+    }
+
+    KeyframeFinder finder(track, static_cast<int64_t>(timeMs * 1000000.0 / timecodeScale));
+    while (pos != 0 && clusters.readCluster(pos, finder, pos)) {
+    }
+
+    // A stale cue can point at garbage, retry from the start
+    if (!finder.found && cue.clusterPosition != 0 && cue.clusterPosition != firstCluster) {
+        pos = firstCluster;
+        while (pos != 0 && clusters.readCluster(pos, finder, pos)) {
+        }
+    }
+
+    if (!finder.found) {
+        return false;
+    }
+
+    keyframe.track = track;
+    keyframe.timeMs = static_cast<double>(finder.timestamp) * timecodeScale / 1000000.0;
+    keyframe.clusterPosition = finder.clusterPosition;
+    if (!clusters.readBytes(finder.frameOffset, finder.frameSize, keyframe.data)) {
+        return false;
+    }
+
+    keyframe.codecPrivate.clear();
+    if (stream->codecPrivateSize != 0 &&
+        !clusters.readBytes(stream->codecPrivateOffset, stream->codecPrivateSize, keyframe.codecPrivate)) {
+        return false;
+    }
+
+    return true;
+}
+
+bool probeMkvDuration(const std::string& filePath, MkvDurationProbe& probe) {
+    probe = MkvDurationProbe();
+
+    // SegmentInfo alone is enough when the muxer wrote a Duration
+    MkvMetadataExtractor extractor;
+    if (!extractor.open(filePath, MKV_SECTION_INFO)) {
+        return false;
+    }
+    probe.bytesRead = extractor.getParseStats().io.bytesRead;
+
+    if (extractor.getDuration() > 0.0) {
+        probe.source = MKV_DURATION_INFO;
+        probe.durationMs = extractor.getDuration();
+        return true;
+    }
+
+    // Tracks for DefaultDuration, Cues to find the last Cluster, parsed from
+    // the file already open
+    if (!extractor.addSections(MKV_SECTION_TRACKS | MKV_SECTION_CUES) ||
+        extractor.getTimecodeScale() == 0) {
+        return false;
+    }
+    probe.bytesRead = extractor.getParseStats().io.bytesRead;
+
+    // Streamed rather than mapped, so bytesRead reflects what was touched
+    const MkvSegmentLayout& layout = extractor.getSegmentLayout();
+    MkvClusterReader clusters;
+    if (!clusters.open(filePath, layout.end, false)) {
+        return false;
+    }
+
+    EndTimeTracker tracker(extractor);
+    uint64_t pos = 0;
+
+    for (const auto& point : extractor.getCueIndex().getPoints()) {
+        pos = std::max(pos, point.clusterPosition);
+    }
+    if (pos != 0) {
+        while (pos != 0 && clusters.readCluster(pos, tracker, pos)) {
+        }
+        probe.source = MKV_DURATION_CUES;
+    }
+
+    // Resync on the first Cluster in the tail, widening the window when a
+    // single Cluster is larger than it
+    uint64_t segmentEnd = clusters.getSegmentEnd();
+    for (uint64_t window = TailProbeSize; !tracker.found; window *= 4) {
+        uint64_t start = segmentEnd - std::min(segmentEnd - std::min(segmentEnd, layout.dataStart), window);
+
+        pos = clusters.findCluster(start);
+        while (pos != 0 && clusters.readCluster(pos, tracker, pos)) {
+        }
+        probe.source = MKV_DURATION_TAIL;
+
+        if (start <= layout.dataStart) {
+            break;
+        }
+    }
+
+    probe.bytesRead += clusters.getStats().bytesRead;
+    if (!tracker.found) {
+        probe.source = MKV_DURATION_NONE;
+        return false;
+    }
+
+    probe.durationMs = static_cast<double>(tracker.endTime) * extractor.getTimecodeScale() / 1000000.0;
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef MKV_CLUSTER_READER_H
+#define MKV_CLUSTER_READER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "mkv_block_reader.h"
+
+class MkvMetadataExtractor;
+
+// Lacing modes, bits 1-2 of the block flags
+enum MkvLacing {
+    MKV_LACING_NONE = 0x00,
+    MKV_LACING_XIPH = 0x02,
+    MKV_LACING_FIXED = 0x04,
+    MKV_LACING_EBML = 0x06
+};
+
+// One SimpleBlock or BlockGroup as seen by MkvBlockVisitor. Only offsets are
+// recorded; the payload stays in the file until someone asks for it.
+struct MkvBlock {
+    uint64_t track;
+    int64_t timestamp;          // absolute, in TimecodeScale units
+    uint64_t duration;          // BlockDuration, 0 if not present
+    uint64_t clusterPosition;   // absolute file offset of the Cluster
+    uint64_t dataOffset;        // absolute file offset of the first frame
+    bool keyframe;
+    uint8_t lacing;
+    std::vector<uint32_t> frameSizes;  // one entry per (laced) frame
+
+    MkvBlock() :
+        track(0), timestamp(0), duration(0), clusterPosition(0), dataOffset(0),
+        keyframe(false), lacing(MKV_LACING_NONE) {
+    }
+};
+
+// Receives the blocks of the clusters walked by MkvClusterReader
+class MkvBlockVisitor {
+public:
+    virtual ~MkvBlockVisitor() {}
+
+    // Return false to stop the walk. `block` is only valid during the call.
+    virtual bool onBlock(const MkvBlock& block) = 0;
+};
+
+// Walks Clusters and decodes the SimpleBlock / BlockGroup headers inside them,
+// including Xiph, EBML and fixed-size lacing. Uses its own reader so it can
+// run next to an open MkvMetadataExtractor.
+class MkvClusterReader {
+public:
+    MkvClusterReader();
+    ~MkvClusterReader();
+
+    // Map the file (unless `useMapping` is false), falling back to the stream
+    // reader. `segmentEnd` is where the Segment ends (0 = end of file).
+    bool open(const std::string& filePath, uint64_t segmentEnd = 0, bool useMapping = true);
+    void close();
+    bool isOpen() const { return reader.isOpen(); }
+    uint64_t getSegmentEnd() const { return limit; }
+
+    // Position of the first Cluster at or after `from`, walking top-level
+    // elements and resyncing over elements of unknown size. 0 if there is none.
+    uint64_t findCluster(uint64_t from);
+
+    // Hand every block of the Cluster at `pos` to `visitor`. On return `next`
+    // holds the position of the following Cluster (0 if there is none).
+    // Returns false if `pos` is not a Cluster or the visitor stopped the walk.
+    bool readCluster(uint64_t pos, MkvBlockVisitor& visitor, uint64_t& next);
+
+    // Copy `size` bytes at `offset` into `data`
+    bool readBytes(uint64_t offset, uint64_t size, std::vector<uint8_t>& data);
+
+    const MkvReadStats& getStats() const { return reader.getStats(); }
+
+private:
+    MkvBlockReader reader;
+    uint64_t limit;
+    int64_t clusterTime;
+    MkvBlock block;  // reused for every block to keep frameSizes' capacity
+
+    bool endsOnLevel1(uint64_t end);
+    bool readBlockGroup(uint64_t size);
+    bool readBlockHeader(uint64_t size);
+    bool readLacing(uint64_t end);
+};
+
+// The frame to hand to a decoder for a given point in time
+struct MkvKeyframe {
+    uint64_t track;
+    double timeMs;
+    uint64_t clusterPosition;
+    std::vector<uint8_t> data;           // first frame of the keyframe block
+    std::vector<uint8_t> codecPrivate;   // CodecPrivate of the track, may be empty
+
+    MkvKeyframe() : track(0), timeMs(0), clusterPosition(0) {}
+};
+
+// Latest keyframe of `track` at or before `timeMs` (the first one after it if
+// there is none before). Track 0 means the first video track. The extractor
+// must have parsed MKV_SECTION_INFO and MKV_SECTION_TRACKS; with
+// MKV_SECTION_CUES the walk starts from the nearest cue instead of the first
+// Cluster. ContentEncodings (header stripping, zlib) are not undone.
+bool readMkvKeyframe(const MkvMetadataExtractor& extractor, uint64_t track, double timeMs, MkvKeyframe& keyframe);
+
+// How probeMkvDuration() found the duration, cheapest first
+enum MkvDurationSource {
+    MKV_DURATION_NONE,
+    MKV_DURATION_INFO,  // Duration element of SegmentInfo
+    MKV_DURATION_CUES,  // blocks from the last cued Cluster to the end
+    MKV_DURATION_TAIL   // blocks of the Clusters in the last few MiB
+};
+
+struct MkvDurationProbe {
+    MkvDurationSource source;
+    double durationMs;
+    uint64_t bytesRead;  // total read from the file, headers included
+
+    MkvDurationProbe() : source(MKV_DURATION_NONE), durationMs(0), bytesRead(0) {}
+};
+
+// Duration of an MKV file, also for files whose SegmentInfo has no Duration
+// (live recordings, some remuxers). Those are timed from the end of the last
+// block, found through the Cues or by resyncing near the end of the file.
+bool probeMkvDuration(const std::string& filePath, MkvDurationProbe& probe);
+
+#endif // MKV_CLUSTER_READER_H
@@ -0,0 +1,219 @@
+#include "mkv_cluster_scanner.h"
+#include "mkv_cluster_reader.h"
+#include "mkv_metadata_extractor_version5.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+void addKeyframeInterval(MkvTrackStatistics& stats, int64_t interval) {
+    // Keyframes out of order (or sharing a timestamp) don't make an interval
+    if (interval <= 0) {
+        return;
+    }
+    uint64_t value = static_cast<uint64_t>(interval);
+    if (stats.minKeyframeInterval == 0 || value < stats.minKeyframeInterval) {
+        stats.minKeyframeInterval = value;
+    }
+    if (value > stats.maxKeyframeInterval) {
+        stats.maxKeyframeInterval = value;
+    }
+}
+
+// Accumulates blocks into the statistics of their track
+class StatisticsCollector : public MkvBlockVisitor {
+public:
+    explicit StatisticsCollector(std::vector<MkvTrackStatistics>& tracks) :
+        tracks(tracks), last(nullptr) {
+    }
+
+    bool onBlock(const MkvBlock& block) override {
+        MkvTrackStatistics* stats = find(block.track);
+        if (!stats) {
+            return true;
+        }
+
+        if (stats->blocks == 0) {
+            stats->firstTimestamp = block.timestamp;
+            stats->lastTimestamp = block.timestamp;
+        }
+        else {
+            stats->firstTimestamp = std::min(stats->firstTimestamp, block.timestamp);
+            stats->lastTimestamp = std::max(stats->lastTimestamp, block.timestamp);
+        }
+
+        stats->blocks++;
+        stats->frames += block.frameSizes.size();
+        for (uint32_t frameSize : block.frameSizes) {
+            stats->bytes += frameSize;
+        }
+
+        if (block.keyframe) {
+            if (stats->keyframes == 0) {
+                stats->firstKeyframe = block.timestamp;
+            }
+            else {
+                addKeyframeInterval(*stats, block.timestamp - stats->lastKeyframe);
+            }
+            stats->lastKeyframe = block.timestamp;
+            stats->keyframes++;
+        }
+
+        return true;
+    }
+
+private:
+    std::vector<MkvTrackStatistics>& tracks;
+    MkvTrackStatistics* last;  // blocks of one track tend to come in runs
+
+    MkvTrackStatistics* find(uint64_t track) {
+        if (last && last->track == track) {
+            return last;
+        }
+        for (auto& stats : tracks) {
+            if (stats.track == track) {
+                last = &stats;
+                return last;
+            }
+        }
+        return nullptr;
+    }
+};
+
+} // namespace
+
+MkvClusterScanner::MkvClusterScanner(const MkvMetadataExtractor& extractor) :
+    extractor(extractor) {
+}
+
+bool MkvClusterScanner::scan(unsigned threads) {
+    auto startTime = std::chrono::steady_clock::now();
+    stats = MkvScanStats();
+
+    // One entry per known track, blocks of other tracks are ignored
+    tracks.clear();
+    for (const auto* streams : { &extractor.getVideoStreams(), &extractor.getAudioStreams(), &extractor.getSubtitleStreams() }) {
+        for (const auto& stream : *streams) {
+            MkvTrackStatistics entry;
+            entry.track = stream.trackNumber;
+            tracks.push_back(entry);
+        }
+    }
+
+    const MkvSegmentLayout& layout = extractor.getSegmentLayout();
+    MkvClusterReader clusters;
+    if (!clusters.open(extractor.getFilePath(), layout.end)) {
+        return false;
+    }
+
+    uint64_t first = layout.firstCluster != 0 ? layout.firstCluster : clusters.findCluster(layout.dataStart);
+    uint64_t end = clusters.getSegmentEnd();
+    clusters.close();
+    if (first == 0 || first >= end) {
+        return false;
+    }
+
+    // Split the Cluster area into ranges of at least MinRangeSize
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    uint64_t span = end - first;
+    uint64_t maxRanges = std::max<uint64_t>(1, span / MinRangeSize);
+    unsigned ranges = static_cast<unsigned>(std::min<uint64_t>(threads, maxRanges));
+
+    std::vector<RangeResult> results(ranges);
+    std::vector<uint64_t> bounds(ranges + 1);
+    for (unsigned i = 0; i <= ranges; i++) {
+        bounds[i] = first + span / ranges * i;
+    }
+    bounds[ranges] = end;
+
+    if (ranges == 1) {
+        scanRange(bounds[0], bounds[1], results[0]);
+    }
+    else {
+        std::vector<std::thread> workers;
+        workers.reserve(ranges);
+        for (unsigned i = 0; i < ranges; i++) {
+            workers.emplace_back(&MkvClusterScanner::scanRange, this, bounds[i], bounds[i + 1], std::ref(results[i]));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Ranges are in file order, so merging them in order keeps the keyframe
+    // intervals that straddle a range boundary
+    for (const auto& result : results) {
+        if (!result.opened) {
+            return false;
+        }
+        for (size_t i = 0; i < tracks.size(); i++) {
+            merge(tracks[i], result.tracks[i]);
+        }
+        stats.clusters += result.clusters;
+        stats.bytesRead += result.bytesRead;
+    }
+
+    stats.ranges = ranges;
+    stats.scanNanoseconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - startTime).count());
+    return true;
+}
+
+void MkvClusterScanner::scanRange(uint64_t start, uint64_t end, RangeResult& result) const {
+    result.tracks = tracks;
+
+    MkvClusterReader clusters;
+    if (!clusters.open(extractor.getFilePath(), extractor.getSegmentLayout().end)) {
+        return;
+    }
+    result.opened = true;
+
+    // Every Cluster starting inside [start, end) belongs to this range, even
+    // if it runs past the end
+    StatisticsCollector collector(result.tracks);
+    uint64_t pos = clusters.findCluster(start);
+    while (pos != 0 && pos < end && clusters.readCluster(pos, collector, pos)) {
+        result.clusters++;
+    }
+
+    result.bytesRead = clusters.getStats().bytesRead;
+}
+
+void MkvClusterScanner::merge(MkvTrackStatistics& total, const MkvTrackStatistics& range) {
+    if (range.blocks == 0) {
+        return;
+    }
+
+    if (total.blocks == 0) {
+        total.firstTimestamp = range.firstTimestamp;
+        total.lastTimestamp = range.lastTimestamp;
+    }
+    else {
+        total.firstTimestamp = std::min(total.firstTimestamp, range.firstTimestamp);
+        total.lastTimestamp = std::max(total.lastTimestamp, range.lastTimestamp);
+    }
+    total.blocks += range.blocks;
+    total.frames += range.frames;
+    total.bytes += range.bytes;
+
+    if (range.keyframes == 0) {
+        return;
+    }
+
+    if (total.keyframes == 0) {
+        total.firstKeyframe = range.firstKeyframe;
+    }
+    else {
+        addKeyframeInterval(total, range.firstKeyframe - total.lastKeyframe);
+    }
+    if (range.keyframes > 1) {
+        addKeyframeInterval(total, static_cast<int64_t>(range.minKeyframeInterval));
+        addKeyframeInterval(total, static_cast<int64_t>(range.maxKeyframeInterval));
+    }
+    total.lastKeyframe = range.lastKeyframe;
+    total.keyframes += range.keyframes;
+}
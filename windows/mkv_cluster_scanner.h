@@ -0,0 +1,86 @@
+#ifndef MKV_CLUSTER_SCANNER_H
+#define MKV_CLUSTER_SCANNER_H
+
+#include <vector>
+#include <cstdint>
+
+class MkvMetadataExtractor;
+
+// Exact per-track counters gathered from every block of the file. Times are
+// in TimecodeScale units.
+struct MkvTrackStatistics {
+    uint64_t track;
+    uint64_t blocks;              // SimpleBlocks and BlockGroups
+    uint64_t frames;              // frames once lacing is undone
+    uint64_t bytes;               // payload bytes, lacing headers excluded
+    uint64_t keyframes;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    int64_t firstKeyframe;
+    int64_t lastKeyframe;
+    uint64_t minKeyframeInterval; // 0 with fewer than two keyframes
+    uint64_t maxKeyframeInterval;
+
+    MkvTrackStatistics() :
+        track(0), blocks(0), frames(0), bytes(0), keyframes(0),
+        firstTimestamp(0), lastTimestamp(0), firstKeyframe(0), lastKeyframe(0),
+        minKeyframeInterval(0), maxKeyframeInterval(0) {
+    }
+
+    // Average distance between keyframes, 0 with fewer than two keyframes
+    double averageKeyframeInterval() const {
+        return keyframes < 2 ? 0.0 : static_cast<double>(lastKeyframe - firstKeyframe) / (keyframes - 1);
+    }
+};
+
+// Cost of the last scan()
+struct MkvScanStats {
+    unsigned ranges;            // byte ranges (and worker threads) used
+    uint64_t clusters;
+    uint64_t bytesRead;         // stream reads, 0 when the file was mapped
+    uint64_t scanNanoseconds;
+
+    MkvScanStats() : ranges(0), clusters(0), bytesRead(0), scanNanoseconds(0) {}
+};
+
+// Walks every Cluster of the Segment to compute MkvTrackStatistics for the
+// tracks of an opened MkvMetadataExtractor (MKV_SECTION_TRACKS is required).
+//
+// The Segment is split into byte ranges, each range resyncs on its first
+// Cluster boundary and is scanned by its own thread with its own mapping. A
+// Cluster belongs to the range it starts in, so the results are simply merged
+// in file order afterwards.
+class MkvClusterScanner {
+public:
+    // Ranges smaller than this are not worth a thread
+    static const uint64_t MinRangeSize = 32 * 1024 * 1024;
+
+    explicit MkvClusterScanner(const MkvMetadataExtractor& extractor);
+
+    // Scan with up to `threads` workers (0 = one per core). Returns false if
+    // the file cannot be opened or has no Cluster.
+    bool scan(unsigned threads = 0);
+
+    // One entry per track of the extractor, in video, audio, subtitle order
+    const std::vector<MkvTrackStatistics>& getTrackStatistics() const { return tracks; }
+    const MkvScanStats& getStats() const { return stats; }
+
+private:
+    const MkvMetadataExtractor& extractor;
+    std::vector<MkvTrackStatistics> tracks;
+    MkvScanStats stats;
+
+    struct RangeResult {
+        std::vector<MkvTrackStatistics> tracks;
+        uint64_t clusters;
+        uint64_t bytesRead;
+        bool opened;
+
+        RangeResult() : clusters(0), bytesRead(0), opened(false) {}
+    };
+
+    void scanRange(uint64_t start, uint64_t end, RangeResult& result) const;
+    static void merge(MkvTrackStatistics& total, const MkvTrackStatistics& range);
+};
+
+#endif // MKV_CLUSTER_SCANNER_H
@@ -1,18 +1,321 @@
 #include "mkv_metadata_extractor_version5.h"
+#include "mkv_attachment_writer.h"
+#include "file_copy.h"
 #include <windows.h>
 #include <boost/nowide/fstream.hpp>
-#include <boost/nowide/cstdio.hpp>
-#include <iostream>
 #include <cmath>
 #include <algorithm>
 #include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <unordered_set>
 #include <stringapiset.h>
 #include <io.h>
 
+namespace {
+
+// Element schemas, sorted by ID. Adding an element is one line here.
+// Strings that repeat across a library (codecs, languages, MIME types, muxers)
+// are atoms and get interned; per-file text like titles is a plain string.
+
+constexpr MkvField<MkvSegmentInfo> segmentInfoFields[] = {
+    mkvFloat(MkvIds::Duration, &MkvSegmentInfo::duration),
+    mkvAtom(MkvIds::MuxingApp, &MkvSegmentInfo::muxingApp),
+    mkvAtom(MkvIds::WritingApp, &MkvSegmentInfo::writingApp),
+    mkvString(MkvIds::Title, &MkvSegmentInfo::title),
+    mkvUInt(MkvIds::TimecodeScale, &MkvSegmentInfo::timecodeScale),
+};
+
+constexpr MkvField<MkvStream> colourFields[] = {
+    mkvUInt8(MkvIds::MatrixCoefficients, &MkvStream::matrixCoefficients),
+    mkvUInt8(MkvIds::BitsPerChannel, &MkvStream::bitsPerChannel),
+    mkvUInt8(MkvIds::Range, &MkvStream::colorRange),
+    mkvUInt8(MkvIds::TransferCharacteristics, &MkvStream::transferCharacteristics),
+    mkvUInt8(MkvIds::Primaries, &MkvStream::colorPrimaries),
+};
+constexpr MkvSchema<MkvStream> colourSchema(colourFields);
+
+constexpr MkvField<MkvStream> videoFields[] = {
+    mkvUInt(MkvIds::PixelWidth, &MkvStream::pixelWidth),
+    mkvUInt(MkvIds::PixelHeight, &MkvStream::pixelHeight),
+    mkvUInt(MkvIds::DisplayWidth, &MkvStream::displayWidth),
+    mkvUInt8(MkvIds::DisplayUnit, &MkvStream::displayUnit),
+    mkvUInt(MkvIds::DisplayHeight, &MkvStream::displayHeight),
+    mkvMaster(MkvIds::Colour, &colourSchema),
+    mkvFloat(MkvIds::FrameRate, &MkvStream::frameRate),
+    mkvHex32(MkvIds::ColourSpace, &MkvStream::colorSpace),
+};
+constexpr MkvSchema<MkvStream> videoSchema(videoFields);
+
+constexpr MkvField<MkvStream> audioFields[] = {
+    mkvUInt8(MkvIds::Channels, &MkvStream::channels),
+    mkvFloat(MkvIds::SamplingFrequency, &MkvStream::samplingFrequency),
+    mkvUInt8(MkvIds::BitDepth, &MkvStream::bitDepth),
+    mkvFloat(MkvIds::OutputSamplingFrequency, &MkvStream::outputSamplingFrequency),
+};
+constexpr MkvSchema<MkvStream> audioSchema(audioFields);
+
+constexpr MkvField<MkvStream> trackEntryFields[] = {
+    mkvUInt8(MkvIds::TrackType, &MkvStream::trackType),
+    mkvAtom(MkvIds::CodecID, &MkvStream::codecID),
+    mkvUInt(MkvIds::TrackNumber, &MkvStream::trackNumber),
+    mkvMaster(MkvIds::Video, &videoSchema),
+    mkvMaster(MkvIds::Audio, &audioSchema),
+    mkvString(MkvIds::Name, &MkvStream::name),
+    mkvData(MkvIds::CodecPrivate, &MkvStream::codecPrivateOffset, &MkvStream::codecPrivateSize),
+    mkvUInt(MkvIds::TrackUID, &MkvStream::trackUID),
+    mkvAtom(MkvIds::Language, &MkvStream::language),
+    mkvUInt(MkvIds::DefaultDuration, &MkvStream::defaultDuration),
+    mkvAtom(MkvIds::CodecName, &MkvStream::codecName),
+};
+
+constexpr MkvField<MkvAttachment> attachedFileFields[] = {
+    mkvData(MkvIds::FileData, &MkvAttachment::dataOffset, &MkvAttachment::dataSize),
+    mkvAtom(MkvIds::FileMimeType, &MkvAttachment::mimeType),
+    mkvString(MkvIds::FileName, &MkvAttachment::fileName),
+    mkvString(MkvIds::FileDescription, &MkvAttachment::description),
+    mkvUInt(MkvIds::FileUID, &MkvAttachment::uid),
+};
+
+constexpr MkvField<MkvEdition> editionFields[] = {
+    mkvUInt(MkvIds::EditionUID, &MkvEdition::uid),
+    mkvUInt8(MkvIds::EditionFlagHidden, &MkvEdition::flagHidden),
+    mkvUInt8(MkvIds::EditionFlagDefault, &MkvEdition::flagDefault),
+    mkvUInt8(MkvIds::EditionFlagOrdered, &MkvEdition::flagOrdered),
+};
+
+constexpr MkvField<MkvChapter> chapterAtomFields[] = {
+    mkvUInt(MkvIds::ChapterTimeStart, &MkvChapter::timeStart),
+    mkvUInt(MkvIds::ChapterTimeEnd, &MkvChapter::timeEnd),
+    mkvUInt8(MkvIds::ChapterFlagHidden, &MkvChapter::flagHidden),
+    mkvUInt8(MkvIds::ChapterFlagEnabled, &MkvChapter::flagEnabled),
+    mkvUInt(MkvIds::ChapterUID, &MkvChapter::uid),
+};
+
+constexpr MkvField<MkvChapter> chapterDisplayFields[] = {
+    mkvString(MkvIds::ChapString, &MkvChapter::title),
+    mkvAtom(MkvIds::ChapLanguage, &MkvChapter::language),
+};
+
+// TagTrackUID may repeat, it is handled by parseTargets() itself
+constexpr MkvField<MkvTag> targetsFields[] = {
+    mkvUInt(MkvIds::TagChapterUID, &MkvTag::chapterUID),
+    mkvUInt(MkvIds::TagAttachmentUID, &MkvTag::attachmentUID),
+    mkvUInt(MkvIds::TagEditionUID, &MkvTag::editionUID),
+    mkvAtom(MkvIds::TargetType, &MkvTag::targetType),
+    mkvUInt(MkvIds::TargetTypeValue, &MkvTag::targetTypeValue),
+};
+
+constexpr MkvField<MkvTag> simpleTagFields[] = {
+    mkvAtom(MkvIds::TagLanguage, &MkvTag::language),
+    mkvUInt8(MkvIds::TagDefault, &MkvTag::isDefault),
+    mkvString(MkvIds::TagString, &MkvTag::value),
+    mkvAtom(MkvIds::TagName, &MkvTag::name),
+};
+
+static_assert(mkvIsSorted(segmentInfoFields), "segmentInfoFields must be sorted by ID");
+static_assert(mkvIsSorted(colourFields), "colourFields must be sorted by ID");
+static_assert(mkvIsSorted(videoFields), "videoFields must be sorted by ID");
+static_assert(mkvIsSorted(audioFields), "audioFields must be sorted by ID");
+static_assert(mkvIsSorted(trackEntryFields), "trackEntryFields must be sorted by ID");
+static_assert(mkvIsSorted(attachedFileFields), "attachedFileFields must be sorted by ID");
+static_assert(mkvIsSorted(editionFields), "editionFields must be sorted by ID");
+static_assert(mkvIsSorted(chapterAtomFields), "chapterAtomFields must be sorted by ID");
+static_assert(mkvIsSorted(chapterDisplayFields), "chapterDisplayFields must be sorted by ID");
+static_assert(mkvIsSorted(targetsFields), "targetsFields must be sorted by ID");
+static_assert(mkvIsSorted(simpleTagFields), "simpleTagFields must be sorted by ID");
+
+constexpr MkvSchema<MkvSegmentInfo> segmentInfoSchema(segmentInfoFields);
+constexpr MkvSchema<MkvStream> trackEntrySchema(trackEntryFields);
+constexpr MkvSchema<MkvAttachment> attachedFileSchema(attachedFileFields);
+constexpr MkvSchema<MkvEdition> editionSchema(editionFields);
+constexpr MkvSchema<MkvChapter> chapterAtomSchema(chapterAtomFields);
+constexpr MkvSchema<MkvChapter> chapterDisplaySchema(chapterDisplayFields);
+constexpr MkvSchema<MkvTag> targetsSchema(targetsFields);
+constexpr MkvSchema<MkvTag> simpleTagSchema(simpleTagFields);
+
+static_assert(trackEntrySchema.multiplier != 0 && videoSchema.multiplier != 0,
+    "hot schemas should dispatch through the perfect hash");
+
+// Chapters and SimpleTags nest; deeper levels of a damaged file are skipped
+const uint32_t MaxNestingDepth = 16;
+
+// Bulk extraction reads neighbouring attachments together while the gap
+// between them stays small, up to BulkReadSize per read
+const uint64_t BulkReadSize = 4 * 1024 * 1024;
+const uint64_t BulkMaxGap = 64 * 1024;
+
+// Attachments from this size up are copied with copyFileSection()
+const uint64_t CopyEngineThreshold = 1024 * 1024;
+
+// String elements are cut to this many bytes, the rest is skipped. Titles,
+// names and tag values are far shorter; a larger size is a damaged file.
+const uint64_t MaxStringSize = 1024 * 1024;
+
+char asciiLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool equalsNoCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (asciiLower(a[i]) != asciiLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Attachment names come from the file: keep them inside the output directory
+// and valid on Windows
+std::string safeFileName(std::string_view name, size_t index) {
+    size_t slash = name.find_last_of("/\\");
+    if (slash != std::string_view::npos) {
+        name.remove_prefix(slash + 1);
+    }
+
+    std::string result(name);
+    for (char& c : result) {
+        if (static_cast<unsigned char>(c) < 0x20 || std::strchr("<>:\"|?*", c) != nullptr) {
+            c = '_';
+        }
+    }
+    while (!result.empty() && (result.back() == '.' || result.back() == ' ')) {
+        result.pop_back();
+    }
+    if (result.empty()) {
+        return "attachment_" + std::to_string(index);
+    }
+
+    // Device names are reserved whatever the extension
+    std::string_view stem(result);
+    stem = stem.substr(0, stem.find('.'));
+    static const char* const reserved[] = {"CON", "PRN", "AUX", "NUL"};
+    bool isReserved = false;
+    for (const char* device : reserved) {
+        isReserved = isReserved || equalsNoCase(stem, device);
+    }
+    if (stem.size() == 4 && stem[3] >= '1' && stem[3] <= '9' &&
+        (equalsNoCase(stem.substr(0, 3), "COM") || equalsNoCase(stem.substr(0, 3), "LPT"))) {
+        isReserved = true;
+    }
+    if (isReserved) {
+        result.insert(0, 1, '_');
+    }
+    return result;
+}
+
+// The bytes of one attachment, for the sfnt parser
+class AttachmentFontSource : public SfntSource {
+public:
+    AttachmentFontSource(MkvMetadataExtractor& extractor, size_t index) :
+        extractor(extractor), index(index), bytesRead(0) {
+    }
+
+    bool read(uint64_t offset, size_t size, std::vector<uint8_t>& data) override {
+        if (!extractor.readAttachment(index, offset, size, data) || data.size() != size) {
+            return false;
+        }
+        bytesRead += size;
+        return true;
+    }
+
+    uint64_t getBytesRead() const { return bytesRead; }
+
+private:
+    MkvMetadataExtractor& extractor;
+    size_t index;
+    uint64_t bytesRead;
+};
+
+// `name`, or "name (2).ext" and so on if an earlier attachment took it.
+// Compared case-insensitively, like Windows file names.
+std::string uniqueFileName(const std::string& name, std::unordered_set<std::string>& used) {
+    size_t dot = name.rfind('.');
+    if (dot == 0 || dot == std::string::npos) {
+        dot = name.size();
+    }
+
+    std::string candidate = name;
+    for (int n = 2;; n++) {
+        std::string key = candidate;
+        for (char& c : key) {
+            c = asciiLower(c);
+        }
+        if (used.insert(key).second) {
+            return candidate;
+        }
+        candidate = name.substr(0, dot) + " (" + std::to_string(n) + ")" + name.substr(dot);
+    }
+}
+
+// Statistics tag names; files remuxed by ffmpeg carry them with a language
+// suffix, e.g. "BPS-eng"
+bool isStatisticsTag(std::string_view name, std::string_view statistic) {
+    return name.size() >= statistic.size() && name.compare(0, statistic.size(), statistic) == 0 &&
+        (name.size() == statistic.size() || name[statistic.size()] == '-');
+}
+
+bool parseDecimal(std::string_view text, uint64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return true;
+}
+
+// "HH:MM:SS.nnnnnnnnn" as written by mkvmerge
+bool parseTagDuration(std::string_view text, double& durationMs) {
+    size_t first = text.find(':');
+    size_t second = first == std::string_view::npos ? first : text.find(':', first + 1);
+    if (second == std::string_view::npos) {
+        return false;
+    }
+
+    std::string_view secondsText = text.substr(second + 1);
+    std::string_view fraction;
+    size_t dot = secondsText.find('.');
+    if (dot != std::string_view::npos) {
+        fraction = secondsText.substr(dot + 1);
+        secondsText = secondsText.substr(0, dot);
+    }
+
+    uint64_t hours = 0;
+    uint64_t minutes = 0;
+    uint64_t seconds = 0;
+    if (!parseDecimal(text.substr(0, first), hours) ||
+        !parseDecimal(text.substr(first + 1, second - first - 1), minutes) ||
+        !parseDecimal(secondsText, seconds)) {
+        return false;
+    }
+
+    double fractionMs = 0;
+    double scale = 100.0;
+    for (char c : fraction) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        fractionMs += (c - '0') * scale;
+        scale /= 10;
+    }
+    durationMs = (hours * 3600 + minutes * 60 + seconds) * 1000.0 + fractionMs;
+    return true;
+}
+
+} // namespace
+
 MkvMetadataExtractor::MkvMetadataExtractor() :
     fileSize(0),
-    duration(0.0),
-    timecodeScale(1000000) // Default timecode scale is 1ms
+    requestedSections(MKV_SECTION_DEFAULT),
+    parsedSections(0)
 {
 }
 
@@ -21,53 +324,56 @@ MkvMetadataExtractor::~MkvMetadataExtractor() {
 }
 
 
-bool MkvMetadataExtractor::open(const std::string& filePath) {
+bool MkvMetadataExtractor::open(const std::string& filePath, uint32_t sections) {
+    return openFile(filePath, false, sections);
+}
+
+bool MkvMetadataExtractor::openMapped(const std::string& filePath, uint32_t sections) {
+    return openFile(filePath, true, sections);
+}
+
+bool MkvMetadataExtractor::openFile(const std::string& path, bool useMapping, uint32_t sections) {
     // Close any previously opened file
     close();
+    requestedSections = sections;
 
-    // Open file
-    file.open(filePath, std::ios::binary);
-    if (!file.is_open()) {
+    // Open file, mapping it when asked and falling back to the stream reader
+    if (!(useMapping && reader.openMapped(path)) && !reader.open(path)) {
         return false;
     }
+    filePath = path;
 
     // Check if file is an MKV by looking at the first 4 bytes
-    char header[4];
-    file.read(header, 4);
-    file.seekg(0, std::ios::beg); // Reset position
-
-    std::cout << "File header bytes: ";
-    for (int i = 0; i < 4; i++) {
-        std::cout << std::hex << (int)(unsigned char)header[i] << " ";
-    }
-    std::cout << std::dec << std::endl;
+    char header[4] = {};
+    reader.read(header, 4);
+    reader.seek(0); // Reset position
 
     // MKV files should start with EBML header (first byte 0x1A)
     if ((unsigned char)header[0] != 0x1A) {
-        std::cout << "Not an MKV file (invalid header)" << std::endl;
         return false;
     }
 
     // Get file size
-    file.seekg(0, std::ios::end);
-    fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+    fileSize = reader.size();
 
     // Parse EBML header and contents
-    return parseEBML();
+    auto parseStart = std::chrono::steady_clock::now();
+    bool ok = parseEBML();
+    parseStats.parseNanoseconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - parseStart).count());
+    parseStats.io = reader.getStats();
+
+    return ok;
 }
 
 void MkvMetadataExtractor::close() {
-    if (file.is_open()) {
-        file.close();
-    }
+    reader.close();
+    filePath.clear();
+    parseStats = MkvParseStats();
 
     // Clear all stored data
-    title.clear();
-    duration = 0.0;
-    timecodeScale = 1000000;
-    muxingApp.clear();
-    writingApp.clear();
+    segmentInfo = MkvSegmentInfo();
 
     videoStreams.clear();
     audioStreams.clear();
@@ -75,133 +381,850 @@ void MkvMetadataExtractor::close() {
     otherStreams.clear();
 
     attachments.clear();
+    cueIndex.clear();
+    editions.clear();
+    chapters.clear();
+    tags.clear();
+
+    // Every view handed out for this file dies here
+    strings.reset();
+
+    layout = MkvSegmentLayout();
+    requestedSections = MKV_SECTION_DEFAULT;
+    parsedSections = 0;
 }
 
 uint64_t MkvMetadataExtractor::getEstimatedBitrate() const {
-    if (duration <= 0.0 || fileSize == 0) {
+    if (segmentInfo.duration <= 0.0 || fileSize == 0) {
         return 0;
     }
 
     // Calculate bitrate in bits per second
-    return static_cast<uint64_t>((fileSize * 8.0) / (duration / 1000.0));
+    return static_cast<uint64_t>((fileSize * 8.0) / (segmentInfo.duration / 1000.0));
+}
+
+bool MkvMetadataExtractor::extractAttachment(size_t index, const std::string& outputPath,
+    FileCopyStats* stats) {
+    if (index >= attachments.size() || !reader.isOpen()) {
+        return false;
+    }
+
+    const MkvAttachment& attachment = attachments[index];
+    if (attachment.dataOffset > fileSize || attachment.dataSize > fileSize - attachment.dataOffset) {
+        return false;
+    }
+
+    // Large attachments go through the copy engine, which lets the kernel
+    // move the bytes instead of pulling them through the reader
+    if (attachment.dataSize >= CopyEngineThreshold) {
+        return copyFileSection(filePath, attachment.dataOffset, attachment.dataSize, outputPath, stats);
+    }
+
+    // Small ones are a single read and write, cheaper than opening the file
+    // a second time. Mapped files are written straight from the mapping.
+    auto start = std::chrono::steady_clock::now();
+    const size_t size = static_cast<size_t>(attachment.dataSize);
+    reader.seek(attachment.dataOffset);
+
+    bool ok = false;
+    std::string_view mappedData;
+    if (reader.isMapped() && reader.readView(size, mappedData)) {
+        ok = MkvAttachmentWriter::writeFile(outputPath,
+            reinterpret_cast<const uint8_t*>(mappedData.data()), size);
+    }
+    else {
+        std::vector<uint8_t> buffer(size);
+        size_t got = 0;
+        while (got < size) {
+            size_t bytesRead = reader.read(buffer.data() + got, size - got);
+            if (bytesRead == 0) {
+                break;
+            }
+            got += bytesRead;
+        }
+        ok = got == size && MkvAttachmentWriter::writeFile(outputPath, buffer.data(), size);
+    }
+
+    if (stats != nullptr) {
+        stats->bytes = ok ? attachment.dataSize : 0;
+        stats->method = FILE_COPY_BUFFERED;
+        stats->elapsedUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    return ok;
 }
 
-bool MkvMetadataExtractor::extractAttachment(size_t index, const std::string& outputPath) {
-    if (index >= attachments.size() || !file.is_open()) {
+bool MkvMetadataExtractor::readAttachment(size_t index, uint64_t offset, uint64_t length,
+    std::vector<uint8_t>& data) {
+    data.clear();
+    if (index >= attachments.size() || !reader.isOpen()) {
         return false;
     }
 
     const MkvAttachment& attachment = attachments[index];
+    if (offset >= attachment.dataSize) {
+        return true;
+    }
+    const uint64_t count = std::min(length, attachment.dataSize - offset);
+    const uint64_t start = attachment.dataOffset + offset;
+    if (start > fileSize || count > fileSize - start || count > SIZE_MAX) {
+        return false;
+    }
+    const size_t size = static_cast<size_t>(count);
 
-    // Use Boost.Nowide to open output file with UTF-8 path
-    FILE* outFile = boost::nowide::fopen(outputPath.c_str(), "wb");
+    reader.seek(start);
+    std::string_view mappedData;
+    if (reader.isMapped() && reader.readView(size, mappedData)) {
+        data.assign(mappedData.begin(), mappedData.end());
+        return true;
+    }
+
+    data.resize(size);
+    size_t got = 0;
+    while (got < size) {
+        size_t bytesRead = reader.read(data.data() + got, size - got);
+        if (bytesRead == 0) {
+            data.clear();
+            return false;
+        }
+        got += bytesRead;
+    }
+    return true;
+}
 
-    if (outFile == nullptr) {
+bool MkvMetadataExtractor::getFonts(std::vector<MkvFontInfo>& fonts, uint64_t* bytesRead) {
+    fonts.clear();
+    if (bytesRead != nullptr) {
+        *bytesRead = 0;
+    }
+    if (!reader.isOpen()) {
         return false;
     }
 
-    // Seek to attachment data in MKV file
-    file.seekg(attachment.dataOffset, std::ios::beg);
+    // In file order, so the reads only ever move forward
+    std::vector<size_t> order(attachments.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return attachments[a].dataOffset < attachments[b].dataOffset;
+    });
+
+    for (size_t index : order) {
+        AttachmentFontSource source(*this, index);
+        std::vector<SfntFace> faces;
+        if (readSfntFaces(source, attachments[index].dataSize, faces)) {
+            for (SfntFace& face : faces) {
+                MkvFontInfo font;
+                font.attachmentIndex = index;
+                font.face = std::move(face);
+                fonts.push_back(std::move(font));
+            }
+        }
+        if (bytesRead != nullptr) {
+            *bytesRead += source.getBytesRead();
+        }
+    }
+    return true;
+}
+
+bool MkvAttachmentFilter::matches(const MkvAttachment& attachment) const {
+    if (mimeTypes.empty() && extensions.empty()) {
+        return true;
+    }
+    for (const std::string& mimeType : mimeTypes) {
+        if (attachment.mimeType.size() >= mimeType.size() &&
+            equalsNoCase(attachment.mimeType.substr(0, mimeType.size()), mimeType)) {
+            return true;
+        }
+    }
+    for (const std::string& extension : extensions) {
+        if (attachment.fileName.size() >= extension.size() &&
+            equalsNoCase(attachment.fileName.substr(attachment.fileName.size() - extension.size()), extension)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MkvMetadataExtractor::extractAllAttachments(const std::string& outputDir,
+    const MkvAttachmentFilter& filter, std::vector<MkvExtractedFile>& manifest,
+    MkvBulkExtractStats* stats) {
+    manifest.clear();
+    if (!reader.isOpen() || outputDir.empty()) {
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::u8path(outputDir), error);
+    if (error) {
+        return false;
+    }
+
+    // Selected attachments in file order, so the whole set is one forward sweep
+    std::vector<size_t> order;
+    for (size_t i = 0; i < attachments.size(); i++) {
+        if (filter.matches(attachments[i])) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return attachments[a].dataOffset < attachments[b].dataOffset;
+    });
+
+    std::string base = outputDir;
+    if (base.back() != '/' && base.back() != '\\') {
+        base.push_back('/');
+    }
+    std::unordered_set<std::string> usedNames;
+    manifest.reserve(order.size());
+    for (size_t index : order) {
+        MkvExtractedFile file;
+        file.index = index;
+        file.path = base + uniqueFileName(safeFileName(attachments[index].fileName, index), usedNames);
+        file.size = attachments[index].dataSize;
+        manifest.push_back(std::move(file));
+    }
+
+    const size_t noTicket = static_cast<size_t>(-1);
+    std::vector<size_t> tickets(manifest.size(), noTicket);
+    uint64_t readsBefore = reader.getStats().streamReads;
+
+    MkvAttachmentWriter writer;
+    size_t next = 0;
+    while (next < manifest.size()) {
+        const MkvAttachment& first = attachments[manifest[next].index];
+
+        // Mapped files are written straight from the mapping
+        if (reader.isMapped()) {
+            std::string_view data;
+            reader.seek(first.dataOffset);
+            if (first.dataSize <= SIZE_MAX && reader.readView(static_cast<size_t>(first.dataSize), data)) {
+                tickets[next] = writer.write(manifest[next].path,
+                    reinterpret_cast<const uint8_t*>(data.data()), data.size(), nullptr);
+            }
+            next++;
+            continue;
+        }
+
+        // Fonts sit back to back, separated only by their element headers,
+        // so a run of them comes in with a single read
+        uint64_t runStart = first.dataOffset;
+        uint64_t runEnd = first.dataOffset + first.dataSize;
+        size_t end = next + 1;
+        while (end < manifest.size()) {
+            const MkvAttachment& attachment = attachments[manifest[end].index];
+            uint64_t attachmentEnd = std::max(runEnd, attachment.dataOffset + attachment.dataSize);
+            if (attachment.dataOffset > runEnd + BulkMaxGap || attachmentEnd - runStart > BulkReadSize) {
+                break;
+            }
+            runEnd = attachmentEnd;
+            end++;
+        }
+
+        if (runEnd > fileSize) {
+            runEnd = fileSize;
+        }
+        if (runEnd <= runStart) {
+            next = end;
+            continue;
+        }
+
+        // A single attachment larger than a bulk read is not buffered at all,
+        // extractAttachment hands it to the copy engine
+        if (runEnd - runStart > BulkReadSize) {
+            manifest[next].written = extractAttachment(manifest[next].index, manifest[next].path);
+            next++;
+            continue;
+        }
 
-    // Read and write in chunks
-    const size_t bufferSize = 4096;
-    char buffer[bufferSize];
-    uint64_t remainingSize = attachment.dataSize;
+        auto buffer = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(runEnd - runStart));
+        reader.seek(runStart);
+        size_t got = 0;
+        while (got < buffer->size()) {
+            size_t bytesRead = reader.read(buffer->data() + got, buffer->size() - got);
+            if (bytesRead == 0) {
+                break;
+            }
+            got += bytesRead;
+        }
+        for (size_t k = next; k < end; k++) {
+            const MkvAttachment& attachment = attachments[manifest[k].index];
+            if (attachment.dataOffset + attachment.dataSize <= runStart + got) {
+                tickets[k] = writer.write(manifest[k].path, buffer->data() + (attachment.dataOffset - runStart),
+                    static_cast<size_t>(attachment.dataSize), buffer);
+            }
+        }
+        next = end;
+    }
+    writer.finish();
+
+    MkvBulkExtractStats result;
+    for (size_t k = 0; k < manifest.size(); k++) {
+        if (tickets[k] != noTicket) {
+            manifest[k].written = writer.succeeded(tickets[k]);
+        }
+        if (manifest[k].written) {
+            result.files++;
+            result.bytes += manifest[k].size;
+        }
+    }
+    result.streamReads = reader.getStats().streamReads - readsBefore;
+    result.elapsedUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    if (stats != nullptr) {
+        *stats = result;
+    }
+    return true;
+}
+
+bool MkvMetadataExtractor::parseEBML() {
+    // Read EBML ID
+    uint32_t id = readID();
+    if (id != MkvIds::EBML) {
+        return false;
+    }
+
+    // Read EBML size
+    uint64_t size = readSize();
+    uint64_t endPos = reader.tell() + size;
+
+    // Skip EBML content (not needed for metadata extraction)
+    if (endPos > fileSize) {
+        reader.seek(0); // Reset position
+        return false;
+    }
+    reader.seek(endPos);
+
+    // IMPORTANT CHANGE: Continue reading until end of file, not endPos
+    // Look for the Segment element after the EBML header
+    while (!reader.eof()) {
+        id = readID();
+        if (reader.eof()) break;  // Check if we reached end of file
+
+        size = readSize();
+        if (id == MkvIds::Segment) {
+            return parseSegment(size);
+        }
+        else {
+            skipBytes(size);
+        }
+    }
+
+    // No Segment element found
+    return false;
+}
+
+bool MkvMetadataExtractor::parseSegment(uint64_t size) {
+    // Unknown-size Segments (live recordings, OBS remuxes) run to the end of
+    // the file. A zero size used to be our marker for that, keep honouring it.
+    uint64_t endPos = (size == 0) ? fileSize : endOfElement(size);
+
+    layout.dataStart = reader.tell();
+    layout.end = endPos;
+
+    // Prefer jumping straight to the elements listed in the SeekHead(s)
+    if (parseSeekHeads() && layout.info != 0 && layout.tracks != 0) {
+        parseStats.strategy = PARSE_STRATEGY_SEEKHEAD;
+        parseKnownSections(requestedSections);
+
+        if ((parsedSections & requestedSections) == requestedSections) {
+            return true;
+        }
+    }
+
+    // No usable SeekHead, or it didn't cover everything: walk the top-level
+    // elements, parsing only the sections that are still missing
+    parseStats.strategy = PARSE_STRATEGY_LINEAR;
+    walkSegment();
+    return true;
+}
+
+void MkvMetadataExtractor::parseKnownSections(uint32_t sections) {
+    // Visit the targets in file order so the reader only moves forward
+    std::vector<std::pair<uint64_t, uint32_t>> targets;
+    if ((sections & MKV_SECTION_INFO) && layout.info != 0) {
+        targets.push_back(std::make_pair(layout.info, MkvIds::SegmentInfo));
+    }
+    if ((sections & MKV_SECTION_TRACKS) && layout.tracks != 0) {
+        targets.push_back(std::make_pair(layout.tracks, MkvIds::Tracks));
+    }
+    if ((sections & MKV_SECTION_ATTACHMENTS) && layout.attachments != 0) {
+        targets.push_back(std::make_pair(layout.attachments, MkvIds::Attachments));
+    }
+    if ((sections & MKV_SECTION_CUES) && layout.cues != 0) {
+        targets.push_back(std::make_pair(layout.cues, MkvIds::Cues));
+    }
+    if ((sections & MKV_SECTION_CHAPTERS) && layout.chapters != 0) {
+        targets.push_back(std::make_pair(layout.chapters, MkvIds::Chapters));
+    }
+    if ((sections & MKV_SECTION_TAGS) && layout.tags != 0) {
+        targets.push_back(std::make_pair(layout.tags, MkvIds::Tags));
+    }
+    std::sort(targets.begin(), targets.end());
+
+    for (const auto& target : targets) {
+        parseLevel1At(target.first, target.second);
+    }
+}
+
+void MkvMetadataExtractor::walkSegment() {
+    // The SeekHead may have left something out or pointed at the wrong place.
+    // Forget those entries so the walk records where the elements really
+    // are; the positions of sections nobody asked for are kept.
+    uint32_t missing = requestedSections & ~parsedSections;
+    if (missing & MKV_SECTION_INFO) layout.info = 0;
+    if (missing & MKV_SECTION_TRACKS) layout.tracks = 0;
+    if (missing & MKV_SECTION_ATTACHMENTS) layout.attachments = 0;
+    if (missing & MKV_SECTION_CUES) layout.cues = 0;
+    if (missing & MKV_SECTION_CHAPTERS) layout.chapters = 0;
+    if (missing & MKV_SECTION_TAGS) layout.tags = 0;
+
+    reader.seek(layout.dataStart);
+
+    while (reader.tell() < layout.end && !reader.eof()) {
+        uint64_t elementPos = reader.tell();
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
+
+        recordLevel1(id, elementPos);
+
+        // An unknown-size Cluster (or garbage) can't be skipped, scan for the
+        // next top-level element instead
+        if (id == 0 || elementSize == MKV_UNKNOWN_SIZE) {
+            if (!resyncToLevel1(elementPos + 1, layout.end)) {
+                break;
+            }
+            continue;
+        }
+
+        parseLevel1(id, elementSize);
+
+        // Stop as soon as everything the caller asked for has been filled
+        if ((parsedSections & requestedSections) == requestedSections) {
+            break;
+        }
+    }
+}
+
+bool MkvMetadataExtractor::addSections(uint32_t sections) {
+    if (!reader.isOpen()) {
+        return false;
+    }
+
+    // Sections asked for before were parsed then, or the file has none
+    uint32_t missing = sections & ~requestedSections;
+    if (missing == 0) {
+        return true;
+    }
+    requestedSections |= missing;
+
+    // Counted with the parse of open(), leaving out reads made in between
+    MkvReadStats before = reader.getStats();
+    auto parseStart = std::chrono::steady_clock::now();
+    parseKnownSections(missing);
+    if ((parsedSections & missing) != missing) {
+        walkSegment();
+    }
+    parseStats.parseNanoseconds += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - parseStart).count());
+
+    const MkvReadStats& after = reader.getStats();
+    parseStats.io.streamReads += after.streamReads - before.streamReads;
+    parseStats.io.streamSeeks += after.streamSeeks - before.streamSeeks;
+    parseStats.io.bytesRead += after.bytesRead - before.bytesRead;
+    parseStats.io.windowSeeks += after.windowSeeks - before.windowSeeks;
+    return true;
+}
+
+bool MkvMetadataExtractor::parseLevel1(uint32_t id, uint64_t size) {
+    // Each section is parsed once, the first copy wins
+    uint32_t wanted = requestedSections & ~parsedSections;
+
+    switch (id) {
+    case MkvIds::SegmentInfo:
+        if (wanted & MKV_SECTION_INFO) {
+            parsedSections |= MKV_SECTION_INFO;
+            return parseSegmentInfo(size);
+        }
+        break;
+
+    case MkvIds::Tracks:
+        if (wanted & MKV_SECTION_TRACKS) {
+            parsedSections |= MKV_SECTION_TRACKS;
+            return parseTracks(size);
+        }
+        break;
+
+    case MkvIds::Attachments:
+        if (wanted & MKV_SECTION_ATTACHMENTS) {
+            parsedSections |= MKV_SECTION_ATTACHMENTS;
+            return parseAttachments(size);
+        }
+        break;
+
+    case MkvIds::Cues:
+        if (wanted & MKV_SECTION_CUES) {
+            parsedSections |= MKV_SECTION_CUES;
+            return parseCues(size);
+        }
+        break;
+
+    case MkvIds::Chapters:
+        if (wanted & MKV_SECTION_CHAPTERS) {
+            parsedSections |= MKV_SECTION_CHAPTERS;
+            return parseChapters(size);
+        }
+        break;
+
+    case MkvIds::Tags:
+        if (wanted & MKV_SECTION_TAGS) {
+            parsedSections |= MKV_SECTION_TAGS;
+            return parseTags(size);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    // Skip unneeded elements
+    skipBytes(size);
+    return true;
+}
+
+bool MkvMetadataExtractor::resyncToLevel1(uint64_t from, uint64_t limit) {
+    parseStats.resyncs++;
+    reader.seek(from);
+
+    uint32_t candidate = 0;
+    while (reader.scanLevel1(limit, candidate)) {
+        uint64_t pos = reader.tell();
+        readID();
+        uint64_t size = readSize();
+
+        // Payload bytes can look like an ID, check that the header makes sense
+        bool plausible = !reader.eof() && reader.tell() <= limit &&
+            (size == MKV_UNKNOWN_SIZE || size <= limit - reader.tell());
+        if (plausible && candidate == MkvIds::Cluster) {
+            uint32_t childId = readID();
+            plausible = (childId == MkvIds::Timestamp || childId == MkvIds::CRC32);
+        }
+
+        if (plausible) {
+            reader.seek(pos);
+            return true;
+        }
+        reader.seek(pos + 1);
+    }
+
+    return false;
+}
+
+uint64_t MkvMetadataExtractor::endOfElement(uint64_t size) {
+    uint64_t pos = reader.tell();
+    if (size == MKV_UNKNOWN_SIZE || size > fileSize - std::min(pos, fileSize)) {
+        return fileSize;
+    }
+    return pos + size;
+}
+
+bool MkvMetadataExtractor::parseLevel1At(uint64_t pos, uint32_t expectedId) {
+    if (pos >= layout.end) {
+        return false;
+    }
+
+    reader.seek(pos);
+    uint32_t id = readID();
+    uint64_t size = readSize();
+
+    // A stale SeekHead entry; don't trust whatever is there
+    if (id != expectedId || reader.eof()) {
+        return false;
+    }
+
+    return parseLevel1(id, size);
+}
+
+void MkvMetadataExtractor::recordLevel1(uint32_t id, uint64_t pos) {
+    switch (id) {
+    case MkvIds::SegmentInfo:
+        if (layout.info == 0) layout.info = pos;
+        break;
+    case MkvIds::Tracks:
+        if (layout.tracks == 0) layout.tracks = pos;
+        break;
+    case MkvIds::Attachments:
+        if (layout.attachments == 0) layout.attachments = pos;
+        break;
+    case MkvIds::Cues:
+        if (layout.cues == 0) layout.cues = pos;
+        break;
+    case MkvIds::Chapters:
+        if (layout.chapters == 0) layout.chapters = pos;
+        break;
+    case MkvIds::Tags:
+        if (layout.tags == 0) layout.tags = pos;
+        break;
+    case MkvIds::Cluster:
+        if (layout.firstCluster == 0) layout.firstCluster = pos;
+        break;
+    default:
+        break;
+    }
+}
+
+bool MkvMetadataExtractor::parseSeekHeads() {
+    reader.seek(layout.dataStart);
+
+    // The SeekHead is normally the first child, possibly after a Void or CRC
+    uint64_t seekHeadPos = 0;
+    uint64_t seekHeadSize = 0;
+    while (reader.tell() < layout.end && !reader.eof()) {
+        uint64_t elementPos = reader.tell();
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
+
+        if (id == MkvIds::SeekHead) {
+            seekHeadPos = elementPos;
+            seekHeadSize = elementSize;
+            break;
+        }
+        if (id != MkvIds::Void && id != MkvIds::CRC32) {
+            return false;
+        }
+        skipBytes(elementSize);
+    }
+
+    if (seekHeadPos == 0) {
+        return false;
+    }
+
+    uint64_t nextSeekHead = 0;
+    parseSeekHead(seekHeadSize, nextSeekHead);
+
+    // mkvmerge may put a second SeekHead at the end (usually for Cues/Tags)
+    if (nextSeekHead != 0 && nextSeekHead != seekHeadPos && nextSeekHead < layout.end) {
+        reader.seek(nextSeekHead);
+        if (readID() == MkvIds::SeekHead) {
+            uint64_t ignored = 0;
+            parseSeekHead(readSize(), ignored);
+        }
+    }
+
+    return true;
+}
+
+bool MkvMetadataExtractor::parseSeekHead(uint64_t size, uint64_t& nextSeekHead) {
+    uint64_t endPos = endOfElement(size);
+
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
+
+        if (id != MkvIds::Seek) {
+            skipBytes(elementSize);
+            continue;
+        }
+
+        uint64_t seekEnd = reader.tell() + elementSize;
+        uint32_t seekId = 0;
+        uint64_t seekPosition = 0;
+        bool hasPosition = false;
+
+        while (reader.tell() < seekEnd && !reader.eof()) {
+            uint32_t childId = readID();
+            uint64_t childSize = readSize();
+
+            switch (childId) {
+            case MkvIds::SeekID:
+                // The payload is the raw element ID bytes
+                seekId = static_cast<uint32_t>(readUnsignedInt(childSize));
+                break;
+
+            case MkvIds::SeekPosition:
+                seekPosition = readUnsignedInt(childSize);
+                hasPosition = true;
+                break;
+
+            default:
+                skipBytes(childSize);
+                break;
+            }
+        }
+
+        if (!hasPosition) {
+            continue;
+        }
+
+        // Positions are relative to the start of the Segment data
+        uint64_t absolute = layout.dataStart + seekPosition;
+        if (seekId == MkvIds::SeekHead) {
+            nextSeekHead = absolute;
+        }
+        else {
+            recordLevel1(seekId, absolute);
+        }
+    }
+
+    return true;
+}
+
+bool MkvMetadataExtractor::parseSegmentInfo(uint64_t size) {
+    parseFields(size, segmentInfoSchema, segmentInfo);
+
+    // Duration is a float in TimecodeScale units, which may come after it
+    segmentInfo.duration = segmentInfo.duration * segmentInfo.timecodeScale / 1000000.0;
+    return true;
+}
+
+bool MkvMetadataExtractor::parseTracks(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
+
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
+
+        if (id == MkvIds::TrackEntry) {
+            MkvStream stream;
+            parseTrackEntry(elementSize, stream);
+            addStream(stream);
+        }
+        else {
+            // Skip unneeded elements
+            skipBytes(elementSize);
+        }
+    }
+
+    return true;
+}
+
+bool MkvMetadataExtractor::parseTrackEntry(uint64_t size, MkvStream& stream) {
+    parseFields(size, trackEntrySchema, stream);
+
+    // Derive the frame rate from the default duration (in nanoseconds) unless
+    // the deprecated FrameRate element gave one
+    if (stream.frameRate == 0 && stream.defaultDuration > 0) {
+        stream.frameRate = 1000000000.0 / stream.defaultDuration;
+    }
+    return true;
+}
+
+template <typename Target>
+bool MkvMetadataExtractor::parseFields(uint64_t size, const MkvSchema<Target>& schema, Target& target) {
+    uint64_t endPos = endOfElement(size);
+
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
+
+        const MkvField<Target>* field = schema.find(id);
+        if (!field) {
+            // Skip unneeded elements
+            skipBytes(elementSize);
+            continue;
+        }
+        parseField(*field, elementSize, target);
+    }
 
-    while (remainingSize > 0 && file.good()) {
-        size_t bytesToRead = (remainingSize > bufferSize) ? bufferSize : static_cast<size_t>(remainingSize);
-        file.read(buffer, bytesToRead);
+    return true;
+}
 
-        size_t bytesRead = file.gcount();
-        fwrite(buffer, 1, bytesRead, outFile);
+template <typename Target>
+void MkvMetadataExtractor::parseField(const MkvField<Target>& field, uint64_t size, Target& target) {
+    switch (field.type) {
+    case MKV_FIELD_UINT:
+        target.*(field.uintMember) = readUnsignedInt(size);
+        break;
 
-        remainingSize -= bytesRead;
-    }
+    case MKV_FIELD_UINT8:
+        target.*(field.uint8Member) = static_cast<uint8_t>(readUnsignedInt(size));
+        break;
 
-    fclose(outFile);
-    return (remainingSize == 0);
-}
+    case MKV_FIELD_FLOAT:
+        target.*(field.floatMember) = readFloat(size);
+        break;
 
+    case MKV_FIELD_STRING:
+        target.*(field.stringMember) = storeString(readStringView(size), false);
+        break;
 
-bool MkvMetadataExtractor::parseEBML() {
-    // Read EBML ID
-    uint32_t id = readID();
-    std::cout << "EBML ID: 0x" << std::hex << id << std::dec << std::endl;
+    case MKV_FIELD_ATOM:
+        target.*(field.stringMember) = storeString(readStringView(size), true);
+        break;
 
-    if (id != MkvIds::EBML) {
-        std::cout << "Invalid EBML ID, expected: 0x" << std::hex << MkvIds::EBML << std::dec << std::endl;
-        return false;
+    case MKV_FIELD_HEX32:
+    {
+        uint64_t value = readUnsignedInt(size);
+        char hexStr[9];
+        snprintf(hexStr, sizeof(hexStr), "%08X", static_cast<unsigned int>(value));
+        target.*(field.stringMember) = storeString(hexStr, true);
     }
+    break;
 
-    // Read EBML size
-    uint64_t size = readSize();
-    std::cout << "EBML size: " << size << std::endl;
-
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
-    std::cout << "End position: " << endPos << std::endl;
+    case MKV_FIELD_DATA:
+        // Only remember where it is, readers fetch it on demand
+        target.*(field.uintMember) = reader.tell();
+        target.*(field.sizeMember) = size;
+        skipBytes(size);
+        break;
 
-    // Skip EBML content (not needed for metadata extraction)
-    file.seekg(endPos, std::ios::beg);
-    if (file.fail()) {
-        std::cout << "Failed to seek to end of EBML header" << std::endl;
-        file.clear(); // Clear error flags
-        file.seekg(0, std::ios::beg); // Reset position
-        return false;
+    case MKV_FIELD_MASTER:
+        parseFields(size, *field.children, target);
+        break;
     }
+}
 
-    // IMPORTANT CHANGE: Continue reading until end of file, not endPos
-    // Look for the Segment element after the EBML header
-    while (!file.eof()) {
-        id = readID();
-        if (file.eof() || file.fail()) break;  // Check if we reached end of file
+bool MkvMetadataExtractor::parseCues(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
 
-        std::cout << "Next element ID: 0x" << std::hex << id << std::dec << std::endl;
+    // A CuePoint takes roughly 16 bytes on disk
+    cueIndex.reserve(static_cast<size_t>((endPos - reader.tell()) / 16));
 
-        size = readSize();
-        std::cout << "Element size: " << size << std::endl;
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
 
-        if (id == MkvIds::Segment) {
-            std::cout << "Found Segment element, parsing..." << std::endl;
-            return parseSegment(size);
+        if (id == MkvIds::CuePoint) {
+            parseCuePoint(elementSize);
         }
         else {
-            std::cout << "Skipping unknown element" << std::endl;
-            skipBytes(size);
+            // Skip unneeded elements
+            skipBytes(elementSize);
         }
     }
 
-    std::cout << "No Segment element found" << std::endl;
-    return false;
+    cueIndex.finalize();
+    return true;
 }
 
-bool MkvMetadataExtractor::parseSegment(uint64_t size) {
-    uint64_t endPos = 0;
+bool MkvMetadataExtractor::parseCuePoint(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
 
-    // Handle unknown size (size == 0 means unknown)
-    if (size == 0) {
-        endPos = fileSize;
-    }
-    else {
-        endPos = file.tellg() + static_cast<std::streampos>(size);
-    }
+    // CueTime may come after the positions, so patch it in at the end
+    size_t first = cueIndex.size();
+    uint64_t time = 0;
 
-    // Parse segment content
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
         switch (id) {
-        case MkvIds::SegmentInfo:
-            parseSegmentInfo(elementSize);
-            break;
-
-        case MkvIds::Tracks:
-            parseTracks(elementSize);
+        case MkvIds::CueTime:
+            time = readUnsignedInt(elementSize);
             break;
 
-        case MkvIds::Attachments:
-            parseAttachments(elementSize);
-            break;
+        case MkvIds::CueTrackPositions:
+        {
+            MkvCuePoint point;
+            parseCueTrackPositions(elementSize, point);
+            if (point.track != 0) {
+                cueIndex.add(point);
+            }
+        }
+        break;
 
         default:
             // Skip unneeded elements
@@ -210,42 +1233,30 @@ bool MkvMetadataExtractor::parseSegment(uint64_t size) {
         }
     }
 
+    cueIndex.setTime(first, time);
+
     return true;
 }
 
-bool MkvMetadataExtractor::parseSegmentInfo(uint64_t size) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+bool MkvMetadataExtractor::parseCueTrackPositions(uint64_t size, MkvCuePoint& point) {
+    uint64_t endPos = endOfElement(size);
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
         switch (id) {
-        case MkvIds::TimecodeScale:
-            timecodeScale = readUnsignedInt(elementSize);
-            break;
-
-        case MkvIds::Duration:
-            if (elementSize == 4) {
-                duration = readFloat(elementSize);
-            }
-            else if (elementSize == 8) {
-                duration = readFloat(elementSize);
-            }
-            // Convert to milliseconds using timecode scale
-            duration = duration * timecodeScale / 1000000.0;
-            break;
-
-        case MkvIds::Title:
-            title = readUTF8(elementSize);
+        case MkvIds::CueTrack:
+            point.track = static_cast<uint32_t>(readUnsignedInt(elementSize));
             break;
 
-        case MkvIds::MuxingApp:
-            muxingApp = readUTF8(elementSize);
+        case MkvIds::CueClusterPosition:
+            // Stored relative to the start of the Segment data
+            point.clusterPosition = layout.dataStart + readUnsignedInt(elementSize);
             break;
 
-        case MkvIds::WritingApp:
-            writingApp = readUTF8(elementSize);
+        case MkvIds::CueRelativePosition:
+            point.relativePosition = static_cast<uint32_t>(readUnsignedInt(elementSize));
             break;
 
         default:
@@ -258,209 +1269,205 @@ bool MkvMetadataExtractor::parseSegmentInfo(uint64_t size) {
     return true;
 }
 
-bool MkvMetadataExtractor::parseTracks(uint64_t size) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
-
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
-        uint32_t id = readID();
-        uint64_t elementSize = readSize();
-
-        if (id == MkvIds::TrackEntry) {
-            MkvStream stream;
-            parseTrackEntry(elementSize, stream);
-            addStream(stream);
-        }
-        else {
-            // Skip unneeded elements
-            skipBytes(elementSize);
+bool MkvMetadataExtractor::findCue(uint64_t track, double timeMs, MkvCuePoint& result) const {
+    if (track == 0) {
+        if (videoStreams.empty()) {
+            return false;
         }
+        track = videoStreams.front().trackNumber;
     }
 
-    return true;
+    if (timeMs < 0.0 || segmentInfo.timecodeScale == 0) {
+        return false;
+    }
+
+    // Cue times are in TimecodeScale units (nanoseconds per tick)
+    uint64_t ticks = static_cast<uint64_t>(timeMs * 1000000.0 / segmentInfo.timecodeScale);
+    return cueIndex.findAtOrBefore(static_cast<uint32_t>(track), ticks, result);
 }
 
-bool MkvMetadataExtractor::parseTrackEntry(uint64_t size, MkvStream& stream) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+void MkvCueIndex::finalize() {
+    auto byTrackThenTime = [](const MkvCuePoint& a, const MkvCuePoint& b) {
+        return a.track != b.track ? a.track < b.track : a.time < b.time;
+    };
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
-        uint32_t id = readID();
-        uint64_t elementSize = readSize();
+    if (!std::is_sorted(points.begin(), points.end(), byTrackThenTime)) {
+        std::sort(points.begin(), points.end(), byTrackThenTime);
+    }
+    points.shrink_to_fit();
+}
 
-        switch (id) {
-        case MkvIds::TrackNumber:
-            stream.trackNumber = readUnsignedInt(elementSize);
-            break;
+bool MkvCueIndex::findAtOrBefore(uint32_t track, uint64_t time, MkvCuePoint& result) const {
+    // First point that is past (track, time)
+    auto it = std::upper_bound(points.begin(), points.end(), std::make_pair(track, time),
+        [](const std::pair<uint32_t, uint64_t>& key, const MkvCuePoint& point) {
+            return key.first != point.track ? key.first < point.track : key.second < point.time;
+        });
 
-        case MkvIds::TrackUID:
-            stream.trackUID = readUnsignedInt(elementSize);
-            break;
+    if (it == points.begin()) {
+        return false;
+    }
 
-        case MkvIds::TrackType:
-            stream.trackType = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
+    --it;
+    if (it->track != track) {
+        return false;
+    }
 
-        case MkvIds::Name:
-            stream.name = readUTF8(elementSize);
-            break;
+    result = *it;
+    return true;
+}
 
-        case MkvIds::Language:
-            stream.language = readString(elementSize);
-            break;
+bool MkvMetadataExtractor::parseAttachments(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
 
-        case MkvIds::CodecID:
-            stream.codecID = readString(elementSize);
-            break;
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
 
-        case MkvIds::CodecName:
-            stream.codecName = readUTF8(elementSize);
-            break;
+        if (id == MkvIds::AttachedFile) {
+            MkvAttachment attachment;
+            parseAttachedFile(elementSize, attachment);
+            attachments.push_back(attachment);
+        }
+        else {
+            // Skip unneeded elements
+            skipBytes(elementSize);
+        }
+    }
 
-        case MkvIds::DefaultDuration:
-            stream.defaultDuration = readUnsignedInt(elementSize);
-            if (stream.defaultDuration > 0) {
-                // Calculate frame rate from default duration (in nanoseconds)
-                stream.frameRate = 1000000000.0 / stream.defaultDuration;
-            }
-            break;
+    return true;
+}
 
-        case MkvIds::Video:
-            parseVideo(elementSize, stream);
-            break;
+bool MkvMetadataExtractor::parseAttachedFile(uint64_t size, MkvAttachment& attachment) {
+    return parseFields(size, attachedFileSchema, attachment);
+}
 
-        case MkvIds::Audio:
-            parseAudio(elementSize, stream);
-            break;
+bool MkvMetadataExtractor::parseChapters(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
 
-        case MkvIds::CodecPrivate:
-            // Skip codec private data for now
-            skipBytes(elementSize);
-            break;
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
 
-        default:
+        if (id == MkvIds::EditionEntry) {
+            parseEditionEntry(elementSize);
+        }
+        else {
             // Skip unneeded elements
             skipBytes(elementSize);
-            break;
         }
     }
 
     return true;
 }
 
-bool MkvMetadataExtractor::parseVideo(uint64_t size, MkvStream& stream) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+bool MkvMetadataExtractor::parseEditionEntry(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
+    editions.push_back(MkvEdition());
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
-        switch (id) {
-        case MkvIds::PixelWidth:
-            stream.pixelWidth = readUnsignedInt(elementSize);
-            break;
+        if (id == MkvIds::ChapterAtom) {
+            parseChapterAtom(elementSize, 0);
+        }
+        else if (const MkvField<MkvEdition>* field = editionSchema.find(id)) {
+            parseField(*field, elementSize, editions.back());
+        }
+        else {
+            // Skip unneeded elements
+            skipBytes(elementSize);
+        }
+    }
 
-        case MkvIds::PixelHeight:
-            stream.pixelHeight = readUnsignedInt(elementSize);
-            break;
+    return true;
+}
 
-        case MkvIds::DisplayWidth:
-            stream.displayWidth = readUnsignedInt(elementSize);
-            break;
+bool MkvMetadataExtractor::parseChapterAtom(uint64_t size, uint32_t depth) {
+    if (depth >= MaxNestingDepth) {
+        skipBytes(size);
+        return false;
+    }
+    uint64_t endPos = endOfElement(size);
 
-        case MkvIds::DisplayHeight:
-            stream.displayHeight = readUnsignedInt(elementSize);
-            break;
+    // Take the slot now so the chapter precedes the ones nested in it
+    size_t slot = chapters.size();
+    chapters.push_back(MkvChapter());
 
-        case MkvIds::DisplayUnit:
-            stream.displayUnit = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
+    MkvChapter chapter;
+    chapter.edition = static_cast<uint32_t>(editions.size() - 1);
+    chapter.depth = depth;
 
-        case MkvIds::FrameRate:
-            stream.frameRate = readFloat(elementSize);
-            break;
+    while (reader.tell() < endPos && !reader.eof()) {
+        uint32_t id = readID();
+        uint64_t elementSize = readSize();
 
-        case MkvIds::ColourSpace:
-        {
-            uint64_t value = readUnsignedInt(elementSize);
-            char hexStr[9];
-            snprintf(hexStr, sizeof(hexStr), "%08X", static_cast<unsigned int>(value));
-            stream.colorSpace = hexStr;
+        if (id == MkvIds::ChapterAtom) {
+            parseChapterAtom(elementSize, depth + 1);
         }
-        break;
-
-        case MkvIds::Colour:
-            parseColour(elementSize, stream);
-            break;
-
-        default:
+        else if (id == MkvIds::ChapterDisplay) {
+            // Only the first display (usually the main language) is kept
+            MkvChapter display;
+            parseFields(elementSize, chapterDisplaySchema, display);
+            if (chapter.title.empty()) {
+                chapter.title = display.title;
+                chapter.language = display.language;
+            }
+        }
+        else if (const MkvField<MkvChapter>* field = chapterAtomSchema.find(id)) {
+            parseField(*field, elementSize, chapter);
+        }
+        else {
             // Skip unneeded elements
             skipBytes(elementSize);
-            break;
         }
     }
 
+    chapters[slot] = chapter;
     return true;
 }
 
-bool MkvMetadataExtractor::parseAudio(uint64_t size, MkvStream& stream) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+bool MkvMetadataExtractor::parseTags(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
-        switch (id) {
-        case MkvIds::SamplingFrequency:
-            stream.samplingFrequency = readFloat(elementSize);
-            break;
-
-        case MkvIds::OutputSamplingFrequency:
-            stream.outputSamplingFrequency = readFloat(elementSize);
-            break;
-
-        case MkvIds::Channels:
-            stream.channels = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
-
-        case MkvIds::BitDepth:
-            stream.bitDepth = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
-
-        default:
+        if (id == MkvIds::Tag) {
+            parseTag(elementSize);
+        }
+        else {
             // Skip unneeded elements
             skipBytes(elementSize);
-            break;
         }
     }
 
     return true;
 }
 
-bool MkvMetadataExtractor::parseColour(uint64_t size, MkvStream& stream) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+bool MkvMetadataExtractor::parseTag(uint64_t size) {
+    uint64_t endPos = endOfElement(size);
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    // Targets normally comes first; SimpleTags met before it are patched below
+    MkvTag targets;
+    std::vector<uint64_t> trackUIDs;
+    size_t first = tags.size();
+    size_t beforeTargets = 0;
+
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
         switch (id) {
-        case MkvIds::MatrixCoefficients:
-            stream.matrixCoefficients = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
-
-        case MkvIds::BitsPerChannel:
-            stream.bitsPerChannel = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
-
-        case MkvIds::Range:
-            stream.colorRange = static_cast<uint8_t>(readUnsignedInt(elementSize));
-            break;
-
-        case MkvIds::TransferCharacteristics:
-            stream.transferCharacteristics = static_cast<uint8_t>(readUnsignedInt(elementSize));
+        case MkvIds::Targets:
+            beforeTargets = tags.size() - first;
+            parseTargets(elementSize, targets, trackUIDs);
             break;
 
-        case MkvIds::Primaries:
-            stream.colorPrimaries = static_cast<uint8_t>(readUnsignedInt(elementSize));
+        case MkvIds::SimpleTag:
+            parseSimpleTag(elementSize, targets, trackUIDs, 0);
             break;
 
         default:
@@ -470,20 +1477,35 @@ bool MkvMetadataExtractor::parseColour(uint64_t size, MkvStream& stream) {
         }
     }
 
+    // (those are not copied per track, they keep the first one)
+    for (size_t i = first; i < first + beforeTargets; i++) {
+        MkvTag& tag = tags[i];
+        tag.targetTypeValue = targets.targetTypeValue;
+        tag.targetType = targets.targetType;
+        tag.trackUID = trackUIDs.empty() ? 0 : trackUIDs.front();
+        tag.editionUID = targets.editionUID;
+        tag.chapterUID = targets.chapterUID;
+        tag.attachmentUID = targets.attachmentUID;
+    }
+
     return true;
 }
 
-bool MkvMetadataExtractor::parseAttachments(uint64_t size) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+bool MkvMetadataExtractor::parseTargets(uint64_t size, MkvTag& targets, std::vector<uint64_t>& trackUIDs) {
+    uint64_t endPos = endOfElement(size);
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
-        if (id == MkvIds::AttachedFile) {
-            MkvAttachment attachment;
-            parseAttachedFile(elementSize, attachment);
-            attachments.push_back(attachment);
+        if (id == MkvIds::TagTrackUID) {
+            uint64_t uid = readUnsignedInt(elementSize);
+            if (uid != 0) {
+                trackUIDs.push_back(uid);
+            }
+        }
+        else if (const MkvField<MkvTag>* field = targetsSchema.find(id)) {
+            parseField(*field, elementSize, targets);
         }
         else {
             // Skip unneeded elements
@@ -494,44 +1516,79 @@ bool MkvMetadataExtractor::parseAttachments(uint64_t size) {
     return true;
 }
 
-bool MkvMetadataExtractor::parseAttachedFile(uint64_t size, MkvAttachment& attachment) {
-    uint64_t endPos = file.tellg() + static_cast<std::streampos>(size);
+bool MkvMetadataExtractor::parseSimpleTag(uint64_t size, const MkvTag& targets,
+    const std::vector<uint64_t>& trackUIDs, uint32_t depth) {
+    if (depth >= MaxNestingDepth) {
+        skipBytes(size);
+        return false;
+    }
+    uint64_t endPos = endOfElement(size);
 
-    while (static_cast<uint64_t>(file.tellg()) < endPos && !file.eof()) {
+    // Nested SimpleTags go after their parent, so fill the parent's slots first
+    MkvTag tag = targets;
+    size_t first = tags.size();
+    size_t copies = std::max<size_t>(trackUIDs.size(), 1);
+    tags.resize(first + copies);
+
+    while (reader.tell() < endPos && !reader.eof()) {
         uint32_t id = readID();
         uint64_t elementSize = readSize();
 
-        switch (id) {
-        case MkvIds::FileUID:
-            attachment.uid = readUnsignedInt(elementSize);
-            break;
-
-        case MkvIds::FileName:
-            attachment.fileName = readUTF8(elementSize);
-            break;
-
-        case MkvIds::FileDescription:
-            attachment.description = readUTF8(elementSize);
-            break;
+        if (id == MkvIds::SimpleTag) {
+            parseSimpleTag(elementSize, targets, trackUIDs, depth + 1);
+        }
+        else if (const MkvField<MkvTag>* field = simpleTagSchema.find(id)) {
+            parseField(*field, elementSize, tag);
+        }
+        else {
+            // Skip unneeded elements, TagBinary included
+            skipBytes(elementSize);
+        }
+    }
 
-        case MkvIds::FileMimeType:
-            attachment.mimeType = readString(elementSize);
-            break;
+    for (size_t i = 0; i < copies; i++) {
+        tags[first + i] = tag;
+        tags[first + i].trackUID = trackUIDs.empty() ? 0 : trackUIDs[i];
+    }
+    return true;
+}
 
-        case MkvIds::FileData:
-            attachment.dataOffset = file.tellg();
-            attachment.dataSize = elementSize;
-            skipBytes(elementSize);
-            break;
+bool MkvMetadataExtractor::getStatisticsTags(uint64_t trackUID, MkvStatisticsTags& statistics) const {
+    statistics = MkvStatisticsTags();
+    if (trackUID == 0) {
+        return false;
+    }
 
-        default:
-            // Skip unneeded elements
-            skipBytes(elementSize);
-            break;
+    bool found = false;
+    for (const MkvTag& tag : tags) {
+        if (tag.trackUID != trackUID) {
+            continue;
+        }
+        if (isStatisticsTag(tag.name, "BPS")) {
+            found |= parseDecimal(tag.value, statistics.bitrate);
+        }
+        else if (isStatisticsTag(tag.name, "NUMBER_OF_FRAMES")) {
+            found |= parseDecimal(tag.value, statistics.frames);
+        }
+        else if (isStatisticsTag(tag.name, "NUMBER_OF_BYTES")) {
+            found |= parseDecimal(tag.value, statistics.bytes);
+        }
+        else if (isStatisticsTag(tag.name, "DURATION")) {
+            found |= parseTagDuration(tag.value, statistics.durationMs);
         }
     }
+    return found;
+}
 
-    return true;
+const MkvStream* MkvMetadataExtractor::findStream(uint64_t trackNumber) const {
+    for (const auto* streams : { &videoStreams, &audioStreams, &subtitleStreams, &otherStreams }) {
+        for (const auto& stream : *streams) {
+            if (stream.trackNumber == trackNumber) {
+                return &stream;
+            }
+        }
+    }
+    return nullptr;
 }
 
 void MkvMetadataExtractor::addStream(const MkvStream& stream) {
@@ -556,91 +1613,12 @@ void MkvMetadataExtractor::addStream(const MkvStream& stream) {
 
 // EBML helper functions
 uint32_t MkvMetadataExtractor::readID() {
-    uint8_t firstByte;
-    file.read(reinterpret_cast<char*>(&firstByte), 1);
-
-    if (firstByte & 0x80) {
-        return firstByte;
-    }
-    else if (firstByte & 0x40) {
-        uint8_t secondByte;
-        file.read(reinterpret_cast<char*>(&secondByte), 1);
-        return (static_cast<uint32_t>(firstByte) << 8) | secondByte;
-    }
-    else if (firstByte & 0x20) {
-        uint8_t bytes[3];
-        file.read(reinterpret_cast<char*>(&bytes[1]), 2);
-        bytes[0] = firstByte;
-        return (static_cast<uint32_t>(bytes[0]) << 16) |
-            (static_cast<uint32_t>(bytes[1]) << 8) |
-            bytes[2];
-    }
-    else if (firstByte & 0x10) {
-        uint8_t bytes[4];
-        file.read(reinterpret_cast<char*>(&bytes[1]), 3);
-        bytes[0] = firstByte;
-        return (static_cast<uint32_t>(bytes[0]) << 24) |
-            (static_cast<uint32_t>(bytes[1]) << 16) |
-            (static_cast<uint32_t>(bytes[2]) << 8) |
-            bytes[3];
-    }
-
-    return 0;
+    parseStats.elements++;
+    return reader.readElementId();
 }
 
 uint64_t MkvMetadataExtractor::readSize() {
-    uint8_t firstByte;
-    file.read(reinterpret_cast<char*>(&firstByte), 1);
-
-    int len = 0;
-    uint64_t value = 0;
-
-    // Determine length
-    if (firstByte & 0x80) {
-        len = 1;
-        value = firstByte & 0x7F;
-    }
-    else if (firstByte & 0x40) {
-        len = 2;
-        value = firstByte & 0x3F;
-    }
-    else if (firstByte & 0x20) {
-        len = 3;
-        value = firstByte & 0x1F;
-    }
-    else if (firstByte & 0x10) {
-        len = 4;
-        value = firstByte & 0x0F;
-    }
-    else if (firstByte & 0x08) {
-        len = 5;
-        value = firstByte & 0x07;
-    }
-    else if (firstByte & 0x04) {
-        len = 6;
-        value = firstByte & 0x03;
-    }
-    else if (firstByte & 0x02) {
-        len = 7;
-        value = firstByte & 0x01;
-    }
-    else if (firstByte & 0x01) {
-        len = 8;
-        value = 0;
-    }
-    else {
-        // Invalid size
-        return 0;
-    }
-
-    // Read remaining bytes
-    for (int i = 1; i < len; i++) {
-        uint8_t nextByte;
-        file.read(reinterpret_cast<char*>(&nextByte), 1);
-        value = (value << 8) | nextByte;
-    }
-
-    return value;
+    return reader.readElementSize();
 }
 
 uint64_t MkvMetadataExtractor::readUnsignedInt(uint64_t size) {
@@ -648,15 +1626,7 @@ uint64_t MkvMetadataExtractor::readUnsignedInt(uint64_t size) {
         skipBytes(size);
         return 0;
     }
-
-    uint64_t value = 0;
-    for (uint64_t i = 0; i < size; i++) {
-        uint8_t byte;
-        file.read(reinterpret_cast<char*>(&byte), 1);
-        value = (value << 8) | byte;
-    }
-
-    return value;
+    return reader.readUnsigned(size);
 }
 
 int64_t MkvMetadataExtractor::readSignedInt(uint64_t size) {
@@ -696,15 +1666,31 @@ double MkvMetadataExtractor::readFloat(uint64_t size) {
 }
 
 std::string MkvMetadataExtractor::readString(uint64_t size) {
-    std::string result;
-    result.resize(size);
+    return std::string(readStringView(size));
+}
+
+std::string_view MkvMetadataExtractor::readStringView(uint64_t size) {
+    std::string_view result;
+
+    // Never more than the file still holds, so a bogus size cannot make the
+    // copy below allocate gigabytes
+    uint64_t remaining = reader.size() - std::min(reader.tell(), reader.size());
+    size_t length = static_cast<size_t>(std::min({ size, remaining, MaxStringSize }));
 
-    file.read(&result[0], size);
+    // Borrow the bytes from the reader when possible, otherwise copy them out
+    if (!reader.readView(length, result)) {
+        stringScratch.resize(length);
+        stringScratch.resize(reader.read(&stringScratch[0], stringScratch.size()));
+        result = stringScratch;
+    }
+    if (length < size) {
+        skipBytes(size - length);
+    }
 
     // Remove any null terminators
     size_t nullPos = result.find('\0');
-    if (nullPos != std::string::npos) {
-        result.resize(nullPos);
+    if (nullPos != std::string_view::npos) {
+        result = result.substr(0, nullPos);
     }
 
     return result;
@@ -714,6 +1700,20 @@ std::string MkvMetadataExtractor::readUTF8(uint64_t size) {
     return readString(size);
 }
 
+std::string_view MkvMetadataExtractor::readUTF8View(uint64_t size) {
+    return readStringView(size);
+}
+
 void MkvMetadataExtractor::skipBytes(uint64_t size) {
-    file.seekg(size, std::ios::cur);
+    reader.seek(endOfElement(size));
+}
+
+std::string_view MkvMetadataExtractor::storeString(std::string_view value, bool shared) {
+    if (shared) {
+        std::string_view interned = mkvInternTable().intern(value);
+        if (!interned.empty()) {
+            return interned;
+        }
+    }
+    return strings.store(value);
 }
\ No newline at end of file
@@ -2,12 +2,18 @@
 #define MKV_METADATA_EXTRACTOR_H
 
 #include <string>
+#include <string_view>
 #include <boost/nowide/fstream.hpp>
 #include <vector>
 #include <map>
 #include <fstream>
 #include <memory>
 #include <cstdint>
+#include "file_copy.h"
+#include "mkv_block_reader.h"
+#include "mkv_schema.h"
+#include "mkv_string_pool.h"
+#include "sfnt_names.h"
 
 // EBML ID constants for Matroska elements
 namespace MkvIds {
@@ -24,6 +30,28 @@ namespace MkvIds {
     // Segment
     const uint32_t Segment = 0x18538067;
 
+    // Global
+    const uint32_t Void = 0xEC;
+    const uint32_t CRC32 = 0xBF;
+
+    // Meta Seek
+    const uint32_t SeekHead = 0x114D9B74;
+    const uint32_t Seek = 0x4DBB;
+    const uint32_t SeekID = 0x53AB;
+    const uint32_t SeekPosition = 0x53AC;
+
+    // Other top-level elements
+    const uint32_t Cluster = 0x1F43B675;
+    const uint32_t Timestamp = 0xE7;
+    const uint32_t SimpleBlock = 0xA3;
+    const uint32_t BlockGroup = 0xA0;
+    const uint32_t Block = 0xA1;
+    const uint32_t BlockDuration = 0x9B;
+    const uint32_t ReferenceBlock = 0xFB;
+    const uint32_t Cues = 0x1C53BB6B;
+    const uint32_t Chapters = 0x1043A770;
+    const uint32_t Tags = 0x1254C367;
+
     // Segment Info
     const uint32_t SegmentInfo = 0x1549A966;
     const uint32_t TimecodeScale = 0x2AD7B1;
@@ -70,6 +98,14 @@ namespace MkvIds {
     const uint32_t Channels = 0x9F;
     const uint32_t BitDepth = 0x6264;
 
+    // Cues
+    const uint32_t CuePoint = 0xBB;
+    const uint32_t CueTime = 0xB3;
+    const uint32_t CueTrackPositions = 0xB7;
+    const uint32_t CueTrack = 0xF7;
+    const uint32_t CueClusterPosition = 0xF1;
+    const uint32_t CueRelativePosition = 0xF0;
+
     // Attachments
     const uint32_t Attachments = 0x1941A469;
     const uint32_t AttachedFile = 0x61A7;
@@ -78,6 +114,37 @@ namespace MkvIds {
     const uint32_t FileMimeType = 0x4660;
     const uint32_t FileData = 0x465C;
     const uint32_t FileUID = 0x46AE;
+
+    // Chapters
+    const uint32_t EditionEntry = 0x45B9;
+    const uint32_t EditionUID = 0x45BC;
+    const uint32_t EditionFlagHidden = 0x45BD;
+    const uint32_t EditionFlagDefault = 0x45DB;
+    const uint32_t EditionFlagOrdered = 0x45DD;
+    const uint32_t ChapterAtom = 0xB6;
+    const uint32_t ChapterUID = 0x73C4;
+    const uint32_t ChapterTimeStart = 0x91;
+    const uint32_t ChapterTimeEnd = 0x92;
+    const uint32_t ChapterFlagHidden = 0x98;
+    const uint32_t ChapterFlagEnabled = 0x4598;
+    const uint32_t ChapterDisplay = 0x80;
+    const uint32_t ChapString = 0x85;
+    const uint32_t ChapLanguage = 0x437C;
+
+    // Tags
+    const uint32_t Tag = 0x7373;
+    const uint32_t Targets = 0x63C0;
+    const uint32_t TargetTypeValue = 0x68CA;
+    const uint32_t TargetType = 0x63CA;
+    const uint32_t TagTrackUID = 0x63C5;
+    const uint32_t TagEditionUID = 0x63C9;
+    const uint32_t TagChapterUID = 0x63C4;
+    const uint32_t TagAttachmentUID = 0x63C6;
+    const uint32_t SimpleTag = 0x67C8;
+    const uint32_t TagName = 0x45A3;
+    const uint32_t TagLanguage = 0x447A;
+    const uint32_t TagDefault = 0x4484;
+    const uint32_t TagString = 0x4487;
 }
 
 // Track types
@@ -91,17 +158,49 @@ enum MkvTrackType {
     TRACK_TYPE_CONTROL = 0x20
 };
 
+// Sections of the file the parser can be asked to fill, combine with |
+enum MkvSection {
+    MKV_SECTION_INFO = 0x01,         // title, duration, muxing/writing app
+    MKV_SECTION_TRACKS = 0x02,       // video/audio/subtitle streams
+    MKV_SECTION_ATTACHMENTS = 0x04,  // attached files
+    MKV_SECTION_CUES = 0x08,         // seek index, see getCueIndex()
+    MKV_SECTION_CHAPTERS = 0x10,     // editions and chapters
+    MKV_SECTION_TAGS = 0x20,         // tags, including mkvmerge's track statistics
+
+    // What open() parses unless told otherwise
+    MKV_SECTION_DEFAULT = MKV_SECTION_INFO | MKV_SECTION_TRACKS | MKV_SECTION_ATTACHMENTS |
+        MKV_SECTION_CHAPTERS | MKV_SECTION_TAGS,
+    MKV_SECTION_ALL = MKV_SECTION_DEFAULT | MKV_SECTION_CUES
+};
+
+// String fields of the structs below are views owned by the extractor that
+// parsed them: they stay valid until its next open() or close(). Copy them
+// into a std::string to keep them longer.
+
+// General information from SegmentInfo
+struct MkvSegmentInfo {
+    std::string_view title;
+    double duration;          // in milliseconds
+    uint64_t timecodeScale;   // nanoseconds per tick
+    std::string_view muxingApp;
+    std::string_view writingApp;
+
+    MkvSegmentInfo() : duration(0.0), timecodeScale(1000000) {} // Default timecode scale is 1ms
+};
+
 // Stream information structure
 struct MkvStream {
     uint64_t trackNumber;
     uint64_t trackUID;
     uint8_t trackType;
-    std::string codecID;
-    std::string codecName;
-    std::string language;
-    std::string name;
+    std::string_view codecID;
+    std::string_view codecName;
+    std::string_view language;
+    std::string_view name;
     uint64_t defaultDuration;
     double frameRate;
+    uint64_t codecPrivateOffset;  // absolute file offset, 0 if absent
+    uint64_t codecPrivateSize;
 
     // Video specific
     uint64_t pixelWidth;
@@ -109,7 +208,7 @@ struct MkvStream {
     uint64_t displayWidth;
     uint64_t displayHeight;
     uint8_t displayUnit;
-    std::string colorSpace;
+    std::string_view colorSpace;
     uint8_t matrixCoefficients;
     uint8_t bitsPerChannel;
     uint8_t colorRange;
@@ -124,6 +223,7 @@ struct MkvStream {
 
     MkvStream() :
         trackNumber(0), trackUID(0), trackType(0), defaultDuration(0), frameRate(0),
+        codecPrivateOffset(0), codecPrivateSize(0),
         pixelWidth(0), pixelHeight(0), displayWidth(0), displayHeight(0), displayUnit(0),
         matrixCoefficients(0), bitsPerChannel(0), colorRange(0),
         transferCharacteristics(0), colorPrimaries(0),
@@ -134,35 +234,227 @@ struct MkvStream {
 // Attachment information
 struct MkvAttachment {
     uint64_t uid;
-    std::string fileName;
-    std::string description;
-    std::string mimeType;
+    std::string_view fileName;
+    std::string_view description;
+    std::string_view mimeType;
     uint64_t dataSize;
     uint64_t dataOffset;
 
     MkvAttachment() : uid(0), dataSize(0), dataOffset(0) {}
 };
 
+// Chapter edition (EditionEntry)
+struct MkvEdition {
+    uint64_t uid;
+    uint8_t flagHidden;
+    uint8_t flagDefault;
+    uint8_t flagOrdered;
+
+    MkvEdition() : uid(0), flagHidden(0), flagDefault(0), flagOrdered(0) {}
+};
+
+// One ChapterAtom. Chapters are listed in file order, nested ones right
+// after their parent with a larger depth.
+struct MkvChapter {
+    uint64_t uid;
+    uint64_t timeStart;          // in nanoseconds, not scaled by TimecodeScale
+    uint64_t timeEnd;            // in nanoseconds, 0 if absent
+    std::string_view title;      // from the first ChapterDisplay
+    std::string_view language;
+    uint8_t flagHidden;
+    uint8_t flagEnabled;
+    uint32_t edition;            // index in getEditions()
+    uint32_t depth;              // 0 for top-level chapters
+
+    MkvChapter() :
+        uid(0), timeStart(0), timeEnd(0), flagHidden(0), flagEnabled(1), edition(0), depth(0) {
+    }
+};
+
+// One SimpleTag together with the Targets of its Tag. A Tag aimed at several
+// tracks gives one entry per track; nested SimpleTags follow their parent.
+struct MkvTag {
+    uint64_t targetTypeValue;    // 50 (movie, episode) unless given
+    std::string_view targetType;
+    uint64_t trackUID;           // 0 for tags about the whole file
+    uint64_t editionUID;
+    uint64_t chapterUID;
+    uint64_t attachmentUID;
+    std::string_view name;
+    std::string_view language;
+    std::string_view value;      // TagString, empty for binary tags
+    uint8_t isDefault;
+
+    MkvTag() :
+        targetTypeValue(50), trackUID(0), editionUID(0), chapterUID(0), attachmentUID(0),
+        isDefault(1) {
+    }
+};
+
+// Statistics mkvmerge stores as tags for every track it writes
+struct MkvStatisticsTags {
+    uint64_t bitrate;     // BPS, in bits per second
+    uint64_t frames;      // NUMBER_OF_FRAMES
+    uint64_t bytes;       // NUMBER_OF_BYTES
+    double durationMs;    // DURATION
+
+    MkvStatisticsTags() : bitrate(0), frames(0), bytes(0), durationMs(0) {}
+};
+
+// Which attachments extractAllAttachments() writes. With both lists empty
+// every attachment matches; otherwise one matches if its MIME type starts
+// with one of `mimeTypes` or its file name ends with one of `extensions`.
+// Both are compared case-insensitively.
+struct MkvAttachmentFilter {
+    std::vector<std::string> mimeTypes;
+    std::vector<std::string> extensions;
+
+    bool matches(const MkvAttachment& attachment) const;
+};
+
+// One face of a font attachment, see getFonts()
+struct MkvFontInfo {
+    size_t attachmentIndex;
+    SfntFace face;
+
+    MkvFontInfo() : attachmentIndex(0) {}
+};
+
+// One entry of the manifest returned by extractAllAttachments()
+struct MkvExtractedFile {
+    size_t index;       // in getAttachments()
+    std::string path;   // UTF-8, inside the output directory
+    uint64_t size;
+    bool written;
+
+    MkvExtractedFile() : index(0), size(0), written(false) {}
+};
+
+struct MkvBulkExtractStats {
+    uint64_t files;        // files fully written
+    uint64_t bytes;        // bytes in those files
+    uint64_t streamReads;  // reads issued to the MKV file, 0 when mapped
+    uint64_t elapsedUs;
+
+    MkvBulkExtractStats() : files(0), bytes(0), streamReads(0), elapsedUs(0) {}
+};
+
+// One entry of the Cues index
+struct MkvCuePoint {
+    uint64_t time;              // in TimecodeScale units
+    uint64_t clusterPosition;   // absolute file offset of the Cluster
+    uint32_t track;
+    uint32_t relativePosition;  // offset of the block inside the Cluster, 0 if unknown
+
+    MkvCuePoint() : time(0), clusterPosition(0), track(0), relativePosition(0) {}
+};
+
+// Cue points sorted by (track, time) in one flat array, so lookups are a
+// binary search over contiguous memory even with hundreds of thousands of cues.
+class MkvCueIndex {
+public:
+    void clear() { points.clear(); }
+    void reserve(size_t count) { points.reserve(count); }
+    void add(const MkvCuePoint& point) { points.push_back(point); }
+
+    // Set the time of every point added since index `first`
+    void setTime(size_t first, uint64_t time) {
+        for (size_t i = first; i < points.size(); i++) {
+            points[i].time = time;
+        }
+    }
+
+    // Sort the points, must be called once all of them were added
+    void finalize();
+
+    // Latest cue of `track` with time <= `time`. Returns false if the track
+    // has no cue at or before that time.
+    bool findAtOrBefore(uint32_t track, uint64_t time, MkvCuePoint& result) const;
+
+    size_t size() const { return points.size(); }
+    bool empty() const { return points.empty(); }
+    const std::vector<MkvCuePoint>& getPoints() const { return points; }
+
+private:
+    std::vector<MkvCuePoint> points;
+};
+
+// Absolute file offsets of the Segment's top-level elements (0 = not found)
+struct MkvSegmentLayout {
+    uint64_t dataStart;
+    uint64_t end;
+    uint64_t info;
+    uint64_t tracks;
+    uint64_t attachments;
+    uint64_t cues;
+    uint64_t chapters;
+    uint64_t tags;
+    uint64_t firstCluster;
+
+    MkvSegmentLayout() :
+        dataStart(0), end(0), info(0), tracks(0), attachments(0),
+        cues(0), chapters(0), tags(0), firstCluster(0) {
+    }
+};
+
+// How the Segment's top-level elements were located
+enum MkvParseStrategy {
+    PARSE_STRATEGY_NONE,
+    PARSE_STRATEGY_SEEKHEAD,  // jumped to the targets listed in the SeekHead
+    PARSE_STRATEGY_LINEAR     // walked the top-level elements (no SeekHead, or it missed some)
+};
+
+// Cost of the last open() call
+struct MkvParseStats {
+    MkvParseStrategy strategy;
+    uint64_t elements;          // EBML elements whose ID was decoded
+    uint64_t resyncs;           // scans for the next top-level element
+    uint64_t parseNanoseconds;  // wall time spent in the parser
+    MkvReadStats io;            // work pushed down to the file stream
+
+    MkvParseStats() : strategy(PARSE_STRATEGY_NONE), elements(0), resyncs(0), parseNanoseconds(0) {}
+};
+
 // Main class for MKV metadata extraction
 class MkvMetadataExtractor {
 public:
     MkvMetadataExtractor();
     ~MkvMetadataExtractor();
 
-    // Open MKV file and parse metadata
-    bool open(const std::string& filePath);
+    // Open MKV file and parse metadata. `sections` is a mask of MkvSection
+    // values; the parser skips everything else and stops once they are filled.
+    bool open(const std::string& filePath, uint32_t sections = MKV_SECTION_DEFAULT);
+
+    // Same as open(), but maps the file and decodes EBML straight from the
+    // mapped bytes. Falls back to the stream reader if the file cannot be mapped.
+    bool openMapped(const std::string& filePath, uint32_t sections = MKV_SECTION_DEFAULT);
+
+    // Sections of the open file actually found and parsed
+    uint32_t getParsedSections() const { return parsedSections; }
+
+    // Parse `sections` of the open file that open() was not asked for,
+    // without reopening it. Sections asked for before are not parsed again,
+    // whether or not the file has them. Returns false if no file is open.
+    bool addSections(uint32_t sections);
+
+    // True if the current file is being read through a memory mapping
+    bool isMapped() const { return reader.isMapped(); }
 
     // Close file and cleanup
     void close();
 
+    // Path given to the last open() call
+    const std::string& getFilePath() const { return filePath; }
+
     // Get general information
-    std::string getTitle() const { return title; }
-    double getDuration() const { return duration; }
-    uint64_t getTimecodeScale() const { return timecodeScale; }
-    std::string getMuxingApp() const { return muxingApp; }
-    std::string getWritingApp() const { return writingApp; }
+    std::string getTitle() const { return std::string(segmentInfo.title); }
+    double getDuration() const { return segmentInfo.duration; }
+    uint64_t getTimecodeScale() const { return segmentInfo.timecodeScale; }
+    std::string getMuxingApp() const { return std::string(segmentInfo.muxingApp); }
+    std::string getWritingApp() const { return std::string(segmentInfo.writingApp); }
 
     // Get stream information
+    const MkvStream* findStream(uint64_t trackNumber) const;
     const std::vector<MkvStream>& getVideoStreams() const { return videoStreams; }
     const std::vector<MkvStream>& getAudioStreams() const { return audioStreams; }
     const std::vector<MkvStream>& getSubtitleStreams() const { return subtitleStreams; }
@@ -170,22 +462,71 @@ public:
     // Get attachment information
     const std::vector<MkvAttachment>& getAttachments() const { return attachments; }
 
-    // Extract attachment data to file
-    bool extractAttachment(size_t index, const std::string& outputPath);
+    // Get the seek index (requires MKV_SECTION_CUES)
+    const MkvCueIndex& getCueIndex() const { return cueIndex; }
+
+    // Get chapters and tags (require MKV_SECTION_CHAPTERS and MKV_SECTION_TAGS)
+    const std::vector<MkvEdition>& getEditions() const { return editions; }
+    const std::vector<MkvChapter>& getChapters() const { return chapters; }
+    const std::vector<MkvTag>& getTags() const { return tags; }
+
+    // The statistics tags of track `trackUID` (BPS, NUMBER_OF_FRAMES,
+    // NUMBER_OF_BYTES, DURATION). Returns false if the file has none for it.
+    bool getStatisticsTags(uint64_t trackUID, MkvStatisticsTags& statistics) const;
+
+    // Nearest cue (keyframe) at or before `timeMs` for `track`. Track 0 means
+    // the first video track.
+    bool findCue(uint64_t track, double timeMs, MkvCuePoint& result) const;
+
+    // Extract attachment data to file. Attachments of 1 MiB and more are
+    // copied by copyFileSection(); `stats` reports how and how fast.
+    bool extractAttachment(size_t index, const std::string& outputPath,
+        FileCopyStats* stats = nullptr);
+
+    // Read `length` bytes of attachment `index`, starting `offset` bytes into
+    // its data, straight from the file into `data`. The window is clamped to
+    // the attachment, so a read running past its end returns fewer bytes.
+    // Returns false if the index is invalid or the file cannot be read.
+    bool readAttachment(size_t index, uint64_t offset, uint64_t length, std::vector<uint8_t>& data);
+
+    // Family and style names of every TrueType/OpenType font attachment
+    // (collections included), read in place at dataOffset in one pass over
+    // the attachments: only the sfnt headers and `name` tables are read.
+    // Attachments that are not sfnt fonts are skipped, whatever their MIME
+    // type. `bytesRead` counts the attachment bytes read.
+    bool getFonts(std::vector<MkvFontInfo>& fonts, uint64_t* bytesRead = nullptr);
+
+    // Write every attachment matching `filter` into `outputDir` (created if
+    // needed) in one forward sweep over the file, under names derived from
+    // their own. Neighbouring attachments are fetched with one large read and
+    // the files are written on background threads. `manifest` lists the
+    // selected attachments in file order, with per-file success. Returns
+    // false only if no file is open or the directory cannot be created.
+    bool extractAllAttachments(const std::string& outputDir, const MkvAttachmentFilter& filter,
+        std::vector<MkvExtractedFile>& manifest, MkvBulkExtractStats* stats = nullptr);
 
     // Calculate estimated bitrate
     uint64_t getEstimatedBitrate() const;
 
+    // I/O and element counters for the last open() call and the
+    // addSections() calls since
+    const MkvParseStats& getParseStats() const { return parseStats; }
+
+    // Where the top-level elements of the Segment live
+    const MkvSegmentLayout& getSegmentLayout() const { return layout; }
+
 private:
-    boost::nowide::ifstream file;
+    MkvBlockReader reader;
+    std::string filePath;
     uint64_t fileSize;
+    MkvParseStats parseStats;
+    std::string stringScratch;
+
+    // Backing store of the string fields, reused from file to file
+    MkvStringArena strings;
 
     // General info
-    std::string title;
-    double duration;
-    uint64_t timecodeScale;
-    std::string muxingApp;
-    std::string writingApp;
+    MkvSegmentInfo segmentInfo;
 
     // Stream collections
     std::vector<MkvStream> videoStreams;
@@ -196,17 +537,61 @@ private:
     // Attachments
     std::vector<MkvAttachment> attachments;
 
+    // Seek index
+    MkvCueIndex cueIndex;
+
+    // Chapters and tags
+    std::vector<MkvEdition> editions;
+    std::vector<MkvChapter> chapters;
+    std::vector<MkvTag> tags;
+
+    MkvSegmentLayout layout;
+    uint32_t requestedSections;
+    uint32_t parsedSections;
+
+    bool openFile(const std::string& path, bool useMapping, uint32_t sections);
+
     // EBML parsing
     bool parseEBML();
     bool parseSegment(uint64_t size);
+    void parseKnownSections(uint32_t sections);
+    void walkSegment();
+    bool parseSeekHeads();
+    bool parseSeekHead(uint64_t size, uint64_t& nextSeekHead);
+    bool parseLevel1(uint32_t id, uint64_t size);
+    bool parseLevel1At(uint64_t pos, uint32_t expectedId);
+    void recordLevel1(uint32_t id, uint64_t pos);
+
+    // Position the reader on the next plausible top-level element in
+    // [from, limit). Used after unknown-size elements.
+    bool resyncToLevel1(uint64_t from, uint64_t limit);
+
+    // End offset of an element starting at the cursor, clamped to the file
+    uint64_t endOfElement(uint64_t size);
     bool parseSegmentInfo(uint64_t size);
     bool parseTracks(uint64_t size);
     bool parseTrackEntry(uint64_t size, MkvStream& stream);
-    bool parseVideo(uint64_t size, MkvStream& stream);
-    bool parseAudio(uint64_t size, MkvStream& stream);
-    bool parseColour(uint64_t size, MkvStream& stream);
+    bool parseCues(uint64_t size);
+    bool parseCuePoint(uint64_t size);
+    bool parseCueTrackPositions(uint64_t size, MkvCuePoint& point);
     bool parseAttachments(uint64_t size);
     bool parseAttachedFile(uint64_t size, MkvAttachment& attachment);
+    bool parseChapters(uint64_t size);
+    bool parseEditionEntry(uint64_t size);
+    bool parseChapterAtom(uint64_t size, uint32_t depth);
+    bool parseTags(uint64_t size);
+    bool parseTag(uint64_t size);
+    bool parseTargets(uint64_t size, MkvTag& targets, std::vector<uint64_t>& trackUIDs);
+    bool parseSimpleTag(uint64_t size, const MkvTag& targets, const std::vector<uint64_t>& trackUIDs,
+        uint32_t depth);
+
+    // Fill `target` from the children of a master element described by `schema`
+    template <typename Target>
+    bool parseFields(uint64_t size, const MkvSchema<Target>& schema, Target& target);
+
+    // Decode one element of `size` bytes at the cursor into `target`
+    template <typename Target>
+    void parseField(const MkvField<Target>& field, uint64_t size, Target& target);
 
     // EBML helper functions
     uint32_t readID();
@@ -216,8 +601,17 @@ private:
     double readFloat(uint64_t size);
     std::string readString(uint64_t size);
     std::string readUTF8(uint64_t size);
+
+    // View variants: no allocation. The view points into the mapping (stable
+    // until close()) or into the read window (valid until the next read).
+    std::string_view readStringView(uint64_t size);
+    std::string_view readUTF8View(uint64_t size);
     void skipBytes(uint64_t size);
 
+    // Keep `value` past the current read: interned when `shared` and short
+    // enough, copied into the arena otherwise
+    std::string_view storeString(std::string_view value, bool shared);
+
     // Add stream to appropriate collection based on type
     void addStream(const MkvStream& stream);
 };
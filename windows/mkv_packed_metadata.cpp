@@ -0,0 +1,234 @@
+#include "mkv_packed_metadata.h"
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// Writes into a buffer sized up front, and collects the string table
+class PackedWriter {
+public:
+    explicit PackedWriter(std::vector<uint8_t>& out) : out(out) {
+        strings.push_back(std::string_view());
+        indexes.emplace(std::string_view(), 0);
+    }
+
+    void put8(size_t offset, uint8_t value) {
+        out[offset] = value;
+    }
+
+    void put16(size_t offset, uint16_t value) {
+        for (int i = 0; i < 2; i++) {
+            out[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    void put32(size_t offset, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    void put64(size_t offset, uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            out[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+        }
+    }
+
+    void putDouble(size_t offset, double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        put64(offset, bits);
+    }
+
+    // `value` must outlive finish()
+    void putString(size_t offset, std::string_view value) {
+        auto it = indexes.find(value);
+        if (it == indexes.end()) {
+            it = indexes.emplace(value, static_cast<uint32_t>(strings.size())).first;
+            strings.push_back(value);
+        }
+        put32(offset, it->second);
+    }
+
+    // Append the string table
+    void finish() {
+        size_t start = out.size();
+        size_t bytes = 0;
+        for (const auto& value : strings) {
+            bytes += value.size();
+        }
+        out.resize(start + 4 + 4 * (strings.size() + 1) + bytes);
+
+        put32(start, static_cast<uint32_t>(strings.size()));
+        size_t data = start + 4 + 4 * (strings.size() + 1);
+        for (size_t i = 0; i < strings.size(); i++) {
+            put32(start + 4 + 4 * i, static_cast<uint32_t>(data));
+            if (!strings[i].empty()) {
+                std::memcpy(&out[data], strings[i].data(), strings[i].size());
+            }
+            data += strings[i].size();
+        }
+        put32(start + 4 + 4 * strings.size(), static_cast<uint32_t>(data));
+        put32(PackedStringTableOffset, static_cast<uint32_t>(start));
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint32_t> indexes;
+};
+
+void packTrack(PackedWriter& writer, const MkvMetadataExtractor& extractor,
+    const MkvStream& stream, size_t record) {
+    writer.put8(record + PackedTrackType, stream.trackType);
+    writer.put32(record + PackedTrackNumber, static_cast<uint32_t>(stream.trackNumber));
+    writer.put64(record + PackedTrackUid, stream.trackUID);
+    writer.putString(record + PackedTrackCodecId, stream.codecID);
+    writer.putString(record + PackedTrackCodecName, stream.codecName);
+    writer.putString(record + PackedTrackLanguage, stream.language);
+    writer.putString(record + PackedTrackName, stream.name);
+
+    if (stream.trackType == TRACK_TYPE_VIDEO) {
+        writer.put8(record + PackedTrackBitDepth, stream.bitsPerChannel);
+        writer.put32(record + PackedTrackWidth, static_cast<uint32_t>(stream.pixelWidth));
+        writer.put32(record + PackedTrackHeight, static_cast<uint32_t>(stream.pixelHeight));
+        writer.put32(record + PackedTrackDisplayWidth, static_cast<uint32_t>(stream.displayWidth));
+        writer.put32(record + PackedTrackDisplayHeight, static_cast<uint32_t>(stream.displayHeight));
+        writer.putDouble(record + PackedTrackRate, stream.frameRate);
+    }
+    else if (stream.trackType == TRACK_TYPE_AUDIO) {
+        writer.put8(record + PackedTrackBitDepth, stream.bitDepth);
+        writer.put8(record + PackedTrackChannels, stream.channels);
+        writer.putDouble(record + PackedTrackRate, stream.samplingFrequency);
+    }
+
+    MkvStatisticsTags statistics;
+    if (extractor.getStatisticsTags(stream.trackUID, statistics)) {
+        writer.put8(record + PackedTrackFlags, PackedTrackHasStatistics);
+        writer.put64(record + PackedTrackBitrate, statistics.bitrate);
+        writer.put64(record + PackedTrackFrameCount, statistics.frames);
+        writer.put64(record + PackedTrackStreamSize, statistics.bytes);
+        writer.putDouble(record + PackedTrackStreamDuration, statistics.durationMs);
+    }
+}
+
+} // namespace
+
+void packMkvMetadata(const MkvMetadataExtractor& extractor, uint32_t sections,
+    std::vector<uint8_t>& out) {
+    size_t tracks = 0;
+    if (sections & MKV_SECTION_TRACKS) {
+        tracks = extractor.getVideoStreams().size() + extractor.getAudioStreams().size() +
+            extractor.getSubtitleStreams().size();
+    }
+    size_t attachments = (sections & MKV_SECTION_ATTACHMENTS) ? extractor.getAttachments().size() : 0;
+    size_t editions = (sections & MKV_SECTION_CHAPTERS) ? extractor.getEditions().size() : 0;
+    size_t chapters = (sections & MKV_SECTION_CHAPTERS) ? extractor.getChapters().size() : 0;
+    size_t tags = (sections & MKV_SECTION_TAGS) ? extractor.getTags().size() : 0;
+
+    const size_t counts[PackedBlockCount] = { tracks, attachments, editions, chapters, tags };
+    const uint32_t strides[PackedBlockCount] = {
+        PackedTrackStride, PackedAttachmentStride, PackedEditionStride, PackedChapterStride, PackedTagStride
+    };
+
+    // Records are zero-filled, so unset fields read as 0 or the empty string
+    size_t blocks[PackedBlockCount];
+    size_t size = PackedHeaderSize;
+    for (uint32_t i = 0; i < PackedBlockCount; i++) {
+        blocks[i] = size;
+        size += counts[i] * strides[i];
+    }
+    out.assign(size, 0);
+
+    PackedWriter writer(out);
+    writer.put32(PackedMagicOffset, PackedMagic);
+    writer.put16(PackedVersionOffset, PackedVersion);
+    writer.put16(PackedHeaderSizeOffset, static_cast<uint16_t>(PackedHeaderSize));
+    writer.put32(PackedSectionsOffset, sections);
+    for (uint32_t i = 0; i < PackedBlockCount; i++) {
+        size_t entry = PackedBlocksOffset + i * 12;
+        writer.put32(entry, static_cast<uint32_t>(blocks[i]));
+        writer.put32(entry + 4, static_cast<uint32_t>(counts[i]));
+        writer.put32(entry + 8, strides[i]);
+    }
+
+    // Owned here so the string table can point at them until finish()
+    std::string title;
+    std::string muxingApp;
+    std::string writingApp;
+    if (sections & MKV_SECTION_INFO) {
+        title = extractor.getTitle();
+        muxingApp = extractor.getMuxingApp();
+        writingApp = extractor.getWritingApp();
+        writer.putDouble(PackedDurationOffset, extractor.getDuration());
+        writer.put64(PackedBitrateOffset, extractor.getEstimatedBitrate());
+        writer.put64(PackedTimecodeScaleOffset, extractor.getTimecodeScale());
+        writer.putString(PackedTitleOffset, title);
+        writer.putString(PackedMuxingAppOffset, muxingApp);
+        writer.putString(PackedWritingAppOffset, writingApp);
+    }
+
+    if (sections & MKV_SECTION_TRACKS) {
+        size_t record = blocks[PackedTracks];
+        for (const auto* streams : { &extractor.getVideoStreams(), &extractor.getAudioStreams(),
+                 &extractor.getSubtitleStreams() }) {
+            for (const auto& stream : *streams) {
+                packTrack(writer, extractor, stream, record);
+                record += PackedTrackStride;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < attachments; i++) {
+        const auto& attachment = extractor.getAttachments()[i];
+        size_t record = blocks[PackedAttachments] + i * PackedAttachmentStride;
+        writer.put64(record + PackedAttachmentUid, attachment.uid);
+        writer.put64(record + PackedAttachmentSize, attachment.dataSize);
+        writer.putString(record + PackedAttachmentFileName, attachment.fileName);
+        writer.putString(record + PackedAttachmentMimeType, attachment.mimeType);
+        writer.putString(record + PackedAttachmentDescription, attachment.description);
+    }
+
+    for (size_t i = 0; i < editions; i++) {
+        const auto& edition = extractor.getEditions()[i];
+        size_t record = blocks[PackedEditions] + i * PackedEditionStride;
+        writer.put64(record + PackedEditionUid, edition.uid);
+        writer.put8(record + PackedEditionFlags, static_cast<uint8_t>(
+            (edition.flagDefault ? PackedEditionDefault : 0) |
+            (edition.flagHidden ? PackedEditionHidden : 0) |
+            (edition.flagOrdered ? PackedEditionOrdered : 0)));
+    }
+
+    for (size_t i = 0; i < chapters; i++) {
+        const auto& chapter = extractor.getChapters()[i];
+        size_t record = blocks[PackedChapters] + i * PackedChapterStride;
+        writer.put64(record + PackedChapterUid, chapter.uid);
+        writer.putDouble(record + PackedChapterStart, chapter.timeStart / 1000000.0);
+        writer.putDouble(record + PackedChapterEnd, chapter.timeEnd / 1000000.0);
+        writer.putString(record + PackedChapterTitle, chapter.title);
+        writer.putString(record + PackedChapterLanguage, chapter.language);
+        writer.put16(record + PackedChapterEdition, static_cast<uint16_t>(chapter.edition));
+        writer.put8(record + PackedChapterDepth, static_cast<uint8_t>(chapter.depth));
+        writer.put8(record + PackedChapterFlags, static_cast<uint8_t>(
+            (chapter.flagHidden ? PackedChapterHidden : 0) |
+            (chapter.flagEnabled ? PackedChapterEnabled : 0)));
+    }
+
+    for (size_t i = 0; i < tags; i++) {
+        const auto& tag = extractor.getTags()[i];
+        size_t record = blocks[PackedTags] + i * PackedTagStride;
+        writer.put64(record + PackedTagTrackUid, tag.trackUID);
+        writer.put64(record + PackedTagEditionUid, tag.editionUID);
+        writer.put64(record + PackedTagChapterUid, tag.chapterUID);
+        writer.put64(record + PackedTagAttachmentUid, tag.attachmentUID);
+        writer.put32(record + PackedTagTargetTypeValue, static_cast<uint32_t>(tag.targetTypeValue));
+        writer.putString(record + PackedTagTargetType, tag.targetType);
+        writer.putString(record + PackedTagName, tag.name);
+        writer.putString(record + PackedTagLanguage, tag.language);
+        writer.putString(record + PackedTagValue, tag.value);
+    }
+
+    writer.finish();
+}
@@ -0,0 +1,132 @@
+#ifndef MKV_PACKED_METADATA_H
+#define MKV_PACKED_METADATA_H
+
+#include <cstdint>
+#include <vector>
+
+#include "mkv_metadata_extractor_version5.h"
+
+// Compact form of the getMkvMetadata result: one little-endian buffer that
+// Dart reads in place instead of a tree of EncodableMaps with a string key
+// per field.
+//
+//   header       PackedHeaderSize bytes, see the Packed* offsets below
+//   records      one block per kind (tracks, attachments, editions, chapters,
+//                tags), each `count` records of `stride` bytes
+//   string table u32 count, u32 offset[count + 1] from the buffer start,
+//                then the UTF-8 bytes. String 0 is the empty string and
+//                equal strings are stored once.
+//
+// Strings in the header and in records are u32 indexes into the string
+// table. Readers must use the strides from the header: newer versions only
+// append fields to records.
+
+const uint32_t PackedMagic = 0x504B564D;  // "MKVP"
+const uint16_t PackedVersion = 1;
+
+// Header fields
+enum PackedHeaderOffset : uint32_t {
+    PackedMagicOffset = 0,          // u32
+    PackedVersionOffset = 4,        // u16
+    PackedHeaderSizeOffset = 6,     // u16
+    PackedSectionsOffset = 8,       // u32, MKV_SECTION_* parsed
+    PackedStringTableOffset = 12,   // u32
+    PackedDurationOffset = 16,      // f64, milliseconds
+    PackedBitrateOffset = 24,       // u64, estimated
+    PackedTimecodeScaleOffset = 32, // u64
+    PackedTitleOffset = 40,         // string
+    PackedMuxingAppOffset = 44,     // string
+    PackedWritingAppOffset = 48,    // string
+    PackedBlocksOffset = 56,        // PackedBlockCount x { u32 offset, u32 count, u32 stride }
+};
+
+enum PackedBlock : uint32_t {
+    PackedTracks,
+    PackedAttachments,
+    PackedEditions,
+    PackedChapters,
+    PackedTags,
+    PackedBlockCount
+};
+
+const uint32_t PackedHeaderSize = 120;
+
+// Track record: video, then audio, then subtitle tracks
+enum PackedTrackOffset : uint32_t {
+    PackedTrackType = 0,            // u8, TRACK_TYPE_*
+    PackedTrackBitDepth = 1,        // u8, bits per channel (video) or sample (audio)
+    PackedTrackChannels = 2,        // u8
+    PackedTrackFlags = 3,           // u8, PackedTrackHasStatistics
+    PackedTrackNumber = 4,          // u32
+    PackedTrackUid = 8,             // u64
+    PackedTrackCodecId = 16,        // string
+    PackedTrackCodecName = 20,      // string
+    PackedTrackLanguage = 24,       // string
+    PackedTrackName = 28,           // string
+    PackedTrackWidth = 32,          // u32
+    PackedTrackHeight = 36,         // u32
+    PackedTrackDisplayWidth = 40,   // u32
+    PackedTrackDisplayHeight = 44,  // u32
+    PackedTrackRate = 48,           // f64, frame rate (video) or sample rate (audio)
+    PackedTrackBitrate = 56,        // u64, statistics tags from here on
+    PackedTrackFrameCount = 64,     // u64
+    PackedTrackStreamSize = 72,     // u64
+    PackedTrackStreamDuration = 80, // f64, milliseconds
+    PackedTrackStride = 88
+};
+
+const uint8_t PackedTrackHasStatistics = 0x01;
+
+enum PackedAttachmentOffset : uint32_t {
+    PackedAttachmentUid = 0,          // u64
+    PackedAttachmentSize = 8,         // u64
+    PackedAttachmentFileName = 16,    // string
+    PackedAttachmentMimeType = 20,    // string
+    PackedAttachmentDescription = 24, // string
+    PackedAttachmentStride = 32
+};
+
+enum PackedEditionOffset : uint32_t {
+    PackedEditionUid = 0,     // u64
+    PackedEditionFlags = 8,   // u8, PackedEdition* flags
+    PackedEditionStride = 16
+};
+
+const uint8_t PackedEditionDefault = 0x01;
+const uint8_t PackedEditionHidden = 0x02;
+const uint8_t PackedEditionOrdered = 0x04;
+
+enum PackedChapterOffset : uint32_t {
+    PackedChapterUid = 0,        // u64
+    PackedChapterStart = 8,      // f64, milliseconds
+    PackedChapterEnd = 16,       // f64, milliseconds
+    PackedChapterTitle = 24,     // string
+    PackedChapterLanguage = 28,  // string
+    PackedChapterEdition = 32,   // u16, index of the edition record
+    PackedChapterDepth = 34,     // u8
+    PackedChapterFlags = 35,     // u8, PackedChapter* flags
+    PackedChapterStride = 40
+};
+
+const uint8_t PackedChapterHidden = 0x01;
+const uint8_t PackedChapterEnabled = 0x02;
+
+enum PackedTagOffset : uint32_t {
+    PackedTagTrackUid = 0,         // u64
+    PackedTagEditionUid = 8,       // u64
+    PackedTagChapterUid = 16,      // u64
+    PackedTagAttachmentUid = 24,   // u64
+    PackedTagTargetTypeValue = 32, // u32
+    PackedTagTargetType = 36,      // string
+    PackedTagName = 40,            // string
+    PackedTagLanguage = 44,        // string
+    PackedTagValue = 48,           // string
+    PackedTagStride = 56
+};
+
+// Pack what `extractor` parsed of `sections` into `out`, replacing its
+// contents. The fields are those of the map getMkvMetadata returns.
+void packMkvMetadata(const MkvMetadataExtractor& extractor, uint32_t sections,
+    std::vector<uint8_t>& out);
+
+#endif // MKV_PACKED_METADATA_H
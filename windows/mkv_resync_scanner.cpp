@@ -0,0 +1,94 @@
+#include "mkv_resync_scanner.h"
+#include "mkv_metadata_extractor_version5.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MKV_SCANNER_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+inline uint32_t loadId(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) |
+        (static_cast<uint32_t>(p[1]) << 16) |
+        (static_cast<uint32_t>(p[2]) << 8) |
+        p[3];
+}
+
+inline unsigned lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+} // namespace
+
+bool isMkvLevel1Id(uint32_t id) {
+    switch (id) {
+    case MkvIds::SeekHead:
+    case MkvIds::SegmentInfo:
+    case MkvIds::Tracks:
+    case MkvIds::Cluster:
+    case MkvIds::Cues:
+    case MkvIds::Attachments:
+    case MkvIds::Chapters:
+    case MkvIds::Tags:
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t findMkvLevel1Id(const uint8_t* data, size_t length, uint32_t& foundId) {
+    if (length < 4) {
+        return length;
+    }
+
+    // Last offset where a whole ID still fits
+    const size_t lastStart = length - 4;
+    size_t i = 0;
+
+#ifdef MKV_SCANNER_SSE2
+    const __m128i highNibble = _mm_set1_epi8(static_cast<char>(0xF0));
+    const __m128i leadNibble = _mm_set1_epi8(0x10);
+
+    while (i + 16 <= lastStart + 1) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hits = _mm_cmpeq_epi8(_mm_and_si128(bytes, highNibble), leadNibble);
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+
+        while (mask != 0) {
+            size_t pos = i + lowestBit(mask);
+            uint32_t id = loadId(data + pos);
+            if (isMkvLevel1Id(id)) {
+                foundId = id;
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+
+        i += 16;
+    }
+#endif
+
+    for (; i <= lastStart; i++) {
+        if ((data[i] & 0xF0) != 0x10) {
+            continue;
+        }
+        uint32_t id = loadId(data + i);
+        if (isMkvLevel1Id(id)) {
+            foundId = id;
+            return i;
+        }
+    }
+
+    return length;
+}
@@ -0,0 +1,23 @@
+#ifndef MKV_RESYNC_SCANNER_H
+#define MKV_RESYNC_SCANNER_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Byte scanner used to resynchronise on the next top-level (level 1) element
+// after an element of unknown size, or from an arbitrary offset in the file.
+//
+// All level 1 Matroska IDs are 4 bytes long and start with 0x1X, so the scan
+// looks for candidate lead bytes 16 at a time (SSE2 when available) and only
+// compares full IDs at those positions.
+
+// Returns true if `id` is one of the Segment's top-level element IDs.
+bool isMkvLevel1Id(uint32_t id);
+
+// Find the first complete level 1 element ID in [data, data + length).
+// Returns its offset and stores the ID in `foundId`, or returns `length` if
+// there is none. IDs cut off by the end of the range are not reported, so a
+// caller scanning in chunks should overlap them by 3 bytes.
+size_t findMkvLevel1Id(const uint8_t* data, size_t length, uint32_t& foundId);
+
+#endif // MKV_RESYNC_SCANNER_H
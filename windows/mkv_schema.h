@@ -0,0 +1,158 @@
+#ifndef MKV_SCHEMA_H
+#define MKV_SCHEMA_H
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+// Table-driven description of the children of an EBML master element.
+//
+// Each MkvField maps one element ID to a member of `Target` and says how the
+// element is decoded, so a parser is a single generic loop over a table like:
+//
+//     constexpr MkvField<MkvStream> audioFields[] = {
+//         mkvUInt8(MkvIds::Channels, &MkvStream::channels),
+//         mkvFloat(MkvIds::SamplingFrequency, &MkvStream::samplingFrequency),
+//     };
+//
+// Tables are kept sorted by ID (checked at compile time with mkvIsSorted).
+// Dispatch goes through a perfect hash computed at compile time: one multiply,
+// one shift and one compare per element, with a binary search as fallback for
+// tables the hash cannot place.
+
+enum MkvFieldType {
+    MKV_FIELD_UINT,     // unsigned integer into a uint64_t
+    MKV_FIELD_UINT8,    // unsigned integer into a uint8_t
+    MKV_FIELD_FLOAT,    // 4 or 8 byte float into a double
+    MKV_FIELD_STRING,   // ASCII or UTF-8 string, copied into the extractor's arena
+    MKV_FIELD_ATOM,     // short string that repeats across files, interned
+    MKV_FIELD_HEX32,    // 32-bit value stored as 8 hex digits, interned
+    MKV_FIELD_DATA,     // binary payload, only its offset and size are kept
+    MKV_FIELD_MASTER    // nested master element parsed into the same target
+};
+
+template <typename Target>
+struct MkvSchema;
+
+template <typename Target>
+struct MkvField {
+    uint32_t id;
+    MkvFieldType type;
+    uint64_t Target::* uintMember;     // UINT, offset for DATA
+    uint64_t Target::* sizeMember;     // size for DATA
+    uint8_t Target::* uint8Member;
+    double Target::* floatMember;
+    std::string_view Target::* stringMember; // STRING, ATOM, HEX32
+    const MkvSchema<Target>* children;  // MASTER
+};
+
+template <typename Target>
+struct MkvSchema {
+    static const unsigned HashBits = 6;
+
+    const MkvField<Target>* fields;
+    size_t count;
+    uint32_t multiplier = 0;                 // 0 if no perfect hash was found
+    uint8_t slots[1 << HashBits] = {};       // field index + 1, 0 = empty
+
+    template <size_t N>
+    constexpr MkvSchema(const MkvField<Target>(&table)[N]) : fields(table), count(N) {
+        static_assert(N < (1 << HashBits), "schema too large for the hash table");
+
+        // Try odd multipliers until every ID lands in its own slot
+        for (uint32_t candidate = 0x9E3779B1u; candidate != 0x9E3779B1u + 2 * 64; candidate += 2) {
+            bool collision = false;
+            for (auto& slot : slots) {
+                slot = 0;
+            }
+            for (size_t i = 0; i < N && !collision; i++) {
+                uint8_t& slot = slots[hash(table[i].id, candidate)];
+                collision = slot != 0;
+                slot = static_cast<uint8_t>(i + 1);
+            }
+            if (!collision) {
+                multiplier = candidate;
+                return;
+            }
+        }
+    }
+
+    static constexpr uint32_t hash(uint32_t id, uint32_t multiplier) {
+        return (id * multiplier) >> (32 - HashBits);
+    }
+
+    // Field for `id`, nullptr if the element is not part of the schema
+    const MkvField<Target>* find(uint32_t id) const {
+        if (multiplier != 0) {
+            uint8_t slot = slots[hash(id, multiplier)];
+            return slot != 0 && fields[slot - 1].id == id ? &fields[slot - 1] : nullptr;
+        }
+
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (fields[middle].id < id) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        return low < count && fields[low].id == id ? &fields[low] : nullptr;
+    }
+};
+
+template <typename Target, size_t N>
+constexpr bool mkvIsSorted(const MkvField<Target>(&table)[N]) {
+    for (size_t i = 1; i < N; i++) {
+        if (table[i - 1].id >= table[i].id) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Field constructors, one per decode type
+
+template <typename Target>
+constexpr MkvField<Target> mkvUInt(uint32_t id, uint64_t Target::* member) {
+    return { id, MKV_FIELD_UINT, member, nullptr, nullptr, nullptr, nullptr, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvUInt8(uint32_t id, uint8_t Target::* member) {
+    return { id, MKV_FIELD_UINT8, nullptr, nullptr, member, nullptr, nullptr, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvFloat(uint32_t id, double Target::* member) {
+    return { id, MKV_FIELD_FLOAT, nullptr, nullptr, nullptr, member, nullptr, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvString(uint32_t id, std::string_view Target::* member) {
+    return { id, MKV_FIELD_STRING, nullptr, nullptr, nullptr, nullptr, member, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvAtom(uint32_t id, std::string_view Target::* member) {
+    return { id, MKV_FIELD_ATOM, nullptr, nullptr, nullptr, nullptr, member, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvHex32(uint32_t id, std::string_view Target::* member) {
+    return { id, MKV_FIELD_HEX32, nullptr, nullptr, nullptr, nullptr, member, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvData(uint32_t id, uint64_t Target::* offset, uint64_t Target::* size) {
+    return { id, MKV_FIELD_DATA, offset, size, nullptr, nullptr, nullptr, nullptr };
+}
+
+template <typename Target>
+constexpr MkvField<Target> mkvMaster(uint32_t id, const MkvSchema<Target>* children) {
+    return { id, MKV_FIELD_MASTER, nullptr, nullptr, nullptr, nullptr, nullptr, children };
+}
+
+#endif // MKV_SCHEMA_H
@@ -0,0 +1,112 @@
+#include "mkv_session_table.h"
+#include <algorithm>
+#include <vector>
+
+MkvSessionTable::MkvSessionTable() :
+    nextHandle(1), stopping(false) {
+}
+
+MkvSessionTable::~MkvSessionTable() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (sweeper.joinable()) {
+        sweeper.join();
+    }
+}
+
+int64_t MkvSessionTable::open(const std::string& path, uint32_t sections,
+    std::chrono::milliseconds idleTimeout) {
+    if (size() >= MaxSessions) {
+        return 0;
+    }
+
+    // Parse outside the lock, it is the slow part
+    auto session = std::make_shared<MkvSession>();
+    if (!session->extractor.openMapped(path, sections)) {
+        return 0;
+    }
+    session->idleTimeout = idleTimeout;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sessions.size() >= MaxSessions) {
+        return 0;
+    }
+    int64_t handle = nextHandle++;
+    session->lastUsed = std::chrono::steady_clock::now();
+    sessions[handle] = std::move(session);
+
+    if (!sweeper.joinable()) {
+        sweeper = std::thread(&MkvSessionTable::sweep, this);
+    }
+    wake.notify_all();
+    return handle;
+}
+
+bool MkvSessionTable::close(int64_t handle) {
+    std::shared_ptr<MkvSession> session;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sessions.find(handle);
+        if (it == sessions.end()) {
+            return false;
+        }
+        session = std::move(it->second);
+        sessions.erase(it);
+    }
+    // The file is closed here unless a call is still using the session
+    return true;
+}
+
+std::shared_ptr<MkvSession> MkvSessionTable::find(int64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sessions.find(handle);
+    if (it == sessions.end()) {
+        return nullptr;
+    }
+    it->second->lastUsed = std::chrono::steady_clock::now();
+    return it->second;
+}
+
+size_t MkvSessionTable::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessions.size();
+}
+
+void MkvSessionTable::sweep() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        auto now = std::chrono::steady_clock::now();
+        auto nextDeadline = std::chrono::steady_clock::time_point::max();
+
+        std::vector<std::shared_ptr<MkvSession>> expired;
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            auto deadline = it->second->lastUsed + it->second->idleTimeout;
+            if (deadline <= now) {
+                expired.push_back(std::move(it->second));
+                it = sessions.erase(it);
+            }
+            else {
+                nextDeadline = std::min(nextDeadline, deadline);
+                ++it;
+            }
+        }
+
+        // Close the files without holding up the callers
+        if (!expired.empty()) {
+            lock.unlock();
+            expired.clear();
+            lock.lock();
+            continue;
+        }
+
+        if (nextDeadline == std::chrono::steady_clock::time_point::max()) {
+            wake.wait(lock);
+        }
+        else {
+            wake.wait_until(lock, nextDeadline);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef MKV_SESSION_TABLE_H
+#define MKV_SESSION_TABLE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "mkv_metadata_extractor_version5.h"
+
+// An MKV file opened once and kept parsed, so repeated calls (metadata,
+// attachments, cues) skip the file open and the parse.
+struct MkvSession {
+    // Held while a call uses the extractor, whose reader has a single cursor
+    std::mutex mutex;
+    MkvMetadataExtractor extractor;
+    std::chrono::milliseconds idleTimeout;
+
+    // Guarded by the table's mutex
+    std::chrono::steady_clock::time_point lastUsed;
+};
+
+// Open sessions by handle. Sessions unused for longer than their idle timeout
+// are closed by a background sweeper; a call that is still using one keeps it
+// alive until it returns. Thread safe.
+class MkvSessionTable {
+public:
+    static const size_t MaxSessions = 256;
+    static constexpr std::chrono::milliseconds DefaultIdleTimeout = std::chrono::minutes(5);
+
+    MkvSessionTable();
+    ~MkvSessionTable();
+
+    MkvSessionTable(const MkvSessionTable&) = delete;
+    MkvSessionTable& operator=(const MkvSessionTable&) = delete;
+
+    // Parse `path` (mapped) and keep it open. Returns the new handle, or 0 if
+    // the file cannot be parsed or MaxSessions are already open.
+    int64_t open(const std::string& path, uint32_t sections,
+        std::chrono::milliseconds idleTimeout = DefaultIdleTimeout);
+
+    // Returns false if the handle is unknown or already expired
+    bool close(int64_t handle);
+
+    // Session behind `handle`, nullptr if unknown or expired. Resets its idle
+    // timer.
+    std::shared_ptr<MkvSession> find(int64_t handle);
+
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::unordered_map<int64_t, std::shared_ptr<MkvSession>> sessions;
+    int64_t nextHandle;
+    bool stopping;
+    std::thread sweeper;
+
+    void sweep();
+};
+
+#endif // MKV_SESSION_TABLE_H
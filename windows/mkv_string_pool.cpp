@@ -0,0 +1,80 @@
+#include "mkv_string_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+MkvStringArena::MkvStringArena(size_t blockSize) :
+    blockSize(blockSize), current(0), used(0) {
+}
+
+std::string_view MkvStringArena::store(std::string_view value) {
+    if (value.empty()) {
+        return std::string_view();
+    }
+
+    // Move on to the next kept block, or add one, until the value fits
+    while (current < blocks.size() && blocks[current].size - used < value.size()) {
+        current++;
+        used = 0;
+    }
+    if (current == blocks.size()) {
+        Block block;
+        block.size = std::max(blockSize, value.size());
+        block.data.reset(new char[block.size]);
+        blocks.push_back(std::move(block));
+        used = 0;
+    }
+
+    char* target = blocks[current].data.get() + used;
+    memcpy(target, value.data(), value.size());
+    used += value.size();
+    return std::string_view(target, value.size());
+}
+
+void MkvStringArena::reset() {
+    current = 0;
+    used = 0;
+}
+
+std::string_view MkvInternTable::intern(std::string_view value) {
+    if (value.empty() || value.size() > MaxLength) {
+        return std::string_view();
+    }
+
+    Shard& shard = shards[std::hash<std::string_view>()(value) % ShardCount];
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto found = shard.entries.find(value);
+        if (found != shard.entries.end()) {
+            return *found;
+        }
+    }
+
+    // Another thread may have added it in between
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto found = shard.entries.find(value);
+    if (found != shard.entries.end()) {
+        return *found;
+    }
+    if (shard.entries.size() >= MaxEntries / ShardCount) {
+        return std::string_view();
+    }
+
+    std::string_view stored = shard.storage.store(value);
+    shard.entries.insert(stored);
+    return stored;
+}
+
+size_t MkvInternTable::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+MkvInternTable& mkvInternTable() {
+    static MkvInternTable table;
+    return table;
+}
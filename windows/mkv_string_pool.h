@@ -0,0 +1,79 @@
+#ifndef MKV_STRING_POOL_H
+#define MKV_STRING_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Storage for the strings parsed out of track, attachment and segment
+// metadata. Parsed structs hold std::string_view into one of these instead of
+// owning a std::string each.
+
+// Bump allocator for strings. Blocks are kept across reset(), so a reused
+// arena stops allocating once it has seen its largest file.
+class MkvStringArena {
+public:
+    static const size_t DefaultBlockSize = 4096;
+
+    explicit MkvStringArena(size_t blockSize = DefaultBlockSize);
+
+    MkvStringArena(const MkvStringArena&) = delete;
+    MkvStringArena& operator=(const MkvStringArena&) = delete;
+
+    // Copy `value` into the arena. The view stays valid until reset().
+    std::string_view store(std::string_view value);
+
+    // Forget every stored string, keeping the blocks for reuse
+    void reset();
+
+    size_t getBlockCount() const { return blocks.size(); }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current;  // block being filled
+    size_t used;     // bytes used in the current block
+};
+
+// Process-wide table of short strings that repeat across files: codec IDs,
+// languages, MIME types, muxer names. Interned strings live until the process
+// exits and are shared by every extractor. Thread safe.
+//
+// Extractors on many threads look up strings that are almost always there
+// already, so the table is split in shards by hash and lookups only take a
+// shared lock on their shard.
+class MkvInternTable {
+public:
+    static const size_t MaxLength = 64;      // longer strings are not interned
+    static const size_t MaxEntries = 16384;  // the table stops growing here
+    static const size_t ShardCount = 16;
+
+    // Shared copy of `value`. Returns an empty view if the value is too long
+    // or the table is full; the caller keeps its own copy then.
+    std::string_view intern(std::string_view value);
+
+    size_t size() const;
+
+private:
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        MkvStringArena storage;
+        std::unordered_set<std::string_view> entries;
+    };
+
+    Shard shards[ShardCount];
+};
+
+// The table every extractor interns into
+MkvInternTable& mkvInternTable();
+
+#endif // MKV_STRING_POOL_H
@@ -0,0 +1,210 @@
+#include "sfnt_names.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t TagCollection = 0x74746366;  // "ttcf"
+const uint32_t TagName = 0x6E616D65;        // "name"
+
+// Versions of a single font: TrueType, CFF, and the two Apple flavours
+const uint32_t VersionTrueType = 0x00010000;
+const uint32_t VersionCff = 0x4F54544F;      // "OTTO"
+const uint32_t VersionAppleTrue = 0x74727565;  // "true"
+const uint32_t VersionType1 = 0x74797031;    // "typ1"
+
+// Sanity limits against damaged files
+const uint32_t MaxFaces = 256;
+const uint32_t MaxNameTableSize = 1024 * 1024;
+
+uint16_t readBE16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t readBE32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+        (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+void appendUtf8(std::string& out, uint32_t c) {
+    if (c < 0x80) {
+        out.push_back(static_cast<char>(c));
+    }
+    else if (c < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+    else if (c < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+    else {
+        out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+}
+
+std::string decodeUtf16BE(const uint8_t* p, size_t size) {
+    std::string out;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        uint32_t c = readBE16(p + i);
+        if (c >= 0xD800 && c < 0xDC00 && i + 3 < size) {
+            uint32_t low = readBE16(p + i + 2);
+            if (low >= 0xDC00 && low < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        if (c >= 0xD800 && c < 0xE000) {
+            c = 0xFFFD;  // unpaired surrogate
+        }
+        appendUtf8(out, c);
+    }
+    return out;
+}
+
+std::string decodeMacRoman(const uint8_t* p, size_t size) {
+    std::string out;
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] < 0x80) {
+            out.push_back(static_cast<char>(p[i]));
+        }
+    }
+    return out;
+}
+
+// How much a name record is preferred, 0 if it cannot be decoded
+int recordPriority(uint16_t platform, uint16_t encoding, uint16_t language) {
+    if (platform == 3 && (encoding == 0 || encoding == 1 || encoding == 10)) {
+        return language == 0x0409 ? 5 : 4;
+    }
+    if (platform == 0) {
+        return 3;
+    }
+    if (platform == 1 && encoding == 0) {
+        return language == 0 ? 2 : 1;
+    }
+    return 0;
+}
+
+// Where each wanted name ID goes in SfntFace
+std::string* nameField(SfntFace& face, uint16_t nameId) {
+    switch (nameId) {
+    case 1: return &face.family;
+    case 2: return &face.subfamily;
+    case 4: return &face.fullName;
+    case 6: return &face.postScriptName;
+    case 16: return &face.typographicFamily;
+    case 17: return &face.typographicSubfamily;
+    default: return nullptr;
+    }
+}
+
+void parseNameTable(const std::vector<uint8_t>& table, SfntFace& face) {
+    if (table.size() < 6) {
+        return;
+    }
+    const uint8_t* data = table.data();
+    size_t count = readBE16(data + 2);
+    size_t stringOffset = readBE16(data + 4);
+    count = std::min(count, (table.size() - 6) / 12);
+
+    int best[18] = {};
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* record = data + 6 + i * 12;
+        uint16_t platform = readBE16(record);
+        uint16_t encoding = readBE16(record + 2);
+        uint16_t language = readBE16(record + 4);
+        uint16_t nameId = readBE16(record + 6);
+        size_t length = readBE16(record + 8);
+        size_t offset = stringOffset + readBE16(record + 10);
+
+        std::string* field = nameField(face, nameId);
+        int priority = recordPriority(platform, encoding, language);
+        if (field == nullptr || priority <= best[nameId] || offset + length > table.size()) {
+            continue;
+        }
+
+        std::string name = platform == 1 ? decodeMacRoman(data + offset, length)
+                                         : decodeUtf16BE(data + offset, length);
+        if (!name.empty()) {
+            *field = std::move(name);
+            best[nameId] = priority;
+        }
+    }
+}
+
+bool readFace(SfntSource& source, uint64_t faceOffset, uint64_t size, SfntFace& face) {
+    std::vector<uint8_t> data;
+    if (faceOffset + 12 > size || !source.read(faceOffset, 12, data)) {
+        return false;
+    }
+    uint32_t version = readBE32(data.data());
+    if (version != VersionTrueType && version != VersionCff && version != VersionAppleTrue &&
+        version != VersionType1) {
+        return false;
+    }
+
+    size_t tableCount = readBE16(data.data() + 4);
+    if (faceOffset + 12 + tableCount * 16 > size ||
+        !source.read(faceOffset + 12, tableCount * 16, data)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < tableCount; i++) {
+        const uint8_t* entry = data.data() + i * 16;
+        if (readBE32(entry) != TagName) {
+            continue;
+        }
+
+        // Table offsets count from the start of the file, even in collections
+        uint64_t offset = readBE32(entry + 8);
+        uint32_t length = readBE32(entry + 12);
+        if (length > MaxNameTableSize || offset + length > size) {
+            return false;
+        }
+        std::vector<uint8_t> table;
+        if (!source.read(offset, length, table)) {
+            return false;
+        }
+        parseNameTable(table, face);
+        break;
+    }
+    return true;
+}
+
+} // namespace
+
+bool readSfntFaces(SfntSource& source, uint64_t size, std::vector<SfntFace>& faces) {
+    faces.clear();
+
+    std::vector<uint8_t> header;
+    if (size < 12 || !source.read(0, 12, header)) {
+        return false;
+    }
+
+    if (readBE32(header.data()) != TagCollection) {
+        SfntFace face;
+        if (!readFace(source, 0, size, face)) {
+            return false;
+        }
+        faces.push_back(std::move(face));
+        return true;
+    }
+
+    uint32_t faceCount = std::min(readBE32(header.data() + 8), MaxFaces);
+    std::vector<uint8_t> offsets;
+    if (12 + faceCount * 4ULL > size || !source.read(12, faceCount * 4, offsets)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < faceCount; i++) {
+        SfntFace face;
+        face.faceIndex = i;
+        if (readFace(source, readBE32(offsets.data() + i * 4), size, face)) {
+            faces.push_back(std::move(face));
+        }
+    }
+    return !faces.empty();
+}
@@ -0,0 +1,42 @@
+#ifndef SFNT_NAMES_H
+#define SFNT_NAMES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Names of one face of a TrueType/OpenType font, decoded to UTF-8. Empty
+// when the font does not carry them.
+struct SfntFace {
+    uint32_t faceIndex;                // within a collection, 0 otherwise
+    std::string family;                // name ID 1
+    std::string subfamily;             // name ID 2, e.g. "Bold Italic"
+    std::string fullName;              // name ID 4
+    std::string postScriptName;        // name ID 6
+    std::string typographicFamily;     // name ID 16
+    std::string typographicSubfamily;  // name ID 17
+
+    SfntFace() : faceIndex(0) {}
+};
+
+// Random access to the bytes of a font file
+class SfntSource {
+public:
+    virtual ~SfntSource() {}
+
+    // Read `size` bytes at `offset` into `data`. Returns false unless all
+    // of them could be read.
+    virtual bool read(uint64_t offset, size_t size, std::vector<uint8_t>& data) = 0;
+};
+
+// Read the names of every face of the sfnt font (.ttf, .otf) or collection
+// (.ttc, .otc) of `size` bytes behind `source`. Only the headers, the table
+// directory and the `name` table are read, a few KiB per face. Returns false
+// if the data is not an sfnt font.
+//
+// Names come from the Windows records (US English first), then the Unicode
+// ones, then Macintosh Roman ones, whose non-ASCII characters are dropped.
+bool readSfntFaces(SfntSource& source, uint64_t size, std::vector<SfntFace>& faces);
+
+#endif // SFNT_NAMES_H
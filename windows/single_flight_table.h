@@ -0,0 +1,163 @@
+#ifndef SINGLE_FLIGHT_TABLE_H
+#define SINGLE_FLIGHT_TABLE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct SingleFlightStats {
+    uint64_t requests;
+    uint64_t joined;  // attached to a flight already under way
+
+    SingleFlightStats() : requests(0), joined(0) {}
+};
+
+// Requests in flight. The first request for a key starts the work (a
+// "flight"); identical requests arriving before it finishes join it and get
+// the same result. Requests without a key always get a flight of their own.
+// Each request can also leave its flight alone, e.g. when it is cancelled.
+// Thread safe.
+template <typename Reply>
+class SingleFlightTable {
+public:
+    // Adds request `requestId` (0 if it has none) for `key` and sets `tag` to
+    // its flight. Returns true if the flight is new and the caller must start
+    // the work. `raised` tells if joining raised the priority of the flight.
+    bool join(const std::string& key, int64_t requestId, int priority, Reply reply,
+        int64_t& tag, bool& raised) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.requests++;
+        raised = false;
+
+        auto existing = key.empty() ? byKey.end() : byKey.find(key);
+        bool created = existing == byKey.end();
+        if (created) {
+            tag = nextTag++;
+            Flight& flight = flights[tag];
+            flight.key = key;
+            flight.priority = priority;
+            if (!key.empty()) {
+                byKey[key] = tag;
+            }
+        }
+        else {
+            tag = existing->second;
+            stats.joined++;
+        }
+
+        Flight& flight = flights[tag];
+        if (!created && priority > flight.priority) {
+            flight.priority = priority;
+            raised = true;
+        }
+        flight.requests.emplace_back(requestId, std::move(reply));
+        if (requestId != 0) {
+            byRequest[requestId] = tag;
+        }
+        return created;
+    }
+
+    // Ends flight `tag` and returns the replies of its requests
+    std::vector<Reply> finish(int64_t tag) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Reply> replies;
+        auto it = flights.find(tag);
+        if (it == flights.end()) {
+            return replies;
+        }
+
+        for (auto& request : it->second.requests) {
+            auto owner = byRequest.find(request.first);
+            if (owner != byRequest.end() && owner->second == tag) {
+                byRequest.erase(owner);
+            }
+            replies.push_back(std::move(request.second));
+        }
+        if (!it->second.key.empty()) {
+            byKey.erase(it->second.key);
+        }
+        flights.erase(it);
+        return replies;
+    }
+
+    // Flight of request `requestId` and how many requests share it
+    bool find(int64_t requestId, int64_t& tag, size_t& requests) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto owner = byRequest.find(requestId);
+        if (owner == byRequest.end()) {
+            return false;
+        }
+        tag = owner->second;
+        requests = flights.at(tag).requests.size();
+        return true;
+    }
+
+    // Takes request `requestId` out of its flight, which keeps running for
+    // the others. Returns false if it is unknown.
+    bool leave(int64_t requestId, Reply& reply) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto owner = byRequest.find(requestId);
+        if (owner == byRequest.end()) {
+            return false;
+        }
+
+        auto& requests = flights.at(owner->second).requests;
+        for (auto it = requests.begin(); it != requests.end(); ++it) {
+            if (it->first == requestId) {
+                reply = std::move(it->second);
+                requests.erase(it);
+                break;
+            }
+        }
+        byRequest.erase(owner);
+        return true;
+    }
+
+    SingleFlightStats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    struct Flight {
+        std::string key;
+        int priority;
+        std::vector<std::pair<int64_t, Reply>> requests;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<int64_t, Flight> flights;
+    std::unordered_map<std::string, int64_t> byKey;
+    std::unordered_map<int64_t, int64_t> byRequest;
+    int64_t nextTag = 1;
+    SingleFlightStats stats;
+};
+
+// Windows path as a key: no long-path prefix, backslashes only, no repeated
+// separators and ASCII case folded, so spellings of one file share a flight
+inline std::string normalizeRequestPath(const std::string& path) {
+    std::string text = path;
+    if (text.rfind("\\\\?\\", 0) == 0) {
+        text = text.substr(4);
+    }
+
+    std::string normalized;
+    normalized.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i] == '/' ? '\\' : text[i];
+        // Keep the leading pair of a UNC path
+        if (c == '\\' && !normalized.empty() && normalized.back() == '\\' && i > 1) {
+            continue;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        normalized.push_back(c);
+    }
+    return normalized;
+}
+
+#endif // SINGLE_FLIGHT_TABLE_H
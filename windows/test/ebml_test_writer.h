@@ -0,0 +1,148 @@
+#ifndef EBML_TEST_WRITER_H
+#define EBML_TEST_WRITER_H
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "mkv_metadata_extractor_version5.h"
+
+// Builds the small MKV files the tests parse, and the temporary directory
+// they are written to.
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+// Element ID as-is, then an 8 byte size and the payload
+inline std::string Element(uint32_t id, const std::string& payload) {
+  std::string out;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    if ((id >> shift) != 0) {
+      out.push_back(static_cast<char>(id >> shift));
+    }
+  }
+  uint64_t size = payload.size() | (uint64_t(1) << 56);
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(size >> shift));
+  }
+  return out + payload;
+}
+
+// Element whose size is the 8 byte "unknown" VINT, as live recordings write
+// their Segment and Clusters
+inline std::string UnknownSizeElement(uint32_t id, const std::string& payload) {
+  std::string element = Element(id, payload);
+  size_t sizeAt = element.size() - payload.size() - 8;
+  element.replace(sizeAt, 8, "\x01\xFF\xFF\xFF\xFF\xFF\xFF\xFF", 8);
+  return element;
+}
+
+// Unsigned integer element, always 8 bytes
+inline std::string UInt(uint32_t id, uint64_t value) {
+  std::string payload;
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    payload.push_back(static_cast<char>(value >> shift));
+  }
+  return Element(id, payload);
+}
+
+inline std::string Float(uint32_t id, double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return UInt(id, bits);
+}
+
+// EBML header, then a Segment holding `segment`
+inline std::string MkvFile(const std::string& segment) {
+  return Element(MkvIds::EBML, Element(MkvIds::DocType, "matroska")) +
+         Element(MkvIds::Segment, segment);
+}
+
+inline void WriteFile(const std::string& path, const std::string& data) {
+  std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+}
+
+inline std::string ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// The Segment of a typical episode: one video track, a few audio and
+// subtitle tracks, and the fonts the subtitles use
+inline std::string TypicalEpisodeSegment() {
+  std::string tracks;
+  tracks += Element(MkvIds::TrackEntry,
+                    UInt(MkvIds::TrackNumber, 1) + UInt(MkvIds::TrackType, TRACK_TYPE_VIDEO) +
+                        Element(MkvIds::CodecID, "V_MPEGH/ISO/HEVC") +
+                        Element(MkvIds::Language, "und") +
+                        Element(MkvIds::Name, "Main video, 1080p HDR10 encode"));
+  const char* languages[] = {"jpn", "eng", "ger"};
+  uint8_t number = 2;
+  for (const char* language : languages) {
+    tracks += Element(MkvIds::TrackEntry,
+                      UInt(MkvIds::TrackNumber, number++) +
+                          UInt(MkvIds::TrackType, TRACK_TYPE_AUDIO) +
+                          Element(MkvIds::CodecID, "A_OPUS") + Element(MkvIds::Language, language) +
+                          Element(MkvIds::Name, std::string("Stereo ") + language + " dub"));
+    tracks += Element(MkvIds::TrackEntry,
+                      UInt(MkvIds::TrackNumber, number++) +
+                          UInt(MkvIds::TrackType, TRACK_TYPE_SUBTITLE) +
+                          Element(MkvIds::CodecID, "S_TEXT/ASS") +
+                          Element(MkvIds::Language, language) +
+                          Element(MkvIds::Name, std::string("Full subtitles ") + language));
+  }
+
+  std::string attachments;
+  for (int i = 0; i < 6; i++) {
+    attachments += Element(
+        MkvIds::AttachedFile,
+        Element(MkvIds::FileName, "SubtitleFont-Regular-" + std::to_string(i) + ".ttf") +
+            Element(MkvIds::FileMimeType, "application/x-truetype-font") +
+            Element(MkvIds::FileData, std::string(64, 'F')) + UInt(MkvIds::FileUID, i + 1));
+  }
+
+  std::string info = UInt(MkvIds::TimecodeScale, 1) +
+                     Element(MkvIds::Title, "Some Show - S01E01 - A Long Episode Title") +
+                     Element(MkvIds::MuxingApp, "libebml v1.4.4 + libmatroska v1.7.1") +
+                     Element(MkvIds::WritingApp, "mkvmerge v80.0 ('Roundabout') 64-bit");
+
+  return Element(MkvIds::SegmentInfo, info) + Element(MkvIds::Tracks, tracks) +
+         Element(MkvIds::Attachments, attachments);
+}
+
+// A fresh directory under the temporary directory for each test, named after
+// the test suite and removed afterwards
+class TempDirTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ::testing::UnitTest::GetInstance()->current_test_info()->test_suite_name();
+    std::filesystem::remove_all(root_);
+    std::filesystem::create_directories(root_);
+    path_ = Path("test.mkv");
+  }
+
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  std::string Path(const std::string& name) const { return (root_ / name).string(); }
+
+  // Write an MKV file whose Segment holds `segment`. Returns its path.
+  std::string WriteMkv(const std::string& segment, const std::string& name = "test.mkv") {
+    std::string path = Path(name);
+    WriteFile(path, MkvFile(segment));
+    return path;
+  }
+
+  std::filesystem::path root_;
+  std::string path_;  // where WriteMkv() writes by default
+};
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
+
+#endif  // EBML_TEST_WRITER_H
@@ -0,0 +1,250 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "ebml_vint.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+// Minimal EBML writer: `value` as a `length` byte VINT, marker bit included
+void WriteVint(std::vector<uint8_t>& out, uint64_t value, unsigned length) {
+  uint64_t encoded = value | (uint64_t(1) << (7 * length));
+  for (unsigned i = length; i > 0; i--) {
+    out.push_back(static_cast<uint8_t>(encoded >> (8 * (i - 1))));
+  }
+}
+
+// Element IDs are written as-is, their marker is part of the value
+void WriteId(std::vector<uint8_t>& out, uint32_t id, unsigned length) {
+  for (unsigned i = length; i > 0; i--) {
+    out.push_back(static_cast<uint8_t>(id >> (8 * (i - 1))));
+  }
+}
+
+// The decoder the parser used before: bit-by-bit length, byte-by-byte value
+uint64_t ReferenceDecodeSize(const uint8_t* p, unsigned& length) {
+  uint8_t mask = 0x80;
+  length = 1;
+  while (length <= 8 && !(p[0] & mask)) {
+    mask >>= 1;
+    length++;
+  }
+  if (length > 8) {
+    length = 0;
+    return 0;
+  }
+  uint64_t value = p[0] & (mask - 1);
+  for (unsigned i = 1; i < length; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value == (uint64_t(1) << (7 * length)) - 1 ? MKV_UNKNOWN_SIZE : value;
+}
+
+// Decode through both paths: exact span (byte loop) and padded span (load)
+void ExpectSizeRoundTrip(uint64_t value, unsigned length) {
+  std::vector<uint8_t> buffer;
+  WriteVint(buffer, value, length);
+
+  uint64_t decoded = 0;
+  ASSERT_EQ(ebmlDecodeSize(buffer.data(), buffer.size(), decoded), length);
+  ASSERT_EQ(decoded, value) << "length " << length << ", exact span";
+
+  buffer.resize(length + 8, 0xAA);
+  decoded = 0;
+  ASSERT_EQ(ebmlDecodeSize(buffer.data(), buffer.size(), decoded), length);
+  ASSERT_EQ(decoded, value) << "length " << length << ", padded span";
+}
+
+// Every value of a length, the all-ones value is reserved
+void ExpectEverySizeRoundTrips(unsigned length) {
+  uint64_t reserved = (uint64_t(1) << (7 * length)) - 1;
+  for (uint64_t value = 0; value < reserved; value++) {
+    ExpectSizeRoundTrip(value, length);
+  }
+}
+
+void ExpectEveryIdRoundTrips(unsigned length) {
+  uint32_t first = uint32_t(1) << (7 * length);
+  uint32_t last = (first << 1) - 1;
+  for (uint32_t id = first; id <= last; id++) {
+    std::vector<uint8_t> buffer;
+    WriteId(buffer, id, length);
+    uint32_t decoded = 0;
+    ASSERT_EQ(ebmlDecodeId(buffer.data(), buffer.size(), decoded), length);
+    ASSERT_EQ(decoded, id);
+
+    buffer.resize(length + 8, 0x55);
+    decoded = 0;
+    ASSERT_EQ(ebmlDecodeId(buffer.data(), buffer.size(), decoded), length);
+    ASSERT_EQ(decoded, id);
+  }
+}
+
+// Small deterministic generator so failures are reproducible
+uint64_t NextRandom(uint64_t& state) {
+  state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return state >> 11;
+}
+
+}  // namespace
+
+TEST(EbmlVint, LengthFromFirstByte) {
+  EXPECT_EQ(ebmlVintLength(0), 0u);
+  for (unsigned byte = 1; byte < 256; byte++) {
+    unsigned expected = 1;
+    while (!(byte & (0x80 >> (expected - 1)))) {
+      expected++;
+    }
+    EXPECT_EQ(ebmlVintLength(static_cast<uint8_t>(byte)), expected) << byte;
+  }
+}
+
+TEST(EbmlVint, SizeRoundTripExhaustiveUpTo2Bytes) {
+  ExpectEverySizeRoundTrips(1);
+  ExpectEverySizeRoundTrips(2);
+}
+
+// Two million values, too slow for every run (seconds, tens of seconds under
+// sanitizers). Run with --gtest_also_run_disabled_tests after changing the
+// decoder.
+TEST(EbmlVint, DISABLED_SizeRoundTripExhaustive3Bytes) {
+  ExpectEverySizeRoundTrips(3);
+}
+
+TEST(EbmlVint, SizeRoundTripLongLengths) {
+  uint64_t state = 42;
+  for (unsigned length = 4; length <= 8; length++) {
+    uint64_t reserved = (uint64_t(1) << (7 * length)) - 1;
+
+    // Edges of the range and around every power of two
+    ExpectSizeRoundTrip(0, length);
+    ExpectSizeRoundTrip(reserved - 1, length);
+    for (unsigned bit = 0; bit < 7 * length; bit++) {
+      uint64_t power = uint64_t(1) << bit;
+      ExpectSizeRoundTrip(power, length);
+      ExpectSizeRoundTrip(power - 1, length);
+      if (power + 1 < reserved) {
+        ExpectSizeRoundTrip(power + 1, length);
+      }
+    }
+
+    for (int i = 0; i < 200000; i++) {
+      ExpectSizeRoundTrip(NextRandom(state) % reserved, length);
+    }
+  }
+}
+
+TEST(EbmlVint, UnknownSizeForEveryLength) {
+  for (unsigned length = 1; length <= 8; length++) {
+    std::vector<uint8_t> buffer;
+    WriteVint(buffer, (uint64_t(1) << (7 * length)) - 1, length);
+    uint64_t decoded = 0;
+    EXPECT_EQ(ebmlDecodeSize(buffer.data(), buffer.size(), decoded), length);
+    EXPECT_EQ(decoded, MKV_UNKNOWN_SIZE) << "length " << length;
+  }
+}
+
+TEST(EbmlVint, RejectsInvalidAndTruncatedSizes) {
+  const uint8_t zero[9] = {};
+  uint64_t decoded = 0;
+  EXPECT_EQ(ebmlDecodeSize(zero, sizeof(zero), decoded), 0u);
+  EXPECT_EQ(ebmlDecodeSize(zero, 0, decoded), 0u);
+
+  std::vector<uint8_t> buffer;
+  WriteVint(buffer, 1000, 4);
+  for (size_t available = 1; available < 4; available++) {
+    EXPECT_EQ(ebmlDecodeSize(buffer.data(), available, decoded), 0u);
+  }
+}
+
+TEST(EbmlVint, IdRoundTripExhaustiveUpTo2Bytes) {
+  ExpectEveryIdRoundTrips(1);
+  ExpectEveryIdRoundTrips(2);
+}
+
+// See DISABLED_SizeRoundTripExhaustive3Bytes
+TEST(EbmlVint, DISABLED_IdRoundTripExhaustive3Bytes) {
+  ExpectEveryIdRoundTrips(3);
+}
+
+TEST(EbmlVint, IdRoundTripFourBytes) {
+  uint64_t state = 7;
+  std::vector<uint32_t> ids = {0x10000000, 0x1FFFFFFF, 0x18538067, 0x1F43B675, 0x1A45DFA3};
+  for (int i = 0; i < 200000; i++) {
+    ids.push_back(0x10000000 | static_cast<uint32_t>(NextRandom(state) & 0x0FFFFFFF));
+  }
+
+  for (uint32_t id : ids) {
+    std::vector<uint8_t> buffer;
+    WriteId(buffer, id, 4);
+    buffer.resize(12, 0);
+    uint32_t decoded = 0;
+    ASSERT_EQ(ebmlDecodeId(buffer.data(), buffer.size(), decoded), 4u);
+    ASSERT_EQ(decoded, id);
+  }
+}
+
+TEST(EbmlVint, RejectsIdsLongerThanFourBytes) {
+  const uint8_t fiveBytes[8] = {0x08, 1, 2, 3, 4, 0, 0, 0};
+  uint32_t decoded = 0;
+  EXPECT_EQ(ebmlDecodeId(fiveBytes, sizeof(fiveBytes), decoded), 0u);
+}
+
+TEST(EbmlVint, UnsignedIntegers) {
+  const uint8_t bytes[16] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFF, 0xFF};
+  EXPECT_EQ(ebmlDecodeUnsigned(bytes, sizeof(bytes), 0), 0u);
+  EXPECT_EQ(ebmlDecodeUnsigned(bytes, sizeof(bytes), 1), 0x01u);
+  EXPECT_EQ(ebmlDecodeUnsigned(bytes, sizeof(bytes), 3), 0x012345u);
+  EXPECT_EQ(ebmlDecodeUnsigned(bytes, sizeof(bytes), 8), 0x0123456789ABCDEFULL);
+  EXPECT_EQ(ebmlDecodeUnsigned(bytes, 3, 3), 0x012345u);
+}
+
+// Micro-benchmark: decoding a dense run of element sizes, mostly 1 and 2
+// bytes long like inside TrackEntry or BlockGroup. Prints ns per VINT; it
+// only fails if the two decoders disagree. Disabled like every benchmark,
+// run with --gtest_also_run_disabled_tests.
+TEST(EbmlVint, DISABLED_DecodeCost) {
+  std::vector<uint8_t> buffer;
+  uint64_t state = 1;
+  const int count = 1000000;
+  for (int i = 0; i < count; i++) {
+    uint64_t r = NextRandom(state);
+    unsigned length = (r & 7) < 5 ? 1 : (r & 7) < 7 ? 2 : 1 + (r >> 8) % 8;
+    WriteVint(buffer, (r >> 16) % ((uint64_t(1) << (7 * length)) - 1), length);
+  }
+  buffer.resize(buffer.size() + 8, 0);
+
+  uint64_t fastSum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t pos = 0, end = buffer.size() - 8; pos < end;) {
+    uint64_t value = 0;
+    pos += ebmlDecodeSize(buffer.data() + pos, buffer.size() - pos, value);
+    fastSum += value;
+  }
+  auto fastTime = std::chrono::steady_clock::now() - start;
+
+  uint64_t referenceSum = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t pos = 0, end = buffer.size() - 8; pos < end;) {
+    unsigned length = 0;
+    referenceSum += ReferenceDecodeSize(buffer.data() + pos, length);
+    pos += length;
+  }
+  auto referenceTime = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(fastSum, referenceSum);
+  std::cout << "clz/load decode: "
+            << std::chrono::duration<double, std::nano>(fastTime).count() / count
+            << " ns/vint, bit loop decode: "
+            << std::chrono::duration<double, std::nano>(referenceTime).count() / count
+            << " ns/vint" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
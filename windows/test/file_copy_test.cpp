@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "ebml_test_writer.h"
+#include "file_copy.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+class FileCopyTest : public TempDirTest {
+ protected:
+  std::string WriteSource(size_t size) {
+    source_.resize(size);
+    for (size_t i = 0; i < size; i++) {
+      source_[i] = static_cast<char>((i * 131) >> 7);
+    }
+    std::string path = Path("source.mkv");
+    WriteFile(path, source_);
+    return path;
+  }
+
+  std::string source_;
+};
+
+}  // namespace
+
+TEST_F(FileCopyTest, CopiesUnalignedSections) {
+  std::string source = WriteSource(3 * 1024 * 1024 + 123);
+
+  // Offsets and lengths off any sector boundary, and a section that ends on
+  // the last byte of the file
+  const uint64_t sections[][2] = {{0, 1}, {4095, 4098}, {12345, 2 * 1024 * 1024 + 7},
+                                  {source_.size() - 777, 777}, {100, 0}};
+  for (const auto& section : sections) {
+    std::string output = Path("out.bin");
+    FileCopyStats stats;
+    ASSERT_TRUE(copyFileSection(source, section[0], section[1], output, &stats));
+    EXPECT_EQ(stats.bytes, section[1]);
+    EXPECT_NE(stats.method, FILE_COPY_NONE);
+    EXPECT_EQ(ReadFile(output), source_.substr(section[0], section[1]));
+  }
+}
+
+TEST_F(FileCopyTest, ShortSourceFailsAndLeavesNoOutput) {
+  std::string source = WriteSource(1000);
+  std::string output = Path("out.bin");
+  EXPECT_FALSE(copyFileSection(source, 900, 200, output));
+  EXPECT_FALSE(std::filesystem::exists(output));
+  EXPECT_FALSE(copyFileSection(Path("missing.mkv"), 0, 10, output));
+  EXPECT_FALSE(copyFileSection(source, 0, 10, Path("missing/out.bin")));
+}
+
+// Benchmark: a 256 MiB attachment, as bundled extras can be. Prints the
+// throughput and the method used. Disabled since it writes half a GiB;
+// run with --gtest_also_run_disabled_tests.
+TEST_F(FileCopyTest, DISABLED_LargeAttachmentThroughput) {
+  std::string source = WriteSource(256 * 1024 * 1024 + 4096);
+  FileCopyStats stats;
+  ASSERT_TRUE(copyFileSection(source, 4096, 256 * 1024 * 1024, Path("extra.mkv"), &stats));
+  EXPECT_EQ(std::filesystem::file_size(Path("extra.mkv")), 256u * 1024 * 1024);
+  std::cout << "256 MiB attachment: " << stats.elapsedUs / 1000.0 << " ms, "
+            << stats.getBytesPerSecond() / (1024 * 1024) << " MiB/s ("
+            << getFileCopyMethodName(stats.method) << ")" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
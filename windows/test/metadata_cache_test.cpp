@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "metadata_cache.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+MetadataCacheKey Key(const std::string& path, uint64_t size = 1000, uint64_t time = 42,
+                     uint32_t kind = 1) {
+  MetadataCacheKey key;
+  key.path = path;
+  key.fileSize = size;
+  key.lastWriteTime = time;
+  key.kind = kind;
+  return key;
+}
+
+std::vector<uint8_t> Payload(const std::string& text) {
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+bool Store(MetadataCache& cache, const MetadataCacheKey& key, const std::string& text) {
+  std::vector<uint8_t> payload = Payload(text);
+  return cache.store(key, payload.data(), payload.size());
+}
+
+class MetadataCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    directory_ = (std::filesystem::temp_directory_path() / "metadata_cache_test").string();
+    std::filesystem::remove_all(directory_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(directory_); }
+
+  std::string directory_;
+};
+
+}  // namespace
+
+TEST_F(MetadataCacheTest, FindsStoredEntriesAfterReopen) {
+  {
+    MetadataCache cache;
+    ASSERT_TRUE(cache.open(directory_));
+    EXPECT_TRUE(Store(cache, Key("C:/videos/a.mkv"), "metadata of a"));
+    EXPECT_TRUE(Store(cache, Key("C:/videos/b.mkv"), "metadata of b"));
+  }
+
+  MetadataCache cache;
+  ASSERT_TRUE(cache.open(directory_));
+  std::vector<uint8_t> payload;
+  ASSERT_TRUE(cache.find(Key("C:/videos/a.mkv"), payload));
+  EXPECT_EQ(payload, Payload("metadata of a"));
+  ASSERT_TRUE(cache.find(Key("C:/videos/b.mkv"), payload));
+  EXPECT_EQ(payload, Payload("metadata of b"));
+  EXPECT_FALSE(cache.find(Key("C:/videos/c.mkv"), payload));
+  EXPECT_EQ(cache.getStats().entries, 2u);
+}
+
+TEST_F(MetadataCacheTest, ChangedFilesMiss) {
+  MetadataCache cache;
+  ASSERT_TRUE(cache.open(directory_));
+  ASSERT_TRUE(Store(cache, Key("a.mkv", 1000, 42, 1), "old"));
+
+  std::vector<uint8_t> payload;
+  EXPECT_FALSE(cache.find(Key("a.mkv", 1001, 42, 1), payload));
+  EXPECT_FALSE(cache.find(Key("a.mkv", 1000, 43, 1), payload));
+  EXPECT_FALSE(cache.find(Key("a.mkv", 1000, 42, 2), payload));
+
+  // A new result for the same file replaces the old one
+  ASSERT_TRUE(Store(cache, Key("a.mkv", 1001, 43, 1), "new"));
+  ASSERT_TRUE(cache.find(Key("a.mkv", 1001, 43, 1), payload));
+  EXPECT_EQ(payload, Payload("new"));
+  EXPECT_FALSE(cache.find(Key("a.mkv", 1000, 42, 1), payload));
+  EXPECT_EQ(cache.getStats().entries, 1u);
+}
+
+TEST_F(MetadataCacheTest, BudgetIsEnforcedAndCompactionKeepsNewest) {
+  const uint64_t budget = 64 * 1024;
+  const std::string value(1000, 'x');
+  int stored = 0;
+  {
+    MetadataCache cache;
+    ASSERT_TRUE(cache.open(directory_, budget));
+    while (Store(cache, Key("file" + std::to_string(stored)), value)) {
+      stored++;
+    }
+    EXPECT_GT(stored, 50);
+    EXPECT_EQ(cache.getStats().rejected, 1u);
+    EXPECT_LE(cache.getStats().dataBytes, budget);
+  }
+
+  MetadataCache cache;
+  ASSERT_TRUE(cache.open(directory_, budget));
+  MetadataCacheStats stats = cache.getStats();
+  EXPECT_LE(stats.dataBytes, budget / 2);
+  EXPECT_GT(stats.compactedBytes, 0u);
+
+  std::vector<uint8_t> payload;
+  EXPECT_TRUE(cache.find(Key("file" + std::to_string(stored - 1)), payload));
+  EXPECT_FALSE(cache.find(Key("file0"), payload));
+  EXPECT_TRUE(Store(cache, Key("after compaction"), value));
+}
+
+TEST_F(MetadataCacheTest, DamagedIndexResetsTheCache) {
+  {
+    MetadataCache cache;
+    ASSERT_TRUE(cache.open(directory_));
+    ASSERT_TRUE(Store(cache, Key("a.mkv"), "a"));
+  }
+  {
+    std::ofstream index(directory_ + "/metadata_cache.idx", std::ios::binary | std::ios::trunc);
+    index << "garbage";
+  }
+
+  MetadataCache cache;
+  ASSERT_TRUE(cache.open(directory_));
+  std::vector<uint8_t> payload;
+  EXPECT_FALSE(cache.find(Key("a.mkv"), payload));
+  EXPECT_TRUE(Store(cache, Key("a.mkv"), "a"));
+  EXPECT_TRUE(cache.find(Key("a.mkv"), payload));
+}
+
+TEST_F(MetadataCacheTest, KeysComeFromTheFile) {
+  std::filesystem::create_directories(directory_);
+  std::string path = directory_ + "/video.mkv";
+  std::ofstream(path, std::ios::binary) << "1234567";
+
+  MetadataCacheKey key;
+  ASSERT_TRUE(makeMetadataCacheKey(path, 3, key));
+  EXPECT_EQ(key.fileSize, 7u);
+  EXPECT_NE(key.lastWriteTime, 0u);
+  EXPECT_EQ(key.kind, 3u);
+  EXPECT_FALSE(makeMetadataCacheKey(directory_ + "/missing.mkv", 3, key));
+  EXPECT_FALSE(makeMetadataCacheKey(directory_, 3, key));
+
+  // Another spelling of the same file
+  MetadataCacheKey other;
+  ASSERT_TRUE(makeMetadataCacheKey(path, 3, key));
+  ASSERT_TRUE(makeMetadataCacheKey(directory_ + "//video.mkv", 3, other));
+  EXPECT_EQ(other.path, key.path);
+}
+
+TEST_F(MetadataCacheTest, OnlyOneCacheAppendsToADirectory) {
+  MetadataCache first;
+  ASSERT_TRUE(first.open(directory_));
+  EXPECT_TRUE(Store(first, Key("a.mkv"), "a"));
+
+  MetadataCache second;
+  EXPECT_FALSE(second.open(directory_));
+  EXPECT_FALSE(second.isOpen());
+  EXPECT_FALSE(Store(second, Key("b.mkv"), "b"));
+
+  first.close();
+  ASSERT_TRUE(second.open(directory_));
+  std::vector<uint8_t> payload;
+  EXPECT_TRUE(second.find(Key("a.mkv"), payload));
+}
+
+// Benchmark: a warm start over a 50k file library, every answer coming from
+// the cache. Prints the time to open the cache and look everything up.
+// Writes 50k entries first, so it only runs with
+// --gtest_also_run_disabled_tests.
+TEST_F(MetadataCacheTest, DISABLED_WarmStartOver50kFiles) {
+  const int files = 50000;
+  const std::string value(600, 'm');  // about one encoded getMkvMetadata map
+  {
+    MetadataCache cache;
+    ASSERT_TRUE(cache.open(directory_));
+    for (int i = 0; i < files; i++) {
+      ASSERT_TRUE(Store(cache, Key("D:/Library/Show " + std::to_string(i / 24) + "/Episode " +
+                                       std::to_string(i) + ".mkv"),
+                        value));
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  MetadataCache cache;
+  ASSERT_TRUE(cache.open(directory_));
+  std::vector<uint8_t> payload;
+  int hits = 0;
+  for (int i = 0; i < files; i++) {
+    hits += cache.find(Key("D:/Library/Show " + std::to_string(i / 24) + "/Episode " +
+                           std::to_string(i) + ".mkv"),
+                       payload);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(hits, files);
+  std::cout << "warm start over " << files << " files: "
+            << std::chrono::duration<double, std::milli>(elapsed).count() << " ms" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "ebml_test_writer.h"
+
+// Built as its own executable: counting allocations means replacing the
+// global allocation functions, which would otherwise apply to every test.
+// All of the plain, array and nothrow forms are replaced so that each pair
+// allocates and frees through the same functions.
+
+namespace {
+std::atomic<uint64_t> g_allocations(0);
+
+void* Allocate(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+}  // namespace
+
+void* operator new(size_t size) {
+  if (void* p = Allocate(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  if (void* p = Allocate(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+class MkvAllocationBench : public TempDirTest {
+ protected:
+  void SetUp() override {
+    TempDirTest::SetUp();
+    WriteMkv(TypicalEpisodeSegment());
+  }
+
+  // Heap allocations per open() once the extractor has warmed up
+  double AllocationsPerFile(bool mapped, int files) {
+    MkvMetadataExtractor extractor;
+    std::streambuf* log = std::cout.rdbuf(nullptr);
+    Open(extractor, mapped);
+
+    uint64_t before = g_allocations.load();
+    for (int i = 0; i < files; i++) {
+      Open(extractor, mapped);
+    }
+    uint64_t allocations = g_allocations.load() - before;
+
+    std::cout.rdbuf(log);
+    return static_cast<double>(allocations) / files;
+  }
+
+  void Open(MkvMetadataExtractor& extractor, bool mapped) {
+    bool ok = mapped ? extractor.openMapped(path_) : extractor.open(path_);
+    ASSERT_TRUE(ok);
+  }
+};
+
+}  // namespace
+
+// Heap allocations per parsed file when one extractor indexes a library.
+// Prints allocations per file; fails if parsing the strings of a file starts
+// allocating per string again.
+TEST_F(MkvAllocationBench, AllocationsPerFile) {
+  const int files = 1000;
+  double mapped = AllocationsPerFile(true, files);
+  double stream = AllocationsPerFile(false, files);
+
+  // 36 strings per file: 3 per track, 2 per attachment, 3 in SegmentInfo
+  std::cout << "allocations per file: " << mapped << " mapped, " << stream << " stream"
+            << std::endl;
+
+  // Mapping handles and stream buffers only, no matter how many strings
+  EXPECT_LE(mapped, 4.0);
+  EXPECT_LE(stream, 8.0);
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
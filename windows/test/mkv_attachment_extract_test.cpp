@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string FontData(int i, size_t size) {
+  std::string data(size, static_cast<char>('a' + i % 26));
+  data.replace(0, 8, "font" + std::to_string(1000 + i));
+  return data;
+}
+
+std::string Attachment(const std::string& name, const std::string& mimeType,
+                       const std::string& data) {
+  return Element(MkvIds::AttachedFile, Element(MkvIds::FileName, name) +
+                                           Element(MkvIds::FileMimeType, mimeType) +
+                                           Element(MkvIds::FileData, data));
+}
+
+class MkvAttachmentExtractTest : public TempDirTest {
+ protected:
+  std::string WriteAttachments(const std::string& attachments) {
+    return WriteMkv(Element(MkvIds::Attachments, attachments));
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvAttachmentExtractTest, WritesEveryAttachmentInBothModes) {
+  std::string path = WriteAttachments(Attachment("a.ttf", "font/ttf", FontData(0, 3000)) +
+                                      Attachment("b.otf", "font/otf", FontData(1, 5000)) +
+                                      Attachment("cover.jpg", "image/jpeg", FontData(2, 100)));
+
+  for (bool mapped : {false, true}) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(mapped ? extractor.openMapped(path, MKV_SECTION_ATTACHMENTS)
+                       : extractor.open(path, MKV_SECTION_ATTACHMENTS));
+
+    std::string dir = Path(mapped ? "mapped" : "stream");
+    std::vector<MkvExtractedFile> manifest;
+    MkvBulkExtractStats stats;
+    ASSERT_TRUE(extractor.extractAllAttachments(dir, MkvAttachmentFilter(), manifest, &stats));
+
+    ASSERT_EQ(manifest.size(), 3u);
+    EXPECT_EQ(stats.files, 3u);
+    EXPECT_EQ(stats.bytes, 8100u);
+    EXPECT_EQ(manifest[1].path, dir + "/b.otf");
+    for (size_t i = 0; i < manifest.size(); i++) {
+      EXPECT_TRUE(manifest[i].written);
+      EXPECT_EQ(manifest[i].index, i);
+      EXPECT_EQ(ReadFile(manifest[i].path), FontData(static_cast<int>(i), manifest[i].size));
+    }
+
+    // The three attachments are neighbours: past what the parse left in the
+    // reader's window, one read brings them all in
+    EXPECT_LE(stats.streamReads, mapped ? 0u : 2u);
+  }
+}
+
+TEST_F(MkvAttachmentExtractTest, FiltersAndNamesSafely) {
+  std::string path = WriteAttachments(Attachment("Font.TTF", "application/x-truetype-font", "1") +
+                                      Attachment("font.ttf", "application/x-truetype-font", "2") +
+                                      Attachment("../../evil.otf", "application/vnd.ms-opentype", "3") +
+                                      Attachment("con.ttf", "font/ttf", "4") +
+                                      Attachment("cover.jpg", "image/jpeg", "5") +
+                                      Attachment("", "font/woff2", "6"));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.openMapped(path, MKV_SECTION_ATTACHMENTS));
+
+  MkvAttachmentFilter filter;
+  filter.mimeTypes = {"font/", "application/x-truetype-font"};
+  filter.extensions = {".OTF"};
+  std::string dir = Path("fonts");
+  std::vector<MkvExtractedFile> manifest;
+  ASSERT_TRUE(extractor.extractAllAttachments(dir, filter, manifest));
+
+  ASSERT_EQ(manifest.size(), 5u);
+  EXPECT_EQ(manifest[0].path, dir + "/Font.TTF");
+  EXPECT_EQ(manifest[1].path, dir + "/font (2).ttf");
+  EXPECT_EQ(manifest[2].path, dir + "/evil.otf");
+  EXPECT_EQ(manifest[3].path, dir + "/_con.ttf");
+  EXPECT_EQ(manifest[4].path, dir + "/attachment_5");
+  EXPECT_EQ(ReadFile(manifest[1].path), "2");
+  EXPECT_EQ(ReadFile(manifest[4].path), "6");
+}
+
+TEST_F(MkvAttachmentExtractTest, ReadsWindowsInMemory) {
+  const std::string cover = FontData(7, 10000);
+  std::string path = WriteAttachments(Attachment("a.ttf", "font/ttf", FontData(0, 300)) +
+                                      Attachment("cover.jpg", "image/jpeg", cover));
+
+  for (bool mapped : {false, true}) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(mapped ? extractor.openMapped(path, MKV_SECTION_ATTACHMENTS)
+                       : extractor.open(path, MKV_SECTION_ATTACHMENTS));
+
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(extractor.readAttachment(1, 0, UINT64_MAX, data));
+    EXPECT_EQ(std::string(data.begin(), data.end()), cover);
+
+    ASSERT_TRUE(extractor.readAttachment(1, 4000, 100, data));
+    EXPECT_EQ(std::string(data.begin(), data.end()), cover.substr(4000, 100));
+
+    // Windows are clamped to the attachment
+    ASSERT_TRUE(extractor.readAttachment(1, 9990, 100, data));
+    EXPECT_EQ(std::string(data.begin(), data.end()), cover.substr(9990));
+    ASSERT_TRUE(extractor.readAttachment(1, 20000, 100, data));
+    EXPECT_TRUE(data.empty());
+
+    EXPECT_FALSE(extractor.readAttachment(2, 0, 100, data));
+  }
+}
+
+// Benchmark: a release with 40 fonts, extracted one call at a time (reopening
+// the file each time, as the per-attachment channel call does) and in one
+// bulk pass. Prints both times. Disabled, use
+// --gtest_also_run_disabled_tests to run it.
+TEST_F(MkvAttachmentExtractTest, DISABLED_FortyFontRelease) {
+  std::string attachments;
+  for (int i = 0; i < 40; i++) {
+    attachments += Attachment("Font" + std::to_string(i) + ".ttf", "font/ttf",
+                              FontData(i, 100 * 1024 + i * 4096));
+  }
+  std::string path = WriteAttachments(attachments);
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < 40; i++) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.open(path, MKV_SECTION_ATTACHMENTS));
+    std::filesystem::create_directories(Path("single"));
+    ASSERT_TRUE(
+        extractor.extractAttachment(i, Path("single") + "/" + std::to_string(i) + ".ttf"));
+  }
+  auto single = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path, MKV_SECTION_ATTACHMENTS));
+  std::vector<MkvExtractedFile> manifest;
+  MkvBulkExtractStats stats;
+  ASSERT_TRUE(
+      extractor.extractAllAttachments(Path("bulk"), MkvAttachmentFilter(), manifest, &stats));
+  auto bulk = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(stats.files, 40u);
+  EXPECT_LE(stats.streamReads, 3u);
+  std::cout << "40 fonts (" << stats.bytes / 1024 << " KiB): one call per font "
+            << std::chrono::duration<double, std::milli>(single).count() << " ms, bulk "
+            << std::chrono::duration<double, std::milli>(bulk).count() << " ms in "
+            << stats.streamReads << " reads" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_attachment_store.h"
+#include "xxhash64.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string Payload(const std::string& seed, size_t size) {
+  std::string data(size, '\0');
+  uint64_t state = XxHash64::hash(seed.data(), seed.size());
+  for (size_t i = 0; i < size; i++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    data[i] = static_cast<char>(state >> 56);
+  }
+  return data;
+}
+
+std::string Attachment(const std::string& name, uint64_t uid, const std::string& data) {
+  return Element(MkvIds::AttachedFile, Element(MkvIds::FileName, name) +
+                                           Element(MkvIds::FileMimeType, "font/ttf") +
+                                           Element(MkvIds::FileData, data) +
+                                           UInt(MkvIds::FileUID, uid));
+}
+
+class MkvAttachmentStoreTest : public TempDirTest {
+ protected:
+  // An episode carrying the season's fonts, each under a fresh FileUID as
+  // mkvmerge assigns them, plus a cover of its own
+  std::string WriteEpisode(int episode, int fonts, size_t fontSize) {
+    std::string attachments;
+    for (int i = 0; i < fonts; i++) {
+      attachments += Attachment("Font" + std::to_string(i) + ".ttf",
+                                (uint64_t(episode + 1) << 32) | (i + 1),
+                                Payload("font" + std::to_string(i), fontSize));
+    }
+    attachments += Attachment("cover.jpg", (uint64_t(episode + 1) << 32) | 0xFFFF,
+                              Payload("cover" + std::to_string(episode), 5000));
+
+    return WriteMkv(Element(MkvIds::Attachments, attachments),
+                    "episode" + std::to_string(episode) + ".mkv");
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvAttachmentStoreTest, XxHash64MatchesReferenceValues) {
+  EXPECT_EQ(XxHash64::hash("", 0), 0xEF46DB3751D8E999ULL);
+  EXPECT_EQ(XxHash64::hash("abc", 3), 0x44BC2CF5AD770999ULL);
+  const std::string text = "Nobody inspects the spammish repetition";
+  EXPECT_EQ(XxHash64::hash(text.data(), text.size()), 0xFBCEA83C8A378BF1ULL);
+
+  // Pieces of any size give the same digest
+  std::string data = Payload("stream", 1000);
+  XxHash64 state;
+  for (size_t i = 0; i < data.size(); i += 13) {
+    state.update(data.data() + i, std::min<size_t>(13, data.size() - i));
+  }
+  EXPECT_EQ(state.digest(), XxHash64::hash(data.data(), data.size()));
+}
+
+TEST_F(MkvAttachmentStoreTest, SharedFontsAreStoredOnce) {
+  std::vector<std::string> episodes = {WriteEpisode(0, 3, 2000), WriteEpisode(1, 3, 2000)};
+  MkvAttachmentStore store;
+  ASSERT_TRUE(store.open(Path("store")));
+
+  std::vector<std::string> firstPaths;
+  for (size_t e = 0; e < episodes.size(); e++) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.openMapped(episodes[e], MKV_SECTION_ATTACHMENTS));
+    for (size_t i = 0; i < extractor.getAttachments().size(); i++) {
+      MkvAttachmentBlob blob;
+      ASSERT_TRUE(store.resolve(extractor, i, blob));
+      EXPECT_EQ(blob.created, e == 0 || i == 3);
+      std::vector<uint8_t> data;
+      ASSERT_TRUE(extractor.readAttachment(i, 0, UINT64_MAX, data));
+      EXPECT_EQ(ReadFile(blob.path), std::string(data.begin(), data.end()));
+      if (e == 0) {
+        firstPaths.push_back(blob.path);
+      }
+      else if (i < 3) {
+        EXPECT_EQ(blob.path, firstPaths[i]);
+      }
+    }
+  }
+
+  MkvAttachmentStoreStats stats = store.getStats();
+  EXPECT_EQ(stats.blobsWritten, 5u);
+  EXPECT_EQ(stats.contentHits, 3u);
+  EXPECT_EQ(stats.uidHits, 0u);
+}
+
+TEST_F(MkvAttachmentStoreTest, KnownUidsSkipTheDataAfterReopen) {
+  std::string episode = WriteEpisode(0, 2, 1000);
+  {
+    MkvAttachmentStore store;
+    ASSERT_TRUE(store.open(Path("store")));
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.open(episode, MKV_SECTION_ATTACHMENTS));
+    MkvAttachmentBlob blob;
+    ASSERT_TRUE(store.resolve(extractor, 0, blob));
+    ASSERT_TRUE(store.resolve(extractor, 1, blob));
+  }
+
+  MkvAttachmentStore store;
+  ASSERT_TRUE(store.open(Path("store")));
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(episode, MKV_SECTION_ATTACHMENTS));
+  MkvAttachmentBlob blob;
+  ASSERT_TRUE(store.resolve(extractor, 0, blob));
+  EXPECT_FALSE(blob.created);
+
+  // A blob removed behind the store's back is written again
+  std::filesystem::remove(std::filesystem::u8path(blob.path));
+  ASSERT_TRUE(store.resolve(extractor, 0, blob));
+  EXPECT_TRUE(blob.created);
+
+  MkvAttachmentStoreStats stats = store.getStats();
+  EXPECT_EQ(stats.uidHits, 1u);
+  EXPECT_EQ(stats.bytesHashed, 1000u);
+}
+
+TEST_F(MkvAttachmentStoreTest, TornUidRecordIsCutOffOnReopen) {
+  std::string episode = WriteEpisode(0, 2, 1000);
+  std::string log = Path("store") + "/uids.idx";
+  {
+    MkvAttachmentStore store;
+    ASSERT_TRUE(store.open(Path("store")));
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.open(episode, MKV_SECTION_ATTACHMENTS));
+    MkvAttachmentBlob blob;
+    ASSERT_TRUE(store.resolve(extractor, 0, blob));
+  }
+  uint64_t recordSize = std::filesystem::file_size(log);
+
+  // A crash halfway through appending the next record
+  {
+    std::ofstream out(log, std::ios::binary | std::ios::app);
+    out.write("\x01\x02\x03\x04\x05\x06\x07", 7);
+  }
+
+  {
+    MkvAttachmentStore store;
+    ASSERT_TRUE(store.open(Path("store")));
+    EXPECT_EQ(std::filesystem::file_size(log), recordSize);
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.open(episode, MKV_SECTION_ATTACHMENTS));
+    MkvAttachmentBlob blob;
+    ASSERT_TRUE(store.resolve(extractor, 1, blob));
+  }
+  EXPECT_EQ(std::filesystem::file_size(log), 2 * recordSize);
+
+  // Both records read back, the one appended after the torn tail included
+  MkvAttachmentStore store;
+  ASSERT_TRUE(store.open(Path("store")));
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(episode, MKV_SECTION_ATTACHMENTS));
+  MkvAttachmentBlob blob;
+  ASSERT_TRUE(store.resolve(extractor, 0, blob));
+  ASSERT_TRUE(store.resolve(extractor, 1, blob));
+  MkvAttachmentStoreStats stats = store.getStats();
+  EXPECT_EQ(stats.uidHits, 2u);
+  EXPECT_EQ(stats.bytesHashed, 0u);
+}
+
+// Benchmark: a 24 episode season sharing 30 fonts, extracted per episode
+// (as extractAllAttachments does) and through the store, then through the
+// store again as a player reopening the season would. Prints the times and
+// the bytes each one writes. Only runs with --gtest_also_run_disabled_tests.
+TEST_F(MkvAttachmentStoreTest, DISABLED_WholeSeason) {
+  const int episodeCount = 24;
+  const int fonts = 30;
+  std::vector<std::string> episodes;
+  for (int e = 0; e < episodeCount; e++) {
+    episodes.push_back(WriteEpisode(e, fonts, 60 * 1024));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t perEpisodeBytes = 0;
+  for (int e = 0; e < episodeCount; e++) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.openMapped(episodes[e], MKV_SECTION_ATTACHMENTS));
+    std::vector<MkvExtractedFile> manifest;
+    MkvBulkExtractStats stats;
+    ASSERT_TRUE(extractor.extractAllAttachments(Path("episode" + std::to_string(e)),
+                                                MkvAttachmentFilter(), manifest, &stats));
+    perEpisodeBytes += stats.bytes;
+  }
+  auto before = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  MkvAttachmentStore store;
+  ASSERT_TRUE(store.open(Path("store")));
+  for (int e = 0; e < episodeCount; e++) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.openMapped(episodes[e], MKV_SECTION_ATTACHMENTS));
+    for (size_t i = 0; i < extractor.getAttachments().size(); i++) {
+      MkvAttachmentBlob blob;
+      ASSERT_TRUE(store.resolve(extractor, i, blob));
+    }
+  }
+  auto after = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int e = 0; e < episodeCount; e++) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.openMapped(episodes[e], MKV_SECTION_ATTACHMENTS));
+    for (size_t i = 0; i < extractor.getAttachments().size(); i++) {
+      MkvAttachmentBlob blob;
+      ASSERT_TRUE(store.resolve(extractor, i, blob));
+    }
+  }
+  auto again = std::chrono::steady_clock::now() - start;
+
+  MkvAttachmentStoreStats stats = store.getStats();
+  EXPECT_EQ(stats.blobsWritten, static_cast<uint64_t>(fonts + episodeCount));
+  EXPECT_EQ(stats.contentHits, static_cast<uint64_t>(fonts * (episodeCount - 1)));
+  EXPECT_EQ(stats.uidHits, static_cast<uint64_t>((fonts + 1) * episodeCount));
+  std::cout << "season of " << episodeCount << " episodes x " << fonts << " fonts: per episode "
+            << std::chrono::duration<double, std::milli>(before).count() << " ms ("
+            << perEpisodeBytes / 1024 << " KiB written), store "
+            << std::chrono::duration<double, std::milli>(after).count() << " ms ("
+            << stats.bytesWritten / 1024 << " KiB written), store again "
+            << std::chrono::duration<double, std::milli>(again).count() << " ms" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
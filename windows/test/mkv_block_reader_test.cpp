@@ -0,0 +1,245 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_block_reader.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+// Bytes that differ at every offset, so a read from the wrong place shows
+std::string Pattern(size_t size) {
+  std::string data(size, '\0');
+  uint32_t state = 12345;
+  for (size_t i = 0; i < size; i++) {
+    state = state * 1103515245u + 12345u;
+    data[i] = static_cast<char>(state >> 24);
+  }
+  return data;
+}
+
+class MkvBlockReaderTest : public TempDirTest {};
+
+}  // namespace
+
+TEST_F(MkvBlockReaderTest, ReadsAcrossWindowBoundaries) {
+  std::string data = Pattern(1000);
+  WriteFile(path_, data);
+
+  // A 16 byte window splits nearly every read below
+  MkvBlockReader reader(16);
+  ASSERT_TRUE(reader.open(path_));
+  EXPECT_EQ(reader.size(), data.size());
+
+  std::string out;
+  size_t chunk = 1;
+  while (out.size() < data.size()) {
+    std::string piece(chunk, '\0');
+    piece.resize(reader.read(&piece[0], piece.size()));
+    ASSERT_FALSE(piece.empty());
+    out += piece;
+    chunk = chunk % 37 + 1;
+  }
+  EXPECT_EQ(out, data);
+  EXPECT_EQ(reader.tell(), data.size());
+}
+
+TEST_F(MkvBlockReaderTest, DecodesElementsSplitByTheWindow) {
+  // A four byte ID and an eight byte size, both straddling the 16 byte window
+  std::string data = std::string(10, '\0') + UInt(MkvIds::TimecodeScale, 1000000) +
+                     Element(MkvIds::Tracks, std::string(3, 'x'));
+  WriteFile(path_, data);
+
+  MkvBlockReader reader(16);
+  ASSERT_TRUE(reader.open(path_));
+  reader.seek(10);
+  EXPECT_EQ(reader.readElementId(), MkvIds::TimecodeScale);
+  EXPECT_EQ(reader.readElementSize(), 8u);
+  EXPECT_EQ(reader.readUnsigned(8), 1000000u);
+  EXPECT_EQ(reader.readElementId(), MkvIds::Tracks);
+  EXPECT_EQ(reader.readElementSize(), 3u);
+  EXPECT_FALSE(reader.eof());
+}
+
+TEST_F(MkvBlockReaderTest, SeeksInsideTheWindowStayInMemory) {
+  std::string data = Pattern(100000);
+  WriteFile(path_, data);
+
+  MkvBlockReader reader;
+  ASSERT_TRUE(reader.open(path_));
+  uint8_t value = 0;
+  ASSERT_TRUE(reader.readByte(value));
+  uint64_t reads = reader.getStats().streamReads;
+
+  // Back and forth inside the first refill
+  reader.seek(1000);
+  ASSERT_TRUE(reader.readByte(value));
+  EXPECT_EQ(value, static_cast<uint8_t>(data[1000]));
+  reader.seek(10);
+  ASSERT_TRUE(reader.readByte(value));
+  EXPECT_EQ(value, static_cast<uint8_t>(data[10]));
+  EXPECT_EQ(reader.getStats().streamReads, reads);
+  EXPECT_EQ(reader.getStats().windowSeeks, 2u);
+
+  // Far away needs the stream again
+  reader.seek(90000);
+  ASSERT_TRUE(reader.readByte(value));
+  EXPECT_EQ(value, static_cast<uint8_t>(data[90000]));
+  EXPECT_GT(reader.getStats().streamReads, reads);
+}
+
+TEST_F(MkvBlockReaderTest, ShortReadAtTheEndOfTheFile) {
+  WriteFile(path_, Pattern(100));
+
+  MkvBlockReader reader(16);
+  ASSERT_TRUE(reader.open(path_));
+  reader.seek(90);
+  char buffer[32];
+  EXPECT_EQ(reader.read(buffer, sizeof(buffer)), 10u);
+  EXPECT_TRUE(reader.eof());
+
+  // Seeking clears it, past the end reports it again
+  reader.seek(0);
+  EXPECT_FALSE(reader.eof());
+  reader.seek(200);
+  uint8_t value = 0;
+  EXPECT_FALSE(reader.readByte(value));
+  EXPECT_TRUE(reader.eof());
+}
+
+TEST_F(MkvBlockReaderTest, StreamViewsAsLargeAsTheWindow) {
+  std::string data = Pattern(200000);
+  WriteFile(path_, data);
+
+  // Larger than the first small refill, which the view makes large enough
+  MkvBlockReader reader;
+  ASSERT_TRUE(reader.open(path_));
+  reader.seek(5000);
+  std::string_view view;
+  ASSERT_TRUE(reader.readView(40000, view));
+  EXPECT_EQ(view, std::string_view(data).substr(5000, 40000));
+  EXPECT_EQ(reader.tell(), 45000u);
+
+  // Only a view that could never fit is refused, without moving
+  EXPECT_FALSE(reader.readView(MkvBlockReader::DefaultWindowSize + 1, view));
+  EXPECT_EQ(reader.tell(), 45000u);
+}
+
+TEST_F(MkvBlockReaderTest, FileCutShortAfterOpenGivesShortReads) {
+  std::string data = Pattern(1000);
+  WriteFile(path_, data);
+
+  MkvBlockReader reader(16);
+  ASSERT_TRUE(reader.open(path_));
+  std::filesystem::resize_file(path_, 500);
+  EXPECT_EQ(reader.size(), 1000u);
+
+  reader.seek(490);
+  char buffer[32];
+  EXPECT_EQ(reader.read(buffer, sizeof(buffer)), 10u);
+  EXPECT_EQ(std::string(buffer, 10), data.substr(490, 10));
+  EXPECT_TRUE(reader.eof());
+
+  // Large reads bypass the window and stop at the same place
+  std::string large(200, '\0');
+  reader.seek(400);
+  EXPECT_EQ(reader.read(&large[0], large.size()), 100u);
+  EXPECT_TRUE(reader.eof());
+
+  // The stream recovers from the failed read for the bytes still there
+  reader.seek(100);
+  EXPECT_EQ(reader.read(buffer, sizeof(buffer)), sizeof(buffer));
+  EXPECT_EQ(std::string(buffer, sizeof(buffer)), data.substr(100, sizeof(buffer)));
+  EXPECT_FALSE(reader.eof());
+
+  uint8_t value = 0;
+  reader.seek(700);
+  EXPECT_FALSE(reader.readByte(value));
+  EXPECT_TRUE(reader.eof());
+}
+
+TEST_F(MkvBlockReaderTest, MappedAndStreamReadsMatch) {
+  std::string data = Pattern(300000);
+  WriteFile(path_, data);
+
+  MkvBlockReader mapped;
+  MkvBlockReader streamed;
+  ASSERT_TRUE(mapped.openMapped(path_));
+  ASSERT_TRUE(streamed.open(path_));
+  EXPECT_TRUE(mapped.isMapped());
+  EXPECT_FALSE(streamed.isMapped());
+  EXPECT_EQ(mapped.size(), streamed.size());
+
+  // Jumping around, as the parser does after a SeekHead
+  const uint64_t offsets[] = {0, 299990, 65530, 65536, 70000, 5, 131071, 250000};
+  for (uint64_t offset : offsets) {
+    std::string a(20, '\0');
+    std::string b(20, '\0');
+    mapped.seek(offset);
+    streamed.seek(offset);
+    a.resize(mapped.read(&a[0], a.size()));
+    b.resize(streamed.read(&b[0], b.size()));
+    EXPECT_EQ(a, b) << "at " << offset;
+    EXPECT_EQ(a, data.substr(offset, 20)) << "at " << offset;
+    EXPECT_EQ(mapped.eof(), streamed.eof()) << "at " << offset;
+  }
+
+  // The mapping serves any view in one piece and never reads the stream
+  std::string_view view;
+  mapped.seek(1000);
+  ASSERT_TRUE(mapped.readView(200000, view));
+  EXPECT_EQ(view, std::string_view(data).substr(1000, 200000));
+  EXPECT_EQ(mapped.getStats().streamReads, 0u);
+}
+
+TEST_F(MkvBlockReaderTest, MappedAndStreamParsesMatch) {
+  WriteMkv(TypicalEpisodeSegment());
+
+  MkvMetadataExtractor mapped;
+  MkvMetadataExtractor streamed;
+  ASSERT_TRUE(mapped.openMapped(path_));
+  ASSERT_TRUE(streamed.open(path_));
+  EXPECT_TRUE(mapped.isMapped());
+  EXPECT_FALSE(streamed.isMapped());
+
+  EXPECT_EQ(mapped.getTitle(), streamed.getTitle());
+  EXPECT_EQ(mapped.getMuxingApp(), streamed.getMuxingApp());
+  EXPECT_EQ(mapped.getWritingApp(), streamed.getWritingApp());
+  EXPECT_EQ(mapped.getParsedSections(), streamed.getParsedSections());
+
+  auto sameStreams = [](const std::vector<MkvStream>& a, const std::vector<MkvStream>& b) {
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+      EXPECT_EQ(a[i].trackNumber, b[i].trackNumber);
+      EXPECT_EQ(a[i].codecID, b[i].codecID);
+      EXPECT_EQ(a[i].language, b[i].language);
+      EXPECT_EQ(a[i].name, b[i].name);
+    }
+  };
+  sameStreams(mapped.getVideoStreams(), streamed.getVideoStreams());
+  sameStreams(mapped.getAudioStreams(), streamed.getAudioStreams());
+  sameStreams(mapped.getSubtitleStreams(), streamed.getSubtitleStreams());
+  EXPECT_EQ(mapped.getAudioStreams().size(), 3u);
+
+  const auto& a = mapped.getAttachments();
+  const auto& b = streamed.getAttachments();
+  ASSERT_EQ(a.size(), b.size());
+  ASSERT_EQ(a.size(), 6u);
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].fileName, b[i].fileName);
+    EXPECT_EQ(a[i].mimeType, b[i].mimeType);
+    EXPECT_EQ(a[i].uid, b[i].uid);
+    EXPECT_EQ(a[i].dataOffset, b[i].dataOffset);
+    EXPECT_EQ(a[i].dataSize, b[i].dataSize);
+  }
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
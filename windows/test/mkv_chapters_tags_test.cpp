@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "ebml_test_writer.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string Track(uint64_t number, uint64_t uid, uint64_t type, const std::string& codec) {
+  return Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, number) +
+                                         UInt(MkvIds::TrackUID, uid) +
+                                         UInt(MkvIds::TrackType, type) +
+                                         Element(MkvIds::CodecID, codec));
+}
+
+std::string Chapter(uint64_t uid, uint64_t startNs, const std::string& title,
+                    const std::string& nested = "") {
+  return Element(MkvIds::ChapterAtom,
+                 UInt(MkvIds::ChapterUID, uid) + UInt(MkvIds::ChapterTimeStart, startNs) +
+                     Element(MkvIds::ChapterDisplay, Element(MkvIds::ChapString, title) +
+                                                         Element(MkvIds::ChapLanguage, "eng")) +
+                     Element(MkvIds::ChapterDisplay, Element(MkvIds::ChapString, "ignored")) +
+                     nested);
+}
+
+std::string SimpleTag(const std::string& name, const std::string& value,
+                      const std::string& nested = "") {
+  return Element(MkvIds::SimpleTag, Element(MkvIds::TagName, name) +
+                                        Element(MkvIds::TagString, value) + nested);
+}
+
+class MkvChaptersTagsTest : public TempDirTest {};
+
+}  // namespace
+
+TEST_F(MkvChaptersTagsTest, ReadsNestedChaptersInFileOrder) {
+  WriteMkv(Element(MkvIds::Chapters,
+                   Element(MkvIds::EditionEntry,
+                           UInt(MkvIds::EditionUID, 7) + UInt(MkvIds::EditionFlagDefault, 1) +
+                               Chapter(1, 0, "Opening") +
+                               Chapter(2, 90000000000, "Part A",
+                                       Chapter(3, 95000000000, "Scene")) +
+                               Chapter(4, 1320000000000, "Ending"))));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_CHAPTERS));
+
+  ASSERT_EQ(extractor.getEditions().size(), 1u);
+  EXPECT_EQ(extractor.getEditions()[0].uid, 7u);
+  EXPECT_EQ(extractor.getEditions()[0].flagDefault, 1);
+
+  const auto& chapters = extractor.getChapters();
+  ASSERT_EQ(chapters.size(), 4u);
+  EXPECT_EQ(chapters[0].title, "Opening");
+  EXPECT_EQ(chapters[0].language, "eng");
+  EXPECT_EQ(chapters[1].title, "Part A");
+  EXPECT_EQ(chapters[1].depth, 0u);
+  EXPECT_EQ(chapters[2].title, "Scene");
+  EXPECT_EQ(chapters[2].uid, 3u);
+  EXPECT_EQ(chapters[2].depth, 1u);
+  EXPECT_EQ(chapters[2].timeStart, 95000000000u);
+  EXPECT_EQ(chapters[3].title, "Ending");
+  EXPECT_EQ(chapters[3].edition, 0u);
+  EXPECT_EQ(chapters[3].flagEnabled, 1);
+}
+
+TEST_F(MkvChaptersTagsTest, ReadsMkvmergeStatistics) {
+  std::string statistics = SimpleTag("BPS", "4213757") + SimpleTag("DURATION", "00:23:40.044000000") +
+                           SimpleTag("NUMBER_OF_FRAMES", "34049") +
+                           SimpleTag("NUMBER_OF_BYTES", "747996544");
+  WriteMkv(Element(MkvIds::Tracks, Track(1, 1001, TRACK_TYPE_VIDEO, "V_MPEG4/ISO/AVC") +
+                                       Track(2, 1002, TRACK_TYPE_AUDIO, "A_AAC")) +
+           Element(MkvIds::Tags,
+                   Element(MkvIds::Tag, Element(MkvIds::Targets, UInt(MkvIds::TagTrackUID, 1001)) +
+                                            statistics) +
+                   // ffmpeg writes the same statistics with a language suffix
+                   Element(MkvIds::Tag, Element(MkvIds::Targets, UInt(MkvIds::TagTrackUID, 1002)) +
+                                            SimpleTag("BPS-eng", "128000")) +
+                   Element(MkvIds::Tag, SimpleTag("TITLE", "Pilot",
+                                                  SimpleTag("SORT_WITH", "Episode 01")))));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_TRACKS | MKV_SECTION_TAGS));
+
+  MkvStatisticsTags video;
+  ASSERT_TRUE(extractor.getStatisticsTags(1001, video));
+  EXPECT_EQ(video.bitrate, 4213757u);
+  EXPECT_EQ(video.frames, 34049u);
+  EXPECT_EQ(video.bytes, 747996544u);
+  EXPECT_DOUBLE_EQ(video.durationMs, 1420044.0);
+
+  MkvStatisticsTags audio;
+  ASSERT_TRUE(extractor.getStatisticsTags(1002, audio));
+  EXPECT_EQ(audio.bitrate, 128000u);
+  EXPECT_EQ(audio.frames, 0u);
+
+  MkvStatisticsTags none;
+  EXPECT_FALSE(extractor.getStatisticsTags(1003, none));
+
+  const auto& tags = extractor.getTags();
+  ASSERT_EQ(tags.size(), 7u);
+  EXPECT_EQ(tags[5].name, "TITLE");
+  EXPECT_EQ(tags[5].value, "Pilot");
+  EXPECT_EQ(tags[5].trackUID, 0u);
+  EXPECT_EQ(tags[5].targetTypeValue, 50u);
+  EXPECT_EQ(tags[6].name, "SORT_WITH");
+}
+
+TEST_F(MkvChaptersTagsTest, CopiesTagsAimedAtSeveralTracks) {
+  WriteMkv(Element(MkvIds::Tags,
+                   Element(MkvIds::Tag, SimpleTag("ENCODER", "x264") +
+                                            Element(MkvIds::Targets,
+                                                    UInt(MkvIds::TargetTypeValue, 30) +
+                                                        UInt(MkvIds::TagTrackUID, 5) +
+                                                        UInt(MkvIds::TagTrackUID, 6)) +
+                                            SimpleTag("BPS", "1000"))));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_TAGS));
+
+  const auto& tags = extractor.getTags();
+  ASSERT_EQ(tags.size(), 3u);
+  // Met before Targets: patched to the first track
+  EXPECT_EQ(tags[0].name, "ENCODER");
+  EXPECT_EQ(tags[0].trackUID, 5u);
+  EXPECT_EQ(tags[0].targetTypeValue, 30u);
+  EXPECT_EQ(tags[1].trackUID, 5u);
+  EXPECT_EQ(tags[2].trackUID, 6u);
+
+  MkvStatisticsTags statistics;
+  ASSERT_TRUE(extractor.getStatisticsTags(6, statistics));
+  EXPECT_EQ(statistics.bitrate, 1000u);
+}
+
+TEST_F(MkvChaptersTagsTest, SkipsChaptersAndTagsUnlessRequested) {
+  WriteMkv(Element(MkvIds::Chapters, Element(MkvIds::EditionEntry, Chapter(1, 0, "Opening"))) +
+           Element(MkvIds::Tags, Element(MkvIds::Tag, SimpleTag("TITLE", "Pilot"))));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_INFO));
+  EXPECT_TRUE(extractor.getEditions().empty());
+  EXPECT_TRUE(extractor.getChapters().empty());
+  EXPECT_TRUE(extractor.getTags().empty());
+}
+
+TEST_F(MkvChaptersTagsTest, CutsOversizedStrings) {
+  WriteMkv(Element(MkvIds::Tags,
+                   Element(MkvIds::Tag, SimpleTag("LYRICS", std::string(3 << 20, 'x')) +
+                                            SimpleTag("TITLE", "Pilot"))));
+
+  for (bool mapped : {false, true}) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(mapped ? extractor.openMapped(path_, MKV_SECTION_TAGS)
+                       : extractor.open(path_, MKV_SECTION_TAGS));
+    const auto& tags = extractor.getTags();
+    ASSERT_EQ(tags.size(), 2u);
+    EXPECT_EQ(tags[0].value.size(), 1u << 20);
+    EXPECT_EQ(tags[1].name, "TITLE");
+    EXPECT_EQ(tags[1].value, "Pilot");
+  }
+}
+
+TEST_F(MkvChaptersTagsTest, ReadsTruncatedStringsUpToTheEndOfFile) {
+  std::string value(2 << 20, 'x');
+  value.replace(0, 5, "Pilot");
+  WriteMkv(Element(MkvIds::Tags, Element(MkvIds::Tag, SimpleTag("TITLE", value))));
+  // Cut the file inside the value, its size now points far past the end
+  std::filesystem::resize_file(path_, std::filesystem::file_size(path_) - value.size() + 5);
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_TAGS));
+  ASSERT_EQ(extractor.getTags().size(), 1u);
+  EXPECT_EQ(extractor.getTags()[0].value, "Pilot");
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
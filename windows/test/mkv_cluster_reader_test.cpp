@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_cluster_reader.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+// SimpleBlock of track 1 at `time`, flags and lacing header as given
+std::string SimpleBlock(int16_t time, uint8_t flags, const std::string& lacing,
+                        const std::string& frames) {
+  std::string header = {'\x81', static_cast<char>(time >> 8), static_cast<char>(time & 0xFF),
+                        static_cast<char>(flags)};
+  return Element(MkvIds::SimpleBlock, header + lacing + frames);
+}
+
+std::string Cluster(uint64_t time, const std::string& blocks) {
+  return Element(MkvIds::Cluster, UInt(MkvIds::Timestamp, time) + blocks);
+}
+
+// Four seconds in millisecond ticks: video track 1 with 40 ms frames, one
+// Cluster per second opening on a keyframe. `info` is added to the
+// SegmentInfo; with `cues` every Cluster gets a CuePoint.
+std::string Movie(const std::string& info, bool cues) {
+  std::string headers =
+      Element(MkvIds::SegmentInfo, UInt(MkvIds::TimecodeScale, 1000000) + info) +
+      Element(MkvIds::Tracks,
+              Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 1) +
+                                              UInt(MkvIds::TrackType, TRACK_TYPE_VIDEO) +
+                                              UInt(MkvIds::DefaultDuration, 40000000) +
+                                              Element(MkvIds::CodecPrivate, "avcC")));
+
+  std::string clusters;
+  std::string cuePoints;
+  for (int second = 0; second < 4; second++) {
+    std::string blocks;
+    for (int16_t time = 0; time < 1000; time += 250) {
+      blocks += SimpleBlock(time, time == 0 ? 0x80 : 0x00, "",
+                            "frame" + std::to_string(second * 1000 + time));
+    }
+    cuePoints += Element(
+        MkvIds::CuePoint,
+        UInt(MkvIds::CueTime, second * 1000) +
+            Element(MkvIds::CueTrackPositions,
+                    UInt(MkvIds::CueTrack, 1) +
+                        UInt(MkvIds::CueClusterPosition, headers.size() + clusters.size())));
+    clusters += Cluster(second * 1000, blocks);
+  }
+
+  return headers + clusters + (cues ? Element(MkvIds::Cues, cuePoints) : "");
+}
+
+struct BlockCollector : MkvBlockVisitor {
+  std::vector<MkvBlock> blocks;
+
+  bool onBlock(const MkvBlock& block) override {
+    blocks.push_back(block);
+    return true;
+  }
+};
+
+class MkvClusterReaderTest : public TempDirTest {
+ protected:
+  // Write a file whose Segment is just `cluster` and read that Cluster
+  std::vector<MkvBlock> ReadOnlyCluster(const std::string& cluster) {
+    WriteMkv(cluster);
+    MkvClusterReader reader;
+    EXPECT_TRUE(reader.open(path_));
+
+    BlockCollector collector;
+    uint64_t next = 0;
+    EXPECT_TRUE(reader.readCluster(MkvFile("").size(), collector, next));
+    EXPECT_EQ(next, 0u);
+    return collector.blocks;
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvClusterReaderTest, ReadsUnlacedBlocks) {
+  auto blocks = ReadOnlyCluster(Cluster(1000, SimpleBlock(5, 0x80, "", std::string(12, 'k')) +
+                                                  SimpleBlock(40, 0x00, "", std::string(7, 'p'))));
+
+  ASSERT_EQ(blocks.size(), 2u);
+  EXPECT_EQ(blocks[0].track, 1u);
+  EXPECT_EQ(blocks[0].timestamp, 1005);
+  EXPECT_TRUE(blocks[0].keyframe);
+  EXPECT_EQ(blocks[0].frameSizes, std::vector<uint32_t>({12}));
+  EXPECT_EQ(blocks[1].timestamp, 1040);
+  EXPECT_FALSE(blocks[1].keyframe);
+  EXPECT_EQ(blocks[1].frameSizes, std::vector<uint32_t>({7}));
+}
+
+TEST_F(MkvClusterReaderTest, ReadsXiphLacing) {
+  // Three frames: 300 (255 + 45), 20, and the 5 bytes left
+  std::string lacing = {'\x02', '\xFF', '\x2D', '\x14'};
+  auto blocks = ReadOnlyCluster(Cluster(0, SimpleBlock(0, 0x80 | MKV_LACING_XIPH, lacing,
+                                                       std::string(325, 'x'))));
+
+  ASSERT_EQ(blocks.size(), 1u);
+  EXPECT_EQ(blocks[0].lacing, MKV_LACING_XIPH);
+  EXPECT_EQ(blocks[0].frameSizes, std::vector<uint32_t>({300, 20, 5}));
+}
+
+TEST_F(MkvClusterReaderTest, ReadsEbmlLacing) {
+  // 300 as a two byte VINT, then -10 as a one byte signed VINT (bias 63)
+  std::string lacing = {'\x02', '\x41', '\x2C', static_cast<char>(0x80 | 53)};
+  auto blocks = ReadOnlyCluster(Cluster(0, SimpleBlock(0, 0x80 | MKV_LACING_EBML, lacing,
+                                                       std::string(300 + 290 + 7, 'x'))));
+
+  ASSERT_EQ(blocks.size(), 1u);
+  EXPECT_EQ(blocks[0].frameSizes, std::vector<uint32_t>({300, 290, 7}));
+}
+
+TEST_F(MkvClusterReaderTest, ReadsFixedLacing) {
+  auto blocks = ReadOnlyCluster(
+      Cluster(0, SimpleBlock(0, 0x80 | MKV_LACING_FIXED, "\x03", std::string(40, 'x'))));
+
+  ASSERT_EQ(blocks.size(), 1u);
+  EXPECT_EQ(blocks[0].frameSizes, std::vector<uint32_t>(4, 10));
+}
+
+TEST_F(MkvClusterReaderTest, DropsBlocksWithBadLacing) {
+  std::string frames(50, 'x');
+  std::string blocks;
+  // EBML lacing whose first size is the unknown-size VINT
+  blocks += SimpleBlock(0, MKV_LACING_EBML, std::string("\x01\xFF", 2), frames);
+  // EBML lacing whose first size runs past the block
+  blocks += SimpleBlock(1, MKV_LACING_EBML, std::string("\x01\x41\x2C", 3), frames);
+  // EBML lacing whose second size (1 + 100000) runs past the block
+  blocks += SimpleBlock(2, MKV_LACING_EBML, std::string("\x02\x81\x31\x86\x9F", 5), frames);
+  // Xiph lacing whose sizes add up to more than the block
+  blocks += SimpleBlock(3, MKV_LACING_XIPH, std::string("\x01\xFF\xFF\x10", 4), frames);
+  // Fixed lacing that doesn't divide the block evenly
+  blocks += SimpleBlock(4, MKV_LACING_FIXED, "\x02", frames);
+  // Followed by a good block, which is still found
+  blocks += SimpleBlock(5, 0x80, "", frames);
+
+  auto read = ReadOnlyCluster(Cluster(0, blocks));
+
+  ASSERT_EQ(read.size(), 1u);
+  EXPECT_EQ(read[0].timestamp, 5);
+  EXPECT_EQ(read[0].frameSizes, std::vector<uint32_t>({50}));
+}
+
+TEST_F(MkvClusterReaderTest, UnknownSizeClusterEndsAtTheNextCluster) {
+  std::string live = UnknownSizeElement(
+      MkvIds::Cluster, UInt(MkvIds::Timestamp, 0) + SimpleBlock(0, 0x80, "", "first") +
+                           SimpleBlock(20, 0x00, "", "second"));
+  // Garbage between Clusters, as a cut recording leaves it
+  std::string junk(300, '\x55');
+  std::string sized = Cluster(40, SimpleBlock(0, 0x80, "", "third"));
+  WriteMkv(live + junk + sized + Element(MkvIds::Cues, ""));
+  uint64_t first = MkvFile("").size();
+
+  MkvClusterReader reader;
+  ASSERT_TRUE(reader.open(path_));
+  EXPECT_EQ(reader.findCluster(0), first);
+
+  BlockCollector collector;
+  uint64_t next = 0;
+  ASSERT_TRUE(reader.readCluster(first, collector, next));
+  ASSERT_EQ(collector.blocks.size(), 2u);
+  EXPECT_EQ(collector.blocks[1].timestamp, 20);
+  EXPECT_EQ(next, first + live.size() + junk.size());
+
+  // The last Cluster points past the Cues to nothing
+  ASSERT_TRUE(reader.readCluster(next, collector, next));
+  ASSERT_EQ(collector.blocks.size(), 3u);
+  EXPECT_EQ(collector.blocks[2].timestamp, 40);
+  EXPECT_EQ(next, 0u);
+}
+
+TEST_F(MkvClusterReaderTest, ReadsTheKeyframeAtOrBeforeATime) {
+  WriteMkv(Movie("", true));
+
+  // Walked from the first Cluster, then started from the nearest cue
+  const uint32_t masks[] = {MKV_SECTION_INFO | MKV_SECTION_TRACKS, MKV_SECTION_ALL};
+  for (uint32_t sections : masks) {
+    MkvMetadataExtractor extractor;
+    ASSERT_TRUE(extractor.open(path_, sections));
+
+    MkvKeyframe keyframe;
+    ASSERT_TRUE(readMkvKeyframe(extractor, 0, 2600.0, keyframe));
+    EXPECT_EQ(keyframe.track, 1u);
+    EXPECT_EQ(keyframe.timeMs, 2000.0);
+    EXPECT_EQ(std::string(keyframe.data.begin(), keyframe.data.end()), "frame2000");
+    EXPECT_EQ(std::string(keyframe.codecPrivate.begin(), keyframe.codecPrivate.end()), "avcC");
+
+    MkvCuePoint cue;
+    if (extractor.findCue(0, 2600.0, cue)) {
+      EXPECT_EQ(keyframe.clusterPosition, cue.clusterPosition);
+    }
+
+    // Exactly on a keyframe, and past the last one
+    ASSERT_TRUE(readMkvKeyframe(extractor, 1, 1000.0, keyframe));
+    EXPECT_EQ(keyframe.timeMs, 1000.0);
+    ASSERT_TRUE(readMkvKeyframe(extractor, 1, 60000.0, keyframe));
+    EXPECT_EQ(keyframe.timeMs, 3000.0);
+
+    EXPECT_FALSE(readMkvKeyframe(extractor, 7, 0.0, keyframe));
+  }
+}
+
+TEST_F(MkvClusterReaderTest, DurationFromInfo) {
+  WriteMkv(Movie(Float(MkvIds::Duration, 3790.0), true));
+
+  MkvDurationProbe probe;
+  ASSERT_TRUE(probeMkvDuration(path_, probe));
+  EXPECT_EQ(probe.source, MKV_DURATION_INFO);
+  EXPECT_DOUBLE_EQ(probe.durationMs, 3790.0);
+  EXPECT_GT(probe.bytesRead, 0u);
+}
+
+TEST_F(MkvClusterReaderTest, DurationFromTheCues) {
+  WriteMkv(Movie("", true));
+
+  // The last block starts at 3750 and lasts one 40 ms DefaultDuration
+  MkvDurationProbe probe;
+  ASSERT_TRUE(probeMkvDuration(path_, probe));
+  EXPECT_EQ(probe.source, MKV_DURATION_CUES);
+  EXPECT_DOUBLE_EQ(probe.durationMs, 3790.0);
+}
+
+TEST_F(MkvClusterReaderTest, DurationFromTheTail) {
+  WriteMkv(Movie("", false));
+
+  MkvDurationProbe probe;
+  ASSERT_TRUE(probeMkvDuration(path_, probe));
+  EXPECT_EQ(probe.source, MKV_DURATION_TAIL);
+  EXPECT_DOUBLE_EQ(probe.durationMs, 3790.0);
+}
+
+TEST_F(MkvClusterReaderTest, NoDurationWithoutBlocks) {
+  WriteMkv(Element(MkvIds::SegmentInfo, UInt(MkvIds::TimecodeScale, 1000000)));
+
+  MkvDurationProbe probe;
+  EXPECT_FALSE(probeMkvDuration(path_, probe));
+  EXPECT_EQ(probe.source, MKV_DURATION_NONE);
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_cluster_reader.h"
+#include "mkv_cluster_scanner.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string SimpleBlock(uint8_t track, int16_t time, uint8_t flags, const std::string& data) {
+  std::string header = {static_cast<char>(0x80 | track), static_cast<char>(time >> 8),
+                        static_cast<char>(time & 0xFF), static_cast<char>(flags)};
+  return Element(MkvIds::SimpleBlock, header + data);
+}
+
+class MkvClusterScannerTest : public TempDirTest {
+ protected:
+  // One Cluster per second of a 25 fps video track 1 and an audio track 2
+  // laced three frames a block, streamed to disk behind an unknown-size
+  // Segment. Keyframes fall on seconds divisible by 3 or 7, so the intervals
+  // vary. Returns the file size.
+  uint64_t WriteLongMovie(int seconds, size_t videoFrameSize) {
+    std::ofstream out(path_, std::ios::binary);
+    std::string header =
+        Element(MkvIds::EBML, Element(MkvIds::DocType, "matroska")) +
+        UnknownSizeElement(MkvIds::Segment, "") +
+        Element(MkvIds::SegmentInfo, UInt(MkvIds::TimecodeScale, 1000000)) +
+        Element(MkvIds::Tracks,
+                Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 1) +
+                                                UInt(MkvIds::TrackType, TRACK_TYPE_VIDEO)) +
+                    Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 2) +
+                                                    UInt(MkvIds::TrackType, TRACK_TYPE_AUDIO)));
+    out.write(header.data(), header.size());
+    uint64_t size = header.size();
+
+    std::string frame(videoFrameSize, '\x11');
+    std::string audio = std::string("\x02\x40\x30", 3) + std::string(64 + 48 + 100, '\x22');
+    for (int second = 0; second < seconds; second++) {
+      std::string blocks;
+      for (int16_t time = 0; time < 1000; time += 40) {
+        bool key = time == 0 && (second % 3 == 0 || second % 7 == 0);
+        blocks += SimpleBlock(1, time, key ? 0x80 : 0x00, frame);
+        if (time % 120 == 0) {
+          blocks += SimpleBlock(2, time, 0x80 | MKV_LACING_XIPH, audio);
+        }
+      }
+      std::string cluster =
+          Element(MkvIds::Cluster, UInt(MkvIds::Timestamp, second * 1000) + blocks);
+      out.write(cluster.data(), cluster.size());
+      size += cluster.size();
+    }
+    return size;
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvClusterScannerTest, SplitScanMatchesSingleThreadedScan) {
+  // Large enough for three ranges of MinRangeSize
+  uint64_t size = WriteLongMovie(200, 24000);
+  ASSERT_GT(size, 3 * MkvClusterScanner::MinRangeSize);
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+
+  MkvClusterScanner single(extractor);
+  ASSERT_TRUE(single.scan(1));
+  EXPECT_EQ(single.getStats().ranges, 1u);
+
+  MkvClusterScanner split(extractor);
+  ASSERT_TRUE(split.scan(8));
+  EXPECT_EQ(split.getStats().ranges, 3u);
+  EXPECT_EQ(split.getStats().clusters, single.getStats().clusters);
+  EXPECT_EQ(single.getStats().clusters, 200u);
+
+  const auto& a = single.getTrackStatistics();
+  const auto& b = split.getTrackStatistics();
+  ASSERT_EQ(a.size(), 2u);
+  ASSERT_EQ(b.size(), 2u);
+  for (size_t i = 0; i < a.size(); i++) {
+    SCOPED_TRACE(a[i].track);
+    EXPECT_EQ(a[i].track, b[i].track);
+    EXPECT_EQ(a[i].blocks, b[i].blocks);
+    EXPECT_EQ(a[i].frames, b[i].frames);
+    EXPECT_EQ(a[i].bytes, b[i].bytes);
+    EXPECT_EQ(a[i].keyframes, b[i].keyframes);
+    EXPECT_EQ(a[i].firstTimestamp, b[i].firstTimestamp);
+    EXPECT_EQ(a[i].lastTimestamp, b[i].lastTimestamp);
+    EXPECT_EQ(a[i].firstKeyframe, b[i].firstKeyframe);
+    EXPECT_EQ(a[i].lastKeyframe, b[i].lastKeyframe);
+    EXPECT_EQ(a[i].minKeyframeInterval, b[i].minKeyframeInterval);
+    EXPECT_EQ(a[i].maxKeyframeInterval, b[i].maxKeyframeInterval);
+  }
+
+  // And the numbers themselves are right
+  const MkvTrackStatistics& video = a[0];
+  EXPECT_EQ(video.blocks, 200u * 25);
+  EXPECT_EQ(video.bytes, 200u * 25 * 24000);
+  EXPECT_EQ(video.lastTimestamp, 199960);
+  EXPECT_EQ(video.firstKeyframe, 0);
+  EXPECT_EQ(video.lastKeyframe, 198000);
+  EXPECT_EQ(video.minKeyframeInterval, 1000u);
+  EXPECT_EQ(video.maxKeyframeInterval, 3000u);
+
+  const MkvTrackStatistics& audio = a[1];
+  EXPECT_EQ(audio.blocks, 200u * 9);
+  EXPECT_EQ(audio.frames, 200u * 9 * 3);
+  EXPECT_EQ(audio.bytes, 200u * 9 * (64 + 48 + 100));
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+
+#include "ebml_test_writer.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string CuePoint(uint64_t time, uint64_t track, uint64_t clusterPosition,
+                     const std::string& more = "") {
+  return Element(MkvIds::CuePoint,
+                 UInt(MkvIds::CueTime, time) +
+                     Element(MkvIds::CueTrackPositions,
+                             UInt(MkvIds::CueTrack, track) +
+                                 UInt(MkvIds::CueClusterPosition, clusterPosition)) +
+                     more);
+}
+
+// Millisecond ticks, a video track 1 and an audio track 2
+std::string Headers() {
+  return Element(MkvIds::SegmentInfo, UInt(MkvIds::TimecodeScale, 1000000)) +
+         Element(MkvIds::Tracks,
+                 Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 1) +
+                                                 UInt(MkvIds::TrackType, TRACK_TYPE_VIDEO)) +
+                     Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 2) +
+                                                     UInt(MkvIds::TrackType, TRACK_TYPE_AUDIO)));
+}
+
+class MkvCuesTest : public TempDirTest {};
+
+}  // namespace
+
+TEST_F(MkvCuesTest, FindsTheCueAtOrBeforeATime) {
+  // Out of order, and one CuePoint carrying both tracks
+  std::string cues = CuePoint(4000, 1, 3000) + CuePoint(0, 1, 100) +
+                     CuePoint(2000, 1, 1500,
+                              Element(MkvIds::CueTrackPositions,
+                                      UInt(MkvIds::CueTrack, 2) +
+                                          UInt(MkvIds::CueClusterPosition, 1400))) +
+                     CuePoint(1000, 2, 700);
+  WriteMkv(Headers() + Element(MkvIds::Cues, cues));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_ALL));
+  ASSERT_EQ(extractor.getCueIndex().size(), 5u);
+  uint64_t dataStart = extractor.getSegmentLayout().dataStart;
+
+  // Track 0 is the first video track
+  MkvCuePoint cue;
+  ASSERT_TRUE(extractor.findCue(0, 2000.0, cue));
+  EXPECT_EQ(cue.time, 2000u);
+  EXPECT_EQ(cue.track, 1u);
+  EXPECT_EQ(cue.clusterPosition, dataStart + 1500);
+
+  ASSERT_TRUE(extractor.findCue(1, 3999.5, cue));
+  EXPECT_EQ(cue.time, 2000u);
+  ASSERT_TRUE(extractor.findCue(1, 0.0, cue));
+  EXPECT_EQ(cue.time, 0u);
+  ASSERT_TRUE(extractor.findCue(1, 1e9, cue));
+  EXPECT_EQ(cue.time, 4000u);
+
+  // Other tracks' cues never answer for this one
+  EXPECT_FALSE(extractor.findCue(2, 500.0, cue));
+  ASSERT_TRUE(extractor.findCue(2, 1500.0, cue));
+  EXPECT_EQ(cue.time, 1000u);
+  EXPECT_EQ(cue.clusterPosition, dataStart + 700);
+  ASSERT_TRUE(extractor.findCue(2, 2500.0, cue));
+  EXPECT_EQ(cue.time, 2000u);
+  EXPECT_EQ(cue.clusterPosition, dataStart + 1400);
+
+  EXPECT_FALSE(extractor.findCue(3, 2000.0, cue));
+  EXPECT_FALSE(extractor.findCue(1, -1.0, cue));
+}
+
+TEST_F(MkvCuesTest, HonoursTheTimecodeScale) {
+  // 10 ms ticks: a cue at tick 300 is at 3 seconds
+  WriteMkv(Element(MkvIds::SegmentInfo, UInt(MkvIds::TimecodeScale, 10000000)) +
+           Element(MkvIds::Tracks,
+                   Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 1) +
+                                                   UInt(MkvIds::TrackType, TRACK_TYPE_VIDEO))) +
+           Element(MkvIds::Cues, CuePoint(0, 1, 10) + CuePoint(300, 1, 20)));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_ALL));
+  MkvCuePoint cue;
+  ASSERT_TRUE(extractor.findCue(0, 2999.0, cue));
+  EXPECT_EQ(cue.time, 0u);
+  ASSERT_TRUE(extractor.findCue(0, 3000.0, cue));
+  EXPECT_EQ(cue.time, 300u);
+}
+
+TEST_F(MkvCuesTest, CuesAreOnlyParsedWhenAsked) {
+  WriteMkv(Headers() + Element(MkvIds::Cues, CuePoint(0, 1, 100)));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_));
+  EXPECT_EQ(extractor.getCueIndex().size(), 0u);
+  MkvCuePoint cue;
+  EXPECT_FALSE(extractor.findCue(0, 0.0, cue));
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string BE16(uint32_t value) {
+  return std::string{static_cast<char>(value >> 8), static_cast<char>(value)};
+}
+
+std::string BE32(uint32_t value) { return BE16(value >> 16) + BE16(value & 0xFFFF); }
+
+std::string Utf16BE(const std::u16string& text) {
+  std::string out;
+  for (char16_t c : text) {
+    out += BE16(c);
+  }
+  return out;
+}
+
+struct NameRecord {
+  uint16_t platform;
+  uint16_t encoding;
+  uint16_t language;
+  uint16_t nameId;
+  std::string data;  // already encoded
+};
+
+NameRecord Windows(uint16_t nameId, const std::u16string& text, uint16_t language = 0x0409) {
+  return NameRecord{3, 1, language, nameId, Utf16BE(text)};
+}
+
+std::string NameTable(const std::vector<NameRecord>& records) {
+  std::string table = BE16(0) + BE16(static_cast<uint32_t>(records.size())) +
+                      BE16(static_cast<uint32_t>(6 + records.size() * 12));
+  std::string strings;
+  for (const NameRecord& record : records) {
+    table += BE16(record.platform) + BE16(record.encoding) + BE16(record.language) +
+             BE16(record.nameId) + BE16(static_cast<uint32_t>(record.data.size())) +
+             BE16(static_cast<uint32_t>(strings.size()));
+    strings += record.data;
+  }
+  return table + strings;
+}
+
+// A font of `tables` (tag, data), laid out from `base` in the file; table
+// offsets count from the start of the file, as in collections
+std::string Font(const std::vector<std::pair<std::string, std::string>>& tables, uint32_t base = 0) {
+  std::string header = BE32(0x00010000) + BE16(static_cast<uint32_t>(tables.size())) +
+                       BE16(0) + BE16(0) + BE16(0);
+  std::string body;
+  uint32_t offset = base + 12 + static_cast<uint32_t>(tables.size()) * 16;
+  for (const auto& table : tables) {
+    header += table.first + BE32(0) + BE32(offset + static_cast<uint32_t>(body.size())) +
+              BE32(static_cast<uint32_t>(table.second.size()));
+    body += table.second;
+    body.resize((body.size() + 3) & ~size_t(3), '\0');
+  }
+  return header + body;
+}
+
+std::string Attachment(const std::string& name, const std::string& mimeType, const std::string& data) {
+  return Element(MkvIds::AttachedFile, Element(MkvIds::FileName, name) +
+                                           Element(MkvIds::FileMimeType, mimeType) +
+                                           Element(MkvIds::FileData, data));
+}
+
+class MkvFontTest : public TempDirTest {
+ protected:
+  void WriteAttachments(const std::string& attachments) {
+    WriteMkv(Element(MkvIds::Attachments, attachments));
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvFontTest, ReadsNamesWithoutTheGlyphs) {
+  std::string glyphs(200000, '\x55');
+  std::string font = Font({{"glyf", glyphs},
+                           {"name", NameTable({Windows(1, u"Gandhi Sans"), Windows(2, u"Bold"),
+                                               Windows(4, u"Gandhi Sans Bold"),
+                                               Windows(6, u"GandhiSans-Bold")})}});
+  WriteAttachments(Attachment("cover.jpg", "image/jpeg", std::string(5000, '\xFF')) +
+                   Attachment("GandhiSans-Bold.ttf", "application/octet-stream", font));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_ATTACHMENTS));
+  std::vector<MkvFontInfo> fonts;
+  uint64_t bytesRead = 0;
+  ASSERT_TRUE(extractor.getFonts(fonts, &bytesRead));
+
+  ASSERT_EQ(fonts.size(), 1u);
+  EXPECT_EQ(fonts[0].attachmentIndex, 1u);
+  EXPECT_EQ(fonts[0].face.faceIndex, 0u);
+  EXPECT_EQ(fonts[0].face.family, "Gandhi Sans");
+  EXPECT_EQ(fonts[0].face.subfamily, "Bold");
+  EXPECT_EQ(fonts[0].face.fullName, "Gandhi Sans Bold");
+  EXPECT_EQ(fonts[0].face.postScriptName, "GandhiSans-Bold");
+  EXPECT_TRUE(fonts[0].face.typographicFamily.empty());
+  EXPECT_LT(bytesRead, 1024u);
+}
+
+TEST_F(MkvFontTest, PrefersWindowsEnglishNames) {
+  std::string font = Font({{"name", NameTable({
+                                        NameRecord{1, 0, 0, 1, "Mac Name"},
+                                        Windows(1, u"明朝", 0x0411),
+                                        Windows(1, u"Mincho"),
+                                        NameRecord{1, 0, 0, 2, "Regular"},
+                                        // U+1D4D0, as a surrogate pair
+                                        Windows(16, u"Math \U0001D4D0"),
+                                    })}});
+  WriteAttachments(Attachment("mincho.ttf", "font/ttf", font));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.openMapped(path_, MKV_SECTION_ATTACHMENTS));
+  std::vector<MkvFontInfo> fonts;
+  ASSERT_TRUE(extractor.getFonts(fonts));
+
+  ASSERT_EQ(fonts.size(), 1u);
+  EXPECT_EQ(fonts[0].face.family, "Mincho");
+  EXPECT_EQ(fonts[0].face.subfamily, "Regular");
+  EXPECT_EQ(fonts[0].face.typographicFamily, "Math \xF0\x9D\x93\x90");
+}
+
+TEST_F(MkvFontTest, ReadsEveryFaceOfACollection) {
+  // Two faces sharing a name table, as collections do
+  const uint32_t header = 12 + 2 * 4;
+  std::string names = NameTable({Windows(1, u"Noto Sans CJK JP"), Windows(2, u"Regular")});
+  std::string first = Font({{"name", names}}, header);
+  std::string second = BE32(0x00010000) + BE16(1) + BE16(0) + BE16(0) + BE16(0) + "name" + BE32(0) +
+                       BE32(header + 12 + 16) + BE32(static_cast<uint32_t>(names.size()));
+  std::string collection = "ttcf" + BE32(0x00010000) + BE32(2) + BE32(header) +
+                           BE32(header + static_cast<uint32_t>(first.size())) + first + second;
+  WriteAttachments(Attachment("NotoSansCJK.ttc", "font/collection", collection) +
+                   Attachment("broken.ttf", "font/ttf", "not a font at all"));
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_ATTACHMENTS));
+  std::vector<MkvFontInfo> fonts;
+  ASSERT_TRUE(extractor.getFonts(fonts));
+
+  ASSERT_EQ(fonts.size(), 2u);
+  for (uint32_t i = 0; i < 2; i++) {
+    EXPECT_EQ(fonts[i].attachmentIndex, 0u);
+    EXPECT_EQ(fonts[i].face.faceIndex, i);
+    EXPECT_EQ(fonts[i].face.family, "Noto Sans CJK JP");
+    EXPECT_EQ(fonts[i].face.subfamily, "Regular");
+  }
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
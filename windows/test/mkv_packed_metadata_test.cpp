@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_packed_metadata.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+std::string Track(uint64_t number, uint64_t uid, uint64_t type, const std::string& codec,
+                  const std::string& details) {
+  return Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, number) +
+                                         UInt(MkvIds::TrackUID, uid) +
+                                         UInt(MkvIds::TrackType, type) +
+                                         Element(MkvIds::CodecID, codec) +
+                                         Element(MkvIds::Language, "eng") + details);
+}
+
+// Reads a packed buffer the way the Dart decoder does
+class PackedReader {
+ public:
+  explicit PackedReader(const std::vector<uint8_t>& data) : data_(data) {}
+
+  uint64_t Get(size_t offset, int bytes) const {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+      value = (value << 8) | data_.at(offset + i);
+    }
+    return value;
+  }
+
+  double GetDouble(size_t offset) const {
+    uint64_t bits = Get(offset, 8);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  std::string GetString(size_t offset) const {
+    size_t table = Get(PackedStringTableOffset, 4);
+    uint32_t index = static_cast<uint32_t>(Get(offset, 4));
+    EXPECT_LT(index, Get(table, 4));
+    size_t start = Get(table + 4 + 4 * index, 4);
+    size_t end = Get(table + 8 + 4 * index, 4);
+    return std::string(data_.begin() + start, data_.begin() + end);
+  }
+
+  size_t StringCount() const { return Get(Get(PackedStringTableOffset, 4), 4); }
+
+  size_t Count(PackedBlock block) const { return Get(PackedBlocksOffset + block * 12 + 4, 4); }
+
+  // Offset of record `index` of `block`
+  size_t Record(PackedBlock block, size_t index) const {
+    size_t entry = PackedBlocksOffset + block * 12;
+    EXPECT_LT(index, Count(block));
+    return Get(entry, 4) + index * Get(entry + 8, 4);
+  }
+
+ private:
+  const std::vector<uint8_t>& data_;
+};
+
+class MkvPackedMetadataTest : public TempDirTest {
+ protected:
+  void SetUp() override {
+    TempDirTest::SetUp();
+    WriteMkv(
+        Element(MkvIds::SegmentInfo, UInt(MkvIds::TimecodeScale, 1000000) +
+                                         Float(MkvIds::Duration, 1420044.0) +
+                                         Element(MkvIds::Title, "Pilot") +
+                                         Element(MkvIds::MuxingApp, "libebml v1.4.4") +
+                                         Element(MkvIds::WritingApp, "mkvmerge v80.0")) +
+        Element(MkvIds::Tracks,
+                Track(1, 1001, TRACK_TYPE_VIDEO, "V_MPEGH/ISO/HEVC",
+                      Element(MkvIds::Video, UInt(MkvIds::PixelWidth, 1920) +
+                                                 UInt(MkvIds::PixelHeight, 1080))) +
+                    Track(2, 1002, TRACK_TYPE_AUDIO, "A_OPUS",
+                          Element(MkvIds::Audio, Float(MkvIds::SamplingFrequency, 48000.0) +
+                                                     UInt(MkvIds::Channels, 6))) +
+                    Track(3, 1003, TRACK_TYPE_SUBTITLE, "S_TEXT/ASS", "")) +
+        Element(MkvIds::Attachments,
+                Element(MkvIds::AttachedFile, Element(MkvIds::FileName, "font.ttf") +
+                                                  Element(MkvIds::FileMimeType, "font/ttf") +
+                                                  UInt(MkvIds::FileUID, 77) +
+                                                  Element(MkvIds::FileData, std::string(300, 'x')))) +
+        Element(MkvIds::Chapters,
+                Element(MkvIds::EditionEntry,
+                        UInt(MkvIds::EditionUID, 7) + UInt(MkvIds::EditionFlagDefault, 1) +
+                            Element(MkvIds::ChapterAtom,
+                                    UInt(MkvIds::ChapterUID, 11) +
+                                        UInt(MkvIds::ChapterTimeStart, 90000000000) +
+                                        Element(MkvIds::ChapterDisplay,
+                                                Element(MkvIds::ChapString, "Part A") +
+                                                    Element(MkvIds::ChapLanguage, "eng"))))) +
+        Element(MkvIds::Tags,
+                Element(MkvIds::Tag,
+                        Element(MkvIds::Targets, UInt(MkvIds::TagTrackUID, 1001)) +
+                            Element(MkvIds::SimpleTag, Element(MkvIds::TagName, "BPS") +
+                                                           Element(MkvIds::TagString, "4213757")) +
+                            Element(MkvIds::SimpleTag,
+                                    Element(MkvIds::TagName, "NUMBER_OF_FRAMES") +
+                                        Element(MkvIds::TagString, "34049")))));
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvPackedMetadataTest, PacksEverySection) {
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_DEFAULT));
+  std::vector<uint8_t> packed;
+  packMkvMetadata(extractor, MKV_SECTION_DEFAULT, packed);
+
+  PackedReader reader(packed);
+  EXPECT_EQ(reader.Get(PackedMagicOffset, 4), PackedMagic);
+  EXPECT_EQ(packed[0], 'M');
+  EXPECT_EQ(reader.Get(PackedVersionOffset, 2), PackedVersion);
+  EXPECT_EQ(reader.Get(PackedHeaderSizeOffset, 2), PackedHeaderSize);
+  EXPECT_EQ(reader.Get(PackedSectionsOffset, 4), uint64_t(MKV_SECTION_DEFAULT));
+  EXPECT_DOUBLE_EQ(reader.GetDouble(PackedDurationOffset), 1420044.0);
+  EXPECT_EQ(reader.Get(PackedTimecodeScaleOffset, 8), 1000000u);
+  EXPECT_EQ(reader.GetString(PackedTitleOffset), "Pilot");
+  EXPECT_EQ(reader.GetString(PackedMuxingAppOffset), "libebml v1.4.4");
+  EXPECT_EQ(reader.GetString(PackedWritingAppOffset), "mkvmerge v80.0");
+
+  ASSERT_EQ(reader.Count(PackedTracks), 3u);
+  size_t video = reader.Record(PackedTracks, 0);
+  EXPECT_EQ(reader.Get(video + PackedTrackType, 1), uint64_t(TRACK_TYPE_VIDEO));
+  EXPECT_EQ(reader.Get(video + PackedTrackNumber, 4), 1u);
+  EXPECT_EQ(reader.Get(video + PackedTrackUid, 8), 1001u);
+  EXPECT_EQ(reader.GetString(video + PackedTrackCodecId), "V_MPEGH/ISO/HEVC");
+  EXPECT_EQ(reader.GetString(video + PackedTrackLanguage), "eng");
+  EXPECT_EQ(reader.Get(video + PackedTrackWidth, 4), 1920u);
+  EXPECT_EQ(reader.Get(video + PackedTrackHeight, 4), 1080u);
+  EXPECT_EQ(reader.Get(video + PackedTrackFlags, 1), uint64_t(PackedTrackHasStatistics));
+  EXPECT_EQ(reader.Get(video + PackedTrackBitrate, 8), 4213757u);
+  EXPECT_EQ(reader.Get(video + PackedTrackFrameCount, 8), 34049u);
+
+  size_t audio = reader.Record(PackedTracks, 1);
+  EXPECT_EQ(reader.Get(audio + PackedTrackType, 1), uint64_t(TRACK_TYPE_AUDIO));
+  EXPECT_EQ(reader.Get(audio + PackedTrackChannels, 1), 6u);
+  EXPECT_DOUBLE_EQ(reader.GetDouble(audio + PackedTrackRate), 48000.0);
+  EXPECT_EQ(reader.Get(audio + PackedTrackFlags, 1), 0u);
+
+  size_t subtitle = reader.Record(PackedTracks, 2);
+  EXPECT_EQ(reader.Get(subtitle + PackedTrackType, 1), uint64_t(TRACK_TYPE_SUBTITLE));
+  EXPECT_EQ(reader.GetString(subtitle + PackedTrackName), "");
+
+  ASSERT_EQ(reader.Count(PackedAttachments), 1u);
+  size_t attachment = reader.Record(PackedAttachments, 0);
+  EXPECT_EQ(reader.Get(attachment + PackedAttachmentUid, 8), 77u);
+  EXPECT_EQ(reader.Get(attachment + PackedAttachmentSize, 8), 300u);
+  EXPECT_EQ(reader.GetString(attachment + PackedAttachmentFileName), "font.ttf");
+  EXPECT_EQ(reader.GetString(attachment + PackedAttachmentMimeType), "font/ttf");
+
+  ASSERT_EQ(reader.Count(PackedEditions), 1u);
+  size_t edition = reader.Record(PackedEditions, 0);
+  EXPECT_EQ(reader.Get(edition + PackedEditionUid, 8), 7u);
+  EXPECT_EQ(reader.Get(edition + PackedEditionFlags, 1), uint64_t(PackedEditionDefault));
+
+  ASSERT_EQ(reader.Count(PackedChapters), 1u);
+  size_t chapter = reader.Record(PackedChapters, 0);
+  EXPECT_EQ(reader.Get(chapter + PackedChapterUid, 8), 11u);
+  EXPECT_DOUBLE_EQ(reader.GetDouble(chapter + PackedChapterStart), 90000.0);
+  EXPECT_EQ(reader.GetString(chapter + PackedChapterTitle), "Part A");
+  EXPECT_EQ(reader.Get(chapter + PackedChapterFlags, 1), uint64_t(PackedChapterEnabled));
+
+  ASSERT_EQ(reader.Count(PackedTags), 2u);
+  size_t tag = reader.Record(PackedTags, 1);
+  EXPECT_EQ(reader.Get(tag + PackedTagTrackUid, 8), 1001u);
+  EXPECT_EQ(reader.Get(tag + PackedTagTargetTypeValue, 4), 50u);
+  EXPECT_EQ(reader.GetString(tag + PackedTagName), "NUMBER_OF_FRAMES");
+  EXPECT_EQ(reader.GetString(tag + PackedTagValue), "34049");
+}
+
+TEST_F(MkvPackedMetadataTest, StoresEqualStringsOnce) {
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_TRACKS));
+  std::vector<uint8_t> packed;
+  packMkvMetadata(extractor, MKV_SECTION_TRACKS, packed);
+
+  // "", "eng" and three codec IDs, although every track has a language
+  PackedReader reader(packed);
+  EXPECT_EQ(reader.StringCount(), 5u);
+  EXPECT_EQ(reader.Get(reader.Record(PackedTracks, 0) + PackedTrackLanguage, 4),
+            reader.Get(reader.Record(PackedTracks, 2) + PackedTrackLanguage, 4));
+}
+
+TEST_F(MkvPackedMetadataTest, LeavesOutSectionsNotAsked) {
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_DEFAULT));
+  std::vector<uint8_t> packed;
+  packMkvMetadata(extractor, MKV_SECTION_TRACKS, packed);
+
+  PackedReader reader(packed);
+  EXPECT_EQ(reader.Count(PackedTracks), 3u);
+  EXPECT_EQ(reader.Count(PackedAttachments), 0u);
+  EXPECT_EQ(reader.Count(PackedChapters), 0u);
+  EXPECT_EQ(reader.Count(PackedTags), 0u);
+  EXPECT_EQ(reader.GetString(PackedTitleOffset), "");
+  EXPECT_DOUBLE_EQ(reader.GetDouble(PackedDurationOffset), 0.0);
+}
+
+// Not a pass/fail check: prints what packing costs per file, to compare with
+// building and encoding the EncodableMap of the same file. Run it with
+// --gtest_also_run_disabled_tests.
+TEST_F(MkvPackedMetadataTest, DISABLED_PackCostPerFile) {
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_DEFAULT));
+
+  const int rounds = 20000;
+  std::vector<uint8_t> packed;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    packMkvMetadata(extractor, MKV_SECTION_DEFAULT, packed);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_FALSE(packed.empty());
+  std::cout << "pack: " << std::chrono::duration<double, std::nano>(elapsed).count() / rounds
+            << " ns and " << packed.size() << " bytes per file" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_block_reader.h"
+#include "mkv_resync_scanner.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+// Payload-like bytes full of 0x1X lead bytes that never complete a level 1
+// ID: every one of them is followed by a zero, which no such ID has second
+std::vector<uint8_t> NearMisses(size_t size) {
+  std::vector<uint8_t> data(size);
+  uint32_t state = 777;
+  for (size_t i = 0; i < size; i++) {
+    state = state * 1103515245u + 12345u;
+    data[i] = static_cast<uint8_t>(state >> 24);
+    if (i > 0 && (data[i - 1] & 0xF0) == 0x10) {
+      data[i] = 0;
+    }
+  }
+  return data;
+}
+
+void PutId(std::vector<uint8_t>& data, size_t pos, uint32_t id) {
+  for (int i = 0; i < 4; i++) {
+    data[pos + i] = static_cast<uint8_t>(id >> (24 - 8 * i));
+  }
+}
+
+// The obvious byte-by-byte scan
+size_t ReferenceFind(const uint8_t* data, size_t length, uint32_t& foundId) {
+  for (size_t i = 0; i + 4 <= length; i++) {
+    uint32_t id = (uint32_t(data[i]) << 24) | (uint32_t(data[i + 1]) << 16) |
+                  (uint32_t(data[i + 2]) << 8) | data[i + 3];
+    if (isMkvLevel1Id(id)) {
+      foundId = id;
+      return i;
+    }
+  }
+  return length;
+}
+
+class MkvResyncScannerTest : public TempDirTest {};
+
+}  // namespace
+
+TEST_F(MkvResyncScannerTest, FindsAnIdAtEveryOffset) {
+  std::vector<uint8_t> data = NearMisses(100);
+  uint32_t id = 0;
+  EXPECT_EQ(findMkvLevel1Id(data.data(), data.size(), id), data.size());
+
+  // Every alignment relative to the 16 byte blocks, and IDs cut by the end
+  for (size_t pos = 0; pos < data.size(); pos++) {
+    std::vector<uint8_t> planted = data;
+    size_t fits = std::min<size_t>(4, planted.size() - pos);
+    std::vector<uint8_t> cluster(4);
+    PutId(cluster, 0, MkvIds::Cluster);
+    std::copy(cluster.begin(), cluster.begin() + fits, planted.begin() + pos);
+
+    uint32_t expectedId = 0;
+    uint32_t foundId = 0;
+    size_t expected = ReferenceFind(planted.data(), planted.size(), expectedId);
+    ASSERT_EQ(findMkvLevel1Id(planted.data(), planted.size(), foundId), expected) << "at " << pos;
+    EXPECT_EQ(expected, fits == 4 ? pos : planted.size()) << "at " << pos;
+    if (expected < planted.size()) {
+      EXPECT_EQ(foundId, expectedId);
+    }
+  }
+}
+
+// Benchmark: resync over 2 GiB without a level 1 ID, as after an unknown-size
+// Cluster near the start of a long recording. Prints GiB/s for the scanner on
+// memory, through the stream reader and through the mapping, next to a plain
+// byte loop. Writes a 2 GiB file, so it only runs with
+// --gtest_also_run_disabled_tests.
+TEST_F(MkvResyncScannerTest, DISABLED_ScanTwoGiB) {
+  const size_t chunkSize = 64 * 1024 * 1024;
+  const int chunks = 32;
+  std::vector<uint8_t> chunk = NearMisses(chunkSize);
+  {
+    std::ofstream out(path_, std::ios::binary);
+    for (int i = 0; i < chunks; i++) {
+      out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+    std::string tail = Element(MkvIds::Cluster, "");
+    out.write(tail.data(), tail.size());
+  }
+  const uint64_t total = uint64_t(chunkSize) * chunks;
+
+  auto report = [&](const char* name, uint64_t bytes, std::chrono::steady_clock::duration time) {
+    double seconds = std::chrono::duration<double>(time).count();
+    std::cout << name << ": " << seconds * 1000 << " ms, "
+              << bytes / seconds / (1024.0 * 1024 * 1024) << " GiB/s" << std::endl;
+  };
+
+  uint32_t id = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < chunks; i++) {
+    ASSERT_EQ(ReferenceFind(chunk.data(), chunk.size(), id), chunk.size());
+  }
+  report("byte loop, memory", total, std::chrono::steady_clock::now() - start);
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < chunks; i++) {
+    ASSERT_EQ(findMkvLevel1Id(chunk.data(), chunk.size(), id), chunk.size());
+  }
+  report("scanner, memory", total, std::chrono::steady_clock::now() - start);
+
+  // The file was just written, so it is in the page cache
+  for (bool mapped : {false, true}) {
+    MkvBlockReader reader;
+    ASSERT_TRUE(mapped ? reader.openMapped(path_) : reader.open(path_));
+    start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(reader.scanLevel1(reader.size(), id));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(reader.tell(), total);
+    EXPECT_EQ(id, MkvIds::Cluster);
+    report(mapped ? "scanLevel1, mapped" : "scanLevel1, stream", total, elapsed);
+  }
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "mkv_metadata_extractor_version5.h"
+#include "mkv_schema.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+constexpr MkvField<MkvStream> kTrackEntryFields[] = {
+    mkvUInt8(MkvIds::TrackType, &MkvStream::trackType),
+    mkvAtom(MkvIds::CodecID, &MkvStream::codecID),
+    mkvUInt(MkvIds::TrackNumber, &MkvStream::trackNumber),
+    mkvString(MkvIds::Name, &MkvStream::name),
+    mkvData(MkvIds::CodecPrivate, &MkvStream::codecPrivateOffset, &MkvStream::codecPrivateSize),
+    mkvUInt(MkvIds::TrackUID, &MkvStream::trackUID),
+    mkvAtom(MkvIds::Language, &MkvStream::language),
+    mkvUInt(MkvIds::DefaultDuration, &MkvStream::defaultDuration),
+    mkvAtom(MkvIds::CodecName, &MkvStream::codecName),
+};
+static_assert(mkvIsSorted(kTrackEntryFields), "kTrackEntryFields must be sorted by ID");
+
+constexpr MkvSchema<MkvStream> kTrackEntrySchema(kTrackEntryFields);
+
+// What the parsers looked like before the schema, used as the baseline
+int SwitchDispatch(uint32_t id) {
+  switch (id) {
+    case MkvIds::TrackType:
+      return 0;
+    case MkvIds::CodecID:
+      return 1;
+    case MkvIds::TrackNumber:
+      return 2;
+    case MkvIds::Name:
+      return 3;
+    case MkvIds::CodecPrivate:
+      return 4;
+    case MkvIds::TrackUID:
+      return 5;
+    case MkvIds::Language:
+      return 6;
+    case MkvIds::DefaultDuration:
+      return 7;
+    case MkvIds::CodecName:
+      return 8;
+    default:
+      return -1;
+  }
+}
+
+// A TrackEntry as muxers usually write it, plus elements nobody parses
+std::vector<uint32_t> TypicalIds() {
+  return {MkvIds::TrackNumber, MkvIds::TrackUID,      MkvIds::TrackType,
+          MkvIds::Language,    MkvIds::CodecID,       MkvIds::CodecPrivate,
+          MkvIds::Name,        MkvIds::DefaultDuration, 0x9C /* FlagLacing */,
+          0x88 /* FlagDefault */, MkvIds::CodecName,  0x55AA /* FlagForced */};
+}
+
+}  // namespace
+
+TEST(MkvSchema, FindsEveryField) {
+  // A perfect hash was found at compile time, not the binary search fallback
+  EXPECT_NE(kTrackEntrySchema.multiplier, 0u);
+
+  for (const auto& field : kTrackEntryFields) {
+    const MkvField<MkvStream>* found = kTrackEntrySchema.find(field.id);
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(found->id, field.id);
+  }
+}
+
+TEST(MkvSchema, IgnoresUnknownIds) {
+  EXPECT_EQ(kTrackEntrySchema.find(0), nullptr);
+  EXPECT_EQ(kTrackEntrySchema.find(0x80), nullptr);
+  EXPECT_EQ(kTrackEntrySchema.find(MkvIds::Video), nullptr);
+  EXPECT_EQ(kTrackEntrySchema.find(0xFFFFFFFF), nullptr);
+}
+
+TEST(MkvSchema, DecodeTypesPointAtTheRightMembers) {
+  MkvStream stream;
+
+  const MkvField<MkvStream>* trackNumber = kTrackEntrySchema.find(MkvIds::TrackNumber);
+  ASSERT_EQ(trackNumber->type, MKV_FIELD_UINT);
+  stream.*(trackNumber->uintMember) = 7;
+
+  const MkvField<MkvStream>* codecId = kTrackEntrySchema.find(MkvIds::CodecID);
+  ASSERT_EQ(codecId->type, MKV_FIELD_ATOM);
+  stream.*(codecId->stringMember) = "V_VP9";
+
+  const MkvField<MkvStream>* codecPrivate = kTrackEntrySchema.find(MkvIds::CodecPrivate);
+  ASSERT_EQ(codecPrivate->type, MKV_FIELD_DATA);
+  stream.*(codecPrivate->uintMember) = 100;
+  stream.*(codecPrivate->sizeMember) = 20;
+
+  EXPECT_EQ(stream.trackNumber, 7u);
+  EXPECT_EQ(stream.codecID, "V_VP9");
+  EXPECT_EQ(stream.codecPrivateOffset, 100u);
+  EXPECT_EQ(stream.codecPrivateSize, 20u);
+}
+
+// Micro-benchmark: cost of mapping an element ID to its handler, schema
+// lookup against the switch it replaced. Prints ns per element; it only
+// fails if the two disagree. Disabled like every benchmark, run with
+// --gtest_also_run_disabled_tests.
+TEST(MkvSchema, DISABLED_DispatchCost) {
+  const std::vector<uint32_t> ids = TypicalIds();
+  const int rounds = 200000;
+
+  int64_t schemaHits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (uint32_t id : ids) {
+      schemaHits += kTrackEntrySchema.find(id) != nullptr;
+    }
+  }
+  auto schemaTime = std::chrono::steady_clock::now() - start;
+
+  int64_t switchHits = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; round++) {
+    for (uint32_t id : ids) {
+      switchHits += SwitchDispatch(id) >= 0;
+    }
+  }
+  auto switchTime = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(schemaHits, switchHits);
+
+  const double elements = static_cast<double>(rounds) * ids.size();
+  std::cout << "schema dispatch: "
+            << std::chrono::duration<double, std::nano>(schemaTime).count() / elements
+            << " ns/element, switch dispatch: "
+            << std::chrono::duration<double, std::nano>(switchTime).count() / elements
+            << " ns/element" << std::endl;
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,265 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ebml_test_writer.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+// The raw ID bytes, as a SeekID stores them
+std::string IdBytes(uint32_t id) {
+  std::string out;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    if ((id >> shift) != 0) {
+      out.push_back(static_cast<char>(id >> shift));
+    }
+  }
+  return out;
+}
+
+// A SeekHead listing (id, offset from the start of the Segment data) pairs
+std::string SeekHead(const std::vector<std::pair<uint32_t, uint64_t>>& entries) {
+  std::string seeks;
+  for (const auto& entry : entries) {
+    seeks += Element(MkvIds::Seek, Element(MkvIds::SeekID, IdBytes(entry.first)) +
+                                       UInt(MkvIds::SeekPosition, entry.second));
+  }
+  return Element(MkvIds::SeekHead, seeks);
+}
+
+std::string Info() {
+  return Element(MkvIds::SegmentInfo,
+                 UInt(MkvIds::TimecodeScale, 1000000) + Element(MkvIds::Title, "Layout"));
+}
+
+std::string Tracks() {
+  return Element(MkvIds::Tracks,
+                 Element(MkvIds::TrackEntry, UInt(MkvIds::TrackNumber, 1) +
+                                                 UInt(MkvIds::TrackType, TRACK_TYPE_VIDEO) +
+                                                 Element(MkvIds::CodecID, "V_MPEG4/ISO/AVC")));
+}
+
+std::string Attachments() {
+  return Element(MkvIds::Attachments,
+                 Element(MkvIds::AttachedFile,
+                         Element(MkvIds::FileName, "font.ttf") +
+                             Element(MkvIds::FileMimeType, "font/ttf") +
+                             Element(MkvIds::FileData, std::string(32, 'F')) +
+                             UInt(MkvIds::FileUID, 1)));
+}
+
+class MkvSegmentLayoutTest : public TempDirTest {};
+
+}  // namespace
+
+TEST_F(MkvSegmentLayoutTest, JumpsToTheSeekHeadTargets) {
+  // Every entry has the same size, so the SeekHead's size is known up front
+  uint64_t head = SeekHead({{MkvIds::SegmentInfo, 0}, {MkvIds::Tracks, 0}}).size();
+  WriteMkv(SeekHead({{MkvIds::SegmentInfo, head}, {MkvIds::Tracks, head + Info().size()}}) +
+           Info() + Tracks());
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+
+  EXPECT_EQ(extractor.getParseStats().strategy, PARSE_STRATEGY_SEEKHEAD);
+  EXPECT_EQ(extractor.getTitle(), "Layout");
+  EXPECT_EQ(extractor.getVideoStreams().size(), 1u);
+}
+
+TEST_F(MkvSegmentLayoutTest, WalksForSectionsTheSeekHeadLeavesOut) {
+  uint64_t head = SeekHead({{MkvIds::SegmentInfo, 0}, {MkvIds::Tracks, 0}}).size();
+  WriteMkv(SeekHead({{MkvIds::SegmentInfo, head}, {MkvIds::Tracks, head + Info().size()}}) +
+           Info() + Tracks() + Attachments());
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_));
+
+  ASSERT_EQ(extractor.getAttachments().size(), 1u);
+  EXPECT_EQ(extractor.getAttachments()[0].fileName, "font.ttf");
+  // Found once, not twice, although the walk passes them again
+  EXPECT_EQ(extractor.getVideoStreams().size(), 1u);
+  EXPECT_EQ(extractor.getTitle(), "Layout");
+  EXPECT_EQ(extractor.getParseStats().strategy, PARSE_STRATEGY_LINEAR);
+  EXPECT_NE(extractor.getSegmentLayout().attachments, 0u);
+}
+
+TEST_F(MkvSegmentLayoutTest, KeepsSeekHeadPositionsOfUnrequestedSections) {
+  // Cues are listed but not asked for; Attachments are asked for but not listed
+  std::string cues = Element(MkvIds::Cues, "");
+  uint64_t head =
+      SeekHead({{MkvIds::SegmentInfo, 0}, {MkvIds::Tracks, 0}, {MkvIds::Cues, 0}}).size();
+  // The walk for Attachments stops before it reaches the Cues
+  uint64_t cuesAt = head + Info().size() + Tracks().size() + Attachments().size();
+  WriteMkv(SeekHead({{MkvIds::SegmentInfo, head},
+                     {MkvIds::Tracks, head + Info().size()},
+                     {MkvIds::Cues, cuesAt}}) +
+           Info() + Tracks() + Attachments() + cues);
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(
+      extractor.open(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS | MKV_SECTION_ATTACHMENTS));
+  EXPECT_EQ(extractor.getAttachments().size(), 1u);
+  EXPECT_EQ(extractor.getSegmentLayout().cues, extractor.getSegmentLayout().dataStart + cuesAt);
+}
+
+TEST_F(MkvSegmentLayoutTest, WalksPastAStaleSeekHeadEntry) {
+  // Tracks is listed where Info is, as after an edit that moved it
+  uint64_t head = SeekHead({{MkvIds::SegmentInfo, 0}, {MkvIds::Tracks, 0}}).size();
+  std::string segment =
+      SeekHead({{MkvIds::SegmentInfo, head}, {MkvIds::Tracks, head}}) + Info() + Tracks();
+  std::string path = WriteMkv(segment);
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path, MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+
+  ASSERT_EQ(extractor.getVideoStreams().size(), 1u);
+  EXPECT_EQ(extractor.getVideoStreams()[0].codecID, "V_MPEG4/ISO/AVC");
+  EXPECT_EQ(extractor.getTitle(), "Layout");
+
+  // The layout reports where Tracks really is, not the stale entry
+  uint64_t tracks = extractor.getSegmentLayout().dataStart + head + Info().size();
+  EXPECT_EQ(extractor.getSegmentLayout().tracks, tracks);
+}
+
+TEST_F(MkvSegmentLayoutTest, AddsSectionsToAnOpenFile) {
+  // Cues through the SeekHead, Attachments found by walking
+  std::string cues = Element(
+      MkvIds::Cues,
+      Element(MkvIds::CuePoint,
+              UInt(MkvIds::CueTime, 0) +
+                  Element(MkvIds::CueTrackPositions,
+                          UInt(MkvIds::CueTrack, 1) + UInt(MkvIds::CueClusterPosition, 0))));
+  uint64_t head =
+      SeekHead({{MkvIds::SegmentInfo, 0}, {MkvIds::Tracks, 0}, {MkvIds::Cues, 0}}).size();
+  WriteMkv(SeekHead({{MkvIds::SegmentInfo, head},
+                     {MkvIds::Tracks, head + Info().size()},
+                     {MkvIds::Cues, head + Info().size() + Tracks().size()}}) +
+           Info() + Tracks() + cues + Attachments());
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.openMapped(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+  EXPECT_EQ(extractor.getCueIndex().size(), 0u);
+  EXPECT_TRUE(extractor.getAttachments().empty());
+
+  ASSERT_TRUE(extractor.addSections(MKV_SECTION_TRACKS | MKV_SECTION_CUES |
+                                    MKV_SECTION_ATTACHMENTS | MKV_SECTION_CHAPTERS));
+  EXPECT_EQ(extractor.getCueIndex().size(), 1u);
+  ASSERT_EQ(extractor.getAttachments().size(), 1u);
+  EXPECT_EQ(extractor.getAttachments()[0].fileName, "font.ttf");
+  EXPECT_EQ(extractor.getVideoStreams().size(), 1u);
+  EXPECT_EQ(extractor.getParsedSections(), uint32_t(MKV_SECTION_INFO | MKV_SECTION_TRACKS |
+                                                    MKV_SECTION_CUES | MKV_SECTION_ATTACHMENTS));
+
+  // Nothing is parsed twice
+  ASSERT_TRUE(extractor.addSections(MKV_SECTION_ALL & ~MKV_SECTION_TAGS));
+  EXPECT_EQ(extractor.getCueIndex().size(), 1u);
+  EXPECT_EQ(extractor.getAttachments().size(), 1u);
+  EXPECT_EQ(extractor.getTitle(), "Layout");
+
+  extractor.close();
+  EXPECT_FALSE(extractor.addSections(MKV_SECTION_TAGS));
+}
+
+TEST_F(MkvSegmentLayoutTest, AddedSectionsCountInTheParseStats) {
+  // Cues behind 1 MB the parser never needs to read
+  std::string cues = Element(
+      MkvIds::Cues,
+      Element(MkvIds::CuePoint,
+              UInt(MkvIds::CueTime, 0) +
+                  Element(MkvIds::CueTrackPositions,
+                          UInt(MkvIds::CueTrack, 1) + UInt(MkvIds::CueClusterPosition, 0))));
+  std::string filler = Element(MkvIds::Void, std::string(1024 * 1024, '\0'));
+  uint64_t head =
+      SeekHead({{MkvIds::SegmentInfo, 0}, {MkvIds::Tracks, 0}, {MkvIds::Cues, 0}}).size();
+  uint64_t cuesAt = head + Info().size() + Tracks().size() + filler.size();
+  WriteMkv(SeekHead({{MkvIds::SegmentInfo, head},
+                     {MkvIds::Tracks, head + Info().size()},
+                     {MkvIds::Cues, cuesAt}}) +
+           Info() + Tracks() + filler + cues);
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+  MkvParseStats opened = extractor.getParseStats();
+
+  ASSERT_TRUE(extractor.addSections(MKV_SECTION_CUES));
+  ASSERT_EQ(extractor.getCueIndex().size(), 1u);
+  const MkvParseStats& added = extractor.getParseStats();
+  EXPECT_GT(added.elements, opened.elements);
+  EXPECT_GT(added.io.streamReads, opened.io.streamReads);
+  EXPECT_GT(added.io.bytesRead, opened.io.bytesRead);
+  // Jumped to the Cues, not read up to them
+  EXPECT_LT(added.io.bytesRead, filler.size());
+}
+
+TEST_F(MkvSegmentLayoutTest, StopsOnceTheRequestedSectionsAreParsed) {
+  // Large attachments after the headers, as in a typical fansub release
+  std::string attachments;
+  for (int i = 0; i < 8; i++) {
+    attachments += Element(MkvIds::AttachedFile,
+                           Element(MkvIds::FileName, "font" + std::to_string(i) + ".ttf") +
+                               Element(MkvIds::FileData, std::string(100000, 'F')) +
+                               UInt(MkvIds::FileUID, i + 1));
+  }
+  WriteMkv(Info() + Tracks() + Element(MkvIds::Attachments, attachments) +
+           Element(MkvIds::Tags, Element(MkvIds::Tag, "")));
+
+  MkvMetadataExtractor headers;
+  ASSERT_TRUE(headers.open(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+  EXPECT_EQ(headers.getParsedSections(), uint32_t(MKV_SECTION_INFO | MKV_SECTION_TRACKS));
+  EXPECT_EQ(headers.getVideoStreams().size(), 1u);
+  EXPECT_TRUE(headers.getAttachments().empty());
+  // Only the first refills were needed, not the 800 KB behind them
+  EXPECT_LT(headers.getParseStats().io.bytesRead, 64u * 1024);
+
+  MkvMetadataExtractor everything;
+  ASSERT_TRUE(everything.open(path_));
+  EXPECT_EQ(everything.getAttachments().size(), 8u);
+  EXPECT_TRUE(everything.getParsedSections() & MKV_SECTION_TAGS);
+  EXPECT_GT(everything.getParseStats().elements, headers.getParseStats().elements);
+
+  // Only what was asked for is filled, even when it was walked past
+  MkvMetadataExtractor tracksOnly;
+  ASSERT_TRUE(tracksOnly.open(path_, MKV_SECTION_TRACKS));
+  EXPECT_EQ(tracksOnly.getParsedSections(), uint32_t(MKV_SECTION_TRACKS));
+  EXPECT_EQ(tracksOnly.getTitle(), "");
+  EXPECT_EQ(tracksOnly.getVideoStreams().size(), 1u);
+}
+
+TEST_F(MkvSegmentLayoutTest, ResyncsAfterAnUnknownSizeCluster) {
+  // A live recording: the Segment and its first Cluster have no size, the
+  // Tags come after the Clusters
+  std::string block = Element(MkvIds::SimpleBlock, std::string("\x81\x00\x00\x80", 4) +
+                                                       std::string(500, 'v'));
+  std::string live = UnknownSizeElement(MkvIds::Cluster, UInt(MkvIds::Timestamp, 0) + block);
+  std::string sized = Element(MkvIds::Cluster, UInt(MkvIds::Timestamp, 40) + block);
+  std::string tags = Element(
+      MkvIds::Tags, Element(MkvIds::Tag, Element(MkvIds::SimpleTag,
+                                                 Element(MkvIds::TagName, "ENCODER") +
+                                                     Element(MkvIds::TagString, "OBS"))));
+  std::string segment = Info() + Tracks() + live + sized + tags;
+  std::string header = Element(MkvIds::EBML, Element(MkvIds::DocType, "matroska")) +
+                       UnknownSizeElement(MkvIds::Segment, "");
+  WriteFile(path_, header + segment);
+
+  MkvMetadataExtractor extractor;
+  ASSERT_TRUE(extractor.open(path_, MKV_SECTION_INFO | MKV_SECTION_TRACKS | MKV_SECTION_TAGS));
+
+  ASSERT_EQ(extractor.getTags().size(), 1u);
+  EXPECT_EQ(extractor.getTags()[0].value, "OBS");
+  EXPECT_EQ(extractor.getVideoStreams().size(), 1u);
+  EXPECT_GE(extractor.getParseStats().resyncs, 1u);
+
+  const MkvSegmentLayout& layout = extractor.getSegmentLayout();
+  EXPECT_EQ(layout.end, header.size() + segment.size());
+  EXPECT_EQ(layout.firstCluster, layout.dataStart + Info().size() + Tracks().size());
+  EXPECT_EQ(layout.tags, layout.dataStart + segment.size() - tags.size());
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "ebml_test_writer.h"
+#include "mkv_session_table.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+class MkvSessionTableTest : public TempDirTest {
+ protected:
+  void SetUp() override {
+    TempDirTest::SetUp();
+    WriteMkv(Element(MkvIds::Tracks, Element(MkvIds::TrackEntry,
+                                             UInt(MkvIds::TrackNumber, 1) +
+                                                 UInt(MkvIds::TrackType, TRACK_TYPE_AUDIO) +
+                                                 Element(MkvIds::CodecID, "A_OPUS"))));
+  }
+};
+
+}  // namespace
+
+TEST_F(MkvSessionTableTest, OpenFindClose) {
+  MkvSessionTable table;
+  int64_t handle = table.open(path_, MKV_SECTION_ALL);
+  ASSERT_NE(handle, 0);
+  EXPECT_EQ(table.size(), 1u);
+
+  std::shared_ptr<MkvSession> session = table.find(handle);
+  ASSERT_NE(session, nullptr);
+  EXPECT_EQ(session->extractor.getAudioStreams().size(), 1u);
+
+  EXPECT_TRUE(table.close(handle));
+  EXPECT_FALSE(table.close(handle));
+  EXPECT_EQ(table.find(handle), nullptr);
+  EXPECT_EQ(table.size(), 0u);
+
+  // A call that still holds the session keeps it usable
+  EXPECT_EQ(session->extractor.getAudioStreams().size(), 1u);
+}
+
+TEST_F(MkvSessionTableTest, UnreadableFilesGetNoHandle) {
+  MkvSessionTable table;
+  EXPECT_EQ(table.open(path_ + ".missing", MKV_SECTION_ALL), 0);
+  EXPECT_EQ(table.size(), 0u);
+}
+
+TEST_F(MkvSessionTableTest, IdleSessionsExpire) {
+  MkvSessionTable table;
+  int64_t idle = table.open(path_, MKV_SECTION_ALL, std::chrono::milliseconds(50));
+  int64_t kept = table.open(path_, MKV_SECTION_ALL, std::chrono::minutes(5));
+  ASSERT_NE(idle, 0);
+  ASSERT_NE(kept, 0);
+  EXPECT_NE(idle, kept);
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (table.size() > 1 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(table.find(idle), nullptr);
+  EXPECT_NE(table.find(kept), nullptr);
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ebml_test_writer.h"
+#include "mkv_string_pool.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+class MkvStringPoolFileTest : public TempDirTest {
+ protected:
+  void SetUp() override {
+    TempDirTest::SetUp();
+    WriteMkv(TypicalEpisodeSegment());
+  }
+};
+
+}  // namespace
+
+TEST(MkvStringArena, StoresCopies) {
+  MkvStringArena arena(16);
+  std::string source = "V_MPEG4/ISO/AVC";
+  std::string_view stored = arena.store(source);
+  source[0] = 'X';
+  EXPECT_EQ(stored, "V_MPEG4/ISO/AVC");
+  EXPECT_TRUE(arena.store("").empty());
+
+  // Larger than a block: gets a block of its own
+  std::string large(100, 'a');
+  EXPECT_EQ(arena.store(large), large);
+  EXPECT_EQ(stored, "V_MPEG4/ISO/AVC");
+}
+
+TEST(MkvStringArena, ResetKeepsBlocks) {
+  MkvStringArena arena(64);
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 20; i++) {
+      EXPECT_EQ(arena.store("string number " + std::to_string(i)),
+                "string number " + std::to_string(i));
+    }
+    arena.reset();
+  }
+  // 20 strings of ~16 bytes fill 5-6 blocks, and they are reused every round
+  EXPECT_LE(arena.getBlockCount(), 6u);
+}
+
+TEST(MkvInternTable, SharesEqualStrings) {
+  MkvInternTable table;
+  std::string first = "application/x-truetype-font";
+  std::string second = first;
+  std::string_view a = table.intern(first);
+  std::string_view b = table.intern(second);
+  EXPECT_EQ(a, first);
+  EXPECT_EQ(a.data(), b.data());
+  EXPECT_NE(a.data(), first.data());
+  EXPECT_EQ(table.size(), 1u);
+
+  // Not worth interning: the caller keeps its own copy
+  EXPECT_TRUE(table.intern(std::string(MkvInternTable::MaxLength + 1, 'x')).empty());
+  EXPECT_TRUE(table.intern("").empty());
+}
+
+TEST(MkvInternTable, ThreadsGetTheSameCopy) {
+  MkvInternTable table;
+  const int threads = 8;
+  const int values = 200;
+  std::vector<std::vector<std::string_view>> seen(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < values; i++) {
+          std::string_view interned = table.intern("codec " + std::to_string((i + t) % values));
+          if (round == 0) {
+            seen[t].push_back(interned);
+          }
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  EXPECT_EQ(table.size(), size_t(values));
+  for (int i = 0; i < values; i++) {
+    std::string_view first = seen[0][i];
+    EXPECT_EQ(first, "codec " + std::to_string(i));
+    for (int t = 1; t < threads; t++) {
+      // Thread t started `t` values further on
+      EXPECT_EQ(seen[t][(i - t + values) % values].data(), first.data());
+    }
+  }
+}
+
+TEST_F(MkvStringPoolFileTest, ParsesStringsIntoThePool) {
+  MkvMetadataExtractor extractor;
+  std::streambuf* log = std::cout.rdbuf(nullptr);
+  ASSERT_TRUE(extractor.openMapped(path_));
+  std::cout.rdbuf(log);
+
+  EXPECT_EQ(extractor.getTitle(), "Some Show - S01E01 - A Long Episode Title");
+  EXPECT_EQ(extractor.getMuxingApp(), "libebml v1.4.4 + libmatroska v1.7.1");
+  ASSERT_EQ(extractor.getVideoStreams().size(), 1u);
+  ASSERT_EQ(extractor.getAudioStreams().size(), 3u);
+  ASSERT_EQ(extractor.getAttachments().size(), 6u);
+
+  const MkvStream& video = extractor.getVideoStreams()[0];
+  EXPECT_EQ(video.codecID, "V_MPEGH/ISO/HEVC");
+  EXPECT_EQ(video.name, "Main video, 1080p HDR10 encode");
+  EXPECT_EQ(extractor.getAudioStreams()[1].language, "eng");
+  EXPECT_EQ(extractor.getAttachments()[5].fileName, "SubtitleFont-Regular-5.ttf");
+
+  // Repeated values point at the same interned bytes
+  const auto& attachments = extractor.getAttachments();
+  EXPECT_EQ(attachments[0].mimeType.data(), attachments[5].mimeType.data());
+  EXPECT_EQ(extractor.getAudioStreams()[0].language.data(),
+            extractor.getSubtitleStreams()[0].language.data());
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "single_flight_table.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+TEST(SingleFlightTable, IdenticalRequestsShareOneFlight) {
+  SingleFlightTable<std::string> table;
+  int64_t first = 0;
+  int64_t second = 0;
+  int64_t other = 0;
+  bool raised = false;
+
+  EXPECT_TRUE(table.join("getVideoDuration|c:\\a.mkv", 1, 0, "widget 1", first, raised));
+  EXPECT_FALSE(table.join("getVideoDuration|c:\\a.mkv", 2, 5, "widget 2", second, raised));
+  EXPECT_TRUE(raised);
+  EXPECT_EQ(first, second);
+  EXPECT_TRUE(table.join("getVideoDuration|c:\\b.mkv", 3, 0, "widget 3", other, raised));
+  EXPECT_NE(first, other);
+
+  EXPECT_EQ(table.finish(first), (std::vector<std::string>{"widget 1", "widget 2"}));
+  // Done flights are forgotten, the next request starts a new one
+  int64_t again = 0;
+  EXPECT_TRUE(table.join("getVideoDuration|c:\\a.mkv", 4, 0, "widget 4", again, raised));
+  EXPECT_NE(again, first);
+
+  SingleFlightStats stats = table.getStats();
+  EXPECT_EQ(stats.requests, 4u);
+  EXPECT_EQ(stats.joined, 1u);
+}
+
+TEST(SingleFlightTable, RequestsWithoutKeyNeverJoin) {
+  SingleFlightTable<int> table;
+  int64_t first = 0;
+  int64_t second = 0;
+  bool raised = false;
+  EXPECT_TRUE(table.join("", 0, 0, 1, first, raised));
+  EXPECT_TRUE(table.join("", 0, 0, 2, second, raised));
+  EXPECT_NE(first, second);
+  EXPECT_EQ(table.getStats().joined, 0u);
+}
+
+TEST(SingleFlightTable, LeavingKeepsTheFlightForOthers) {
+  SingleFlightTable<std::string> table;
+  int64_t tag = 0;
+  bool raised = false;
+  table.join("getThumbnail|c:\\a.mkv", 10, 0, "first", tag, raised);
+  table.join("getThumbnail|c:\\a.mkv", 11, 0, "second", tag, raised);
+
+  int64_t found = 0;
+  size_t requests = 0;
+  ASSERT_TRUE(table.find(10, found, requests));
+  EXPECT_EQ(found, tag);
+  EXPECT_EQ(requests, 2u);
+
+  std::string reply;
+  ASSERT_TRUE(table.leave(10, reply));
+  EXPECT_EQ(reply, "first");
+  EXPECT_FALSE(table.find(10, found, requests));
+  ASSERT_TRUE(table.find(11, found, requests));
+  EXPECT_EQ(requests, 1u);
+
+  EXPECT_EQ(table.finish(tag), std::vector<std::string>{"second"});
+  EXPECT_FALSE(table.find(11, found, requests));
+}
+
+TEST(SingleFlightTable, NormalizesPathSpellings) {
+  EXPECT_EQ(normalizeRequestPath("C:/Videos//Show/EP01.MKV"), "c:\\videos\\show\\ep01.mkv");
+  EXPECT_EQ(normalizeRequestPath("\\\\?\\C:\\Videos\\ep01.mkv"), "c:\\videos\\ep01.mkv");
+  EXPECT_EQ(normalizeRequestPath("\\\\server\\share\\ep01.mkv"), "\\\\server\\share\\ep01.mkv");
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -4,10 +4,18 @@
 #include <gtest/gtest.h>
 #include <windows.h>
 
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <variant>
+#include <vector>
 
+#include "ebml_test_writer.h"
+#include "mkv_packed_metadata.h"
 #include "video_thumbnail_exporter_plugin.h"
 
 namespace video_thumbnail_exporter {
@@ -15,11 +23,40 @@ namespace test {
 
 namespace {
 
+using flutter::EncodableList;
 using flutter::EncodableMap;
 using flutter::EncodableValue;
 using flutter::MethodCall;
 using flutter::MethodResultFunctions;
 
+class VideoThumbnailExporterPluginFileTest : public TempDirTest {};
+
+// Stands in for the platform thread: completions run when the test asks
+class QueuedDispatcher : public CompletionDispatcher {
+ public:
+  void post(std::function<void()> completion) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    completions_.push_back(std::move(completion));
+  }
+
+  // Runs what was posted so far. Returns false if nothing was.
+  bool RunPosted() {
+    std::vector<std::function<void()>> completions;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      completions.swap(completions_);
+    }
+    for (auto& completion : completions) {
+      completion();
+    }
+    return !completions.empty();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::function<void()>> completions_;
+};
+
 }  // namespace
 
 TEST(VideoThumbnailExporterPlugin, GetPlatformVersion) {
@@ -39,5 +76,99 @@ TEST(VideoThumbnailExporterPlugin, GetPlatformVersion) {
   EXPECT_TRUE(result_string.rfind("Windows ", 0) == 0);
 }
 
+TEST_F(VideoThumbnailExporterPluginFileTest, MkvMetadataBatchReportsErrorsPerFile) {
+  std::string path = WriteMkv(Element(MkvIds::SegmentInfo, Element(MkvIds::Title, "Pilot")));
+
+  VideoThumbnailExporterPlugin plugin;
+  EncodableMap reply;
+  plugin.HandleMethodCall(
+      MethodCall("getMkvMetadataBatch",
+                 std::make_unique<EncodableValue>(EncodableMap{
+                     {EncodableValue("mkvPaths"),
+                      EncodableValue(EncodableList{EncodableValue(path),
+                                                   EncodableValue("missing.mkv"),
+                                                   EncodableValue(path)})},
+                 })),
+      std::make_unique<MethodResultFunctions<>>(
+          [&reply](const EncodableValue* result) {
+            reply = std::get<EncodableMap>(*result);
+          },
+          nullptr, nullptr));
+
+  const auto& results = std::get<EncodableList>(reply[EncodableValue("results")]);
+  ASSERT_EQ(results.size(), 3u);
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& entry = std::get<EncodableMap>(results[i]);
+    bool missing = i == 1;
+    EXPECT_EQ(entry.count(EncodableValue("metadata")), missing ? 0u : 1u);
+    EXPECT_EQ(entry.count(EncodableValue("error")), missing ? 1u : 0u);
+  }
+  EXPECT_EQ(std::get<int64_t>(reply[EncodableValue("failed")]), 1);
+}
+
+TEST_F(VideoThumbnailExporterPluginFileTest, MkvMetadataBatchRunsOnTheWorkers) {
+  std::string path = WriteMkv(Element(MkvIds::SegmentInfo, Element(MkvIds::Title, "Pilot")));
+
+  auto dispatcher = std::make_unique<QueuedDispatcher>();
+  QueuedDispatcher* platform = dispatcher.get();
+  VideoThumbnailExporterPlugin plugin(std::move(dispatcher));
+  bool replied = false;
+  EncodableMap reply;
+  plugin.HandleMethodCall(
+      MethodCall("getMkvMetadataBatch",
+                 std::make_unique<EncodableValue>(EncodableMap{
+                     {EncodableValue("mkvPaths"), EncodableValue(EncodableList(40, EncodableValue(path)))},
+                 })),
+      std::make_unique<MethodResultFunctions<>>(
+          [&](const EncodableValue* result) {
+            reply = std::get<EncodableMap>(*result);
+            replied = true;
+          },
+          nullptr, nullptr));
+
+  // The reply comes once the last of the batch's tasks completes
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while (!replied && std::chrono::steady_clock::now() < deadline) {
+    if (!platform->RunPosted()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  ASSERT_TRUE(replied);
+
+  const auto& results = std::get<EncodableList>(reply[EncodableValue("results")]);
+  ASSERT_EQ(results.size(), 40u);
+  for (const auto& result : results) {
+    EXPECT_EQ(std::get<EncodableMap>(result).count(EncodableValue("metadata")), 1u);
+  }
+  EXPECT_EQ(std::get<int64_t>(reply[EncodableValue("failed")]), 0);
+  EXPECT_EQ(std::get<int64_t>(reply[EncodableValue("cancelled")]), 0);
+}
+
+TEST_F(VideoThumbnailExporterPluginFileTest, MkvMetadataCanBePacked) {
+  std::string path = WriteMkv(Element(MkvIds::SegmentInfo, Element(MkvIds::Title, "Pilot")));
+
+  VideoThumbnailExporterPlugin plugin;
+  EncodableValue map;
+  EncodableValue packed;
+  for (bool pack : {false, true}) {
+    plugin.HandleMethodCall(
+        MethodCall("getMkvMetadata",
+                   std::make_unique<EncodableValue>(EncodableMap{
+                       {EncodableValue("mkvPath"), EncodableValue(path)},
+                       {EncodableValue("sections"), EncodableValue(int(MKV_SECTION_INFO))},
+                       {EncodableValue("packed"), EncodableValue(pack)},
+                   })),
+        std::make_unique<MethodResultFunctions<>>(
+            [&](const EncodableValue* result) { (pack ? packed : map) = *result; },
+            nullptr, nullptr));
+  }
+
+  EXPECT_EQ(std::get<std::string>(std::get<EncodableMap>(map)[EncodableValue("title")]), "Pilot");
+  const auto& bytes = std::get<std::vector<uint8_t>>(packed);
+  ASSERT_GT(bytes.size(), size_t(PackedHeaderSize));
+  EXPECT_EQ(std::string(bytes.begin(), bytes.begin() + 4), "MKVP");
+  EXPECT_NE(std::string(bytes.begin(), bytes.end()).find("Pilot"), std::string::npos);
+}
+
 }  // namespace test
 }  // namespace video_thumbnail_exporter
@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "worker_pool.h"
+
+namespace video_thumbnail_exporter {
+namespace test {
+
+namespace {
+
+// Stands in for the platform thread: completions wait until drain()
+class QueuedDispatcher : public CompletionDispatcher {
+ public:
+  void post(std::function<void()> completion) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    completions_.push_back(std::move(completion));
+    posted_.notify_all();
+  }
+
+  // Waits for `count` completions and runs them on the calling thread
+  void drain(size_t count) {
+    std::vector<std::function<void()>> completions;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      posted_.wait(lock, [&] { return completions_.size() >= count; });
+      completions.swap(completions_);
+    }
+    for (auto& completion : completions) {
+      completion();
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable posted_;
+  std::vector<std::function<void()>> completions_;
+};
+
+}  // namespace
+
+TEST(WorkerPool, RunsWorkOffTheCallingThreadAndCompletesThroughTheDispatcher) {
+  QueuedDispatcher dispatcher;
+  WorkerPool pool(dispatcher, 4);
+
+  const std::thread::id caller = std::this_thread::get_id();
+  const int count = 200;
+  std::atomic<int> offThread{0};
+  std::vector<int> results(count, -1);
+  int completions = 0;
+
+  for (int i = 0; i < count; i++) {
+    auto value = std::make_shared<int>(0);
+    ASSERT_TRUE(pool.submit(
+        [&, i, value] {
+          if (std::this_thread::get_id() != caller) {
+            offThread++;
+          }
+          *value = i * i;
+        },
+        [&, i, value] {
+          EXPECT_EQ(std::this_thread::get_id(), caller);
+          results[i] = *value;
+          completions++;
+        }));
+  }
+
+  dispatcher.drain(count);
+  EXPECT_EQ(completions, count);
+  EXPECT_EQ(offThread.load(), count);
+  for (int i = 0; i < count; i++) {
+    EXPECT_EQ(results[i], i * i);
+  }
+
+  WorkerPoolStats stats = pool.getStats();
+  EXPECT_EQ(stats.submitted, static_cast<uint64_t>(count));
+  EXPECT_LE(stats.threads, 4u);
+  EXPECT_GT(stats.peakQueued, 0u);
+}
+
+TEST(WorkerPool, SubmitDoesNotWaitForSlowWork) {
+  QueuedDispatcher dispatcher;
+  WorkerPool pool(dispatcher, 2);
+
+  std::mutex gate;
+  std::unique_lock<std::mutex> closed(gate);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100; i++) {
+    pool.submit([&] { std::lock_guard<std::mutex> wait(gate); }, nullptr);
+  }
+  // A 60 fps frame is 16 ms; queueing a hundred calls must fit in one easily
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(16));
+  EXPECT_GE(pool.getStats().queued, 98u);
+  closed.unlock();
+}
+
+// Blocks the single worker of a pool until open() so tasks pile up behind it
+class Gate {
+ public:
+  std::function<void()> wait() {
+    return [this] {
+      while (!open_) {
+        std::this_thread::yield();
+      }
+    };
+  }
+  void open() { open_ = true; }
+
+ private:
+  std::atomic<bool> open_{false};
+};
+
+WorkerTask Task(std::function<void()> work, int priority, int64_t tag = 0) {
+  WorkerTask task;
+  task.work = std::move(work);
+  task.priority = priority;
+  task.tag = tag;
+  return task;
+}
+
+TEST(WorkerPool, RunsHigherPrioritiesFirst) {
+  QueuedDispatcher dispatcher;
+  WorkerPool pool(dispatcher, 1);
+  Gate gate;
+  pool.submit(gate.wait(), nullptr);
+  while (pool.getStats().running == 0) {
+    std::this_thread::yield();
+  }
+
+  std::mutex orderMutex;
+  std::vector<int> order;
+  auto record = [&](int id) {
+    return [&, id] {
+      std::lock_guard<std::mutex> lock(orderMutex);
+      order.push_back(id);
+    };
+  };
+  pool.submit(Task(record(1), 0));
+  pool.submit(Task(record(2), 5));
+  pool.submit(Task(record(3), 0, 30));
+  pool.submit(Task(record(4), 5));
+
+  // Scrolled into view: 3 jumps ahead of everything
+  EXPECT_TRUE(pool.reprioritize(30, 10));
+  EXPECT_FALSE(pool.reprioritize(99, 10));
+
+  gate.open();
+  while (pool.getStats().completed < 5) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(order, (std::vector<int>{3, 2, 4, 1}));
+}
+
+TEST(WorkerPool, CancelledTasksNeverRun) {
+  QueuedDispatcher dispatcher;
+  WorkerPool pool(dispatcher, 1);
+  Gate gate;
+  pool.submit(gate.wait(), nullptr);
+  while (pool.getStats().running == 0) {
+    std::this_thread::yield();
+  }
+
+  std::atomic<int> ran{0};
+  int cancelled = 0;
+  for (int64_t tag = 1; tag <= 10; tag++) {
+    WorkerTask task = Task([&] { ran++; }, 0, tag);
+    task.cancelled = [&] { cancelled++; };
+    pool.submit(std::move(task));
+  }
+  for (int64_t tag = 1; tag <= 10; tag += 2) {
+    EXPECT_TRUE(pool.cancel(tag));
+  }
+  EXPECT_FALSE(pool.cancel(1));
+
+  // The cancellations are posted like completions
+  dispatcher.drain(5);
+  EXPECT_EQ(cancelled, 5);
+
+  gate.open();
+  while (pool.getStats().completed < 6) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(ran.load(), 5);
+
+  WorkerPoolStats stats = pool.getStats();
+  EXPECT_EQ(stats.cancelled, 5u);
+  EXPECT_EQ(stats.queued, 0u);
+  EXPECT_GT(stats.maxWaitNanoseconds, 0u);
+  EXPECT_GE(stats.totalWaitNanoseconds, stats.maxWaitNanoseconds);
+}
+
+TEST(WorkerPool, TasksSharingATagAreCancelledTogether) {
+  QueuedDispatcher dispatcher;
+  WorkerPool pool(dispatcher, 1);
+  Gate gate;
+  pool.submit(Task(gate.wait(), 0, 7));
+  while (pool.getStats().running == 0) {
+    std::this_thread::yield();
+  }
+
+  // The running part keeps going, the queued ones go
+  std::atomic<int> ran{0};
+  int cancelled = 0;
+  for (int i = 0; i < 4; i++) {
+    WorkerTask task = Task([&] { ran++; }, 0, 7);
+    task.cancelled = [&] { cancelled++; };
+    pool.submit(std::move(task));
+  }
+  pool.submit(Task([&] { ran++; }, 0, 8));
+  EXPECT_TRUE(pool.hasQueued(7));
+  EXPECT_TRUE(pool.reprioritize(7, 5));
+  EXPECT_TRUE(pool.cancel(7));
+  EXPECT_FALSE(pool.cancel(7));
+  // Only the running part is left
+  EXPECT_FALSE(pool.hasQueued(7));
+  EXPECT_TRUE(pool.hasQueued(8));
+
+  dispatcher.drain(4);
+  EXPECT_EQ(cancelled, 4);
+
+  gate.open();
+  while (pool.getStats().completed < 2) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(ran.load(), 1);
+  EXPECT_EQ(pool.getStats().cancelled, 4u);
+}
+
+TEST(WorkerPool, DropsQueuedWorkOnDestruction) {
+  QueuedDispatcher dispatcher;
+  std::atomic<bool> open{false};
+  std::atomic<int> ran{0};
+  int cancelled = 0;
+  std::thread opener;
+  {
+    WorkerPool pool(dispatcher, 1);
+    for (int i = 0; i < 10; i++) {
+      WorkerTask task;
+      task.work = [&] {
+        while (!open) {
+          std::this_thread::yield();
+        }
+        ran++;
+      };
+      task.cancelled = [&] { cancelled++; };
+      pool.submit(std::move(task));
+    }
+    while (pool.getStats().running == 0) {
+      std::this_thread::yield();
+    }
+    // Let the running job finish only once the pool is being destroyed
+    opener = std::thread([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      open = true;
+    });
+  }
+  opener.join();
+  // Only the job already running when the pool went away, the rest are told
+  EXPECT_EQ(ran.load(), 1);
+  dispatcher.drain(9);
+  EXPECT_EQ(cancelled, 9);
+}
+
+}  // namespace test
+}  // namespace video_thumbnail_exporter
@@ -1,6 +1,9 @@
 #include "video_thumbnail_exporter_plugin.h"
 #include "thumbnail_exporter.h"
 #include "mkv_metadata_extractor_version5.h"
+#include "mkv_cluster_reader.h"
+#include "mkv_cluster_scanner.h"
+#include "mkv_packed_metadata.h"
 #include "video_duration.h"
 
 // This must be included before many other Windows headers.
@@ -11,10 +14,18 @@
 
 #include <flutter/method_channel.h>
 #include <flutter/plugin_registrar_windows.h>
+#include <flutter/standard_message_codec.h>
 #include <flutter/standard_method_codec.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <vector>
 
 #include <mfapi.h>
 #include <mfidl.h>
@@ -26,6 +37,230 @@
 namespace video_thumbnail_exporter
 {
 
+  // Posts completions to the window of the Flutter view and runs them when
+  // the platform thread picks the message up
+  class PlatformThreadDispatcher : public CompletionDispatcher
+  {
+  public:
+    explicit PlatformThreadDispatcher(flutter::PluginRegistrarWindows *registrar)
+        : registrar_(registrar),
+          message_(RegisterWindowMessageW(L"VideoThumbnailExporterCompletion"))
+    {
+      flutter::FlutterView *view = registrar->GetView();
+      if (view && message_ != 0)
+      {
+        window_ = GetAncestor(view->GetNativeWindow(), GA_ROOT);
+      }
+      if (window_)
+      {
+        delegate_id_ = registrar->RegisterTopLevelWindowProcDelegate(
+            [this](HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam)
+            {
+              return HandleMessage(hwnd, message, wparam, lparam);
+            });
+      }
+    }
+
+    ~PlatformThreadDispatcher()
+    {
+      if (window_)
+      {
+        registrar_->UnregisterTopLevelWindowProcDelegate(delegate_id_);
+      }
+    }
+
+    // False when there is no window to post to (e.g. a headless engine)
+    bool IsReady() const { return window_ != nullptr; }
+
+    void post(std::function<void()> completion) override
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      completions_.push_back(std::move(completion));
+
+      // One message drains everything queued until it is handled
+      if (!posted_)
+      {
+        posted_ = PostMessageW(window_, message_, 0, 0) != FALSE;
+      }
+    }
+
+  private:
+    std::optional<LRESULT> HandleMessage(HWND, UINT message, WPARAM, LPARAM)
+    {
+      if (message != message_)
+      {
+        return std::nullopt;
+      }
+
+      std::deque<std::function<void()>> completions;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completions.swap(completions_);
+        posted_ = false;
+      }
+      for (auto &completion : completions)
+      {
+        completion();
+      }
+      return 0;
+    }
+
+    flutter::PluginRegistrarWindows *registrar_;
+    UINT message_;
+    HWND window_ = nullptr;
+    int delegate_id_ = 0;
+
+    std::mutex mutex_;
+    std::deque<std::function<void()>> completions_;
+    bool posted_ = false;
+  };
+
+  // Reply of a call run on a worker, kept until the platform thread sends it
+  struct MethodOutcome
+  {
+    enum Kind
+    {
+      kNone,
+      kSuccess,
+      kError,
+      kNotImplemented
+    };
+
+    Kind kind = kNone;
+    flutter::EncodableValue value;  // result, or error details
+    bool hasValue = false;
+    std::string errorCode;
+    std::string errorMessage;
+
+    void SendTo(flutter::MethodResult<flutter::EncodableValue> &result) const
+    {
+      switch (kind)
+      {
+      case kSuccess:
+        result.Success(value);
+        break;
+      case kError:
+        result.Error(errorCode, errorMessage, hasValue ? &value : nullptr);
+        break;
+      case kNotImplemented:
+        result.NotImplemented();
+        break;
+      case kNone:
+        result.Error("native_error", "The call finished without a result.");
+        break;
+      }
+    }
+  };
+
+  class RecordingMethodResult : public flutter::MethodResult<flutter::EncodableValue>
+  {
+  public:
+    explicit RecordingMethodResult(std::shared_ptr<MethodOutcome> outcome)
+        : outcome_(std::move(outcome)) {}
+
+  protected:
+    void SuccessInternal(const flutter::EncodableValue *result) override
+    {
+      outcome_->kind = MethodOutcome::kSuccess;
+      if (result)
+      {
+        outcome_->value = *result;
+      }
+    }
+
+    void ErrorInternal(const std::string &error_code, const std::string &error_message,
+                       const flutter::EncodableValue *error_details) override
+    {
+      outcome_->kind = MethodOutcome::kError;
+      outcome_->errorCode = error_code;
+      outcome_->errorMessage = error_message;
+      if (error_details)
+      {
+        outcome_->value = *error_details;
+        outcome_->hasValue = true;
+      }
+    }
+
+    void NotImplementedInternal() override
+    {
+      outcome_->kind = MethodOutcome::kNotImplemented;
+    }
+
+  private:
+    std::shared_ptr<MethodOutcome> outcome_;
+  };
+
+  // Cheap calls answered on the platform thread even when workers exist
+  bool RunsOnPlatformThread(const std::string &method)
+  {
+    return method == "closeMkvSession" || method == "initializeExtractor";
+  }
+
+  // Calls that reopen shared state and so must run alone
+  bool NeedsExclusiveState(const std::string &method)
+  {
+    return method == "configureMetadataCache";
+  }
+
+  // Calls that may have to reopen shared state first, see OpenSharedState
+  bool OpensSharedState(const std::string &method)
+  {
+    return method == "resolveMkvAttachments";
+  }
+
+  // Key under which identical calls share one flight, empty for calls that
+  // must each run (side effects, sessions being opened, ...)
+  std::string SingleFlightKey(const std::string &method, const flutter::EncodableValue *arguments)
+  {
+    if (method != "getThumbnail" && method != "getVideoDuration" && method != "probeMkvDuration" &&
+        method != "getFileMetadata" && method != "getMkvMetadata")
+    {
+      return std::string();
+    }
+    const auto *args = arguments ? std::get_if<flutter::EncodableMap>(arguments) : nullptr;
+    if (!args)
+    {
+      return std::string();
+    }
+
+    // The map is sorted, so equal arguments always give the same key
+    std::string key = method;
+    for (const auto &kv : *args)
+    {
+      const auto *name = std::get_if<std::string>(&kv.first);
+      if (!name || *name == "requestId" || *name == "priority")
+      {
+        continue;
+      }
+
+      key += '\n';
+      key += *name;
+      key += '=';
+      bool isPath = name->size() >= 4 && name->compare(name->size() - 4, 4, "Path") == 0;
+      if (const auto *text = std::get_if<std::string>(&kv.second))
+      {
+        key += isPath ? normalizeRequestPath(*text) : *text;
+      }
+      else if (const auto *small = std::get_if<int32_t>(&kv.second))
+      {
+        key += std::to_string(*small);
+      }
+      else if (const auto *large = std::get_if<int64_t>(&kv.second))
+      {
+        key += std::to_string(*large);
+      }
+      else if (const auto *flag = std::get_if<bool>(&kv.second))
+      {
+        key += *flag ? "true" : "false";
+      }
+      else
+      {
+        return std::string();
+      }
+    }
+    return key;
+  }
+
   // static
   void VideoThumbnailExporterPlugin::RegisterWithRegistrar(
       flutter::PluginRegistrarWindows *registrar)
@@ -35,20 +270,41 @@ namespace video_thumbnail_exporter
             registrar->messenger(), "video_thumbnail_exporter",
             &flutter::StandardMethodCodec::GetInstance());
 
-    auto plugin = std::make_unique<VideoThumbnailExporterPlugin>();
+    // Without a window to post results to, calls run on the platform thread
+    auto dispatcher = std::make_unique<PlatformThreadDispatcher>(registrar);
+    if (!dispatcher->IsReady())
+    {
+      dispatcher.reset();
+    }
+    auto plugin = std::make_unique<VideoThumbnailExporterPlugin>(std::move(dispatcher));
 
     channel->SetMethodCallHandler(
         [plugin_pointer = plugin.get()](const auto &call, auto result)
         {
           plugin_pointer->HandleMethodCall(call, std::move(result));
         });
+    plugin->channel_ = std::move(channel);
 
     registrar->AddPlugin(std::move(plugin));
   }
 
   VideoThumbnailExporterPlugin::VideoThumbnailExporterPlugin() {}
 
-  VideoThumbnailExporterPlugin::~VideoThumbnailExporterPlugin() {}
+  VideoThumbnailExporterPlugin::VideoThumbnailExporterPlugin(
+      std::unique_ptr<CompletionDispatcher> dispatcher)
+      : dispatcher_(std::move(dispatcher))
+  {
+    if (dispatcher_)
+    {
+      workers_ = std::make_unique<WorkerPool>(*dispatcher_);
+    }
+  }
+
+  VideoThumbnailExporterPlugin::~VideoThumbnailExporterPlugin()
+  {
+    // Running calls finish before the state they use is destroyed
+    workers_.reset();
+  }
 
   // Helper function to convert wide string to UTF-8
   std::string WideToUtf8(const std::wstring &wide)
@@ -69,205 +325,1988 @@ namespace video_thumbnail_exporter
     return strTo;
   }
 
-  void VideoThumbnailExporterPlugin::HandleMethodCall(
-      const flutter::MethodCall<flutter::EncodableValue> &method_call,
-      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result)
+  // Kinds of results in the metadata cache. Bump kCacheResultVersion when the
+  // layout of a cached map or packed buffer changes so old entries stop
+  // matching.
+  const uint32_t kCacheResultVersion = 2;
+  const uint32_t kCacheKindDuration = 0x01;
+  const uint32_t kCacheKindMkvMetadata = 0x100;  // | MkvSection mask
+  const uint32_t kCacheKindMkvPackedMetadata = 0x200;  // | MkvSection mask
+
+  uint32_t CacheKind(uint32_t kind)
   {
-    // Helper lambda to convert EncodableValue→std::wstring
-    auto getString = [&](const flutter::EncodableValue &val) -> std::wstring
+    return (kCacheResultVersion << 24) | kind;
+  }
+
+  // Largest window readMkvAttachment returns in one message; bigger
+  // attachments are read in chunks
+  const int64_t kMaxAttachmentReadSize = 64 * 1024 * 1024;
+
+  // Files per worker task of a getMkvMetadataBatch without chunks: enough
+  // tasks to spread over the pool and to cancel the rest of a batch
+  const size_t kMkvBatchTaskSize = 16;
+
+  bool VideoThumbnailExporterPlugin::OpenMetadataCache()
+  {
+    std::lock_guard<std::mutex> lock(metadata_cache_open_mutex_);
+    if (!metadata_cache_enabled_)
     {
-      if (auto strPtr = std::get_if<std::string>(&val))
+      return false;
+    }
+    if (metadata_cache_opened_)
+    {
+      return metadata_cache_.isOpen();
+    }
+    metadata_cache_opened_ = true;
+
+    if (metadata_cache_directory_.empty())
+    {
+      const wchar_t *localAppData = _wgetenv(L"LOCALAPPDATA");
+      if (!localAppData)
       {
-        // Convert UTF-8 std::string to std::wstring
-        int len = MultiByteToWideChar(CP_UTF8, 0, strPtr->c_str(), -1, nullptr, 0);
-        std::wstring wstr(len, L'\0');
-        MultiByteToWideChar(CP_UTF8, 0, strPtr->c_str(), -1, &wstr[0], len);
-        // trim trailing null
-        if (!wstr.empty() && wstr.back() == L'\0')
-        {
-          wstr.pop_back();
-        }
-        return wstr;
+        return false;
       }
-      return L"";
-    };
+      metadata_cache_directory_ =
+          WideToUtf8(localAppData) + "\\video_thumbnail_exporter\\metadata_cache";
+    }
+    return metadata_cache_.open(metadata_cache_directory_, metadata_cache_budget_);
+  }
 
-    auto method = method_call.method_name();
+  std::string VideoThumbnailExporterPlugin::AttachmentStoreDirectory(const std::string &directory)
+  {
+    if (!directory.empty())
+    {
+      return directory;
+    }
+    const wchar_t *localAppData = _wgetenv(L"LOCALAPPDATA");
+    if (!localAppData)
+    {
+      return std::string();
+    }
+    return WideToUtf8(localAppData) + "\\video_thumbnail_exporter\\attachments";
+  }
 
-    // Extract video thumbnail
-    if (method == "getThumbnail")
+  bool VideoThumbnailExporterPlugin::OpenAttachmentStore(const std::string &directory)
+  {
+    std::string storeDirectory = AttachmentStoreDirectory(directory);
+    if (storeDirectory.empty())
     {
-      // Expect arguments as a Map: {
-      //   'videoPath': String,
-      //   'outputPath': String,
-      //   'size': int
-      // }
-      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
-      if (!args)
+      return false;
+    }
+    if (attachment_store_.isOpen() && attachment_store_.getDirectory() == storeDirectory)
+    {
+      return true;
+    }
+    return attachment_store_.open(storeDirectory);
+  }
+
+  bool VideoThumbnailExporterPlugin::IsAttachmentStoreOpen(const std::string &directory)
+  {
+    std::string storeDirectory = AttachmentStoreDirectory(directory);
+    return !storeDirectory.empty() && attachment_store_.isOpen() &&
+           attachment_store_.getDirectory() == storeDirectory;
+  }
+
+  // The storeDirectory argument of a call, empty if it has none
+  std::string StoreDirectoryArgument(const flutter::MethodCall<flutter::EncodableValue> &method_call)
+  {
+    if (const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments()))
+    {
+      auto it = args->find(flutter::EncodableValue("storeDirectory"));
+      if (it != args->end() && std::get_if<std::string>(&it->second))
       {
-        result->Error(
-            "bad_args",
-            "Expected a map with keys 'videoPath', 'outputPath', 'size'.");
-        return;
+        return std::get<std::string>(it->second);
       }
+    }
+    return std::string();
+  }
 
-      // Extract each field:
-      std::wstring videoPathW, outputPathW;
-      UINT sizePx = 0;
+  bool VideoThumbnailExporterPlugin::IsSharedStateOpen(
+      const flutter::MethodCall<flutter::EncodableValue> &method_call)
+  {
+    return IsAttachmentStoreOpen(StoreDirectoryArgument(method_call));
+  }
 
-      // Loop over the map and pick out our keys:
-      for (const auto &kv : *args)
+  void VideoThumbnailExporterPlugin::OpenSharedState(
+      const flutter::MethodCall<flutter::EncodableValue> &method_call)
+  {
+    // A failure is reported by the call itself, which finds the store closed
+    OpenAttachmentStore(StoreDirectoryArgument(method_call));
+  }
+
+  bool VideoThumbnailExporterPlugin::FindCachedResult(
+      const MetadataCacheKey &key, flutter::EncodableValue &value)
+  {
+    std::vector<uint8_t> payload;
+    if (!OpenMetadataCache() || !metadata_cache_.find(key, payload))
+    {
+      return false;
+    }
+
+    auto decoded = flutter::StandardMessageCodec::GetInstance().DecodeMessage(payload);
+    if (!decoded)
+    {
+      return false;
+    }
+    value = std::move(*decoded);
+    return true;
+  }
+
+  void VideoThumbnailExporterPlugin::StoreCachedResult(
+      const MetadataCacheKey &key, const flutter::EncodableValue &value)
+  {
+    if (!OpenMetadataCache())
+    {
+      return;
+    }
+
+    // A full cache just stops remembering until it is compacted on next open
+    auto encoded = flutter::StandardMessageCodec::GetInstance().EncodeMessage(value);
+    metadata_cache_.store(key, encoded->data(), encoded->size());
+  }
+
+  // Fields shared by every kind of stream, plus the statistics tags when the
+  // file has them (exact bitrate and frame count, as counted by mkvmerge)
+  void AddStreamFields(const MkvMetadataExtractor &extractor, const MkvStream &stream,
+                       flutter::EncodableMap &map)
+  {
+    map[flutter::EncodableValue("trackNumber")] =
+        flutter::EncodableValue(static_cast<int>(stream.trackNumber));
+    map[flutter::EncodableValue("trackUid")] =
+        flutter::EncodableValue(static_cast<int64_t>(stream.trackUID));
+    map[flutter::EncodableValue("codecId")] =
+        flutter::EncodableValue(std::string(stream.codecID));
+    map[flutter::EncodableValue("codecName")] =
+        flutter::EncodableValue(std::string(stream.codecName));
+    map[flutter::EncodableValue("language")] =
+        flutter::EncodableValue(std::string(stream.language));
+    map[flutter::EncodableValue("name")] =
+        flutter::EncodableValue(std::string(stream.name));
+
+    MkvStatisticsTags statistics;
+    if (extractor.getStatisticsTags(stream.trackUID, statistics))
+    {
+      map[flutter::EncodableValue("bitrate")] =
+          flutter::EncodableValue(static_cast<int64_t>(statistics.bitrate));
+      map[flutter::EncodableValue("frameCount")] =
+          flutter::EncodableValue(static_cast<int64_t>(statistics.frames));
+      map[flutter::EncodableValue("streamSize")] =
+          flutter::EncodableValue(static_cast<int64_t>(statistics.bytes));
+      map[flutter::EncodableValue("streamDuration")] =
+          flutter::EncodableValue(statistics.durationMs);
+    }
+  }
+
+  // Metadata map returned by getMkvMetadata, limited to `sections`
+  flutter::EncodableMap BuildMkvMetadataMap(const MkvMetadataExtractor &extractor, uint32_t sections)
+  {
+    flutter::EncodableMap metadata;
+
+    // Add general information
+    if (sections & MKV_SECTION_INFO)
+    {
+      metadata[flutter::EncodableValue("title")] =
+          flutter::EncodableValue(extractor.getTitle());
+      metadata[flutter::EncodableValue("duration")] =
+          flutter::EncodableValue(extractor.getDuration());
+      metadata[flutter::EncodableValue("muxingApp")] =
+          flutter::EncodableValue(extractor.getMuxingApp());
+      metadata[flutter::EncodableValue("writingApp")] =
+          flutter::EncodableValue(extractor.getWritingApp());
+      metadata[flutter::EncodableValue("bitrate")] =
+          flutter::EncodableValue(static_cast<int64_t>(extractor.getEstimatedBitrate()));
+    }
+
+    if (sections & MKV_SECTION_TRACKS)
+    {
+      // Add video streams info
+      flutter::EncodableList videoStreams;
+      for (const auto &stream : extractor.getVideoStreams())
       {
-        const auto &key = kv.first;
-        const auto &value = kv.second;
-        if (auto keyStr = std::get_if<std::string>(&key))
-        {
-          if (*keyStr == "videoPath")
+        flutter::EncodableMap videoStream;
+        AddStreamFields(extractor, stream, videoStream);
+        videoStream[flutter::EncodableValue("width")] =
+            flutter::EncodableValue(static_cast<int>(stream.pixelWidth));
+        videoStream[flutter::EncodableValue("height")] =
+            flutter::EncodableValue(static_cast<int>(stream.pixelHeight));
+        videoStream[flutter::EncodableValue("displayWidth")] =
+            flutter::EncodableValue(static_cast<int>(stream.displayWidth));
+        videoStream[flutter::EncodableValue("displayHeight")] =
+            flutter::EncodableValue(static_cast<int>(stream.displayHeight));
+        videoStream[flutter::EncodableValue("frameRate")] =
+            flutter::EncodableValue(stream.frameRate);
+        videoStream[flutter::EncodableValue("bitDepth")] =
+            flutter::EncodableValue(static_cast<int>(stream.bitsPerChannel));
+
+        videoStreams.push_back(flutter::EncodableValue(videoStream));
+      }
+      metadata[flutter::EncodableValue("videoStreams")] =
+          flutter::EncodableValue(videoStreams);
+
+      // Add audio streams info
+      flutter::EncodableList audioStreams;
+      for (const auto &stream : extractor.getAudioStreams())
+      {
+        flutter::EncodableMap audioStream;
+        AddStreamFields(extractor, stream, audioStream);
+        audioStream[flutter::EncodableValue("channels")] =
+            flutter::EncodableValue(static_cast<int>(stream.channels));
+        audioStream[flutter::EncodableValue("sampleRate")] =
+            flutter::EncodableValue(stream.samplingFrequency);
+        audioStream[flutter::EncodableValue("bitDepth")] =
+            flutter::EncodableValue(static_cast<int>(stream.bitDepth));
+
+        audioStreams.push_back(flutter::EncodableValue(audioStream));
+      }
+      metadata[flutter::EncodableValue("audioStreams")] =
+          flutter::EncodableValue(audioStreams);
+
+      // Add subtitle streams info
+      flutter::EncodableList subtitleStreams;
+      for (const auto &stream : extractor.getSubtitleStreams())
+      {
+        flutter::EncodableMap subtitleStream;
+        AddStreamFields(extractor, stream, subtitleStream);
+        subtitleStreams.push_back(flutter::EncodableValue(subtitleStream));
+      }
+      metadata[flutter::EncodableValue("subtitleStreams")] =
+          flutter::EncodableValue(subtitleStreams);
+    }
+
+    if (sections & MKV_SECTION_ATTACHMENTS)
+    {
+      // Add attachments info
+      flutter::EncodableList attachmentsList;
+      for (size_t i = 0; i < extractor.getAttachments().size(); i++)
+      {
+        const auto &attachment = extractor.getAttachments()[i];
+        flutter::EncodableMap attachmentMap;
+        attachmentMap[flutter::EncodableValue("fileName")] =
+            flutter::EncodableValue(std::string(attachment.fileName));
+        attachmentMap[flutter::EncodableValue("mimeType")] =
+            flutter::EncodableValue(std::string(attachment.mimeType));
+        attachmentMap[flutter::EncodableValue("description")] =
+            flutter::EncodableValue(std::string(attachment.description));
+        attachmentMap[flutter::EncodableValue("size")] =
+            flutter::EncodableValue(static_cast<int64_t>(attachment.dataSize));
+        attachmentMap[flutter::EncodableValue("index")] =
+            flutter::EncodableValue(static_cast<int>(i));
+
+        attachmentsList.push_back(flutter::EncodableValue(attachmentMap));
+      }
+      metadata[flutter::EncodableValue("attachments")] =
+          flutter::EncodableValue(attachmentsList);
+    }
+
+    if (sections & MKV_SECTION_CHAPTERS)
+    {
+      flutter::EncodableList editionsList;
+      for (const auto &edition : extractor.getEditions())
+      {
+        flutter::EncodableMap editionMap;
+        editionMap[flutter::EncodableValue("uid")] =
+            flutter::EncodableValue(static_cast<int64_t>(edition.uid));
+        editionMap[flutter::EncodableValue("default")] =
+            flutter::EncodableValue(edition.flagDefault != 0);
+        editionMap[flutter::EncodableValue("hidden")] =
+            flutter::EncodableValue(edition.flagHidden != 0);
+        editionMap[flutter::EncodableValue("ordered")] =
+            flutter::EncodableValue(edition.flagOrdered != 0);
+        editionsList.push_back(flutter::EncodableValue(editionMap));
+      }
+      metadata[flutter::EncodableValue("editions")] =
+          flutter::EncodableValue(editionsList);
+
+      flutter::EncodableList chaptersList;
+      for (const auto &chapter : extractor.getChapters())
+      {
+        flutter::EncodableMap chapterMap;
+        chapterMap[flutter::EncodableValue("edition")] =
+            flutter::EncodableValue(static_cast<int>(chapter.edition));
+        chapterMap[flutter::EncodableValue("depth")] =
+            flutter::EncodableValue(static_cast<int>(chapter.depth));
+        chapterMap[flutter::EncodableValue("uid")] =
+            flutter::EncodableValue(static_cast<int64_t>(chapter.uid));
+        chapterMap[flutter::EncodableValue("start")] =
+            flutter::EncodableValue(chapter.timeStart / 1000000.0);
+        chapterMap[flutter::EncodableValue("end")] =
+            flutter::EncodableValue(chapter.timeEnd / 1000000.0);
+        chapterMap[flutter::EncodableValue("title")] =
+            flutter::EncodableValue(std::string(chapter.title));
+        chapterMap[flutter::EncodableValue("language")] =
+            flutter::EncodableValue(std::string(chapter.language));
+        chapterMap[flutter::EncodableValue("hidden")] =
+            flutter::EncodableValue(chapter.flagHidden != 0);
+        chapterMap[flutter::EncodableValue("enabled")] =
+            flutter::EncodableValue(chapter.flagEnabled != 0);
+        chaptersList.push_back(flutter::EncodableValue(chapterMap));
+      }
+      metadata[flutter::EncodableValue("chapters")] =
+          flutter::EncodableValue(chaptersList);
+    }
+
+    if (sections & MKV_SECTION_TAGS)
+    {
+      flutter::EncodableList tagsList;
+      for (const auto &tag : extractor.getTags())
+      {
+        flutter::EncodableMap tagMap;
+        tagMap[flutter::EncodableValue("targetTypeValue")] =
+            flutter::EncodableValue(static_cast<int>(tag.targetTypeValue));
+        tagMap[flutter::EncodableValue("targetType")] =
+            flutter::EncodableValue(std::string(tag.targetType));
+        tagMap[flutter::EncodableValue("trackUid")] =
+            flutter::EncodableValue(static_cast<int64_t>(tag.trackUID));
+        tagMap[flutter::EncodableValue("editionUid")] =
+            flutter::EncodableValue(static_cast<int64_t>(tag.editionUID));
+        tagMap[flutter::EncodableValue("chapterUid")] =
+            flutter::EncodableValue(static_cast<int64_t>(tag.chapterUID));
+        tagMap[flutter::EncodableValue("attachmentUid")] =
+            flutter::EncodableValue(static_cast<int64_t>(tag.attachmentUID));
+        tagMap[flutter::EncodableValue("name")] =
+            flutter::EncodableValue(std::string(tag.name));
+        tagMap[flutter::EncodableValue("language")] =
+            flutter::EncodableValue(std::string(tag.language));
+        tagMap[flutter::EncodableValue("value")] =
+            flutter::EncodableValue(std::string(tag.value));
+        tagsList.push_back(flutter::EncodableValue(tagMap));
+      }
+      metadata[flutter::EncodableValue("tags")] =
+          flutter::EncodableValue(tagsList);
+    }
+
+    return metadata;
+  }
+
+  // The extractor an MKV call works on. For a session, the session stays
+  // locked until the call returns.
+  struct MkvCallTarget
+  {
+    std::shared_ptr<MkvSession> session;
+    std::unique_lock<std::mutex> lock;
+    MkvMetadataExtractor local;
+    MkvMetadataExtractor *extractor = nullptr;
+  };
+
+  bool VideoThumbnailExporterPlugin::OpenMkvTarget(
+      int64_t session, const std::string &path, uint32_t sections,
+      MkvCallTarget &target,
+      flutter::MethodResult<flutter::EncodableValue> &result)
+  {
+    if (session != 0)
+    {
+      target.session = mkv_sessions_.find(session);
+      if (!target.session)
+      {
+        result.Error(
+            "invalid_session",
+            "Unknown or expired MKV session.");
+        return false;
+      }
+      target.lock = std::unique_lock<std::mutex>(target.session->mutex);
+      target.extractor = &target.session->extractor;
+
+      // The session may have been opened for fewer sections than this call
+      // needs; parse the rest now, they stay parsed for later calls
+      if (!target.extractor->addSections(sections))
+      {
+        result.Error(
+            "file_error",
+            "Failed to read the MKV session's file.");
+        return false;
+      }
+      return true;
+    }
+
+    if (!target.local.openMapped(path, sections))
+    {
+      result.Error(
+          "file_error",
+          "Failed to open the MKV file.");
+      return false;
+    }
+    target.extractor = &target.local;
+    return true;
+  }
+
+  // getMkvMetadata result for what `extractor` parsed of `sections`
+  flutter::EncodableValue BuildMkvMetadata(const MkvMetadataExtractor &extractor, uint32_t sections, bool packed)
+  {
+    if (packed)
+    {
+      std::vector<uint8_t> bytes;
+      packMkvMetadata(extractor, sections, bytes);
+      return flutter::EncodableValue(std::move(bytes));
+    }
+    return flutter::EncodableValue(BuildMkvMetadataMap(extractor, sections));
+  }
+
+  bool VideoThumbnailExporterPlugin::LoadMkvMetadata(
+      const std::string &path, uint32_t sections, bool packed, flutter::EncodableValue &metadata)
+  {
+    MetadataCacheKey cacheKey;
+    uint32_t kind = (packed ? kCacheKindMkvPackedMetadata : kCacheKindMkvMetadata) | sections;
+    bool cacheable = makeMetadataCacheKey(path, CacheKind(kind), cacheKey);
+    if (cacheable && FindCachedResult(cacheKey, metadata))
+    {
+      return true;
+    }
+
+    MkvMetadataExtractor extractor;
+    if (!extractor.openMapped(path, sections))
+    {
+      return false;
+    }
+
+    metadata = BuildMkvMetadata(extractor, sections, packed);
+    if (cacheable)
+    {
+      StoreCachedResult(cacheKey, metadata);
+    }
+    return true;
+  }
+
+  void VideoThumbnailExporterPlugin::SendToDart(const std::string &method, flutter::EncodableValue arguments)
+  {
+    if (!channel_)
+    {
+      return;
+    }
+
+    auto shared = std::make_shared<flutter::EncodableValue>(std::move(arguments));
+    auto send = [this, method, shared]()
+    {
+      channel_->InvokeMethod(method, std::make_unique<flutter::EncodableValue>(std::move(*shared)));
+    };
+    if (dispatcher_)
+    {
+      dispatcher_->post(send);
+    }
+    else
+    {
+      send();
+    }
+  }
+
+  // Dart ints arrive as int32 or int64 depending on their value
+  bool GetInt64(const flutter::EncodableValue &value, int64_t &number)
+  {
+    if (auto small = std::get_if<int32_t>(&value))
+    {
+      number = *small;
+      return true;
+    }
+    if (auto large = std::get_if<int64_t>(&value))
+    {
+      number = *large;
+      return true;
+    }
+    return false;
+  }
+
+  bool GetSessionHandle(const flutter::EncodableValue &value, int64_t &handle)
+  {
+    return GetInt64(value, handle);
+  }
+
+  // Strings of an EncodableList, other values are skipped
+  void GetStringList(const flutter::EncodableValue &value, std::vector<std::string> &strings)
+  {
+    if (auto list = std::get_if<flutter::EncodableList>(&value))
+    {
+      for (const auto &item : *list)
+      {
+        if (auto text = std::get_if<std::string>(&item))
+        {
+          strings.push_back(*text);
+        }
+      }
+    }
+  }
+
+  // True if the path has an .mkv extension (any case)
+  bool IsMkvPath(const std::wstring &path)
+  {
+    size_t dot = path.find_last_of(L'.');
+    return dot != std::wstring::npos && _wcsicmp(path.c_str() + dot, L".mkv") == 0;
+  }
+
+  // A getMkvMetadataBatch call. With workers it is split into tasks that
+  // each fill their own range of `entries`.
+  struct MkvMetadataBatch
+  {
+    std::vector<std::string> paths;
+    uint32_t sections = MKV_SECTION_DEFAULT;
+    size_t chunkSize = 0;  // 0 for a single reply
+    int64_t batchId = 0;
+    bool packed = false;
+    std::chrono::steady_clock::time_point startTime;
+    flutter::EncodableList entries;
+    std::atomic<int64_t> failed{0};
+    std::atomic<int64_t> cancelled{0};
+    size_t pendingTasks = 0;  // only used on the platform thread
+  };
+
+  bool VideoThumbnailExporterPlugin::ParseMkvMetadataBatch(
+      const flutter::EncodableValue *arguments, MkvMetadataBatch &batch,
+      flutter::MethodResult<flutter::EncodableValue> &result)
+  {
+    const auto *args = arguments ? std::get_if<flutter::EncodableMap>(arguments) : nullptr;
+    if (!args)
+    {
+      result.Error(
+          "bad_args",
+          "Expected a map with key 'mkvPaths' and optionally 'sections', 'chunkSize', 'batchId', 'packed'.");
+      return false;
+    }
+
+    int chunkSize = 0;
+    for (const auto &kv : *args)
+    {
+      const auto &key = kv.first;
+      const auto &value = kv.second;
+      if (auto keyStr = std::get_if<std::string>(&key))
+      {
+        if (*keyStr == "mkvPaths")
+        {
+          GetStringList(value, batch.paths);
+        }
+        else if (*keyStr == "sections" && std::get_if<int>(&value))
+        {
+          batch.sections = static_cast<uint32_t>(std::get<int>(value)) & MKV_SECTION_DEFAULT;
+        }
+        else if (*keyStr == "chunkSize" && std::get_if<int>(&value))
+        {
+          chunkSize = std::get<int>(value);
+        }
+        else if (*keyStr == "batchId")
+        {
+          GetInt64(value, batch.batchId);
+        }
+        else if (*keyStr == "packed" && std::get_if<bool>(&value))
+        {
+          batch.packed = std::get<bool>(value);
+        }
+      }
+    }
+
+    if (chunkSize < 0)
+    {
+      result.Error(
+          "invalid_args",
+          "Missing or invalid parameters.");
+      return false;
+    }
+
+    batch.chunkSize = static_cast<size_t>(chunkSize);
+    batch.startTime = std::chrono::steady_clock::now();
+    batch.entries.resize(batch.paths.size());
+    return true;
+  }
+
+  void VideoThumbnailExporterPlugin::LoadMkvMetadataBatchFiles(
+      MkvMetadataBatch &batch, size_t first, size_t last)
+  {
+    for (size_t i = first; i < last; i++)
+    {
+      flutter::EncodableMap entry;
+      entry[flutter::EncodableValue("path")] = flutter::EncodableValue(batch.paths[i]);
+      flutter::EncodableValue metadata;
+      if (LoadMkvMetadata(batch.paths[i], batch.sections, batch.packed, metadata))
+      {
+        entry[flutter::EncodableValue("metadata")] = std::move(metadata);
+      }
+      else
+      {
+        entry[flutter::EncodableValue("error")] = flutter::EncodableValue("file_error");
+        entry[flutter::EncodableValue("message")] =
+            flutter::EncodableValue("Failed to open the MKV file.");
+        batch.failed++;
+      }
+      batch.entries[i] = flutter::EncodableValue(std::move(entry));
+    }
+    SendMkvMetadataBatchChunk(batch, first, last);
+  }
+
+  int64_t VideoThumbnailExporterPlugin::FailMkvMetadataBatchFiles(
+      MkvMetadataBatch &batch, size_t first, size_t last,
+      const std::string &code, const std::string &message)
+  {
+    int64_t count = 0;
+    for (size_t i = first; i < last; i++)
+    {
+      if (!batch.entries[i].IsNull())
+      {
+        continue;
+      }
+      flutter::EncodableMap entry;
+      entry[flutter::EncodableValue("path")] = flutter::EncodableValue(batch.paths[i]);
+      entry[flutter::EncodableValue("error")] = flutter::EncodableValue(code);
+      entry[flutter::EncodableValue("message")] = flutter::EncodableValue(message);
+      batch.entries[i] = flutter::EncodableValue(std::move(entry));
+      count++;
+    }
+    SendMkvMetadataBatchChunk(batch, first, last);
+    return count;
+  }
+
+  void VideoThumbnailExporterPlugin::SendMkvMetadataBatchChunk(
+      MkvMetadataBatch &batch, size_t first, size_t last)
+  {
+    if (batch.chunkSize == 0)
+    {
+      return;
+    }
+    flutter::EncodableMap chunk;
+    chunk[flutter::EncodableValue("batchId")] = flutter::EncodableValue(batch.batchId);
+    chunk[flutter::EncodableValue("offset")] = flutter::EncodableValue(static_cast<int>(first));
+    chunk[flutter::EncodableValue("results")] = flutter::EncodableValue(flutter::EncodableList(
+        std::make_move_iterator(batch.entries.begin() + first),
+        std::make_move_iterator(batch.entries.begin() + last)));
+    SendToDart("onMkvMetadataBatchChunk", flutter::EncodableValue(std::move(chunk)));
+  }
+
+  // The reply to getMkvMetadataBatch. With chunks the results have already
+  // been sent.
+  flutter::EncodableValue MkvMetadataBatchReply(MkvMetadataBatch &batch)
+  {
+    flutter::EncodableMap response;
+    response[flutter::EncodableValue("results")] = flutter::EncodableValue(
+        batch.chunkSize > 0 ? flutter::EncodableList() : std::move(batch.entries));
+    response[flutter::EncodableValue("count")] =
+        flutter::EncodableValue(static_cast<int64_t>(batch.paths.size()));
+    response[flutter::EncodableValue("failed")] = flutter::EncodableValue(batch.failed.load());
+    response[flutter::EncodableValue("cancelled")] = flutter::EncodableValue(batch.cancelled.load());
+    response[flutter::EncodableValue("elapsedMs")] = flutter::EncodableValue(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch.startTime).count());
+    return flutter::EncodableValue(response);
+  }
+
+  void VideoThumbnailExporterPlugin::SubmitMkvMetadataBatch(
+      std::shared_ptr<MkvMetadataBatch> batch, int64_t tag, int priority)
+  {
+    size_t count = batch->paths.size();
+    size_t step = batch->chunkSize > 0 ? batch->chunkSize : kMkvBatchTaskSize;
+    batch->pendingTasks = (count + step - 1) / step + 1;
+
+    for (size_t first = 0; first < count; first += step)
+    {
+      size_t last = std::min(first + step, count);
+
+      // Every task carries the request's tag, so cancelRequest and
+      // reprioritize reach the parts of the batch still queued
+      WorkerTask task;
+      task.priority = priority;
+      task.tag = tag;
+      task.work = [this, batch, first, last]()
+      {
+        try
+        {
+          std::shared_lock<std::shared_mutex> lock(state_mutex_);
+          LoadMkvMetadataBatchFiles(*batch, first, last);
+        }
+        catch (const std::exception &e)
+        {
+          batch->failed += FailMkvMetadataBatchFiles(*batch, first, last, "native_error", e.what());
+        }
+      };
+      task.completion = [this, batch, tag]()
+      {
+        FinishMkvMetadataBatchTask(*batch, tag);
+      };
+      task.cancelled = [this, batch, tag, first, last]()
+      {
+        batch->cancelled += FailMkvMetadataBatchFiles(
+            *batch, first, last, "cancelled", "The request was cancelled before this file was read.");
+        FinishMkvMetadataBatchTask(*batch, tag);
+      };
+
+      if (!workers_->submit(std::move(task)))
+      {
+        batch->cancelled += FailMkvMetadataBatchFiles(
+            *batch, first, last, "shutting_down", "The plugin is shutting down.");
+        batch->pendingTasks--;
+      }
+    }
+
+    // The extra count held above keeps a task finishing early from replying
+    // before every part was submitted
+    FinishMkvMetadataBatchTask(*batch, tag);
+  }
+
+  void VideoThumbnailExporterPlugin::FinishMkvMetadataBatchTask(MkvMetadataBatch &batch, int64_t tag)
+  {
+    if (--batch.pendingTasks > 0)
+    {
+      return;
+    }
+    flutter::EncodableValue reply = MkvMetadataBatchReply(batch);
+    for (const auto &waiting : flights_.finish(tag))
+    {
+      waiting->Success(reply);
+    }
+  }
+
+  void VideoThumbnailExporterPlugin::HandleMethodCall(
+      const flutter::MethodCall<flutter::EncodableValue> &method_call,
+      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result)
+  {
+    const std::string &method = method_call.method_name();
+
+    // Scheduling controls act on the queue itself, on the platform thread
+    if (method == "cancelRequest" || method == "reprioritize" || method == "getSchedulerStats")
+    {
+      HandleSchedulerCall(method_call, *result);
+      return;
+    }
+
+    if (!workers_ || RunsOnPlatformThread(method))
+    {
+      if (OpensSharedState(method))
+      {
+        OpenSharedState(method_call);
+      }
+      RunMethodCall(method_call, std::move(result));
+      return;
+    }
+
+    std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> reply(std::move(result));
+    WorkerTask task;
+
+    // Optional 'requestId' (to cancel or reprioritize later) and 'priority'
+    int64_t requestId = 0;
+    if (const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments()))
+    {
+      auto it = args->find(flutter::EncodableValue("requestId"));
+      if (it != args->end())
+      {
+        GetInt64(it->second, requestId);
+      }
+      it = args->find(flutter::EncodableValue("priority"));
+      if (it != args->end() && std::get_if<int>(&it->second))
+      {
+        task.priority = std::get<int>(it->second);
+      }
+    }
+
+    // Checked before the batch joins a flight, which it would never finish
+    std::shared_ptr<MkvMetadataBatch> batch;
+    if (method == "getMkvMetadataBatch")
+    {
+      batch = std::make_shared<MkvMetadataBatch>();
+      if (!ParseMkvMetadataBatch(method_call.arguments(), *batch, *reply))
+      {
+        return;
+      }
+    }
+
+    // A duplicate of a call in flight just waits for its result
+    bool raised = false;
+    if (!flights_.join(SingleFlightKey(method, method_call.arguments()), requestId, task.priority,
+                       reply, task.tag, raised))
+    {
+      if (raised)
+      {
+        workers_->reprioritize(task.tag, task.priority);
+      }
+      return;
+    }
+
+    // A batch becomes many tasks rather than one
+    if (batch)
+    {
+      SubmitMkvMetadataBatch(batch, task.tag, task.priority);
+      return;
+    }
+
+    // The call only lives as long as this function, the worker gets a copy
+    auto call = std::make_shared<flutter::MethodCall<flutter::EncodableValue>>(
+        method,
+        std::make_unique<flutter::EncodableValue>(
+            method_call.arguments() ? *method_call.arguments() : flutter::EncodableValue()));
+    auto outcome = std::make_shared<MethodOutcome>();
+    bool exclusive = NeedsExclusiveState(method);
+    bool opensState = OpensSharedState(method);
+
+    task.work = [this, call, outcome, exclusive, opensState]()
+    {
+      auto recorder = std::make_unique<RecordingMethodResult>(outcome);
+      try
+      {
+        if (exclusive)
+        {
+          std::unique_lock<std::shared_mutex> lock(state_mutex_);
+          RunMethodCall(*call, std::move(recorder));
+        }
+        else
+        {
+          // Only the reopen excludes other calls, the call itself runs
+          // alongside them. Mostly the state is open already, which a shared
+          // lock is enough to tell.
+          bool reopen = false;
+          if (opensState)
+          {
+            std::shared_lock<std::shared_mutex> lock(state_mutex_);
+            reopen = !IsSharedStateOpen(*call);
+          }
+          if (reopen)
+          {
+            std::unique_lock<std::shared_mutex> lock(state_mutex_);
+            OpenSharedState(*call);
+          }
+          std::shared_lock<std::shared_mutex> lock(state_mutex_);
+          RunMethodCall(*call, std::move(recorder));
+        }
+      }
+      catch (const std::exception &e)
+      {
+        outcome->kind = MethodOutcome::kError;
+        outcome->errorCode = "native_error";
+        outcome->errorMessage = e.what();
+      }
+    };
+
+    int64_t tag = task.tag;
+    task.completion = [this, outcome, tag]()
+    {
+      for (const auto &waiting : flights_.finish(tag))
+      {
+        outcome->SendTo(*waiting);
+      }
+    };
+    task.cancelled = [this, tag]()
+    {
+      for (const auto &waiting : flights_.finish(tag))
+      {
+        waiting->Error("cancelled", "The request was cancelled before it started.");
+      }
+    };
+
+    if (!workers_->submit(std::move(task)))
+    {
+      for (const auto &waiting : flights_.finish(tag))
+      {
+        waiting->Error("shutting_down", "The plugin is shutting down.");
+      }
+    }
+  }
+
+  void VideoThumbnailExporterPlugin::HandleSchedulerCall(
+      const flutter::MethodCall<flutter::EncodableValue> &method_call,
+      flutter::MethodResult<flutter::EncodableValue> &result)
+  {
+    const std::string &method = method_call.method_name();
+    if (method == "getSchedulerStats")
+    {
+      WorkerPoolStats stats = workers_ ? workers_->getStats() : WorkerPoolStats();
+      uint64_t started = stats.completed + stats.running;
+      flutter::EncodableMap statsMap;
+      statsMap[flutter::EncodableValue("queued")] = flutter::EncodableValue(static_cast<int>(stats.queued));
+      statsMap[flutter::EncodableValue("running")] = flutter::EncodableValue(static_cast<int>(stats.running));
+      statsMap[flutter::EncodableValue("peakQueued")] = flutter::EncodableValue(static_cast<int>(stats.peakQueued));
+      statsMap[flutter::EncodableValue("threads")] = flutter::EncodableValue(static_cast<int>(stats.threads));
+      statsMap[flutter::EncodableValue("submitted")] = flutter::EncodableValue(static_cast<int64_t>(stats.submitted));
+      statsMap[flutter::EncodableValue("completed")] = flutter::EncodableValue(static_cast<int64_t>(stats.completed));
+      statsMap[flutter::EncodableValue("cancelled")] = flutter::EncodableValue(static_cast<int64_t>(stats.cancelled));
+      statsMap[flutter::EncodableValue("averageWaitMs")] = flutter::EncodableValue(
+          started > 0 ? stats.totalWaitNanoseconds / 1000000.0 / started : 0.0);
+      statsMap[flutter::EncodableValue("maxWaitMs")] =
+          flutter::EncodableValue(stats.maxWaitNanoseconds / 1000000.0);
+
+      SingleFlightStats flightStats = flights_.getStats();
+      statsMap[flutter::EncodableValue("dedupRequests")] =
+          flutter::EncodableValue(static_cast<int64_t>(flightStats.requests));
+      statsMap[flutter::EncodableValue("dedupHits")] =
+          flutter::EncodableValue(static_cast<int64_t>(flightStats.joined));
+      statsMap[flutter::EncodableValue("dedupHitRate")] = flutter::EncodableValue(
+          flightStats.requests > 0 ? static_cast<double>(flightStats.joined) / flightStats.requests : 0.0);
+      result.Success(flutter::EncodableValue(statsMap));
+      return;
+    }
+
+    const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+    int64_t requestId = 0;
+    int priority = 0;
+    bool hasPriority = false;
+    if (args)
+    {
+      for (const auto &kv : *args)
+      {
+        if (auto keyStr = std::get_if<std::string>(&kv.first))
+        {
+          if (*keyStr == "requestId")
+          {
+            GetInt64(kv.second, requestId);
+          }
+          else if (*keyStr == "priority" && std::get_if<int>(&kv.second))
+          {
+            priority = std::get<int>(kv.second);
+            hasPriority = true;
+          }
+        }
+      }
+    }
+
+    if (requestId == 0 || (method == "reprioritize" && !hasPriority))
+    {
+      result.Error(
+          "invalid_args",
+          "Missing or invalid parameters.");
+      return;
+    }
+
+    // False once the request has started (or when calls run inline)
+    bool changed = false;
+    int64_t tag = 0;
+    size_t sharing = 0;
+    if (workers_ && flights_.find(requestId, tag, sharing))
+    {
+      std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>> reply;
+      if (method == "reprioritize")
+      {
+        changed = workers_->reprioritize(tag, priority);
+      }
+      else if (sharing > 1)
+      {
+        // The others still want the result, only this request goes. A
+        // flight already running is past cancelling, like any other request.
+        if (workers_->hasQueued(tag) && flights_.leave(requestId, reply))
+        {
+          reply->Error("cancelled", "The request was cancelled before it started.");
+          changed = true;
+        }
+      }
+      else
+      {
+        changed = workers_->cancel(tag);
+      }
+    }
+    result.Success(flutter::EncodableValue(changed));
+  }
+
+  void VideoThumbnailExporterPlugin::RunMethodCall(
+      const flutter::MethodCall<flutter::EncodableValue> &method_call,
+      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result)
+  {
+    // Helper lambda to convert EncodableValue→std::wstring
+    auto getString = [&](const flutter::EncodableValue &val) -> std::wstring
+    {
+      if (auto strPtr = std::get_if<std::string>(&val))
+      {
+        // Convert UTF-8 std::string to std::wstring
+        int len = MultiByteToWideChar(CP_UTF8, 0, strPtr->c_str(), -1, nullptr, 0);
+        std::wstring wstr(len, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, strPtr->c_str(), -1, &wstr[0], len);
+        // trim trailing null
+        if (!wstr.empty() && wstr.back() == L'\0')
+        {
+          wstr.pop_back();
+        }
+        return wstr;
+      }
+      return L"";
+    };
+
+    auto method = method_call.method_name();
+
+    // Extract video thumbnail
+    if (method == "getThumbnail")
+    {
+      // Expect arguments as a Map: {
+      //   'videoPath': String,
+      //   'outputPath': String,
+      //   'size': int
+      // }
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'videoPath', 'outputPath', 'size'.");
+        return;
+      }
+
+      // Extract each field:
+      std::wstring videoPathW, outputPathW;
+      UINT sizePx = 0;
+
+      // Loop over the map and pick out our keys:
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "videoPath")
+          {
+            videoPathW = getString(value);
+          }
+          else if (*keyStr == "outputPath")
+          {
+            outputPathW = getString(value);
+          }
+          else if (*keyStr == "size")
+          {
+            if (auto intPtr = std::get_if<int>(&value))
+            {
+              sizePx = static_cast<UINT>(*intPtr);
+            }
+          }
+        }
+      }
+
+      // Validate
+      if (videoPathW.empty() || outputPathW.empty() || sizePx == 0)
+      {
+        result->Error(
+            "invalid_args",
+            "One or more of 'videoPath', 'outputPath', or 'size' is missing/invalid.");
+        return;
+      }
+
+      // Call our native helper:
+      bool ok = GetExplorerThumbnail(videoPathW, outputPathW, sizePx);
+      if (ok)
+      {
+        result->Success(flutter::EncodableValue(true));
+      }
+      else
+      {
+        result->Error(
+            "native_error",
+            "Failed to retrieve or save the thumbnail. Check paths & permissions.");
+      }
+    }
+    // Get video duration
+    else if (method == "getVideoDuration")
+    {
+      std::wstring videoPathW;
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (args)
+      {
+        for (const auto &kv : *args)
+        {
+          if (kv.first == flutter::EncodableValue("videoPath"))
+          {
+            videoPathW = getString(kv.second); // Using your existing string conversion helper
+          }
+        }
+      }
+
+      if (videoPathW.empty())
+      {
+        result->Error("invalid_args", "Missing or invalid 'videoPath' parameter.");
+        return;
+      }
+
+      MetadataCacheKey cacheKey;
+      flutter::EncodableValue cached;
+      bool cacheable = makeMetadataCacheKey(WideToUtf8(videoPathW), CacheKind(kCacheKindDuration), cacheKey);
+      if (cacheable && FindCachedResult(cacheKey, cached))
+      {
+        result->Success(cached);
+        return;
+      }
+
+      // MKVs are probed natively, Media Foundation is much slower to open them
+      double duration = 0.0;
+      if (IsMkvPath(videoPathW))
+      {
+        MkvDurationProbe probe;
+        if (probeMkvDuration(WideToUtf8(videoPathW), probe))
+        {
+          duration = probe.durationMs;
+        }
+      }
+
+      // Get video duration
+      if (duration <= 0.0)
+      {
+        duration = GetVideoFileDuration(videoPathW);
+      }
+
+      // Failures are not cached, the file may just be locked right now
+      if (cacheable && duration > 0.0)
+      {
+        StoreCachedResult(cacheKey, flutter::EncodableValue(duration));
+      }
+      result->Success(flutter::EncodableValue(duration));
+    }
+    // Duration of an MKV file along with how it was found
+    else if (method == "probeMkvDuration")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with key 'mkvPath'.");
+        return;
+      }
+
+      std::string mkvPath;
+      auto it = args->find(flutter::EncodableValue("mkvPath"));
+      if (it != args->end() && std::get_if<std::string>(&it->second))
+      {
+        mkvPath = std::get<std::string>(it->second);
+      }
+
+      if (mkvPath.empty())
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid 'mkvPath' parameter.");
+        return;
+      }
+
+      MkvDurationProbe probe;
+      if (!probeMkvDuration(mkvPath, probe))
+      {
+        result->Error(
+            "file_error",
+            "Failed to determine the duration of the MKV file.");
+        return;
+      }
+
+      const char *source = "info";
+      if (probe.source == MKV_DURATION_CUES)
+      {
+        source = "cues";
+      }
+      else if (probe.source == MKV_DURATION_TAIL)
+      {
+        source = "tail";
+      }
+
+      flutter::EncodableMap probeMap;
+      probeMap[flutter::EncodableValue("durationMs")] = flutter::EncodableValue(probe.durationMs);
+      probeMap[flutter::EncodableValue("method")] = flutter::EncodableValue(std::string(source));
+      probeMap[flutter::EncodableValue("bytesRead")] =
+          flutter::EncodableValue(static_cast<int64_t>(probe.bytesRead));
+
+      result->Success(flutter::EncodableValue(probeMap));
+    }
+    // Get file metadata
+    else if (method == "getFileMetadata")
+    {
+      std::wstring filePathW;
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (args)
+      {
+        for (const auto &kv : *args)
+        {
+          if (kv.first == flutter::EncodableValue("filePath"))
+          {
+            filePathW = getString(kv.second);
+          }
+        }
+      }
+
+      if (filePathW.empty())
+      {
+        result->Error("invalid_args", "Missing or invalid 'filePath' parameter.");
+        return;
+      }
+
+      // Get file metadata
+      WIN32_FILE_ATTRIBUTE_DATA fileAttrData;
+      flutter::EncodableMap metadata;
+
+      if (GetFileAttributesEx(filePathW.c_str(), GetFileExInfoStandard, &fileAttrData))
+      {
+        // Convert FILETIME to milliseconds since epoch
+        ULARGE_INTEGER creationTime, accessTime, modifiedTime;
+        creationTime.LowPart = fileAttrData.ftCreationTime.dwLowDateTime;
+        creationTime.HighPart = fileAttrData.ftCreationTime.dwHighDateTime;
+        accessTime.LowPart = fileAttrData.ftLastAccessTime.dwLowDateTime;
+        accessTime.HighPart = fileAttrData.ftLastAccessTime.dwHighDateTime;
+        modifiedTime.LowPart = fileAttrData.ftLastWriteTime.dwLowDateTime;
+        modifiedTime.HighPart = fileAttrData.ftLastWriteTime.dwHighDateTime;
+
+        // Calculate file size
+        ULARGE_INTEGER fileSize;
+        fileSize.HighPart = fileAttrData.nFileSizeHigh;
+        fileSize.LowPart = fileAttrData.nFileSizeLow;
+
+        // Convert Windows FILETIME (100-nanosecond intervals since January 1, 1601) to
+        // Unix epoch time (seconds since January 1, 1970)
+        const int64_t WINDOWS_TICK = 10000000;
+        const int64_t SEC_TO_UNIX_EPOCH = 11644473600LL;
+
+        // Use WINDOWS_TICK in calculations
+        int64_t creationTimeMs = (creationTime.QuadPart / (WINDOWS_TICK / 1000)) - (SEC_TO_UNIX_EPOCH * 1000);
+        int64_t accessTimeMs = (accessTime.QuadPart / (WINDOWS_TICK / 1000)) - (SEC_TO_UNIX_EPOCH * 1000);
+        int64_t modifiedTimeMs = (modifiedTime.QuadPart / (WINDOWS_TICK / 1000)) - (SEC_TO_UNIX_EPOCH * 1000);
+
+        metadata[flutter::EncodableValue("creationTime")] = flutter::EncodableValue(static_cast<int64_t>(creationTimeMs));
+        metadata[flutter::EncodableValue("accessTime")] = flutter::EncodableValue(static_cast<int64_t>(accessTimeMs));
+        metadata[flutter::EncodableValue("modifiedTime")] = flutter::EncodableValue(static_cast<int64_t>(modifiedTimeMs));
+        metadata[flutter::EncodableValue("fileSize")] = flutter::EncodableValue(static_cast<int64_t>(fileSize.QuadPart));
+
+        result->Success(flutter::EncodableValue(metadata));
+      }
+      else
+      {
+        DWORD error = GetLastError();
+        std::string errorMsg = "Failed to get file attributes. Error code: " + std::to_string(error);
+        result->Error("file_error", errorMsg);
+      }
+    }
+    // Get MKV metadata
+    else if (method == "getMkvMetadata")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with key 'mkvPath' or 'session'.");
+        return;
+      }
+
+      // Get the MKV file path (or session), the sections to parse and the
+      // encoding of the result
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      uint32_t sections = MKV_SECTION_DEFAULT;
+      bool packed = false;
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "sections" && std::get_if<int>(&value))
+          {
+            sections = static_cast<uint32_t>(std::get<int>(value)) & MKV_SECTION_DEFAULT;
+          }
+          else if (*keyStr == "packed" && std::get_if<bool>(&value))
+          {
+            packed = std::get<bool>(value);
+          }
+        }
+      }
+
+      if (mkvPath.empty() && sessionHandle == 0)
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid 'mkvPath' parameter.");
+        return;
+      }
+
+      // A session is already parsed, the cache would not save anything
+      if (sessionHandle != 0)
+      {
+        MkvCallTarget target;
+        if (OpenMkvTarget(sessionHandle, mkvPath, sections, target, *result))
+        {
+          result->Success(BuildMkvMetadata(*target.extractor, sections, packed));
+        }
+        return;
+      }
+
+      flutter::EncodableValue metadata;
+      if (!LoadMkvMetadata(mkvPath, sections, packed, metadata))
+      {
+        result->Error(
+            "file_error",
+            "Failed to open the MKV file.");
+        return;
+      }
+
+      // Return the metadata
+      result->Success(metadata);
+    }
+    // Metadata of many MKV files in one call. Only runs here without workers,
+    // SubmitMkvMetadataBatch spreads it over them otherwise.
+    else if (method == "getMkvMetadataBatch")
+    {
+      MkvMetadataBatch batch;
+      if (!ParseMkvMetadataBatch(method_call.arguments(), batch, *result))
+      {
+        return;
+      }
+      size_t count = batch.paths.size();
+      size_t step = batch.chunkSize > 0 ? batch.chunkSize : std::max<size_t>(count, 1);
+      for (size_t first = 0; first < count; first += step)
+      {
+        LoadMkvMetadataBatchFiles(batch, first, std::min(first + step, count));
+      }
+      result->Success(MkvMetadataBatchReply(batch));
+    }
+    // Extract an attachment from an MKV file
+    else if (method == "extractMkvAttachment")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'mkvPath' (or 'session'), 'attachmentIndex', 'outputPath'.");
+        return;
+      }
+
+      // Get the parameters
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      int attachmentIndex = -1;
+      std::string outputPath;
+      bool reportStats = false;
+
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "attachmentIndex" && std::get_if<int>(&value))
+          {
+            attachmentIndex = std::get<int>(value);
+          }
+          else if (*keyStr == "outputPath" && std::get_if<std::string>(&value))
+          {
+            outputPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "reportStats" && std::get_if<bool>(&value))
+          {
+            reportStats = std::get<bool>(value);
+          }
+        }
+      }
+
+      if ((mkvPath.empty() && sessionHandle == 0) || attachmentIndex < 0 || outputPath.empty())
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid parameters.");
+        return;
+      }
+
+      // Extract the attachment, only the Attachments section is needed
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_ATTACHMENTS, target, *result))
+      {
+        return;
+      }
+      MkvMetadataExtractor &extractor = *target.extractor;
+
+      if (static_cast<size_t>(attachmentIndex) >= extractor.getAttachments().size())
+      {
+        result->Error(
+            "invalid_index",
+            "Attachment index out of range.");
+        return;
+      }
+
+      FileCopyStats copyStats;
+      bool success = extractor.extractAttachment(attachmentIndex, outputPath, &copyStats);
+      if (success && reportStats)
+      {
+        flutter::EncodableMap response;
+        response[flutter::EncodableValue("bytes")] = flutter::EncodableValue(static_cast<int64_t>(copyStats.bytes));
+        response[flutter::EncodableValue("elapsedUs")] = flutter::EncodableValue(static_cast<int64_t>(copyStats.elapsedUs));
+        response[flutter::EncodableValue("bytesPerSecond")] =
+            flutter::EncodableValue(static_cast<int64_t>(copyStats.getBytesPerSecond()));
+        response[flutter::EncodableValue("method")] =
+            flutter::EncodableValue(std::string(getFileCopyMethodName(copyStats.method)));
+        result->Success(flutter::EncodableValue(response));
+      }
+      else if (success)
+      {
+        result->Success(flutter::EncodableValue(true));
+      }
+      else
+      {
+        result->Error(
+            "extract_error",
+            "Failed to extract the attachment.");
+      }
+    }
+    // Return attachment bytes (or a window of them) without a temp file
+    else if (method == "readMkvAttachment")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'mkvPath' (or 'session'), 'attachmentIndex' and optionally 'offset', 'length'.");
+        return;
+      }
+
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      int attachmentIndex = -1;
+      int64_t offset = 0;
+      int64_t length = -1;
+
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "attachmentIndex" && std::get_if<int>(&value))
+          {
+            attachmentIndex = std::get<int>(value);
+          }
+          else if (*keyStr == "offset")
+          {
+            GetInt64(value, offset);
+          }
+          else if (*keyStr == "length")
+          {
+            GetInt64(value, length);
+          }
+        }
+      }
+
+      if ((mkvPath.empty() && sessionHandle == 0) || attachmentIndex < 0 || offset < 0)
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid parameters.");
+        return;
+      }
+
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_ATTACHMENTS, target, *result))
+      {
+        return;
+      }
+      MkvMetadataExtractor &extractor = *target.extractor;
+
+      if (static_cast<size_t>(attachmentIndex) >= extractor.getAttachments().size())
+      {
+        result->Error(
+            "invalid_index",
+            "Attachment index out of range.");
+        return;
+      }
+
+      // Without a length the rest of the attachment is returned
+      const uint64_t dataSize = extractor.getAttachments()[attachmentIndex].dataSize;
+      const uint64_t remaining = static_cast<uint64_t>(offset) < dataSize ? dataSize - offset : 0;
+      const uint64_t count = length >= 0 ? std::min(static_cast<uint64_t>(length), remaining) : remaining;
+      if (count > static_cast<uint64_t>(kMaxAttachmentReadSize))
+      {
+        result->Error(
+            "too_large",
+            "The attachment is larger than 64 MiB, read it in chunks with 'offset' and 'length'.");
+        return;
+      }
+
+      std::vector<uint8_t> data;
+      if (!extractor.readAttachment(attachmentIndex, offset, count, data))
+      {
+        result->Error(
+            "read_error",
+            "Failed to read the attachment.");
+        return;
+      }
+      result->Success(flutter::EncodableValue(std::move(data)));
+    }
+    // Extract every attachment (or those matching a filter) in one pass
+    else if (method == "extractAllMkvAttachments")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'mkvPath' (or 'session'), 'outputDir' and optionally 'mimeTypes', 'extensions'.");
+        return;
+      }
+
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      std::string outputDir;
+      MkvAttachmentFilter filter;
+
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "outputDir" && std::get_if<std::string>(&value))
+          {
+            outputDir = std::get<std::string>(value);
+          }
+          else if (*keyStr == "mimeTypes")
+          {
+            GetStringList(value, filter.mimeTypes);
+          }
+          else if (*keyStr == "extensions")
+          {
+            GetStringList(value, filter.extensions);
+          }
+        }
+      }
+
+      if ((mkvPath.empty() && sessionHandle == 0) || outputDir.empty())
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid parameters.");
+        return;
+      }
+
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_ATTACHMENTS, target, *result))
+      {
+        return;
+      }
+      MkvMetadataExtractor &extractor = *target.extractor;
+
+      std::vector<MkvExtractedFile> manifest;
+      MkvBulkExtractStats stats;
+      if (!extractor.extractAllAttachments(outputDir, filter, manifest, &stats))
+      {
+        result->Error(
+            "extract_error",
+            "Failed to create the output directory.");
+        return;
+      }
+
+      flutter::EncodableList files;
+      for (const auto &file : manifest)
+      {
+        const auto &attachment = extractor.getAttachments()[file.index];
+        flutter::EncodableMap entry;
+        entry[flutter::EncodableValue("index")] = flutter::EncodableValue(static_cast<int>(file.index));
+        entry[flutter::EncodableValue("fileName")] = flutter::EncodableValue(std::string(attachment.fileName));
+        entry[flutter::EncodableValue("mimeType")] = flutter::EncodableValue(std::string(attachment.mimeType));
+        entry[flutter::EncodableValue("path")] = flutter::EncodableValue(file.path);
+        entry[flutter::EncodableValue("size")] = flutter::EncodableValue(static_cast<int64_t>(file.size));
+        entry[flutter::EncodableValue("written")] = flutter::EncodableValue(file.written);
+        files.push_back(flutter::EncodableValue(entry));
+      }
+
+      flutter::EncodableMap response;
+      response[flutter::EncodableValue("files")] = flutter::EncodableValue(files);
+      response[flutter::EncodableValue("writtenFiles")] = flutter::EncodableValue(static_cast<int64_t>(stats.files));
+      response[flutter::EncodableValue("bytes")] = flutter::EncodableValue(static_cast<int64_t>(stats.bytes));
+      response[flutter::EncodableValue("streamReads")] = flutter::EncodableValue(static_cast<int64_t>(stats.streamReads));
+      response[flutter::EncodableValue("elapsedUs")] = flutter::EncodableValue(static_cast<int64_t>(stats.elapsedUs));
+      response[flutter::EncodableValue("bytesPerSecond")] = flutter::EncodableValue(
+          static_cast<int64_t>(stats.elapsedUs > 0 ? stats.bytes * 1000000 / stats.elapsedUs : 0));
+      result->Success(flutter::EncodableValue(response));
+    }
+    // Resolve attachments to deduplicated blobs in the attachment store
+    else if (method == "resolveMkvAttachments")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'mkvPath' (or 'session') and optionally 'storeDirectory', 'mimeTypes', 'extensions'.");
+        return;
+      }
+
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      std::string storeDirectory;
+      MkvAttachmentFilter filter;
+
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "storeDirectory" && std::get_if<std::string>(&value))
+          {
+            storeDirectory = std::get<std::string>(value);
+          }
+          else if (*keyStr == "mimeTypes")
+          {
+            GetStringList(value, filter.mimeTypes);
+          }
+          else if (*keyStr == "extensions")
+          {
+            GetStringList(value, filter.extensions);
+          }
+        }
+      }
+
+      if (mkvPath.empty() && sessionHandle == 0)
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid parameters.");
+        return;
+      }
+
+      // Opened beforehand by OpenSharedState, under the exclusive lock
+      if (!IsAttachmentStoreOpen(storeDirectory))
+      {
+        result->Error(
+            "store_error",
+            "Failed to open the attachment store.");
+        return;
+      }
+
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_ATTACHMENTS, target, *result))
+      {
+        return;
+      }
+      MkvMetadataExtractor &extractor = *target.extractor;
+
+      MkvAttachmentStoreStats before = attachment_store_.getStats();
+      flutter::EncodableList files;
+      const auto &attachments = extractor.getAttachments();
+      for (size_t i = 0; i < attachments.size(); i++)
+      {
+        if (!filter.matches(attachments[i]))
+        {
+          continue;
+        }
+
+        MkvAttachmentBlob blob;
+        bool resolved = attachment_store_.resolve(extractor, i, blob);
+
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(blob.hash));
+
+        flutter::EncodableMap entry;
+        entry[flutter::EncodableValue("index")] = flutter::EncodableValue(static_cast<int>(i));
+        entry[flutter::EncodableValue("fileName")] = flutter::EncodableValue(std::string(attachments[i].fileName));
+        entry[flutter::EncodableValue("mimeType")] = flutter::EncodableValue(std::string(attachments[i].mimeType));
+        entry[flutter::EncodableValue("size")] = flutter::EncodableValue(static_cast<int64_t>(attachments[i].dataSize));
+        entry[flutter::EncodableValue("resolved")] = flutter::EncodableValue(resolved);
+        if (resolved)
+        {
+          entry[flutter::EncodableValue("path")] = flutter::EncodableValue(blob.path);
+          entry[flutter::EncodableValue("hash")] = flutter::EncodableValue(std::string(hash));
+          entry[flutter::EncodableValue("created")] = flutter::EncodableValue(blob.created);
+        }
+        files.push_back(flutter::EncodableValue(entry));
+      }
+
+      MkvAttachmentStoreStats after = attachment_store_.getStats();
+      flutter::EncodableMap response;
+      response[flutter::EncodableValue("files")] = flutter::EncodableValue(files);
+      response[flutter::EncodableValue("uidHits")] =
+          flutter::EncodableValue(static_cast<int64_t>(after.uidHits - before.uidHits));
+      response[flutter::EncodableValue("contentHits")] =
+          flutter::EncodableValue(static_cast<int64_t>(after.contentHits - before.contentHits));
+      response[flutter::EncodableValue("blobsWritten")] =
+          flutter::EncodableValue(static_cast<int64_t>(after.blobsWritten - before.blobsWritten));
+      response[flutter::EncodableValue("bytesWritten")] =
+          flutter::EncodableValue(static_cast<int64_t>(after.bytesWritten - before.bytesWritten));
+      result->Success(flutter::EncodableValue(response));
+    }
+    // Family and style names of the font attachments, read in place
+    else if (method == "getMkvFonts")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with key 'mkvPath' (or 'session').");
+        return;
+      }
+
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+        }
+      }
+
+      if (mkvPath.empty() && sessionHandle == 0)
+      {
+        result->Error(
+            "invalid_args",
+            "Missing or invalid parameters.");
+        return;
+      }
+
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_ATTACHMENTS, target, *result))
+      {
+        return;
+      }
+      MkvMetadataExtractor &extractor = *target.extractor;
+
+      std::vector<MkvFontInfo> fonts;
+      uint64_t bytesRead = 0;
+      if (!extractor.getFonts(fonts, &bytesRead))
+      {
+        result->Error(
+            "read_error",
+            "Failed to read the font attachments.");
+        return;
+      }
+
+      const auto &attachments = extractor.getAttachments();
+      flutter::EncodableList list;
+      for (const MkvFontInfo &font : fonts)
+      {
+        flutter::EncodableMap entry;
+        entry[flutter::EncodableValue("attachmentIndex")] = flutter::EncodableValue(static_cast<int>(font.attachmentIndex));
+        entry[flutter::EncodableValue("fileName")] =
+            flutter::EncodableValue(std::string(attachments[font.attachmentIndex].fileName));
+        entry[flutter::EncodableValue("faceIndex")] = flutter::EncodableValue(static_cast<int>(font.face.faceIndex));
+        entry[flutter::EncodableValue("family")] = flutter::EncodableValue(font.face.family);
+        entry[flutter::EncodableValue("subfamily")] = flutter::EncodableValue(font.face.subfamily);
+        entry[flutter::EncodableValue("fullName")] = flutter::EncodableValue(font.face.fullName);
+        entry[flutter::EncodableValue("postScriptName")] = flutter::EncodableValue(font.face.postScriptName);
+        entry[flutter::EncodableValue("typographicFamily")] = flutter::EncodableValue(font.face.typographicFamily);
+        entry[flutter::EncodableValue("typographicSubfamily")] = flutter::EncodableValue(font.face.typographicSubfamily);
+        list.push_back(flutter::EncodableValue(entry));
+      }
+
+      flutter::EncodableMap response;
+      response[flutter::EncodableValue("fonts")] = flutter::EncodableValue(list);
+      response[flutter::EncodableValue("bytesRead")] = flutter::EncodableValue(static_cast<int64_t>(bytesRead));
+      result->Success(flutter::EncodableValue(response));
+    }
+    // Find the nearest keyframe at or before a timestamp using the MKV Cues
+    else if (method == "findMkvCue")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      if (!args)
+      {
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'mkvPath' (or 'session'), 'timeMs' and optionally 'track'.");
+        return;
+      }
+
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      double timeMs = -1.0;
+      int track = 0;
+
+      for (const auto &kv : *args)
+      {
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
+        {
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
+          {
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "timeMs" && std::get_if<double>(&value))
           {
-            videoPathW = getString(value);
+            timeMs = std::get<double>(value);
           }
-          else if (*keyStr == "outputPath")
+          else if (*keyStr == "timeMs" && std::get_if<int>(&value))
           {
-            outputPathW = getString(value);
+            timeMs = static_cast<double>(std::get<int>(value));
           }
-          else if (*keyStr == "size")
+          else if (*keyStr == "track" && std::get_if<int>(&value))
           {
-            if (auto intPtr = std::get_if<int>(&value))
-            {
-              sizePx = static_cast<UINT>(*intPtr);
-            }
+            track = std::get<int>(value);
           }
         }
       }
 
-      // Validate
-      if (videoPathW.empty() || outputPathW.empty() || sizePx == 0)
+      if ((mkvPath.empty() && sessionHandle == 0) || timeMs < 0.0 || track < 0)
       {
         result->Error(
             "invalid_args",
-            "One or more of 'videoPath', 'outputPath', or 'size' is missing/invalid.");
+            "Missing or invalid parameters.");
         return;
       }
 
-      // Call our native helper:
-      bool ok = GetExplorerThumbnail(videoPathW, outputPathW, sizePx);
-      if (ok)
+      // Info for the TimecodeScale, Tracks to resolve the default video track
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_INFO | MKV_SECTION_TRACKS | MKV_SECTION_CUES, target, *result))
       {
-        result->Success(flutter::EncodableValue(true));
+        return;
       }
-      else
+      MkvMetadataExtractor &extractor = *target.extractor;
+
+      MkvCuePoint cue;
+      if (!extractor.findCue(static_cast<uint64_t>(track), timeMs, cue))
       {
-        result->Error(
-            "native_error",
-            "Failed to retrieve or save the thumbnail. Check paths & permissions.");
+        // No cue at or before that time (or no Cues at all)
+        result->Success(flutter::EncodableValue());
+        return;
       }
+
+      flutter::EncodableMap cueMap;
+      cueMap[flutter::EncodableValue("track")] =
+          flutter::EncodableValue(static_cast<int>(cue.track));
+      cueMap[flutter::EncodableValue("timeMs")] =
+          flutter::EncodableValue(static_cast<double>(cue.time) * extractor.getTimecodeScale() / 1000000.0);
+      cueMap[flutter::EncodableValue("clusterPosition")] =
+          flutter::EncodableValue(static_cast<int64_t>(cue.clusterPosition));
+      cueMap[flutter::EncodableValue("relativePosition")] =
+          flutter::EncodableValue(static_cast<int64_t>(cue.relativePosition));
+      cueMap[flutter::EncodableValue("cueCount")] =
+          flutter::EncodableValue(static_cast<int64_t>(extractor.getCueIndex().size()));
+
+      result->Success(flutter::EncodableValue(cueMap));
     }
-    // Get video duration
-    else if (method == "getVideoDuration")
+    // Demux the keyframe for a timestamp without going through the shell
+    else if (method == "getMkvKeyframe")
     {
-      std::wstring videoPathW;
       const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
-      if (args)
-      {
-        for (const auto &kv : *args)
-        {
-          if (kv.first == flutter::EncodableValue("videoPath"))
-          {
-            videoPathW = getString(kv.second); // Using your existing string conversion helper
-          }
-        }
-      }
-
-      if (videoPathW.empty())
+      if (!args)
       {
-        result->Error("invalid_args", "Missing or invalid 'videoPath' parameter.");
+        result->Error(
+            "bad_args",
+            "Expected a map with keys 'mkvPath' (or 'session'), 'timeMs' and optionally 'track'.");
         return;
       }
 
-      // Get video duration
-      double duration = GetVideoFileDuration(videoPathW);
-      result->Success(flutter::EncodableValue(duration));
-    }
-    // Get file metadata
-    else if (method == "getFileMetadata")
-    {
-      std::wstring filePathW;
-      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
-      if (args)
+      std::string mkvPath;
+      int64_t sessionHandle = 0;
+      double timeMs = -1.0;
+      int track = 0;
+
+      for (const auto &kv : *args)
       {
-        for (const auto &kv : *args)
+        const auto &key = kv.first;
+        const auto &value = kv.second;
+        if (auto keyStr = std::get_if<std::string>(&key))
         {
-          if (kv.first == flutter::EncodableValue("filePath"))
+          if (*keyStr == "mkvPath" && std::get_if<std::string>(&value))
           {
-            filePathW = getString(kv.second);
+            mkvPath = std::get<std::string>(value);
+          }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "timeMs" && std::get_if<double>(&value))
+          {
+            timeMs = std::get<double>(value);
+          }
+          else if (*keyStr == "timeMs" && std::get_if<int>(&value))
+          {
+            timeMs = static_cast<double>(std::get<int>(value));
+          }
+          else if (*keyStr == "track" && std::get_if<int>(&value))
+          {
+            track = std::get<int>(value);
           }
         }
       }
 
-      if (filePathW.empty())
+      if ((mkvPath.empty() && sessionHandle == 0) || timeMs < 0.0 || track < 0)
       {
-        result->Error("invalid_args", "Missing or invalid 'filePath' parameter.");
+        result->Error(
+            "invalid_args",
+            "Missing or invalid parameters.");
         return;
       }
 
-      // Get file metadata
-      WIN32_FILE_ATTRIBUTE_DATA fileAttrData;
-      flutter::EncodableMap metadata;
-
-      if (GetFileAttributesEx(filePathW.c_str(), GetFileExInfoStandard, &fileAttrData))
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_INFO | MKV_SECTION_TRACKS | MKV_SECTION_CUES, target, *result))
       {
-        // Convert FILETIME to milliseconds since epoch
-        ULARGE_INTEGER creationTime, accessTime, modifiedTime;
-        creationTime.LowPart = fileAttrData.ftCreationTime.dwLowDateTime;
-        creationTime.HighPart = fileAttrData.ftCreationTime.dwHighDateTime;
-        accessTime.LowPart = fileAttrData.ftLastAccessTime.dwLowDateTime;
-        accessTime.HighPart = fileAttrData.ftLastAccessTime.dwHighDateTime;
-        modifiedTime.LowPart = fileAttrData.ftLastWriteTime.dwLowDateTime;
-        modifiedTime.HighPart = fileAttrData.ftLastWriteTime.dwHighDateTime;
-
-        // Calculate file size
-        ULARGE_INTEGER fileSize;
-        fileSize.HighPart = fileAttrData.nFileSizeHigh;
-        fileSize.LowPart = fileAttrData.nFileSizeLow;
+        return;
+      }
+      MkvMetadataExtractor &extractor = *target.extractor;
 
-        // Convert Windows FILETIME (100-nanosecond intervals since January 1, 1601) to
-        // Unix epoch time (seconds since January 1, 1970)
-        const int64_t WINDOWS_TICK = 10000000;
-        const int64_t SEC_TO_UNIX_EPOCH = 11644473600LL;
+      MkvKeyframe keyframe;
+      if (!readMkvKeyframe(extractor, static_cast<uint64_t>(track), timeMs, keyframe))
+      {
+        // No such track or no keyframe in it
+        result->Success(flutter::EncodableValue());
+        return;
+      }
 
-        // Use WINDOWS_TICK in calculations
-        int64_t creationTimeMs = (creationTime.QuadPart / (WINDOWS_TICK / 1000)) - (SEC_TO_UNIX_EPOCH * 1000);
-        int64_t accessTimeMs = (accessTime.QuadPart / (WINDOWS_TICK / 1000)) - (SEC_TO_UNIX_EPOCH * 1000);
-        int64_t modifiedTimeMs = (modifiedTime.QuadPart / (WINDOWS_TICK / 1000)) - (SEC_TO_UNIX_EPOCH * 1000);
+      const MkvStream *stream = extractor.findStream(keyframe.track);
 
-        metadata[flutter::EncodableValue("creationTime")] = flutter::EncodableValue(static_cast<int64_t>(creationTimeMs));
-        metadata[flutter::EncodableValue("accessTime")] = flutter::EncodableValue(static_cast<int64_t>(accessTimeMs));
-        metadata[flutter::EncodableValue("modifiedTime")] = flutter::EncodableValue(static_cast<int64_t>(modifiedTimeMs));
-        metadata[flutter::EncodableValue("fileSize")] = flutter::EncodableValue(static_cast<int64_t>(fileSize.QuadPart));
+      flutter::EncodableMap keyframeMap;
+      keyframeMap[flutter::EncodableValue("track")] =
+          flutter::EncodableValue(static_cast<int>(keyframe.track));
+      keyframeMap[flutter::EncodableValue("timeMs")] =
+          flutter::EncodableValue(keyframe.timeMs);
+      keyframeMap[flutter::EncodableValue("clusterPosition")] =
+          flutter::EncodableValue(static_cast<int64_t>(keyframe.clusterPosition));
+      keyframeMap[flutter::EncodableValue("codecId")] =
+          flutter::EncodableValue(stream ? std::string(stream->codecID) : std::string());
+      keyframeMap[flutter::EncodableValue("codecPrivate")] =
+          flutter::EncodableValue(std::move(keyframe.codecPrivate));
+      keyframeMap[flutter::EncodableValue("data")] =
+          flutter::EncodableValue(std::move(keyframe.data));
 
-        result->Success(flutter::EncodableValue(metadata));
-      }
-      else
-      {
-        DWORD error = GetLastError();
-        std::string errorMsg = "Failed to get file attributes. Error code: " + std::to_string(error);
-        result->Error("file_error", errorMsg);
-      }
+      result->Success(flutter::EncodableValue(keyframeMap));
     }
-    // Get MKV metadata
-    else if (method == "getMkvMetadata")
+    // Exact per-track statistics from a full scan of the Clusters
+    else if (method == "getMkvTrackStatistics")
     {
       const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
       if (!args)
       {
         result->Error(
             "bad_args",
-            "Expected a map with key 'mkvPath'.");
+            "Expected a map with keys 'mkvPath' (or 'session') and optionally 'threads'.");
         return;
       }
 
-      // Get the MKV file path
       std::string mkvPath;
+      int64_t sessionHandle = 0;
+      int threads = 0;
+
       for (const auto &kv : *args)
       {
         const auto &key = kv.first;
@@ -278,129 +2317,95 @@ namespace video_thumbnail_exporter
           {
             mkvPath = std::get<std::string>(value);
           }
+          else if (*keyStr == "session")
+          {
+            GetSessionHandle(value, sessionHandle);
+          }
+          else if (*keyStr == "threads" && std::get_if<int>(&value))
+          {
+            threads = std::get<int>(value);
+          }
         }
       }
 
-      if (mkvPath.empty())
+      if ((mkvPath.empty() && sessionHandle == 0) || threads < 0)
       {
         result->Error(
             "invalid_args",
-            "Missing or invalid 'mkvPath' parameter.");
+            "Missing or invalid parameters.");
         return;
       }
 
-      // Create MKV metadata extractor
-      MkvMetadataExtractor extractor;
-      if (!extractor.open(mkvPath))
+      MkvCallTarget target;
+      if (!OpenMkvTarget(sessionHandle, mkvPath, MKV_SECTION_INFO | MKV_SECTION_TRACKS, target, *result))
       {
-        result->Error(
-            "file_error",
-            "Failed to open the MKV file.");
         return;
       }
+      MkvMetadataExtractor &extractor = *target.extractor;
 
-      // Build a response map with the metadata
-      flutter::EncodableMap metadata;
-
-      // Add general information
-      metadata[flutter::EncodableValue("title")] =
-          flutter::EncodableValue(extractor.getTitle());
-      metadata[flutter::EncodableValue("duration")] =
-          flutter::EncodableValue(extractor.getDuration());
-      metadata[flutter::EncodableValue("muxingApp")] =
-          flutter::EncodableValue(extractor.getMuxingApp());
-      metadata[flutter::EncodableValue("writingApp")] =
-          flutter::EncodableValue(extractor.getWritingApp());
-      metadata[flutter::EncodableValue("bitrate")] =
-          flutter::EncodableValue(static_cast<int64_t>(extractor.getEstimatedBitrate()));
-
-      // Add video streams info
-      flutter::EncodableList videoStreams;
-      for (const auto &stream : extractor.getVideoStreams())
+      MkvClusterScanner scanner(extractor);
+      if (!scanner.scan(static_cast<unsigned>(threads)))
       {
-        flutter::EncodableMap videoStream;
-        videoStream[flutter::EncodableValue("trackNumber")] =
-            flutter::EncodableValue(static_cast<int>(stream.trackNumber));
-        videoStream[flutter::EncodableValue("codecId")] =
-            flutter::EncodableValue(stream.codecID);
-        videoStream[flutter::EncodableValue("codecName")] =
-            flutter::EncodableValue(stream.codecName);
-        videoStream[flutter::EncodableValue("width")] =
-            flutter::EncodableValue(static_cast<int>(stream.pixelWidth));
-        videoStream[flutter::EncodableValue("height")] =
-            flutter::EncodableValue(static_cast<int>(stream.pixelHeight));
-        videoStream[flutter::EncodableValue("frameRate")] =
-            flutter::EncodableValue(stream.frameRate);
-
-        videoStreams.push_back(flutter::EncodableValue(videoStream));
+        result->Error(
+            "file_error",
+            "Failed to scan the clusters of the MKV file.");
+        return;
       }
-      metadata[flutter::EncodableValue("videoStreams")] =
-          flutter::EncodableValue(videoStreams);
 
-      // Add audio streams info
-      flutter::EncodableList audioStreams;
-      for (const auto &stream : extractor.getAudioStreams())
+      // Convert TimecodeScale units to milliseconds
+      const double msPerTick = extractor.getTimecodeScale() / 1000000.0;
+
+      flutter::EncodableList trackList;
+      for (const auto &stats : scanner.getTrackStatistics())
       {
-        flutter::EncodableMap audioStream;
-        audioStream[flutter::EncodableValue("trackNumber")] =
-            flutter::EncodableValue(static_cast<int>(stream.trackNumber));
-        audioStream[flutter::EncodableValue("codecId")] =
-            flutter::EncodableValue(stream.codecID);
-        audioStream[flutter::EncodableValue("codecName")] =
-            flutter::EncodableValue(stream.codecName);
-        audioStream[flutter::EncodableValue("channels")] =
-            flutter::EncodableValue(static_cast<int>(stream.channels));
-        audioStream[flutter::EncodableValue("sampleRate")] =
-            flutter::EncodableValue(stream.samplingFrequency);
-        audioStream[flutter::EncodableValue("bitDepth")] =
-            flutter::EncodableValue(static_cast<int>(stream.bitDepth));
+        const double durationMs = (stats.lastTimestamp - stats.firstTimestamp) * msPerTick;
 
-        audioStreams.push_back(flutter::EncodableValue(audioStream));
+        flutter::EncodableMap trackMap;
+        trackMap[flutter::EncodableValue("track")] = flutter::EncodableValue(static_cast<int>(stats.track));
+        trackMap[flutter::EncodableValue("blocks")] = flutter::EncodableValue(static_cast<int64_t>(stats.blocks));
+        trackMap[flutter::EncodableValue("frames")] = flutter::EncodableValue(static_cast<int64_t>(stats.frames));
+        trackMap[flutter::EncodableValue("bytes")] = flutter::EncodableValue(static_cast<int64_t>(stats.bytes));
+        trackMap[flutter::EncodableValue("keyframes")] = flutter::EncodableValue(static_cast<int64_t>(stats.keyframes));
+        trackMap[flutter::EncodableValue("durationMs")] = flutter::EncodableValue(durationMs);
+        trackMap[flutter::EncodableValue("bitrate")] =
+            flutter::EncodableValue(durationMs > 0.0 ? static_cast<int64_t>(stats.bytes * 8 * 1000.0 / durationMs) : int64_t(0));
+        trackMap[flutter::EncodableValue("minKeyframeIntervalMs")] =
+            flutter::EncodableValue(stats.minKeyframeInterval * msPerTick);
+        trackMap[flutter::EncodableValue("maxKeyframeIntervalMs")] =
+            flutter::EncodableValue(stats.maxKeyframeInterval * msPerTick);
+        trackMap[flutter::EncodableValue("avgKeyframeIntervalMs")] =
+            flutter::EncodableValue(stats.averageKeyframeInterval() * msPerTick);
+        trackList.push_back(flutter::EncodableValue(trackMap));
       }
-      metadata[flutter::EncodableValue("audioStreams")] =
-          flutter::EncodableValue(audioStreams);
 
-      // Add attachments info
-      flutter::EncodableList attachmentsList;
-      for (size_t i = 0; i < extractor.getAttachments().size(); i++)
-      {
-        const auto &attachment = extractor.getAttachments()[i];
-        flutter::EncodableMap attachmentMap;
-        attachmentMap[flutter::EncodableValue("fileName")] =
-            flutter::EncodableValue(attachment.fileName);
-        attachmentMap[flutter::EncodableValue("mimeType")] =
-            flutter::EncodableValue(attachment.mimeType);
-        attachmentMap[flutter::EncodableValue("description")] =
-            flutter::EncodableValue(attachment.description);
-        attachmentMap[flutter::EncodableValue("size")] =
-            flutter::EncodableValue(static_cast<int64_t>(attachment.dataSize));
-        attachmentMap[flutter::EncodableValue("index")] =
-            flutter::EncodableValue(static_cast<int>(i));
+      const MkvScanStats &scanStats = scanner.getStats();
 
-        attachmentsList.push_back(flutter::EncodableValue(attachmentMap));
-      }
-      metadata[flutter::EncodableValue("attachments")] =
-          flutter::EncodableValue(attachmentsList);
+      flutter::EncodableMap statisticsMap;
+      statisticsMap[flutter::EncodableValue("tracks")] = flutter::EncodableValue(trackList);
+      statisticsMap[flutter::EncodableValue("clusters")] =
+          flutter::EncodableValue(static_cast<int64_t>(scanStats.clusters));
+      statisticsMap[flutter::EncodableValue("threads")] =
+          flutter::EncodableValue(static_cast<int>(scanStats.ranges));
+      statisticsMap[flutter::EncodableValue("scanMs")] =
+          flutter::EncodableValue(scanStats.scanNanoseconds / 1000000.0);
 
-      // Return the metadata
-      result->Success(flutter::EncodableValue(metadata));
+      result->Success(flutter::EncodableValue(statisticsMap));
     }
-    // Extract an attachment from an MKV file
-    else if (method == "extractMkvAttachment")
+    // Parse an MKV file once and keep it open for later calls
+    else if (method == "openMkvSession")
     {
       const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
       if (!args)
       {
         result->Error(
             "bad_args",
-            "Expected a map with keys 'mkvPath', 'attachmentIndex', 'outputPath'.");
+            "Expected a map with key 'mkvPath' and optionally 'sections', 'idleTimeoutMs'.");
         return;
       }
 
-      // Get the parameters
       std::string mkvPath;
-      int attachmentIndex = -1;
-      std::string outputPath;
+      uint32_t sections = MKV_SECTION_ALL;
+      int idleTimeoutMs = static_cast<int>(MkvSessionTable::DefaultIdleTimeout.count());
 
       for (const auto &kv : *args)
       {
@@ -412,18 +2417,18 @@ namespace video_thumbnail_exporter
           {
             mkvPath = std::get<std::string>(value);
           }
-          else if (*keyStr == "attachmentIndex" && std::get_if<int>(&value))
+          else if (*keyStr == "sections" && std::get_if<int>(&value))
           {
-            attachmentIndex = std::get<int>(value);
+            sections = static_cast<uint32_t>(std::get<int>(value)) & MKV_SECTION_ALL;
           }
-          else if (*keyStr == "outputPath" && std::get_if<std::string>(&value))
+          else if (*keyStr == "idleTimeoutMs" && std::get_if<int>(&value))
           {
-            outputPath = std::get<std::string>(value);
+            idleTimeoutMs = std::get<int>(value);
           }
         }
       }
 
-      if (mkvPath.empty() || attachmentIndex < 0 || outputPath.empty())
+      if (mkvPath.empty() || idleTimeoutMs <= 0)
       {
         result->Error(
             "invalid_args",
@@ -431,9 +2436,16 @@ namespace video_thumbnail_exporter
         return;
       }
 
-      // Extract the attachment
-      MkvMetadataExtractor extractor;
-      if (!extractor.open(mkvPath))
+      if (mkv_sessions_.size() >= MkvSessionTable::MaxSessions)
+      {
+        result->Error(
+            "too_many_sessions",
+            "Too many MKV sessions are open, close some first.");
+        return;
+      }
+
+      int64_t handle = mkv_sessions_.open(mkvPath, sections, std::chrono::milliseconds(idleTimeoutMs));
+      if (handle == 0)
       {
         result->Error(
             "file_error",
@@ -441,25 +2453,104 @@ namespace video_thumbnail_exporter
         return;
       }
 
-      if (static_cast<size_t>(attachmentIndex) >= extractor.getAttachments().size())
+      result->Success(flutter::EncodableValue(handle));
+    }
+    // Release a session opened by openMkvSession
+    else if (method == "closeMkvSession")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      int64_t sessionHandle = 0;
+      if (args)
+      {
+        auto it = args->find(flutter::EncodableValue("session"));
+        if (it != args->end())
+        {
+          GetSessionHandle(it->second, sessionHandle);
+        }
+      }
+
+      if (sessionHandle == 0)
       {
         result->Error(
-            "invalid_index",
-            "Attachment index out of range.");
+            "invalid_args",
+            "Missing or invalid 'session' parameter.");
         return;
       }
 
-      bool success = extractor.extractAttachment(attachmentIndex, outputPath);
-      if (success)
+      // False if it had already expired
+      result->Success(flutter::EncodableValue(mkv_sessions_.close(sessionHandle)));
+    }
+    // Move, resize, disable or clear the persistent metadata cache
+    else if (method == "configureMetadataCache")
+    {
+      const auto *args = std::get_if<flutter::EncodableMap>(method_call.arguments());
+      std::string directory = metadata_cache_directory_;
+      int64_t maxBytes = static_cast<int64_t>(metadata_cache_budget_);
+      bool enabled = metadata_cache_enabled_;
+      bool clear = false;
+
+      if (args)
       {
-        result->Success(flutter::EncodableValue(true));
+        for (const auto &kv : *args)
+        {
+          const auto &key = kv.first;
+          const auto &value = kv.second;
+          if (auto keyStr = std::get_if<std::string>(&key))
+          {
+            if (*keyStr == "directory" && std::get_if<std::string>(&value))
+            {
+              directory = std::get<std::string>(value);
+            }
+            else if (*keyStr == "maxBytes" && std::get_if<int>(&value))
+            {
+              maxBytes = std::get<int>(value);
+            }
+            else if (*keyStr == "maxBytes" && std::get_if<int64_t>(&value))
+            {
+              maxBytes = std::get<int64_t>(value);
+            }
+            else if (*keyStr == "enabled" && std::get_if<bool>(&value))
+            {
+              enabled = std::get<bool>(value);
+            }
+            else if (*keyStr == "clear" && std::get_if<bool>(&value))
+            {
+              clear = std::get<bool>(value);
+            }
+          }
+        }
       }
-      else
+
+      if (maxBytes <= 0)
       {
         result->Error(
-            "extract_error",
-            "Failed to extract the attachment.");
+            "invalid_args",
+            "Missing or invalid parameters.");
+        return;
+      }
+
+      // Reopen with the new settings, which also compacts to the new budget
+      metadata_cache_.close();
+      metadata_cache_directory_ = directory;
+      metadata_cache_budget_ = static_cast<uint64_t>(maxBytes);
+      metadata_cache_enabled_ = enabled;
+      metadata_cache_opened_ = false;
+      if (OpenMetadataCache() && clear)
+      {
+        metadata_cache_.clear();
       }
+
+      const MetadataCacheStats stats = metadata_cache_.getStats();
+      flutter::EncodableMap statsMap;
+      statsMap[flutter::EncodableValue("enabled")] = flutter::EncodableValue(metadata_cache_.isOpen());
+      statsMap[flutter::EncodableValue("directory")] = flutter::EncodableValue(metadata_cache_.getDirectory());
+      statsMap[flutter::EncodableValue("entries")] = flutter::EncodableValue(static_cast<int64_t>(stats.entries));
+      statsMap[flutter::EncodableValue("dataBytes")] = flutter::EncodableValue(static_cast<int64_t>(stats.dataBytes));
+      statsMap[flutter::EncodableValue("maxBytes")] = flutter::EncodableValue(static_cast<int64_t>(stats.budget));
+      statsMap[flutter::EncodableValue("compactedBytes")] =
+          flutter::EncodableValue(static_cast<int64_t>(stats.compactedBytes));
+
+      result->Success(flutter::EncodableValue(statsMap));
     }
     // Initialize the extractor
     else if (method == "initializeExtractor")
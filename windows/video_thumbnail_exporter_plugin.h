@@ -5,21 +5,138 @@
 #include <flutter/plugin_registrar_windows.h>
 
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include "metadata_cache.h"
+#include "mkv_attachment_store.h"
+#include "mkv_session_table.h"
+#include "single_flight_table.h"
 #include "thumbnail_exporter.h"
+#include "worker_pool.h"
 
 namespace video_thumbnail_exporter {
 
+struct MkvCallTarget;
+struct MkvMetadataBatch;
+
 class VideoThumbnailExporterPlugin : public flutter::Plugin {
  public:
   static void RegisterWithRegistrar(flutter::PluginRegistrarWindows* registrar);
 
+  // Without a dispatcher every call runs on the calling thread. With one,
+  // calls that touch the disk run on a worker pool and their results are
+  // sent through `dispatcher`.
   VideoThumbnailExporterPlugin();
+  explicit VideoThumbnailExporterPlugin(std::unique_ptr<CompletionDispatcher> dispatcher);
   virtual ~VideoThumbnailExporterPlugin();
 
   void HandleMethodCall(
       const flutter::MethodCall<flutter::EncodableValue>& method_call,
       std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+
+ private:
+  // cancelRequest, reprioritize and getSchedulerStats
+  void HandleSchedulerCall(
+      const flutter::MethodCall<flutter::EncodableValue>& method_call,
+      flutter::MethodResult<flutter::EncodableValue>& result);
+
+  // Does the work of one method call, on whichever thread it was given to
+  void RunMethodCall(
+      const flutter::MethodCall<flutter::EncodableValue>& method_call,
+      std::unique_ptr<flutter::MethodResult<flutter::EncodableValue>> result);
+
+  // Results kept across launches in the persistent metadata cache. The cache
+  // is opened in %LOCALAPPDATA% on first use unless configured otherwise.
+  bool FindCachedResult(const MetadataCacheKey& key, flutter::EncodableValue& value);
+  void StoreCachedResult(const MetadataCacheKey& key, const flutter::EncodableValue& value);
+  bool OpenMetadataCache();
+
+  // Points `target` at the extractor of `session`, or at a fresh parse of
+  // `path` when no session was given. Either way `sections` are parsed; a
+  // session adds the ones it was not opened with. Reports the error on
+  // `result` and returns false if neither can be used.
+  bool OpenMkvTarget(int64_t session, const std::string& path, uint32_t sections,
+                     MkvCallTarget& target,
+                     flutter::MethodResult<flutter::EncodableValue>& result);
+
+  // Metadata map of `path` limited to `sections`, or its packed form (see
+  // mkv_packed_metadata.h), from the metadata cache when it has it. Returns
+  // false if the file cannot be parsed.
+  bool LoadMkvMetadata(const std::string& path, uint32_t sections, bool packed,
+                       flutter::EncodableValue& metadata);
+
+  // getMkvMetadataBatch. Reads the arguments into `batch`, or reports them on
+  // `result` and returns false.
+  bool ParseMkvMetadataBatch(const flutter::EncodableValue* arguments, MkvMetadataBatch& batch,
+                             flutter::MethodResult<flutter::EncodableValue>& result);
+
+  // Parses files [first, last) of `batch` and sends them as a chunk if the
+  // batch has chunks
+  void LoadMkvMetadataBatchFiles(MkvMetadataBatch& batch, size_t first, size_t last);
+
+  // Gives the files of [first, last) not parsed yet an error entry, sends
+  // the chunk like LoadMkvMetadataBatchFiles and returns how many it set
+  int64_t FailMkvMetadataBatchFiles(MkvMetadataBatch& batch, size_t first, size_t last,
+                                    const std::string& code, const std::string& message);
+
+  void SendMkvMetadataBatchChunk(MkvMetadataBatch& batch, size_t first, size_t last);
+
+  // Queues `batch` on the workers as tasks tagged `tag` (one per chunk). The
+  // requests of flight `tag` get the reply once every task is done or
+  // cancelled.
+  void SubmitMkvMetadataBatch(std::shared_ptr<MkvMetadataBatch> batch, int64_t tag, int priority);
+  void FinishMkvMetadataBatchTask(MkvMetadataBatch& batch, int64_t tag);
+
+  // Calls `method` on the Dart side of the channel, from the platform thread
+  void SendToDart(const std::string& method, flutter::EncodableValue arguments);
+
+  // `directory`, or the attachment store directory in %LOCALAPPDATA% when
+  // empty. Empty if that cannot be found.
+  std::string AttachmentStoreDirectory(const std::string& directory);
+
+  // Opens the attachment store in `directory` (see AttachmentStoreDirectory)
+  // unless it is already open there. Needs state_mutex_ held exclusively when
+  // workers exist.
+  bool OpenAttachmentStore(const std::string& directory);
+
+  // True if the attachment store is open in `directory`
+  bool IsAttachmentStoreOpen(const std::string& directory);
+
+  // True if what `method_call` needs is open already. Enough to hold
+  // state_mutex_ shared.
+  bool IsSharedStateOpen(const flutter::MethodCall<flutter::EncodableValue>& method_call);
+
+  // Reopens what `method_call` needs before it runs, see OpensSharedState
+  void OpenSharedState(const flutter::MethodCall<flutter::EncodableValue>& method_call);
+
+  MetadataCache metadata_cache_;
+  std::string metadata_cache_directory_;
+  uint64_t metadata_cache_budget_ = MetadataCache::DefaultBudget;
+  bool metadata_cache_enabled_ = true;
+  bool metadata_cache_opened_ = false;
+
+  // Owned here so results can be pushed to Dart, see SendToDart
+  std::unique_ptr<flutter::MethodChannel<flutter::EncodableValue>> channel_;
+
+  // MKV files kept parsed between calls, see openMkvSession
+  MkvSessionTable mkv_sessions_;
+
+  // Attachment payloads shared across files, see resolveMkvAttachments
+  MkvAttachmentStore attachment_store_;
+
+  // Held shared by calls running on workers, and exclusively while the
+  // metadata cache or the attachment store is reopened
+  std::shared_mutex state_mutex_;
+  // Guards the lazy open of the metadata cache
+  std::mutex metadata_cache_open_mutex_;
+
+  // Queued and running calls; identical ones share a single flight
+  SingleFlightTable<std::shared_ptr<flutter::MethodResult<flutter::EncodableValue>>> flights_;
+
+  // Declared last so the workers stop before anything they use goes away
+  std::unique_ptr<CompletionDispatcher> dispatcher_;
+  std::unique_ptr<WorkerPool> workers_;
 };
 
 }  // namespace video_thumbnail_exporter
@@ -0,0 +1,165 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(CompletionDispatcher& dispatcher, uint32_t threadCount) :
+    dispatcher(dispatcher), threadCount(threadCount), nextSequence(0), stopping(false) {
+    if (this->threadCount == 0) {
+        uint32_t cores = std::thread::hardware_concurrency();
+        this->threadCount = std::max<uint32_t>(cores > 1 ? cores - 1 : 1, 2);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    std::vector<std::function<void()>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto& queued : queue) {
+            if (queued.second.task.cancelled) {
+                cancelled.push_back(std::move(queued.second.task.cancelled));
+            }
+            stats.cancelled++;
+        }
+        queue.clear();
+        tagged.clear();
+        stats.queued = 0;
+    }
+    wake.notify_all();
+
+    // Whoever waits on a dropped task still hears about it
+    for (auto& callback : cancelled) {
+        dispatcher.post(std::move(callback));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool WorkerPool::submit(WorkerTask task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            return false;
+        }
+
+        QueueKey key{ task.priority, nextSequence++ };
+        if (task.tag != 0) {
+            tagged.emplace(task.tag, key);
+        }
+        queue.emplace(key, QueuedTask{ std::move(task), std::chrono::steady_clock::now() });
+        stats.submitted++;
+        stats.queued = static_cast<uint32_t>(queue.size());
+        stats.peakQueued = std::max(stats.peakQueued, stats.queued);
+
+        // Another thread only helps if the others are all busy
+        if (threads.size() < threadCount && stats.running + stats.queued > threads.size()) {
+            threads.emplace_back(&WorkerPool::run, this);
+            stats.threads = static_cast<uint32_t>(threads.size());
+        }
+    }
+    wake.notify_one();
+    return true;
+}
+
+bool WorkerPool::submit(std::function<void()> work, std::function<void()> completion) {
+    WorkerTask task;
+    task.work = std::move(work);
+    task.completion = std::move(completion);
+    return submit(std::move(task));
+}
+
+bool WorkerPool::cancel(int64_t tag) {
+    std::vector<std::function<void()>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto range = tagged.equal_range(tag);
+        if (range.first == range.second) {
+            return false;
+        }
+        for (auto it = range.first; it != range.second; ++it) {
+            auto queued = queue.find(it->second);
+            if (queued->second.task.cancelled) {
+                cancelled.push_back(std::move(queued->second.task.cancelled));
+            }
+            queue.erase(queued);
+            stats.cancelled++;
+        }
+        tagged.erase(range.first, range.second);
+        stats.queued = static_cast<uint32_t>(queue.size());
+    }
+
+    for (auto& callback : cancelled) {
+        dispatcher.post(std::move(callback));
+    }
+    return true;
+}
+
+bool WorkerPool::hasQueued(int64_t tag) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tagged.count(tag) != 0;
+}
+
+bool WorkerPool::reprioritize(int64_t tag, int priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto range = tagged.equal_range(tag);
+    if (range.first == range.second) {
+        return false;
+    }
+
+    for (auto it = range.first; it != range.second; ++it) {
+        auto queued = queue.find(it->second);
+        QueueKey key{ priority, it->second.sequence };
+        QueuedTask task = std::move(queued->second);
+        task.task.priority = priority;
+        queue.erase(queued);
+        queue.emplace(key, std::move(task));
+        it->second = key;
+    }
+    return true;
+}
+
+WorkerPoolStats WorkerPool::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void WorkerPool::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        auto first = queue.begin();
+        uint64_t sequence = first->first.sequence;
+        QueuedTask queued = std::move(first->second);
+        queue.erase(first);
+        if (queued.task.tag != 0) {
+            auto range = tagged.equal_range(queued.task.tag);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second.sequence == sequence) {
+                    tagged.erase(it);
+                    break;
+                }
+            }
+        }
+        stats.queued = static_cast<uint32_t>(queue.size());
+        stats.running++;
+
+        uint64_t wait = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - queued.queuedAt).count());
+        stats.totalWaitNanoseconds += wait;
+        stats.maxWaitNanoseconds = std::max(stats.maxWaitNanoseconds, wait);
+        lock.unlock();
+
+        queued.task.work();
+        if (queued.task.completion) {
+            dispatcher.post(std::move(queued.task.completion));
+        }
+
+        lock.lock();
+        stats.running--;
+        stats.completed++;
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Where finished work goes. The plugin's dispatcher posts completions to the
+// platform thread, the only one allowed to send method results; tests run
+// them inline or collect them.
+class CompletionDispatcher {
+public:
+    virtual ~CompletionDispatcher() {}
+
+    // Called on a worker thread; `completion` must run exactly once
+    virtual void post(std::function<void()> completion) = 0;
+};
+
+struct WorkerTask {
+    std::function<void()> work;
+    std::function<void()> completion;  // posted once `work` returns
+    std::function<void()> cancelled;   // posted instead if cancelled while queued
+    int priority;                      // higher runs first, FIFO within a priority
+    int64_t tag;                       // names the task for cancel()/reprioritize(), 0 for none;
+                                       // the parts of one request can share it
+
+    WorkerTask() : priority(0), tag(0) {}
+};
+
+struct WorkerPoolStats {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t cancelled;
+    uint32_t queued;      // waiting for a worker
+    uint32_t running;
+    uint32_t peakQueued;
+    uint32_t threads;
+    uint64_t totalWaitNanoseconds;  // queued until started, over completed tasks
+    uint64_t maxWaitNanoseconds;
+
+    WorkerPoolStats() :
+        submitted(0), completed(0), cancelled(0), queued(0), running(0), peakQueued(0), threads(0),
+        totalWaitNanoseconds(0), maxWaitNanoseconds(0) {
+    }
+};
+
+// Runs work on a fixed set of threads, highest priority first, and hands each
+// completion to the dispatcher once its work is done. Tasks still queued can
+// be cancelled or given another priority through their tag. Threads start
+// with the first submission. Thread safe.
+class WorkerPool {
+public:
+    // 0 picks one thread per core, leaving one for the platform thread
+    explicit WorkerPool(CompletionDispatcher& dispatcher, uint32_t threadCount = 0);
+
+    // Waits for running work. Queued work is dropped and posts its
+    // `cancelled` callbacks, like cancel().
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Returns false once the pool is shutting down
+    bool submit(WorkerTask task);
+
+    // Run `work` on a worker at priority 0, then post `completion`
+    bool submit(std::function<void()> work, std::function<void()> completion);
+
+    // Drop the queued tasks tagged `tag` and post their `cancelled` callbacks.
+    // Returns false if none is queued (unknown, already running or done).
+    bool cancel(int64_t tag);
+
+    // True if tasks tagged `tag` are waiting for a worker. Only a snapshot,
+    // a worker may pick them up right after.
+    bool hasQueued(int64_t tag) const;
+
+    // Move the queued tasks tagged `tag` to `priority`, keeping their place
+    // among equals. Returns false if none is queued.
+    bool reprioritize(int64_t tag, int priority);
+
+    WorkerPoolStats getStats() const;
+
+private:
+    // Highest priority first, then submission order
+    struct QueueKey {
+        int priority;
+        uint64_t sequence;
+
+        bool operator<(const QueueKey& other) const {
+            return priority != other.priority ? priority > other.priority : sequence < other.sequence;
+        }
+    };
+
+    struct QueuedTask {
+        WorkerTask task;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    CompletionDispatcher& dispatcher;
+    uint32_t threadCount;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::map<QueueKey, QueuedTask> queue;
+    std::unordered_multimap<int64_t, QueueKey> tagged;
+    uint64_t nextSequence;
+    std::vector<std::thread> threads;
+    bool stopping;
+    WorkerPoolStats stats;
+
+    void run();
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,138 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Streaming XXH64 (https://github.com/Cyan4973/xxHash), used to identify
+// attachment payloads by content. Runs at memory bandwidth, far faster than
+// the disk the bytes come from. Feed the bytes with update() in any number
+// of pieces; digest() does not change the state.
+class XxHash64 {
+public:
+    explicit XxHash64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0) {
+        v[0] = seed + Prime1 + Prime2;
+        v[1] = seed + Prime2;
+        v[2] = seed;
+        v[3] = seed - Prime1;
+        this->seed = seed;
+        totalLength = 0;
+        bufferSize = 0;
+    }
+
+    void update(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+        totalLength += size;
+
+        if (bufferSize + size < 32) {
+            memcpy(buffer + bufferSize, p, size);
+            bufferSize += size;
+            return;
+        }
+
+        if (bufferSize > 0) {
+            size_t fill = 32 - bufferSize;
+            memcpy(buffer + bufferSize, p, fill);
+            consumeStripe(buffer);
+            p += fill;
+            bufferSize = 0;
+        }
+
+        while (end - p >= 32) {
+            consumeStripe(p);
+            p += 32;
+        }
+
+        bufferSize = static_cast<size_t>(end - p);
+        memcpy(buffer, p, bufferSize);
+    }
+
+    uint64_t digest() const {
+        uint64_t h;
+        if (totalLength >= 32) {
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+            for (int i = 0; i < 4; i++) {
+                h = (h ^ round(0, v[i])) * Prime1 + Prime4;
+            }
+        }
+        else {
+            h = seed + Prime5;
+        }
+        h += totalLength;
+
+        const uint8_t* p = buffer;
+        const uint8_t* end = buffer + bufferSize;
+        for (; end - p >= 8; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * Prime1 + Prime4;
+        }
+        if (end - p >= 4) {
+            h ^= static_cast<uint64_t>(read32(p)) * Prime1;
+            h = rotl(h, 23) * Prime2 + Prime3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= *p * Prime5;
+            h = rotl(h, 11) * Prime1;
+        }
+
+        h ^= h >> 33;
+        h *= Prime2;
+        h ^= h >> 29;
+        h *= Prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0) {
+        XxHash64 state(seed);
+        state.update(data, size);
+        return state.digest();
+    }
+
+private:
+    static const uint64_t Prime1 = 11400714785074694791ULL;
+    static const uint64_t Prime2 = 14029467366897019727ULL;
+    static const uint64_t Prime3 = 1609587929392839161ULL;
+    static const uint64_t Prime4 = 9650029242287828579ULL;
+    static const uint64_t Prime5 = 2870177450012600261ULL;
+
+    uint64_t v[4];
+    uint64_t seed;
+    uint64_t totalLength;
+    uint8_t buffer[32];
+    size_t bufferSize;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    // Little-endian loads, like the rest of the parser's targets
+    static uint64_t read64(const uint8_t* p) {
+        uint64_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t lane) {
+        acc += lane * Prime2;
+        acc = rotl(acc, 31);
+        return acc * Prime1;
+    }
+
+    void consumeStripe(const uint8_t* p) {
+        for (int i = 0; i < 4; i++) {
+            v[i] = round(v[i], read64(p + i * 8));
+        }
+    }
+};
+
+#endif // XXHASH64_H